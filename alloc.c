@@ -0,0 +1,176 @@
+#include "alloc.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+/*--------------------------------------------------------------------*/
+
+/* Every block starts with its size and pool, so that Alloc_free and
+   Alloc_realloc need neither.  The other members keep the block
+   aligned for the widest scalar types, as malloc would. */
+union Header
+{
+	struct
+	{
+		size_t iSize;
+		enum AllocPool ePool;
+	} s;
+	long double ldAlign;
+	long long llAlign;
+	void *pvAlign;
+};
+
+struct Pool
+{
+	long lLiveBytes, lLiveBlocks, lPeakBytes, lAllocs;
+};
+
+static const char *apcPoolNames[ALLOC_POOLS] = {"lexer", "planner", "jobs"};
+
+/* Only the main loop allocates, never a signal handler */
+static struct Pool asPools[ALLOC_POOLS];
+
+/*--------------------------------------------------------------------*/
+
+static void *Alloc_count(union Header *psHeader, enum AllocPool ePool,
+	size_t iSize)
+
+/* Record psHeader, a new block of iSize bytes, in pool ePool and
+   return the memory after it, or NULL if psHeader is NULL. */
+
+{
+	struct Pool *psPool = &asPools[ePool];
+
+	if(psHeader == NULL) return NULL;
+	psHeader->s.iSize = iSize;
+	psHeader->s.ePool = ePool;
+	psPool->lLiveBytes += iSize;
+	psPool->lLiveBlocks++;
+	psPool->lAllocs++;
+	if(psPool->lLiveBytes > psPool->lPeakBytes)
+		psPool->lPeakBytes = psPool->lLiveBytes;
+	return psHeader + 1;
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Alloc_uncount(union Header *psHeader)
+
+/* Remove psHeader from the live blocks of its pool. */
+
+{
+	struct Pool *psPool = &asPools[psHeader->s.ePool];
+
+	psPool->lLiveBytes -= psHeader->s.iSize;
+	psPool->lLiveBlocks--;
+}
+
+/*--------------------------------------------------------------------*/
+
+void *Alloc_malloc(enum AllocPool ePool, size_t iSize)
+
+/* Like malloc, counting the block in pool ePool. */
+
+{
+	assert(ePool < ALLOC_POOLS);
+
+	return Alloc_count((union Header *)malloc(sizeof(union Header) + iSize),
+		ePool, iSize);
+}
+
+/*--------------------------------------------------------------------*/
+
+void *Alloc_calloc(enum AllocPool ePool, size_t iCount, size_t iSize)
+
+/* Like calloc, counting the block in pool ePool. */
+
+{
+	assert(ePool < ALLOC_POOLS);
+
+	if(iSize != 0 && iCount > ((size_t)-1 - sizeof(union Header)) / iSize)
+		return NULL;
+	return Alloc_count((union Header *)calloc(1, sizeof(union Header) + iCount * iSize),
+		ePool, iCount * iSize);
+}
+
+/*--------------------------------------------------------------------*/
+
+void *Alloc_realloc(enum AllocPool ePool, void *pv, size_t iSize)
+
+/* Like realloc of pv, counting the block in pool ePool. */
+
+{
+	union Header *psHeader, *psNew;
+
+	assert(ePool < ALLOC_POOLS);
+
+	if(pv == NULL) return Alloc_malloc(ePool, iSize);
+	psHeader = (union Header *)pv - 1;
+	psNew = (union Header *)realloc(psHeader, sizeof(union Header) + iSize);
+	if(psNew == NULL) return NULL;
+	/* Not a new allocation, only a new size */
+	Alloc_uncount(psNew);
+	asPools[ePool].lAllocs--;
+	return Alloc_count(psNew, ePool, iSize);
+}
+
+/*--------------------------------------------------------------------*/
+
+char *Alloc_strdup(enum AllocPool ePool, const char *pc)
+
+/* Like strdup, counting the copy in pool ePool. */
+
+{
+	size_t iSize;
+	char *pcCopy;
+
+	assert(pc != NULL);
+
+	iSize = strlen(pc) + 1;
+	pcCopy = (char *)Alloc_malloc(ePool, iSize);
+	if(pcCopy != NULL) memcpy(pcCopy, pc, iSize);
+	return pcCopy;
+}
+
+/*--------------------------------------------------------------------*/
+
+void Alloc_free(void *pv)
+
+/* Free pv. */
+
+{
+	union Header *psHeader;
+
+	if(pv == NULL) return;
+	psHeader = (union Header *)pv - 1;
+	Alloc_uncount(psHeader);
+	free(psHeader);
+}
+
+/*--------------------------------------------------------------------*/
+
+void Alloc_print(FILE *psFile, int iJson)
+
+/* Print the accounting of every pool to psFile. */
+
+{
+	const struct Pool *psPool;
+	int i;
+
+	assert(psFile != NULL);
+
+	if(iJson) fprintf(psFile, "{");
+	for(i=0;i<ALLOC_POOLS;i++)
+	{
+		psPool = &asPools[i];
+		if(iJson)
+			fprintf(psFile, "%s\"%s\":{\"live_bytes\":%ld,\"live_blocks\":%ld,\"peak_bytes\":%ld,\"allocs\":%ld}",
+				i ? "," : "", apcPoolNames[i], psPool->lLiveBytes,
+				psPool->lLiveBlocks, psPool->lPeakBytes, psPool->lAllocs);
+		else
+			fprintf(psFile, "%-16s live %ld bytes in %ld blocks, peak %ld bytes, %ld allocations\n",
+				apcPoolNames[i], psPool->lLiveBytes, psPool->lLiveBlocks,
+				psPool->lPeakBytes, psPool->lAllocs);
+	}
+	if(iJson) fprintf(psFile, "}\n");
+}
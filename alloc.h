@@ -0,0 +1,35 @@
+#ifndef ALLOC_INCLUDED
+#define ALLOC_INCLUDED
+
+#include <stdio.h>
+#include <stddef.h>
+
+/* Allocation accounting: the lexer, the planner and the job table
+   allocate through these functions, which keep the live bytes and
+   blocks and the number of allocations of each pool, so that a long
+   session can show that none of them grows. */
+
+/* The pools blocks are counted in */
+enum AllocPool {ALLOC_LEXER, ALLOC_PLANNER, ALLOC_JOBS, ALLOC_POOLS};
+
+/* Like malloc, counting the block in pool ePool. */
+void *Alloc_malloc(enum AllocPool ePool, size_t iSize);
+
+/* Like calloc, counting the block in pool ePool. */
+void *Alloc_calloc(enum AllocPool ePool, size_t iCount, size_t iSize);
+
+/* Like realloc of pv, which must come from this module, counting the
+   block in pool ePool. */
+void *Alloc_realloc(enum AllocPool ePool, void *pv, size_t iSize);
+
+/* Like strdup, counting the copy in pool ePool. */
+char *Alloc_strdup(enum AllocPool ePool, const char *pc);
+
+/* Free pv, which must come from this module or be NULL. */
+void Alloc_free(void *pv);
+
+/* Print the live bytes and blocks, the peak bytes and the number of
+   allocations of every pool to psFile, as JSON if iJson is 1. */
+void Alloc_print(FILE *psFile, int iJson);
+
+#endif
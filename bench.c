@@ -0,0 +1,500 @@
+/*--------------------------------------------------------------------*/
+/* bench.c                                                            */
+/* Macro benchmark of the spawn overhead of ish: run fixed workloads  */
+/* of commands, pipelines, redirections and background jobs through   */
+/* ish and through any other shells given, such as dash and bash,     */
+/* and report their rates, latencies and kernel counters.             */
+/*--------------------------------------------------------------------*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/perf_event.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+/*--------------------------------------------------------------------*/
+
+enum {FALSE, TRUE};
+
+/* The files of a run live in a directory made from DIR_TEMPLATE */
+#define DIR_TEMPLATE "/tmp/ish_bench.XXXXXX"
+
+enum {MAX_PATH_SIZE = 1024, MAX_DIR_SIZE = sizeof(DIR_TEMPLATE)};
+
+/* The workloads, each a script run by every shell.  The commands of
+   all but the pipelines are this program run as "bench --stamp", a
+   true(1) that records when it starts and exits. */
+enum Workload {WORK_TRUE, WORK_PIPELINE, WORK_REDIRECT, WORK_BACKGROUND,
+	WORKLOADS};
+static const char *apcWorkloads[] = {"true", "pipeline", "redirect",
+	"background"};
+
+/* The number of cat(1)s in each pipeline of the pipeline workload */
+enum {PIPELINE_STAGES = 32};
+
+enum {MAX_REPEATS = 15};
+
+/* The kernel counters read for each run */
+enum Counter {COUNTER_SWITCHES, COUNTER_FAULTS, COUNTERS};
+
+/* What a run of a script by a shell took */
+struct Run
+{
+	double dSeconds;
+	long long allCounters[COUNTERS];
+};
+
+/* The state of a benchmark */
+struct Bench
+{
+	int iCommands;
+	int iRepeats;
+
+	/* The path of this program, and the directory of the scripts,
+	   the stamps and the files redirected */
+	char acSelf[MAX_PATH_SIZE];
+	char acDir[MAX_DIR_SIZE];
+
+	/* 1 (TRUE) while perf_event_open() works, after which the counters
+	   come from the rusage of the shell and the children it waited for */
+	int iPerf;
+
+	/* Spawn latencies (ms) of the runs of one workload by one shell */
+	double *pdLatency;
+	int iLatencies, iMaxLatencies;
+};
+
+/*--------------------------------------------------------------------*/
+
+static long long Bench_now(void)
+
+/* Return CLOCK_MONOTONIC in nanoseconds. */
+
+{
+	struct timespec sNow;
+
+	clock_gettime(CLOCK_MONOTONIC, &sNow);
+	return (long long)sNow.tv_sec * 1000000000LL + sNow.tv_nsec;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Bench_stamp(const char *pcFile, long long llStart)
+
+/* Append llStart and the current time to pcFile in one write, which
+   O_APPEND keeps whole among those of concurrent stamps.  Return the
+   exit status of "bench --stamp". */
+
+{
+	long long allStamp[2];
+	int iFd;
+
+	iFd = open(pcFile, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+	if(iFd == -1) return EXIT_FAILURE;
+	allStamp[0] = llStart;
+	allStamp[1] = Bench_now();
+	if(write(iFd, allStamp, sizeof(allStamp)) != (ssize_t)sizeof(allStamp))
+	{
+		close(iFd);
+		return EXIT_FAILURE;
+	}
+	close(iFd);
+	return EXIT_SUCCESS;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Bench_isIsh(const char *pcShell)
+
+/* Return 1 (TRUE) if pcShell is ish, which takes jobs back with fg
+   where the others, with no job control in scripts, use wait. */
+
+{
+	const char *pcName = strrchr(pcShell, '/');
+
+	pcName = (pcName == NULL) ? pcShell : pcName + 1;
+	return strcmp(pcName, "ish") == 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Bench_writeScript(struct Bench *psBench, enum Workload eWorkload,
+	const char *pcShell, const char *pcScript)
+
+/* Write the script of workload eWorkload for pcShell to pcScript.
+   Return the number of commands it runs, or -1 if it cannot be
+   written. */
+
+{
+	FILE *psFile;
+	const char *pcDir = psBench->acDir, *pcSelf = psBench->acSelf;
+	int i, j, iCommands = 0;
+
+	psFile = fopen(pcScript, "w");
+	if(psFile == NULL) return -1;
+	switch(eWorkload)
+	{
+	case WORK_TRUE:
+		for(i = 0; i < psBench->iCommands; i++)
+			fprintf(psFile, "'%s' --stamp %s/stamps\n", pcSelf, pcDir);
+		iCommands = psBench->iCommands;
+		break;
+	case WORK_PIPELINE:
+		for(i = 0; i < psBench->iCommands / PIPELINE_STAGES; i++)
+		{
+			fprintf(psFile, "cat %s/in", pcDir);
+			for(j = 1; j < PIPELINE_STAGES; j++) fprintf(psFile, " | cat");
+			fprintf(psFile, " > %s/out\n", pcDir);
+		}
+		iCommands = i * PIPELINE_STAGES;
+		break;
+	case WORK_REDIRECT:
+		for(i = 0; i < psBench->iCommands; i++)
+			fprintf(psFile, "'%s' --stamp %s/stamps < %s/in > %s/out\n",
+				pcSelf, pcDir, pcDir, pcDir);
+		iCommands = psBench->iCommands;
+		break;
+	case WORK_BACKGROUND:
+		for(i = 0; i < psBench->iCommands; i++)
+			fprintf(psFile, "'%s' --stamp %s/stamps &\n%s\n",
+				pcSelf, pcDir, Bench_isIsh(pcShell) ? "fg" : "wait");
+		iCommands = psBench->iCommands;
+		break;
+	default:
+		assert(FALSE);
+	}
+	if(fclose(psFile) != 0) return -1;
+	return iCommands;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Bench_openCounter(int iPid, enum Counter eCounter)
+
+/* Return a disabled software counter of eCounter for iPid and its
+   descendants, enabled when iPid execs, or -1 if perf_event_open() is
+   not available. */
+
+{
+	struct perf_event_attr sAttr;
+
+	memset(&sAttr, 0, sizeof(sAttr));
+	sAttr.size = sizeof(sAttr);
+	sAttr.type = PERF_TYPE_SOFTWARE;
+	sAttr.config = (eCounter == COUNTER_SWITCHES) ?
+		PERF_COUNT_SW_CONTEXT_SWITCHES : PERF_COUNT_SW_PAGE_FAULTS;
+	sAttr.disabled = 1;
+	sAttr.inherit = 1;
+	sAttr.enable_on_exec = 1;
+	return (int)syscall(SYS_perf_event_open, &sAttr, iPid, -1, -1, PERF_FLAG_FD_CLOEXEC);
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Bench_runShell(struct Bench *psBench, const char *pcShell,
+	const char *pcScript, struct Run *psRun)
+
+/* Run pcScript with pcShell and fill in *psRun.  The counters are
+   attached to the shell before it execs, while it waits on a pipe.
+   Return 1 (TRUE) if the shell exited with status 0. */
+
+{
+	char acErr[MAX_PATH_SIZE];
+	int aiGo[2], aiCounter[COUNTERS], iPid, iStatus, iNull, iErr, i;
+	struct rusage sUsage;
+	long long llStart;
+	char c = 0;
+
+	snprintf(acErr, MAX_PATH_SIZE, "%s/err", psBench->acDir);
+	if(pipe2(aiGo, O_CLOEXEC) != 0) return FALSE;
+
+	iPid = fork();
+	if(iPid < 0) return FALSE;
+	if(iPid == 0)
+	{
+		iNull = open("/dev/null", O_RDWR);
+		iErr = open(acErr, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+		if(iNull == -1 || iErr == -1) _exit(127);
+		dup2(iNull, 0);
+		dup2(iNull, 1);
+		dup2(iErr, 2);
+		if(iNull > 2) close(iNull);
+		if(iErr > 2) close(iErr);
+		/* Keep any .ishrc or startup file out of the run */
+		setenv("HOME", "/dev/null", 1);
+		unsetenv("ENV");
+		unsetenv("BASH_ENV");
+		close(aiGo[1]);
+		if(read(aiGo[0], &c, 1) != 1) _exit(127);
+		execl(pcShell, pcShell, pcScript, (char *)NULL);
+		perror(pcShell);
+		_exit(127);
+	}
+	close(aiGo[0]);
+
+	for(i = 0; i < COUNTERS; i++)
+	{
+		aiCounter[i] = psBench->iPerf ? Bench_openCounter(iPid, (enum Counter)i) : -1;
+		if(aiCounter[i] == -1) psBench->iPerf = FALSE;
+	}
+
+	llStart = Bench_now();
+	if(write(aiGo[1], &c, 1) != 1) kill(iPid, SIGKILL);
+	close(aiGo[1]);
+	while(wait4(iPid, &iStatus, 0, &sUsage) == -1 && errno == EINTR);
+	psRun->dSeconds = (Bench_now() - llStart) / 1e9;
+
+	/* Failing counters are closed and replaced by the rusage, which
+	   covers the children waited for by the shell */
+	for(i = 0; i < COUNTERS; i++)
+	{
+		if(aiCounter[i] == -1) continue;
+		if(!psBench->iPerf || read(aiCounter[i], &psRun->allCounters[i],
+			sizeof(long long)) != (ssize_t)sizeof(long long))
+			psBench->iPerf = FALSE;
+		close(aiCounter[i]);
+	}
+	if(!psBench->iPerf)
+	{
+		psRun->allCounters[COUNTER_SWITCHES] = sUsage.ru_nvcsw + sUsage.ru_nivcsw;
+		psRun->allCounters[COUNTER_FAULTS] = sUsage.ru_minflt + sUsage.ru_majflt;
+	}
+	return WIFEXITED(iStatus) && WEXITSTATUS(iStatus) == 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Bench_collect(struct Bench *psBench, const char *pcStamps)
+
+/* Add to the latencies of psBench the time from the exit of each
+   command stamped to pcStamps to the start of the next one, which is
+   what the shell takes to reap a command and spawn another.  Remove
+   pcStamps.  Return the number of stamps. */
+
+{
+	long long allStamp[2], llLastExit = -1;
+	FILE *psFile;
+	int iStamps = 0;
+
+	psFile = fopen(pcStamps, "r");
+	if(psFile == NULL) return 0;
+	while(fread(allStamp, sizeof(allStamp), 1, psFile) == 1)
+	{
+		if(llLastExit >= 0 && allStamp[0] >= llLastExit
+			&& psBench->iLatencies < psBench->iMaxLatencies)
+			psBench->pdLatency[psBench->iLatencies++] = (allStamp[0] - llLastExit) / 1e6;
+		llLastExit = allStamp[1];
+		iStamps++;
+	}
+	fclose(psFile);
+	unlink(pcStamps);
+	return iStamps;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Bench_compare(const void *pv1, const void *pv2)
+
+/* Compare two doubles for qsort. */
+
+{
+	double d1 = *(const double *)pv1, d2 = *(const double *)pv2;
+
+	return (d1 > d2) - (d1 < d2);
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Bench_workload(struct Bench *psBench, const char *pcShell,
+	enum Workload eWorkload)
+
+/* Run workload eWorkload through pcShell the number of times asked
+   and print one line of results: the median commands per second and
+   counters per command, and the spawn latencies of all runs.  Return
+   1 (TRUE) if every run ran all its commands. */
+
+{
+	char acScript[MAX_PATH_SIZE], acStamps[MAX_PATH_SIZE];
+	struct Run asRuns[MAX_REPEATS];
+	double adRate[MAX_REPEATS], adCounter[COUNTERS][MAX_REPEATS];
+	const char *pcName = strrchr(pcShell, '/');
+	int iCommands, iStamps, iOk = TRUE, i, j;
+	struct stat sStat;
+
+	snprintf(acScript, MAX_PATH_SIZE, "%s/script", psBench->acDir);
+	snprintf(acStamps, MAX_PATH_SIZE, "%s/stamps", psBench->acDir);
+	iCommands = Bench_writeScript(psBench, eWorkload, pcShell, acScript);
+	if(iCommands <= 0)
+	{
+		perror(acScript);
+		return FALSE;
+	}
+
+	psBench->iLatencies = 0;
+	for(i = 0; i < psBench->iRepeats; i++)
+	{
+		memset(&asRuns[i], 0, sizeof(struct Run));
+		unlink(acStamps);
+		if(!Bench_runShell(psBench, pcShell, acScript, &asRuns[i]))
+			iOk = FALSE;
+		iStamps = Bench_collect(psBench, acStamps);
+		if(eWorkload != WORK_PIPELINE && iStamps != iCommands)
+			iOk = FALSE;
+		adRate[i] = iCommands / asRuns[i].dSeconds;
+		for(j = 0; j < COUNTERS; j++)
+			adCounter[j][i] = (double)asRuns[i].allCounters[j] / iCommands;
+	}
+
+	qsort(adRate, psBench->iRepeats, sizeof(double), Bench_compare);
+	for(j = 0; j < COUNTERS; j++)
+		qsort(adCounter[j], psBench->iRepeats, sizeof(double), Bench_compare);
+
+	printf("bench: %-10s %-6s %9.0f", apcWorkloads[eWorkload],
+		(pcName == NULL) ? pcShell : pcName + 1, adRate[psBench->iRepeats / 2]);
+	if(psBench->iLatencies > 0)
+	{
+		qsort(psBench->pdLatency, psBench->iLatencies, sizeof(double), Bench_compare);
+		printf(" %8.3f %8.3f", psBench->pdLatency[psBench->iLatencies / 2],
+			psBench->pdLatency[(psBench->iLatencies * 99) / 100]);
+	}
+	else
+		printf(" %8s %8s", "-", "-");
+	printf(" %10.2f %10.1f%s\n", adCounter[COUNTER_SWITCHES][psBench->iRepeats / 2],
+		adCounter[COUNTER_FAULTS][psBench->iRepeats / 2], iOk ? "" : "  FAILED");
+
+	/* Show why a shell failed a workload */
+	snprintf(acScript, MAX_PATH_SIZE, "%s/err", psBench->acDir);
+	if(!iOk && stat(acScript, &sStat) == 0 && sStat.st_size > 0)
+		fprintf(stderr, "bench: %s wrote to stderr, see %s\n", pcShell, acScript);
+	fflush(stdout);
+	return iOk;
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Bench_cleanup(struct Bench *psBench)
+
+/* Remove the files of psBench and their directory. */
+
+{
+	static const char *apcFiles[] = {"script", "stamps", "in", "out", "err"};
+	char acPath[MAX_PATH_SIZE];
+	size_t i;
+
+	for(i = 0; i < sizeof(apcFiles) / sizeof(apcFiles[0]); i++)
+	{
+		snprintf(acPath, MAX_PATH_SIZE, "%s/%s", psBench->acDir, apcFiles[i]);
+		unlink(acPath);
+	}
+	rmdir(psBench->acDir);
+}
+
+/*--------------------------------------------------------------------*/
+
+int main(int argc, char *argv[])
+
+/* bench [-n commands] [-r repeats] shell...
+   Run every workload through every shell and print, for each, the
+   median commands per second over the repeats, the p50 and p99 spawn
+   latency and the median context switches and page faults per
+   command.  Return 0 iff every shell ran every workload in full.  Run
+   as "bench --stamp file", append the start and exit times to file and
+   exit: the command of the workloads. */
+
+{
+	struct Bench sBench;
+	long long llStart = Bench_now();
+	char acPath[MAX_PATH_SIZE];
+	FILE *psFile;
+	int iOpt, iLen, iOk = TRUE, i, j;
+
+	if(argc == 3 && strcmp(argv[1], "--stamp") == 0)
+		return Bench_stamp(argv[2], llStart);
+
+	memset(&sBench, 0, sizeof(sBench));
+	sBench.iCommands = 10000;
+	sBench.iRepeats = 3;
+	sBench.iPerf = TRUE;
+
+	while((iOpt = getopt(argc, argv, "n:r:")) != -1)
+	{
+		switch(iOpt)
+		{
+		case 'n': sBench.iCommands = atoi(optarg); break;
+		case 'r': sBench.iRepeats = atoi(optarg); break;
+		default: optind = argc + 1; break;
+		}
+	}
+	if(optind >= argc || sBench.iCommands < PIPELINE_STAGES || sBench.iRepeats <= 0
+		|| sBench.iRepeats > MAX_REPEATS)
+	{
+		fprintf(stderr, "Usage: %s [-n commands >= %d] [-r repeats <= %d] shell...\n",
+			argv[0], (int)PIPELINE_STAGES, (int)MAX_REPEATS);
+		return EXIT_FAILURE;
+	}
+
+	/* The workloads run this program by its absolute path */
+	iLen = readlink("/proc/self/exe", sBench.acSelf, MAX_PATH_SIZE - 1);
+	if(iLen < 0)
+	{
+		perror("/proc/self/exe");
+		return EXIT_FAILURE;
+	}
+	sBench.acSelf[iLen] = '\0';
+
+	sBench.iMaxLatencies = sBench.iCommands * sBench.iRepeats;
+	sBench.pdLatency = (double *)calloc(sBench.iMaxLatencies, sizeof(double));
+	if(sBench.pdLatency == NULL)
+	{
+		fprintf(stderr, "Cannot allocate memory\n");
+		return EXIT_FAILURE;
+	}
+
+	strcpy(sBench.acDir, DIR_TEMPLATE);
+	if(mkdtemp(sBench.acDir) == NULL)
+	{
+		perror(sBench.acDir);
+		free(sBench.pdLatency);
+		return EXIT_FAILURE;
+	}
+	snprintf(acPath, MAX_PATH_SIZE, "%s/in", sBench.acDir);
+	psFile = fopen(acPath, "w");
+	if(psFile != NULL)
+	{
+		fprintf(psFile, "the input of the redirections and pipelines\n");
+		fclose(psFile);
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+	printf("bench: %d commands per workload, median of %d runs\n",
+		sBench.iCommands, sBench.iRepeats);
+	printf("bench: %-10s %-6s %9s %8s %8s %10s %10s\n", "workload", "shell",
+		"cmds/s", "p50 ms", "p99 ms", "ctxsw/cmd", "faults/cmd");
+	for(i = 0; i < WORKLOADS; i++)
+		for(j = optind; j < argc; j++)
+		{
+			if(access(argv[j], X_OK) != 0)
+			{
+				if(i == 0) fprintf(stderr, "bench: %s not found, skipped\n", argv[j]);
+				continue;
+			}
+			if(!Bench_workload(&sBench, argv[j], (enum Workload)i))
+				iOk = FALSE;
+		}
+	printf("bench: counters from %s\n", sBench.iPerf ?
+		"perf_event_open" : "getrusage (perf_event_open is not available)");
+
+	Bench_cleanup(&sBench);
+	free(sBench.pdLatency);
+	return iOk ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,565 @@
+#include "block.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <ctype.h>
+
+/*--------------------------------------------------------------------*/
+
+enum {FALSE, TRUE};
+
+/* errMsg has room for 50 characters */
+#define SYNTAX_ERROR "Syntax error near %.24s"
+
+/*--------------------------------------------------------------------*/
+
+static const char *Block_word(DynArray_T oTokens, int iPos)
+
+/* Return the value of token iPos of oTokens if it is a word, or
+   NULL. */
+
+{
+	if(iPos >= DynArray_getLength(oTokens)) return NULL;
+	if(Token_getType(DynArray_get(oTokens, iPos)) != TOKEN_WORD) return NULL;
+	return Token_getValue(DynArray_get(oTokens, iPos));
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Block_isWord(DynArray_T oTokens, int iPos, const char *pcKeyword)
+
+/* Return 1 (TRUE) if token iPos of oTokens is the word pcKeyword. */
+
+{
+	const char *pcWord = Block_word(oTokens, iPos);
+
+	return pcWord != NULL && strcmp(pcWord, pcKeyword) == 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Block_isTerminator(const char *pcWord)
+
+/* Return 1 (TRUE) if pcWord ends a sequence of commands. */
+
+{
+	return pcWord != NULL && (strcmp(pcWord, "do") == 0
+		|| strcmp(pcWord, "done") == 0 || strcmp(pcWord, "then") == 0
+		|| strcmp(pcWord, "elif") == 0 || strcmp(pcWord, "else") == 0
+		|| strcmp(pcWord, "fi") == 0 || strcmp(pcWord, "}") == 0);
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Block_isName(const char *pcWord, size_t iLength)
+
+/* Return 1 (TRUE) if the iLength first characters of pcWord are a
+   variable or function name. */
+
+{
+	size_t i;
+
+	if(iLength == 0 || !(isalpha((unsigned char)pcWord[0]) || pcWord[0] == '_'))
+		return FALSE;
+	for(i=1;i<iLength;i++)
+		if(!isalnum((unsigned char)pcWord[i]) && pcWord[i] != '_') return FALSE;
+	return TRUE;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Block_isFunction(const char *pcWord)
+
+/* Return 1 (TRUE) if pcWord is "name()", which starts the definition
+   of function name. */
+
+{
+	size_t iLength;
+
+	if(pcWord == NULL) return FALSE;
+	iLength = strlen(pcWord);
+	return iLength > 2 && strcmp(pcWord + iLength - 2, "()") == 0
+		&& Block_isName(pcWord, iLength - 2);
+}
+
+/*--------------------------------------------------------------------*/
+
+int Block_nesting(DynArray_T oTokens, int *piCompound)
+
+/* Return the change of nesting of the line oTokens. */
+
+{
+	const char *pcWord;
+	enum TokenType eType;
+	int iLength, iNesting = 0, iCommand = TRUE, i;
+
+	assert(oTokens != NULL);
+	assert(piCompound != NULL);
+
+	*piCompound = FALSE;
+	iLength = DynArray_getLength(oTokens);
+	for(i=0;i<iLength;i++)
+	{
+		eType = Token_getType(DynArray_get(oTokens, i));
+		if(eType != TOKEN_WORD)
+		{
+			/* Only a list operator or a pipe starts a new command */
+			iCommand = Token_isListOperator(DynArray_get(oTokens, i)) || eType == TOKEN_P;
+			continue;
+		}
+		if(!iCommand) continue;
+
+		pcWord = Token_getValue(DynArray_get(oTokens, i));
+		if(strcmp(pcWord, "for") == 0 || strcmp(pcWord, "while") == 0
+			|| strcmp(pcWord, "if") == 0 || strcmp(pcWord, "{") == 0)
+			iNesting++;
+		else if(strcmp(pcWord, "done") == 0 || strcmp(pcWord, "fi") == 0
+			|| strcmp(pcWord, "}") == 0)
+			iNesting--;
+		else if(!Block_isTerminator(pcWord) && !Block_isFunction(pcWord))
+		{
+			iCommand = FALSE;
+			continue;
+		}
+		*piCompound = TRUE;
+		/* A command follows every keyword but for, done, fi and '}', and
+		   the '{' of a function definition counts as one */
+		iCommand = strcmp(pcWord, "for") != 0 && strcmp(pcWord, "done") != 0
+			&& strcmp(pcWord, "fi") != 0 && strcmp(pcWord, "}") != 0;
+	}
+	return iNesting;
+}
+
+/*--------------------------------------------------------------------*/
+
+int Block_needsSeparator(DynArray_T oTokens)
+
+/* Return 1 (TRUE) unless oTokens ends with do, then, else, '{' or
+   "name()". */
+
+{
+	int iLength;
+
+	assert(oTokens != NULL);
+
+	iLength = DynArray_getLength(oTokens);
+	if(iLength == 0) return FALSE;
+	return !Block_isWord(oTokens, iLength - 1, "do")
+		&& !Block_isWord(oTokens, iLength - 1, "then")
+		&& !Block_isWord(oTokens, iLength - 1, "else")
+		&& !Block_isWord(oTokens, iLength - 1, "{")
+		&& !Block_isFunction(Block_word(oTokens, iLength - 1));
+}
+
+/*--------------------------------------------------------------------*/
+
+int Block_needsBody(DynArray_T oTokens)
+
+/* Return 1 (TRUE) if oTokens ends with "name()". */
+
+{
+	int iLength;
+
+	assert(oTokens != NULL);
+
+	iLength = DynArray_getLength(oTokens);
+	return iLength > 0 && Block_isFunction(Block_word(oTokens, iLength - 1));
+}
+
+/*--------------------------------------------------------------------*/
+
+void Block_free(struct Block *psBlock)
+
+/* Free the tree psBlock. */
+
+{
+	int i;
+
+	if(psBlock == NULL) return;
+	for(i=0;i<psBlock->iBlocks;i++) Block_free(psBlock->ppsBlocks[i]);
+	free(psBlock->ppsBlocks);
+	free(psBlock->peOperators);
+	if(psBlock->oWords != NULL) DynArray_free(psBlock->oWords);
+	free(psBlock->pcName);
+	Block_free(psBlock->psCondition);
+	Block_free(psBlock->psBody);
+	Block_free(psBlock->psElse);
+	free(psBlock);
+}
+
+/*--------------------------------------------------------------------*/
+
+static struct Block *Block_new(enum BlockType eType, char *errMsg)
+
+/* Return a new empty Block of type eType, or NULL with a message in
+   errMsg. */
+
+{
+	struct Block *psBlock;
+
+	psBlock = (struct Block *)calloc(1, sizeof(struct Block));
+	if(psBlock == NULL)
+	{
+		strcpy(errMsg, "Cannot allocate memory");
+		return NULL;
+	}
+	psBlock->eType = eType;
+	return psBlock;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Block_expect(DynArray_T oTokens, int *piPos,
+	const char *pcKeyword, char *errMsg)
+
+/* Skip the word pcKeyword at *piPos.  Return 0 (FALSE) with a message
+   in errMsg if it is not there. */
+
+{
+	if(Block_isWord(oTokens, *piPos, pcKeyword))
+	{
+		(*piPos)++;
+		return TRUE;
+	}
+	if(*piPos < DynArray_getLength(oTokens))
+		snprintf(errMsg, MAX_ERROR_SIZE, SYNTAX_ERROR,
+			Token_getValue(DynArray_get(oTokens, *piPos)));
+	else
+		snprintf(errMsg, MAX_ERROR_SIZE, "Missing %s", pcKeyword);
+	return FALSE;
+}
+
+static struct Block *Block_parseSequence(DynArray_T oTokens, int *piPos,
+	char *errMsg);
+
+/*--------------------------------------------------------------------*/
+
+static struct Block *Block_parseFor(DynArray_T oTokens, int *piPos,
+	char *errMsg)
+
+/* Parse "for name in words; do sequence done" at *piPos. */
+
+{
+	struct Block *psBlock;
+	const char *pcName;
+
+	(*piPos)++;
+	pcName = Block_word(oTokens, *piPos);
+	if(pcName == NULL || !Block_isName(pcName, strlen(pcName)))
+	{
+		strcpy(errMsg, "for: invalid variable name");
+		return NULL;
+	}
+	(*piPos)++;
+	if(!Block_expect(oTokens, piPos, "in", errMsg)) return NULL;
+
+	psBlock = Block_new(BLOCK_FOR, errMsg);
+	if(psBlock == NULL) return NULL;
+	psBlock->pcName = strdup(pcName);
+	psBlock->oWords = DynArray_new(0);
+	if(psBlock->pcName == NULL || psBlock->oWords == NULL)
+	{
+		strcpy(errMsg, "Cannot allocate memory");
+		Block_free(psBlock);
+		return NULL;
+	}
+	while(Block_word(oTokens, *piPos) != NULL)
+	{
+		if(!DynArray_add(psBlock->oWords, DynArray_get(oTokens, *piPos)))
+		{
+			strcpy(errMsg, "Cannot allocate memory");
+			Block_free(psBlock);
+			return NULL;
+		}
+		(*piPos)++;
+	}
+
+	/* The words end with ';' or the end of the line */
+	if(*piPos < DynArray_getLength(oTokens)
+		&& Token_getType(DynArray_get(oTokens, *piPos)) == TOKEN_SEMI)
+		(*piPos)++;
+	if(!Block_expect(oTokens, piPos, "do", errMsg)
+		|| (psBlock->psBody = Block_parseSequence(oTokens, piPos, errMsg)) == NULL
+		|| !Block_expect(oTokens, piPos, "done", errMsg))
+	{
+		Block_free(psBlock);
+		return NULL;
+	}
+	return psBlock;
+}
+
+/*--------------------------------------------------------------------*/
+
+static struct Block *Block_parseWhile(DynArray_T oTokens, int *piPos,
+	char *errMsg)
+
+/* Parse "while sequence do sequence done" at *piPos. */
+
+{
+	struct Block *psBlock;
+
+	(*piPos)++;
+	psBlock = Block_new(BLOCK_WHILE, errMsg);
+	if(psBlock == NULL) return NULL;
+	if((psBlock->psCondition = Block_parseSequence(oTokens, piPos, errMsg)) == NULL
+		|| !Block_expect(oTokens, piPos, "do", errMsg)
+		|| (psBlock->psBody = Block_parseSequence(oTokens, piPos, errMsg)) == NULL
+		|| !Block_expect(oTokens, piPos, "done", errMsg))
+	{
+		Block_free(psBlock);
+		return NULL;
+	}
+	return psBlock;
+}
+
+/*--------------------------------------------------------------------*/
+
+static struct Block *Block_parseIf(DynArray_T oTokens, int *piPos,
+	char *errMsg)
+
+/* Parse "if sequence then sequence [elif ...] [else sequence] fi" at
+   *piPos, which is the if or an elif.  An elif is parsed as an if in
+   the else part that shares the fi. */
+
+{
+	struct Block *psBlock;
+
+	(*piPos)++;
+	psBlock = Block_new(BLOCK_IF, errMsg);
+	if(psBlock == NULL) return NULL;
+	if((psBlock->psCondition = Block_parseSequence(oTokens, piPos, errMsg)) == NULL
+		|| !Block_expect(oTokens, piPos, "then", errMsg)
+		|| (psBlock->psBody = Block_parseSequence(oTokens, piPos, errMsg)) == NULL)
+	{
+		Block_free(psBlock);
+		return NULL;
+	}
+
+	if(Block_isWord(oTokens, *piPos, "elif"))
+	{
+		psBlock->psElse = Block_parseIf(oTokens, piPos, errMsg);
+		if(psBlock->psElse == NULL)
+		{
+			Block_free(psBlock);
+			return NULL;
+		}
+		return psBlock;
+	}
+	if(Block_isWord(oTokens, *piPos, "else"))
+	{
+		(*piPos)++;
+		psBlock->psElse = Block_parseSequence(oTokens, piPos, errMsg);
+		if(psBlock->psElse == NULL)
+		{
+			Block_free(psBlock);
+			return NULL;
+		}
+	}
+	if(!Block_expect(oTokens, piPos, "fi", errMsg))
+	{
+		Block_free(psBlock);
+		return NULL;
+	}
+	return psBlock;
+}
+
+/*--------------------------------------------------------------------*/
+
+static struct Block *Block_parseGroup(DynArray_T oTokens, int *piPos,
+	char *errMsg)
+
+/* Parse "{ sequence }" at *piPos. */
+
+{
+	struct Block *psBlock;
+
+	(*piPos)++;
+	psBlock = Block_new(BLOCK_GROUP, errMsg);
+	if(psBlock == NULL) return NULL;
+	if((psBlock->psBody = Block_parseSequence(oTokens, piPos, errMsg)) == NULL
+		|| !Block_expect(oTokens, piPos, "}", errMsg))
+	{
+		Block_free(psBlock);
+		return NULL;
+	}
+	return psBlock;
+}
+
+/*--------------------------------------------------------------------*/
+
+static struct Block *Block_parseFunction(DynArray_T oTokens, int *piPos,
+	char *errMsg)
+
+/* Parse "name() { sequence }" at *piPos.  The body is kept both as a
+   tree and as the range of its tokens, which the definition copies. */
+
+{
+	struct Block *psBlock;
+	const char *pcWord = Block_word(oTokens, *piPos);
+
+	(*piPos)++;
+	psBlock = Block_new(BLOCK_FUNCTION, errMsg);
+	if(psBlock == NULL) return NULL;
+	psBlock->pcName = strndup(pcWord, strlen(pcWord) - 2);
+	if(psBlock->pcName == NULL)
+	{
+		strcpy(errMsg, "Cannot allocate memory");
+		Block_free(psBlock);
+		return NULL;
+	}
+	if(!Block_isWord(oTokens, *piPos, "{"))
+	{
+		Block_expect(oTokens, piPos, "{", errMsg);
+		Block_free(psBlock);
+		return NULL;
+	}
+	psBlock->iStart = *piPos + 1;
+	psBlock->psBody = Block_parseGroup(oTokens, piPos, errMsg);
+	if(psBlock->psBody == NULL)
+	{
+		Block_free(psBlock);
+		return NULL;
+	}
+	/* *piPos is past the '}' */
+	psBlock->iEnd = *piPos - 1;
+	return psBlock;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Block_append(struct Block *psSequence, struct Block *psBlock,
+	enum TokenType eOperator)
+
+/* Append psBlock, run after eOperator, to psSequence.  Return 0
+   (FALSE) if insufficient memory is available. */
+
+{
+	struct Block **ppsNew;
+	enum TokenType *peNew;
+
+	ppsNew = (struct Block **)realloc(psSequence->ppsBlocks,
+		(psSequence->iBlocks + 1) * sizeof(struct Block *));
+	if(ppsNew == NULL) return FALSE;
+	psSequence->ppsBlocks = ppsNew;
+	peNew = (enum TokenType *)realloc(psSequence->peOperators,
+		(psSequence->iBlocks + 1) * sizeof(enum TokenType));
+	if(peNew == NULL) return FALSE;
+	psSequence->peOperators = peNew;
+	psSequence->ppsBlocks[psSequence->iBlocks] = psBlock;
+	psSequence->peOperators[psSequence->iBlocks] = eOperator;
+	psSequence->iBlocks++;
+	return TRUE;
+}
+
+/*--------------------------------------------------------------------*/
+
+static struct Block *Block_parseSequence(DynArray_T oTokens, int *piPos,
+	char *errMsg)
+
+/* Parse the commands at *piPos up to a do, done, then, elif, else, fi
+   or '}' that starts a command, or the end of oTokens. */
+
+{
+	struct Block *psSequence, *psBlock;
+	enum TokenType eOperator = TOKEN_SEMI;
+	const char *pcWord;
+	int iLength = DynArray_getLength(oTokens), iEnd;
+
+	psSequence = Block_new(BLOCK_SEQUENCE, errMsg);
+	if(psSequence == NULL) return NULL;
+
+	while(*piPos < iLength)
+	{
+		pcWord = Block_word(oTokens, *piPos);
+		if(Block_isTerminator(pcWord)) break;
+
+		if(pcWord != NULL && strcmp(pcWord, "for") == 0)
+			psBlock = Block_parseFor(oTokens, piPos, errMsg);
+		else if(pcWord != NULL && strcmp(pcWord, "while") == 0)
+			psBlock = Block_parseWhile(oTokens, piPos, errMsg);
+		else if(pcWord != NULL && strcmp(pcWord, "if") == 0)
+			psBlock = Block_parseIf(oTokens, piPos, errMsg);
+		else if(pcWord != NULL && strcmp(pcWord, "{") == 0)
+			psBlock = Block_parseGroup(oTokens, piPos, errMsg);
+		else if(Block_isFunction(pcWord))
+			psBlock = Block_parseFunction(oTokens, piPos, errMsg);
+		else
+		{
+			/* A pipeline: lexLine already checked its syntax */
+			for(iEnd=*piPos;iEnd<iLength;iEnd++)
+				if(Token_isListOperator(DynArray_get(oTokens, iEnd))) break;
+			psBlock = Block_new(BLOCK_PIPELINE, errMsg);
+			if(psBlock != NULL)
+			{
+				psBlock->iStart = *piPos;
+				psBlock->iEnd = iEnd;
+			}
+			*piPos = iEnd;
+		}
+		if(psBlock == NULL) goto FAIL;
+		if(!Block_append(psSequence, psBlock, eOperator))
+		{
+			strcpy(errMsg, "Cannot allocate memory");
+			Block_free(psBlock);
+			goto FAIL;
+		}
+
+		/* A block may only be followed by a list operator */
+		if(*piPos < iLength && !Token_isListOperator(DynArray_get(oTokens, *piPos)))
+		{
+			if(Block_isTerminator(Block_word(oTokens, *piPos))) break;
+			snprintf(errMsg, MAX_ERROR_SIZE, SYNTAX_ERROR,
+				Token_getValue(DynArray_get(oTokens, *piPos)));
+			goto FAIL;
+		}
+		eOperator = TOKEN_SEMI;
+		if(*piPos < iLength)
+		{
+			eOperator = Token_getType(DynArray_get(oTokens, *piPos));
+			(*piPos)++;
+		}
+	}
+
+	/* Nothing to run, or "&&" or "||" with nothing after it */
+	if(psSequence->iBlocks == 0 || eOperator != TOKEN_SEMI)
+	{
+		if(*piPos < iLength)
+			snprintf(errMsg, MAX_ERROR_SIZE, SYNTAX_ERROR,
+				Token_getValue(DynArray_get(oTokens, *piPos)));
+		else
+			strcpy(errMsg, "Unexpected end of block");
+		goto FAIL;
+	}
+	return psSequence;
+
+	FAIL:
+		Block_free(psSequence);
+		return NULL;
+}
+
+/*--------------------------------------------------------------------*/
+
+struct Block *Block_parse(DynArray_T oTokens, char *errMsg)
+
+/* Build the plan tree of oTokens. */
+
+{
+	struct Block *psBlock;
+	int iPos = 0;
+
+	assert(oTokens != NULL);
+	assert(errMsg != NULL);
+
+	psBlock = Block_parseSequence(oTokens, &iPos, errMsg);
+	if(psBlock == NULL) return NULL;
+	if(iPos < DynArray_getLength(oTokens))
+	{
+		/* A done, fi, ... without its for, while or if */
+		snprintf(errMsg, MAX_ERROR_SIZE, SYNTAX_ERROR,
+			Token_getValue(DynArray_get(oTokens, iPos)));
+		Block_free(psBlock);
+		return NULL;
+	}
+	return psBlock;
+}
@@ -0,0 +1,66 @@
+#ifndef BLOCK_INCLUDED
+#define BLOCK_INCLUDED
+
+#include "dynarray.h"
+#include "token.h"
+
+/* A Block is a node of the plan tree of a command list that uses
+   for, while or if.  The tree refers to the tokens of the list by
+   index, so that running a loop again expands variables and globs
+   but never lexes or checks the syntax again.  The tokens stay owned
+   by the caller. */
+
+enum BlockType {BLOCK_PIPELINE, BLOCK_SEQUENCE, BLOCK_FOR, BLOCK_WHILE,
+	BLOCK_IF, BLOCK_GROUP, BLOCK_FUNCTION};
+
+struct Block
+{
+	enum BlockType eType;
+
+	/* BLOCK_PIPELINE: the tokens iStart to iEnd-1.  BLOCK_FUNCTION:
+	   the tokens of the body between '{' and '}' */
+	int iStart, iEnd;
+
+	/* BLOCK_SEQUENCE: the blocks, each run depending on the operator
+	   before it: TOKEN_SEMI, TOKEN_AND or TOKEN_OR */
+	struct Block **ppsBlocks;
+	enum TokenType *peOperators;
+	int iBlocks;
+
+	/* BLOCK_FOR: the variable and the words it takes in turn.
+	   BLOCK_FUNCTION: the name of the function, without "()". */
+	char *pcName;
+	DynArray_T oWords;
+
+	/* BLOCK_WHILE and BLOCK_IF: the condition.  Every type but
+	   BLOCK_PIPELINE and BLOCK_SEQUENCE: the body.  BLOCK_IF: the elif
+	   or else part, or NULL. */
+	struct Block *psCondition, *psBody, *psElse;
+};
+
+/* Return the change of nesting of the tokens oTokens of one line: one
+   for each for, while, if and '{' that starts a command, minus one for
+   each done, fi and '}'.  Store 1 in *piCompound if the line uses any
+   of these, do, then, elif, else or a function definition "name()",
+   or 0 otherwise. */
+int Block_nesting(DynArray_T oTokens, int *piCompound);
+
+/* Return 1 (TRUE) if the next line of a block must be separated from
+   oTokens by ';', that is unless oTokens ends with do, then, else, '{'
+   or "name()" or is empty. */
+int Block_needsSeparator(DynArray_T oTokens);
+
+/* Return 1 (TRUE) if oTokens ends with a function definition "name()"
+   whose body starts on the next line. */
+int Block_needsBody(DynArray_T oTokens);
+
+/* Build the plan tree of oTokens, which is a command list whose lines
+   passed lexLine().  Return NULL with a message in errMsg if the
+   blocks are not well formed or insufficient memory is available.
+   The caller owns the tree. */
+struct Block *Block_parse(DynArray_T oTokens, char *errMsg);
+
+/* Free the tree psBlock. */
+void Block_free(struct Block *psBlock);
+
+#endif
@@ -0,0 +1,346 @@
+#define _GNU_SOURCE
+#include "cgroup.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+/*--------------------------------------------------------------------*/
+
+enum {MAX_PATH_SIZE = 1024};
+
+#define SYSTEM_NAME "./ish"
+
+#ifndef SYS_clone3
+#define SYS_clone3 435
+#endif
+
+#ifndef CLONE_INTO_CGROUP
+#define CLONE_INTO_CGROUP 0x200000000ULL
+#endif
+
+/* The argument of clone3, as laid out by the kernel (CLONE_ARGS_SIZE_VER2) */
+struct CloneArgs
+{
+	unsigned long long flags;
+	unsigned long long pidfd;
+	unsigned long long child_tid;
+	unsigned long long parent_tid;
+	unsigned long long exit_signal;
+	unsigned long long stack;
+	unsigned long long stack_size;
+	unsigned long long tls;
+	unsigned long long set_tid;
+	unsigned long long set_tid_size;
+	unsigned long long cgroup;
+};
+
+/* Suffix of the next cgroup created without a name */
+static int iNextJob = 1;
+
+/*--------------------------------------------------------------------*/
+
+static int Cgroup_getRoot(char *pcRoot)
+
+/* Store the directory below which job cgroups are created in pcRoot,
+   which has room for MAX_PATH_SIZE characters.  Return 1 if
+   successful, or 0 if there is no cgroup v2 hierarchy. */
+
+{
+	char acLine[MAX_PATH_SIZE], acMount[MAX_PATH_SIZE];
+	FILE *psFile;
+	int iFound = 0;
+
+	if(getenv("ISH_CGROUP_ROOT") != NULL)
+	{
+		snprintf(pcRoot, MAX_PATH_SIZE, "%s", getenv("ISH_CGROUP_ROOT"));
+		return 1;
+	}
+
+	/* Where the cgroup2 file system is mounted ... */
+	psFile = fopen("/proc/self/mountinfo", "r");
+	if(psFile == NULL) return 0;
+	while(!iFound && fgets(acLine, MAX_PATH_SIZE, psFile) != NULL)
+		iFound = strstr(acLine, " - cgroup2 ") != NULL
+			&& sscanf(acLine, "%*s %*s %*s %*s %1023s", acMount) == 1;
+	fclose(psFile);
+	if(!iFound) return 0;
+
+	/* ... and the shell's place in it */
+	psFile = fopen("/proc/self/cgroup", "r");
+	if(psFile == NULL) return 0;
+	iFound = 0;
+	while(!iFound && fgets(acLine, MAX_PATH_SIZE, psFile) != NULL)
+		iFound = strncmp(acLine, "0::", 3) == 0;
+	fclose(psFile);
+	if(!iFound) return 0;
+
+	acLine[strcspn(acLine, "\n")] = '\0';
+	snprintf(pcRoot, MAX_PATH_SIZE, "%s%s", acMount,
+		strcmp(acLine + 3, "/") == 0 ? "" : acLine + 3);
+	return 1;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Cgroup_write(const char *pcDir, const char *pcFile,
+	const char *pcValue)
+
+/* Write pcValue to the interface file pcFile of the cgroup pcDir.
+   Return 1 if successful, or 0 with errno set otherwise. */
+
+{
+	char acPath[2 * MAX_PATH_SIZE];
+	int iFd, iLen, iSaved;
+
+	snprintf(acPath, sizeof(acPath), "%s/%s", pcDir, pcFile);
+	iFd = open(acPath, O_WRONLY | O_CLOEXEC);
+	if(iFd < 0) return 0;
+	iLen = strlen(pcValue);
+	if(write(iFd, pcValue, iLen) != iLen)
+	{
+		iSaved = errno;
+		close(iFd);
+		errno = iSaved;
+		return 0;
+	}
+	close(iFd);
+	return 1;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Cgroup_enable(const char *pcRoot, const char *pcController)
+
+/* Enable controller pcController ("+cpu") for the children of the
+   cgroup pcRoot.  Return 1 if it is enabled, or 0 with errno set
+   otherwise. */
+
+{
+	char acPath[2 * MAX_PATH_SIZE], acWord[64];
+	FILE *psFile;
+	int iSaved, iEnabled = 0;
+
+	if(Cgroup_write(pcRoot, "cgroup.subtree_control", pcController)) return 1;
+
+	/* A write can be refused even though the controller is enabled
+	   already, as when the root is not ours to change */
+	iSaved = errno;
+	snprintf(acPath, sizeof(acPath), "%s/cgroup.subtree_control", pcRoot);
+	psFile = fopen(acPath, "r");
+	if(psFile != NULL)
+	{
+		while(!iEnabled && fscanf(psFile, "%63s", acWord) == 1)
+			iEnabled = strcmp(acWord, pcController + 1) == 0;
+		fclose(psFile);
+	}
+	errno = iSaved;
+	return iEnabled;
+}
+
+/*--------------------------------------------------------------------*/
+
+int Cgroup_open(const char *pcName, const char *pcCpuMax,
+	const char *pcMemoryMax, const char *pcIoMax, char **ppcPath,
+	int *piCreated)
+
+/* Open or create a job cgroup and apply its limits.  Return its
+   descriptor, or -1 after printing an error message. */
+
+{
+	char acRoot[MAX_PATH_SIZE], acPath[2 * MAX_PATH_SIZE], acCpu[64];
+	const char *apcFile[3] = {"cpu.max", "memory.max", "io.max"};
+	const char *apcController[3] = {"+cpu", "+memory", "+io"};
+	const char *apcValue[3];
+	int iFd, i;
+
+	assert(ppcPath != NULL);
+	assert(piCreated != NULL);
+
+	if(!Cgroup_getRoot(acRoot))
+	{
+		fprintf(stderr, "%s: limit: no cgroup v2 hierarchy found\n", SYSTEM_NAME);
+		return -1;
+	}
+
+	*piCreated = 0;
+	if(pcName != NULL)
+	{
+		if(strchr(pcName, '/') != NULL || strcmp(pcName, "..") == 0)
+		{
+			fprintf(stderr, "%s: limit: %s: invalid cgroup name\n", SYSTEM_NAME, pcName);
+			return -1;
+		}
+		snprintf(acPath, sizeof(acPath), "%s/%s", acRoot, pcName);
+		if(mkdir(acPath, 0755) == 0) *piCreated = 1;
+		else if(errno != EEXIST)
+		{
+			fprintf(stderr, "%s: limit: %s: %s\n", SYSTEM_NAME, acPath, strerror(errno));
+			return -1;
+		}
+	}
+	else
+	{
+		for(;;)
+		{
+			snprintf(acPath, sizeof(acPath), "%s/ish-%d-%d", acRoot, (int)getpid(), iNextJob++);
+			if(mkdir(acPath, 0755) == 0) break;
+			if(errno != EEXIST)
+			{
+				fprintf(stderr, "%s: limit: %s: %s\n", SYSTEM_NAME, acPath, strerror(errno));
+				return -1;
+			}
+		}
+		*piCreated = 1;
+	}
+
+	/* "N%" is a share of one CPU */
+	if(pcCpuMax != NULL && pcCpuMax[0] != '\0' && pcCpuMax[strlen(pcCpuMax)-1] == '%')
+	{
+		snprintf(acCpu, sizeof(acCpu), "%ld 100000", atol(pcCpuMax) * 1000);
+		pcCpuMax = acCpu;
+	}
+
+	apcValue[0] = pcCpuMax;
+	apcValue[1] = pcMemoryMax;
+	apcValue[2] = pcIoMax;
+	for(i=0;i<3;i++)
+	{
+		if(apcValue[i] == NULL) continue;
+		/* The controller must be enabled for the children of the root.
+		   cgroup v2 refuses that with EBUSY while the root has processes
+		   of its own, as the shell's own cgroup does. */
+		if(!Cgroup_enable(acRoot, apcController[i]))
+		{
+			fprintf(stderr, "%s: limit: %s: cannot enable %s: %s%s\n", SYSTEM_NAME, acRoot,
+				apcController[i] + 1, strerror(errno),
+				errno == EBUSY ? " (set ISH_CGROUP_ROOT to a cgroup without processes)" : "");
+			if(*piCreated) rmdir(acPath);
+			return -1;
+		}
+		if(!Cgroup_write(acPath, apcFile[i], apcValue[i]))
+		{
+			fprintf(stderr, "%s: limit: %s/%s: %s\n", SYSTEM_NAME, acPath, apcFile[i], strerror(errno));
+			if(*piCreated) rmdir(acPath);
+			return -1;
+		}
+	}
+
+	iFd = open(acPath, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	*ppcPath = strdup(acPath);
+	if(iFd < 0 || *ppcPath == NULL)
+	{
+		fprintf(stderr, "%s: limit: %s: %s\n", SYSTEM_NAME, acPath, strerror(errno));
+		if(iFd >= 0) close(iFd);
+		free(*ppcPath);
+		if(*piCreated) rmdir(acPath);
+		return -1;
+	}
+	return iFd;
+}
+
+/*--------------------------------------------------------------------*/
+
+int Cgroup_fork(int iCgroupFd)
+
+/* fork() into the cgroup iCgroupFd. */
+
+{
+	struct CloneArgs sArgs;
+	int pid, iFd;
+
+	memset(&sArgs, 0, sizeof(sArgs));
+	sArgs.flags = CLONE_INTO_CGROUP;
+	sArgs.exit_signal = SIGCHLD;
+	sArgs.cgroup = iCgroupFd;
+
+	pid = syscall(SYS_clone3, &sArgs, sizeof(sArgs));
+	if(pid != -1 || (errno != ENOSYS && errno != E2BIG && errno != EINVAL))
+		return pid;
+
+	/* Without clone3 the child joins the cgroup before running anything */
+	pid = fork();
+	if(pid == 0)
+	{
+		iFd = openat(iCgroupFd, "cgroup.procs", O_WRONLY | O_CLOEXEC);
+		if(iFd < 0 || write(iFd, "0", 1) != 1)
+		{
+			perror("cgroup.procs");
+			_exit(EXIT_FAILURE);
+		}
+		close(iFd);
+	}
+	return pid;
+}
+
+/*--------------------------------------------------------------------*/
+
+static long Cgroup_readKey(const char *pcPath, const char *pcFile,
+	const char *pcKey)
+
+/* Return the sum of the values of pcKey ("key value" or "key=value")
+   in the interface file pcFile of the cgroup pcPath.  If pcKey is
+   NULL, return the single number the file holds.  Return -1 if the
+   file cannot be read. */
+
+{
+	char acPath[2 * MAX_PATH_SIZE], acWord[256];
+	FILE *psFile;
+	long lSum = 0;
+	int iLen;
+
+	snprintf(acPath, sizeof(acPath), "%s/%s", pcPath, pcFile);
+	psFile = fopen(acPath, "r");
+	if(psFile == NULL) return -1;
+
+	if(pcKey == NULL)
+	{
+		if(fscanf(psFile, "%ld", &lSum) != 1) lSum = -1;
+		fclose(psFile);
+		return lSum;
+	}
+
+	iLen = strlen(pcKey);
+	while(fscanf(psFile, "%255s", acWord) == 1)
+	{
+		if(strcmp(acWord, pcKey) == 0)
+		{
+			long lValue;
+			if(fscanf(psFile, "%ld", &lValue) == 1) lSum += lValue;
+		}
+		else if(strncmp(acWord, pcKey, iLen) == 0 && acWord[iLen] == '=')
+			lSum += atol(acWord + iLen + 1);
+	}
+	fclose(psFile);
+	return lSum;
+}
+
+/*--------------------------------------------------------------------*/
+
+void Cgroup_printStats(const char *pcPath, FILE *psFile)
+
+/* Print the usage of the cgroup pcPath on one line. */
+
+{
+	long lCpu, lMemory, lRead, lWrite;
+
+	assert(pcPath != NULL);
+	assert(psFile != NULL);
+
+	lCpu = Cgroup_readKey(pcPath, "cpu.stat", "usage_usec");
+	lMemory = Cgroup_readKey(pcPath, "memory.current", NULL);
+	lRead = Cgroup_readKey(pcPath, "io.stat", "rbytes");
+	lWrite = Cgroup_readKey(pcPath, "io.stat", "wbytes");
+
+	fprintf(psFile, "\tcgroup %s:", pcPath);
+	if(lCpu >= 0) fprintf(psFile, " cpu %.2fs", lCpu / 1e6);
+	if(lMemory >= 0) fprintf(psFile, " mem %ldK", lMemory / 1024);
+	if(lRead >= 0) fprintf(psFile, " io read %ldK write %ldK", lRead / 1024, lWrite / 1024);
+	fprintf(psFile, "\n");
+}
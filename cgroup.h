@@ -0,0 +1,31 @@
+#ifndef CGROUP_INCLUDED
+#define CGROUP_INCLUDED
+
+#include <stdio.h>
+
+/* Open cgroup pcName below the shell's cgroup v2 root, creating it if
+   it does not exist, and write the non-NULL limits pcCpuMax,
+   pcMemoryMax and pcIoMax to its cpu.max, memory.max and io.max.  If
+   pcName is NULL, a new cgroup with a fresh name is created.  The root
+   is $ISH_CGROUP_ROOT if set, or else the cgroup of the shell.  Store
+   the path of the cgroup in *ppcPath, which the caller owns, and set
+   *piCreated to 1 if the cgroup was created by this call.  A limit
+   whose controller cannot be enabled below the root is an error: the
+   root must hold no processes, which the shell's cgroup usually does.
+   Return an O_DIRECTORY descriptor of the cgroup, or -1 after printing
+   an error message. */
+int Cgroup_open(const char *pcName, const char *pcCpuMax,
+	const char *pcMemoryMax, const char *pcIoMax, char **ppcPath,
+	int *piCreated);
+
+/* Like fork(), but the child starts its life inside the cgroup whose
+   descriptor is iCgroupFd (clone3 with CLONE_INTO_CGROUP).  On kernels
+   without clone3 the child moves itself into the cgroup before it
+   returns. */
+int Cgroup_fork(int iCgroupFd);
+
+/* Write the CPU time, memory and I/O usage of the cgroup at pcPath to
+   psFile on one line. */
+void Cgroup_printStats(const char *pcPath, FILE *psFile);
+
+#endif
@@ -0,0 +1,274 @@
+#include "define.h"
+#include "token.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+/*--------------------------------------------------------------------*/
+
+enum {FALSE, TRUE};
+
+enum {BUCKET_COUNT = 256};
+
+/* A Definition is an alias or a function. */
+struct Definition
+{
+	enum DefineType eType;
+	char *pcName;
+
+	/* The value of an alias as typed, or NULL */
+	char *pcText;
+
+	/* The tokens, owned, and the plan tree of a function */
+	DynArray_T oTokens;
+	struct Block *psBlock;
+
+	/* Number of Define_hold not yet released, and 1 once the
+	   definition left the table */
+	int iHolds;
+	int iRemoved;
+
+	struct Definition *psNext;
+};
+
+static struct Definition *apsBuckets[BUCKET_COUNT];
+
+/*--------------------------------------------------------------------*/
+
+static unsigned int Define_hash(enum DefineType eType, const char *pcName)
+
+/* Return the bucket of pcName of type eType. */
+
+{
+	unsigned int uiHash = 5381 + eType;
+
+	while(*pcName != '\0')
+		uiHash = uiHash * 33 + (unsigned char)*pcName++;
+	return uiHash % BUCKET_COUNT;
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Define_destroy(struct Definition *psDefinition)
+
+/* Free psDefinition and everything it owns. */
+
+{
+	free(psDefinition->pcName);
+	free(psDefinition->pcText);
+	if(psDefinition->oTokens != NULL)
+	{
+		DynArray_map(psDefinition->oTokens, freeToken, NULL);
+		DynArray_free(psDefinition->oTokens);
+	}
+	Block_free(psDefinition->psBlock);
+	free(psDefinition);
+}
+
+/*--------------------------------------------------------------------*/
+
+static struct Definition **Define_find(enum DefineType eType,
+	const char *pcName)
+
+/* Return the link that points to the definition of pcName of type
+   eType, or to the NULL that ends its bucket. */
+
+{
+	struct Definition **ppsLink;
+
+	for(ppsLink = &apsBuckets[Define_hash(eType, pcName)]; *ppsLink != NULL;
+		ppsLink = &(*ppsLink)->psNext)
+	{
+		if((*ppsLink)->eType == eType && strcmp((*ppsLink)->pcName, pcName) == 0)
+			break;
+	}
+	return ppsLink;
+}
+
+/*--------------------------------------------------------------------*/
+
+int Define_remove(enum DefineType eType, const char *pcName)
+
+/* Remove the definition of pcName of type eType. */
+
+{
+	struct Definition **ppsLink, *psDefinition;
+
+	assert(pcName != NULL);
+
+	ppsLink = Define_find(eType, pcName);
+	psDefinition = *ppsLink;
+	if(psDefinition == NULL) return FALSE;
+	*ppsLink = psDefinition->psNext;
+	psDefinition->iRemoved = TRUE;
+	if(psDefinition->iHolds == 0) Define_destroy(psDefinition);
+	return TRUE;
+}
+
+/*--------------------------------------------------------------------*/
+
+int Define_set(enum DefineType eType, const char *pcName, const char *pcText,
+	DynArray_T oTokens, struct Block *psBlock)
+
+/* Define pcName of type eType. */
+
+{
+	struct Definition *psDefinition, **ppsLink;
+
+	assert(pcName != NULL);
+	assert(oTokens != NULL);
+
+	psDefinition = (struct Definition *)calloc(1, sizeof(struct Definition));
+	if(psDefinition == NULL)
+	{
+		DynArray_map(oTokens, freeToken, NULL);
+		DynArray_free(oTokens);
+		Block_free(psBlock);
+		return FALSE;
+	}
+	psDefinition->eType = eType;
+	psDefinition->oTokens = oTokens;
+	psDefinition->psBlock = psBlock;
+	psDefinition->pcName = strdup(pcName);
+	if(pcText != NULL) psDefinition->pcText = strdup(pcText);
+	if(psDefinition->pcName == NULL || (pcText != NULL && psDefinition->pcText == NULL))
+	{
+		Define_destroy(psDefinition);
+		return FALSE;
+	}
+
+	Define_remove(eType, pcName);
+	ppsLink = &apsBuckets[Define_hash(eType, pcName)];
+	psDefinition->psNext = *ppsLink;
+	*ppsLink = psDefinition;
+	return TRUE;
+}
+
+/*--------------------------------------------------------------------*/
+
+struct Definition *Define_get(enum DefineType eType, const char *pcName)
+
+/* Return the definition of pcName of type eType, or NULL. */
+
+{
+	assert(pcName != NULL);
+
+	return *Define_find(eType, pcName);
+}
+
+/*--------------------------------------------------------------------*/
+
+void Define_hold(struct Definition *psDefinition)
+
+/* Keep psDefinition valid until Define_release. */
+
+{
+	assert(psDefinition != NULL);
+
+	psDefinition->iHolds++;
+}
+
+/*--------------------------------------------------------------------*/
+
+void Define_release(struct Definition *psDefinition)
+
+/* Undo one Define_hold of psDefinition. */
+
+{
+	assert(psDefinition != NULL);
+	assert(psDefinition->iHolds > 0);
+
+	psDefinition->iHolds--;
+	if(psDefinition->iHolds == 0 && psDefinition->iRemoved)
+		Define_destroy(psDefinition);
+}
+
+/*--------------------------------------------------------------------*/
+
+DynArray_T Define_getTokens(struct Definition *psDefinition)
+
+/* Return the tokens of psDefinition. */
+
+{
+	assert(psDefinition != NULL);
+
+	return psDefinition->oTokens;
+}
+
+/*--------------------------------------------------------------------*/
+
+struct Block *Define_getBlock(struct Definition *psDefinition)
+
+/* Return the plan tree of function psDefinition. */
+
+{
+	assert(psDefinition != NULL);
+
+	return psDefinition->psBlock;
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Define_printAlias(FILE *psFile, struct Definition *psDefinition)
+
+/* Write alias psDefinition to psFile so that it can be read back. */
+
+{
+	const char *pc;
+
+	fprintf(psFile, "alias %s='", psDefinition->pcName);
+	for(pc = psDefinition->pcText; *pc != '\0'; pc++)
+	{
+		if(*pc == '\'') fputs("'\"'\"'", psFile);
+		else fputc(*pc, psFile);
+	}
+	fputs("'\n", psFile);
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Define_compareNames(const void *pvFirst, const void *pvSecond)
+
+/* Order two definitions by name for qsort. */
+
+{
+	return strcmp((*(struct Definition * const *)pvFirst)->pcName,
+		(*(struct Definition * const *)pvSecond)->pcName);
+}
+
+/*--------------------------------------------------------------------*/
+
+int Define_printAliases(FILE *psFile, const char *pcName)
+
+/* Write alias pcName, or every alias sorted by name, to psFile. */
+
+{
+	struct Definition *psDefinition, **ppsAliases;
+	int iAliases = 0, i;
+
+	assert(psFile != NULL);
+
+	if(pcName != NULL)
+	{
+		psDefinition = Define_get(DEFINE_ALIAS, pcName);
+		if(psDefinition == NULL) return FALSE;
+		Define_printAlias(psFile, psDefinition);
+		return TRUE;
+	}
+
+	for(i=0;i<BUCKET_COUNT;i++)
+		for(psDefinition = apsBuckets[i]; psDefinition != NULL; psDefinition = psDefinition->psNext)
+			if(psDefinition->eType == DEFINE_ALIAS) iAliases++;
+	if(iAliases == 0) return TRUE;
+
+	ppsAliases = (struct Definition **)malloc(iAliases * sizeof(struct Definition *));
+	if(ppsAliases == NULL) return FALSE;
+	iAliases = 0;
+	for(i=0;i<BUCKET_COUNT;i++)
+		for(psDefinition = apsBuckets[i]; psDefinition != NULL; psDefinition = psDefinition->psNext)
+			if(psDefinition->eType == DEFINE_ALIAS) ppsAliases[iAliases++] = psDefinition;
+	qsort(ppsAliases, iAliases, sizeof(struct Definition *), Define_compareNames);
+	for(i=0;i<iAliases;i++) Define_printAlias(psFile, ppsAliases[i]);
+	free(ppsAliases);
+	return TRUE;
+}
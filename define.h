@@ -0,0 +1,53 @@
+#ifndef DEFINE_INCLUDED
+#define DEFINE_INCLUDED
+
+#include <stdio.h>
+#include "dynarray.h"
+#include "block.h"
+
+/* The aliases and functions the user defined, in a hash table.  Both
+   are lexed, and a function is parsed into its plan tree, once when it
+   is defined, so that using one costs a lookup and no lexing.  Aliases
+   and functions have separate names. */
+
+enum DefineType {DEFINE_ALIAS, DEFINE_FUNCTION};
+
+struct Definition;
+
+/* Define the alias or function pcName of type eType, replacing any
+   earlier one, with the tokens oTokens and, for a function, the plan
+   tree psBlock of oTokens.  pcText is the value of an alias as typed,
+   or NULL.  The definition takes ownership of oTokens, its tokens and
+   psBlock, even on failure.  Return 0 (FALSE) if insufficient memory
+   is available. */
+int Define_set(enum DefineType eType, const char *pcName, const char *pcText,
+	DynArray_T oTokens, struct Block *psBlock);
+
+/* Return the definition of pcName of type eType, or NULL.  It stays
+   valid until pcName is defined again or removed, unless it is held. */
+struct Definition *Define_get(enum DefineType eType, const char *pcName);
+
+/* Keep psDefinition valid until Define_release, even if its name is
+   defined again or removed meanwhile, as when a function redefines
+   itself. */
+void Define_hold(struct Definition *psDefinition);
+
+/* Undo one Define_hold of psDefinition. */
+void Define_release(struct Definition *psDefinition);
+
+/* Remove the definition of pcName of type eType.  Return 0 (FALSE) if
+   there is none. */
+int Define_remove(enum DefineType eType, const char *pcName);
+
+/* Return the tokens of psDefinition. */
+DynArray_T Define_getTokens(struct Definition *psDefinition);
+
+/* Return the plan tree of function psDefinition. */
+struct Block *Define_getBlock(struct Definition *psDefinition);
+
+/* Write the definition of alias pcName to psFile as "alias name='value'",
+   or every alias if pcName is NULL.  Return 0 (FALSE) if there is no
+   alias pcName or insufficient memory is available. */
+int Define_printAliases(FILE *psFile, const char *pcName);
+
+#endif
@@ -7,10 +7,15 @@
 #include "dynarray.h"
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 
 enum { MIN_PHYS_LENGTH = 2 };
 enum { GROWTH_FACTOR = 2 };
 
+/* The number of elements stored inside the DynArray itself.  Most
+   command lines have fewer tokens than this. */
+enum { INLINE_LENGTH = 16 };
+
 /*--------------------------------------------------------------------*/
 /* A DynArray consists of an array, along with its logical and
    physical lengths. */
@@ -24,8 +29,12 @@ struct DynArray
 	   DynArray. */
 	int iPhysLength;
 	
-	/* The array that underlies the DynArray. */
+	/* The array that underlies the DynArray: apvInline, or a heap
+	   array once the DynArray has outgrown it. */
 	const void **ppvArray;
+
+	/* Storage for the first INLINE_LENGTH elements. */
+	const void *apvInline[INLINE_LENGTH];
 };
 /*--------------------------------------------------------------------*/
 /* Check the invariants of oDynArray.  Return 1 (TRUE) iff oDynArray
@@ -37,6 +46,8 @@ static int DynArray_isValid(DynArray_T oDynArray)
 	if (oDynArray->iPhysLength < MIN_PHYS_LENGTH) return 0;
 	if (oDynArray->iLength > oDynArray->iPhysLength) return 0;
 	if (oDynArray->ppvArray == NULL) return 0;
+	if (oDynArray->ppvArray == oDynArray->apvInline
+		&& oDynArray->iPhysLength != INLINE_LENGTH) return 0;
 	return 1;
 }
 #endif
@@ -54,11 +65,14 @@ DynArray_T DynArray_new(int iLength)
 		return NULL;
 	
 	oDynArray->iLength = iLength;
-	if (iLength > MIN_PHYS_LENGTH)
-		oDynArray->iPhysLength = iLength;
-	else
-		oDynArray->iPhysLength = MIN_PHYS_LENGTH;
+	if (iLength <= INLINE_LENGTH) {
+		oDynArray->iPhysLength = INLINE_LENGTH;
+		oDynArray->ppvArray = oDynArray->apvInline;
+		memset(oDynArray->apvInline, 0, sizeof(oDynArray->apvInline));
+		return oDynArray;
+	}
 	
+	oDynArray->iPhysLength = iLength;
 	oDynArray->ppvArray =
 		(const void**)calloc((size_t)oDynArray->iPhysLength,
 							 sizeof(void*));
@@ -76,10 +90,22 @@ void DynArray_free(DynArray_T oDynArray)
 	assert(oDynArray != NULL);
 	assert(DynArray_isValid(oDynArray));
 	
-	free(oDynArray->ppvArray);
+	if (oDynArray->ppvArray != oDynArray->apvInline)
+		free(oDynArray->ppvArray);
 	free(oDynArray);
 }
 /*--------------------------------------------------------------------*/
+/* Remove all elements of oDynArray, keeping its memory for reuse. */
+void DynArray_clear(DynArray_T oDynArray)
+{
+	assert(oDynArray != NULL);
+	assert(DynArray_isValid(oDynArray));
+	
+	oDynArray->iLength = 0;
+	
+	assert(DynArray_isValid(oDynArray));
+}
+/*--------------------------------------------------------------------*/
 /* Return the length of oDynArray. */
 int DynArray_getLength(DynArray_T oDynArray)
 {
@@ -131,10 +157,20 @@ static int DynArray_grow(DynArray_T oDynArray)
 	
 	iNewLength = oDynArray->iPhysLength * GROWTH_FACTOR;
 	
-	ppvNewArray = (const void**)
-		realloc(oDynArray->ppvArray, sizeof(void*) * iNewLength);
-	if (ppvNewArray == NULL)
-		return 0;
+	/* The inline storage is copied out on the first growth */
+	if (oDynArray->ppvArray == oDynArray->apvInline) {
+		ppvNewArray = (const void**)malloc(sizeof(void*) * iNewLength);
+		if (ppvNewArray == NULL)
+			return 0;
+		memcpy(ppvNewArray, oDynArray->apvInline,
+			   sizeof(oDynArray->apvInline));
+	}
+	else {
+		ppvNewArray = (const void**)
+			realloc(oDynArray->ppvArray, sizeof(void*) * iNewLength);
+		if (ppvNewArray == NULL)
+			return 0;
+	}
 	
 	oDynArray->iPhysLength = iNewLength;
 	oDynArray->ppvArray = ppvNewArray;
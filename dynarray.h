@@ -17,6 +17,10 @@ DynArray_T DynArray_new(int iLength);
 /* Free oDynArray. */
 void DynArray_free(DynArray_T oDynArray);
 
+/* Remove all elements of oDynArray, keeping its memory so that it can
+   be filled again without allocating. */
+void DynArray_clear(DynArray_T oDynArray);
+
 /* Return the length of oDynArray. */
 int DynArray_getLength(DynArray_T oDynArray);
 
@@ -0,0 +1,618 @@
+#include "edit.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+
+/*--------------------------------------------------------------------*/
+
+enum {FALSE, TRUE};
+
+/* Lines kept in the history */
+enum {MAX_HISTORY = 1000};
+
+/* Bytes of input handled per read(), and per write() of output */
+enum {READ_SIZE = 256};
+
+enum {DEFAULT_COLUMNS = 80};
+
+#define KEY_CTRL(c) ((c) & 0x1f)
+enum {KEY_ESC = 27, KEY_BACKSPACE = 127};
+
+/* How much of an escape sequence was read */
+enum EscState {ESC_NONE, ESC_START, ESC_CSI, ESC_SS3};
+
+/* What the line editor returns to its caller */
+enum Result {RESULT_EDITING, RESULT_ACCEPT, RESULT_CANCEL, RESULT_EOF};
+
+/* The line being edited, in the caller's buffer, and the byte the
+   cursor is on */
+static char *pcBuf;
+static int iSize, iLen, iPos;
+
+/* The prompt, the width of the screen, the first byte shown after the
+   prompt, and the byte the terminal cursor is actually on */
+static const char *pcPrompt;
+static int iPromptCols, iCols, iOffset, iScreen;
+
+/* Output not yet written */
+static char *pcOut;
+static size_t iOutLen, iOutSize;
+
+/* The text of the last kill */
+static char *pcKill;
+
+/* Input read but not handled yet: what follows the end of a line in
+   pasted text belongs to the next lines */
+static char acInput[READ_SIZE];
+static int iInputPos, iInputLen;
+
+/* The history, oldest first, the entry shown while walking it, and the
+   line that was being typed before the walk started */
+static char *apcHistory[MAX_HISTORY];
+static int iHistory, iHistoryPos;
+static char *pcTyped;
+
+/*--------------------------------------------------------------------*/
+
+int Edit_isTerminal(void)
+
+/* Return 1 (TRUE) if stdin and stdout are a terminal. */
+
+{
+	const char *pcTerm = getenv("TERM");
+
+	return isatty(0) && isatty(1) && pcTerm != NULL
+		&& strcmp(pcTerm, "dumb") != 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Edit_append(const char *pc, size_t iBytes)
+
+/* Append iBytes of pc to the output.  Output that does not fit in
+   memory is dropped. */
+
+{
+	char *pcNew;
+	size_t iNewSize;
+
+	if(iOutLen + iBytes > iOutSize)
+	{
+		iNewSize = (iOutSize == 0) ? READ_SIZE : iOutSize;
+		while(iOutLen + iBytes > iNewSize) iNewSize *= 2;
+		pcNew = (char *)realloc(pcOut, iNewSize);
+		if(pcNew == NULL) return;
+		pcOut = pcNew;
+		iOutSize = iNewSize;
+	}
+	memcpy(pcOut + iOutLen, pc, iBytes);
+	iOutLen += iBytes;
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Edit_flush(void)
+
+/* Write the output to the terminal at once. */
+
+{
+	size_t iDone = 0;
+	ssize_t n;
+
+	while(iDone < iOutLen)
+	{
+		n = write(1, pcOut + iDone, iOutLen - iDone);
+		if(n < 0 && errno == EINTR) continue;
+		if(n <= 0) break;
+		iDone += n;
+	}
+	iOutLen = 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Edit_isContinuation(char c)
+
+/* Return 1 (TRUE) if c continues a UTF-8 character. */
+
+{
+	return ((unsigned char)c & 0xC0) == 0x80;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Edit_columns(int iFrom, int iTo)
+
+/* Return the screen columns bytes iFrom to iTo-1 take, counting one
+   per character. */
+
+{
+	int iColumns = 0;
+
+	for(;iFrom<iTo;iFrom++)
+		if(!Edit_isContinuation(pcBuf[iFrom])) iColumns++;
+	return iColumns;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Edit_previous(int i)
+
+/* Return the start of the character before byte i. */
+
+{
+	if(i > 0) i--;
+	while(i > 0 && Edit_isContinuation(pcBuf[i])) i--;
+	return i;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Edit_next(int i)
+
+/* Return the start of the character after byte i. */
+
+{
+	if(i < iLen) i++;
+	while(i < iLen && Edit_isContinuation(pcBuf[i])) i++;
+	return i;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Edit_width(void)
+
+/* Return the columns left for the line after the prompt.  The last
+   column stays free so that the terminal never wraps. */
+
+{
+	int iWidth = iCols - iPromptCols - 1;
+
+	return (iWidth < 1) ? 1 : iWidth;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Edit_visibleEnd(void)
+
+/* Return the byte after the last one that fits on the screen. */
+
+{
+	int i = iOffset, iColumns = 0, iWidth = Edit_width();
+
+	while(i < iLen && iColumns < iWidth)
+	{
+		i = Edit_next(i);
+		iColumns++;
+	}
+	return i;
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Edit_moveCursor(int iTo)
+
+/* Move the terminal cursor from iScreen to byte iTo, which are both
+   visible. */
+
+{
+	char acMove[32];
+	int iColumns;
+
+	if(iTo < iScreen)
+	{
+		iColumns = Edit_columns(iTo, iScreen);
+		if(iColumns == 1) Edit_append("\b", 1);
+		else Edit_append(acMove, snprintf(acMove, sizeof(acMove), "\x1b[%dD", iColumns));
+	}
+	else if(iTo > iScreen)
+	{
+		iColumns = Edit_columns(iScreen, iTo);
+		Edit_append(acMove, snprintf(acMove, sizeof(acMove), "\x1b[%dC", iColumns));
+	}
+	iScreen = iTo;
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Edit_drawFrom(int iFrom, int iErase)
+
+/* Write the visible text from byte iFrom on, erase the rest of the
+   screen line if iErase, and put the cursor back on iPos. */
+
+{
+	int iEnd = Edit_visibleEnd();
+
+	Edit_moveCursor(iFrom);
+	if(iFrom < iEnd)
+	{
+		Edit_append(pcBuf + iFrom, iEnd - iFrom);
+		iScreen = iEnd;
+	}
+	if(iErase) Edit_append("\x1b[K", 3);
+	Edit_moveCursor(iPos);
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Edit_refresh(void)
+
+/* Redraw the prompt and the visible part of the line. */
+
+{
+	Edit_append("\r", 1);
+	Edit_append(pcPrompt, strlen(pcPrompt));
+	iScreen = iOffset;
+	Edit_drawFrom(iOffset, TRUE);
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Edit_scroll(void)
+
+/* Move iOffset so that the cursor is visible, and to 0 if the whole
+   line fits.  Return 1 (TRUE) if it moved, so that the line must be
+   redrawn. */
+
+{
+	int iOld = iOffset, iWidth = Edit_width(), iBack, i;
+
+	if(iOffset > 0 && Edit_columns(0, iLen) < iWidth)
+		iOffset = 0;
+	else if(iPos < iOffset || Edit_columns(iOffset, iPos) >= iWidth)
+	{
+		/* Jump rather than crawl, so that a redraw is rarely needed:
+		   the cursor lands in the middle going left, near the end
+		   going right */
+		iBack = (iPos < iOffset) ? iWidth / 2 : iWidth - iWidth / 4;
+		for(i=iPos;i>0&&iBack>0;iBack--) i = Edit_previous(i);
+		iOffset = i;
+	}
+	return iOffset != iOld;
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Edit_update(int iFrom, int iErase)
+
+/* Show the line after a change at byte iFrom, which may have made it
+   shorter if iErase. */
+
+{
+	if(Edit_scroll()) Edit_refresh();
+	else Edit_drawFrom(iFrom > iOffset ? iFrom : iOffset, iErase);
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Edit_moveTo(int iTo)
+
+/* Move the cursor to byte iTo. */
+
+{
+	iPos = iTo;
+	if(Edit_scroll()) Edit_refresh();
+	else Edit_moveCursor(iPos);
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Edit_insert(const char *pc, int iBytes)
+
+/* Insert iBytes of pc at the cursor. */
+
+{
+	int iFrom = iPos;
+
+	if(iLen + iBytes > iSize - 2)
+	{
+		Edit_append("\a", 1);
+		iBytes = iSize - 2 - iLen;
+		if(iBytes <= 0) return;
+	}
+	memmove(pcBuf + iPos + iBytes, pcBuf + iPos, iLen - iPos);
+	memcpy(pcBuf + iPos, pc, iBytes);
+	iLen += iBytes;
+	iPos += iBytes;
+	Edit_update(iFrom, FALSE);
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Edit_delete(int iFrom, int iTo, int iKill)
+
+/* Delete bytes iFrom to iTo-1 and put the cursor on iFrom.  Keep them
+   for Ctrl-Y if iKill. */
+
+{
+	char *pcNew;
+
+	if(iFrom >= iTo) return;
+	if(iKill)
+	{
+		pcNew = strndup(pcBuf + iFrom, iTo - iFrom);
+		if(pcNew != NULL)
+		{
+			free(pcKill);
+			pcKill = pcNew;
+		}
+	}
+	memmove(pcBuf + iFrom, pcBuf + iTo, iLen - iTo);
+	iLen -= iTo - iFrom;
+	iPos = iFrom;
+	Edit_update(iFrom, TRUE);
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Edit_wordStart(int i)
+
+/* Return the start of the word before byte i. */
+
+{
+	while(i > 0 && pcBuf[i-1] == ' ') i--;
+	while(i > 0 && pcBuf[i-1] != ' ') i--;
+	return i;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Edit_wordEnd(int i)
+
+/* Return the end of the word after byte i. */
+
+{
+	while(i < iLen && pcBuf[i] == ' ') i++;
+	while(i < iLen && pcBuf[i] != ' ') i++;
+	return i;
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Edit_show(const char *pcLine)
+
+/* Replace the line by pcLine, with the cursor at its end. */
+
+{
+	iLen = strlen(pcLine);
+	if(iLen > iSize - 2) iLen = iSize - 2;
+	memcpy(pcBuf, pcLine, iLen);
+	iPos = iLen;
+	iOffset = 0;
+	Edit_scroll();
+	Edit_refresh();
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Edit_walkHistory(int iStep)
+
+/* Show the history entry iStep after the one shown, -1 being older.
+   The line being typed is kept as the entry after the newest. */
+
+{
+	int iTo = iHistoryPos + iStep;
+	char *pcNew;
+
+	if(iTo < 0 || iTo > iHistory) return;
+	if(iHistoryPos == iHistory)
+	{
+		pcNew = strndup(pcBuf, iLen);
+		if(pcNew == NULL) return;
+		free(pcTyped);
+		pcTyped = pcNew;
+	}
+	iHistoryPos = iTo;
+	Edit_show(iTo == iHistory ? pcTyped : apcHistory[iTo]);
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Edit_addHistory(void)
+
+/* Add the line to the history unless it is empty or repeats the last
+   entry.  The oldest entry goes once the history is full. */
+
+{
+	char *pcLine;
+
+	if(iLen == 0) return;
+	if(iHistory > 0 && strlen(apcHistory[iHistory-1]) == (size_t)iLen
+		&& memcmp(apcHistory[iHistory-1], pcBuf, iLen) == 0)
+		return;
+	pcLine = strndup(pcBuf, iLen);
+	if(pcLine == NULL) return;
+	if(iHistory == MAX_HISTORY)
+	{
+		free(apcHistory[0]);
+		memmove(apcHistory, apcHistory + 1, (MAX_HISTORY - 1) * sizeof(char *));
+		iHistory--;
+	}
+	apcHistory[iHistory++] = pcLine;
+}
+
+/*--------------------------------------------------------------------*/
+
+static enum Result Edit_key(char c, enum EscState *peEsc, int *piParam)
+
+/* Handle byte c of input, which may continue the escape sequence in
+   *peEsc with parameter *piParam. */
+
+{
+	switch(*peEsc)
+	{
+		case ESC_START:
+			*peEsc = ESC_NONE;
+			if(c == '[') { *peEsc = ESC_CSI; *piParam = 0; }
+			else if(c == 'O') *peEsc = ESC_SS3;
+			else if(c == 'b') Edit_moveTo(Edit_wordStart(iPos));
+			else if(c == 'f') Edit_moveTo(Edit_wordEnd(iPos));
+			else if(c == 'd') Edit_delete(iPos, Edit_wordEnd(iPos), TRUE);
+			return RESULT_EDITING;
+
+		case ESC_CSI:
+			if(c >= '0' && c <= '9') { *piParam = *piParam * 10 + c - '0'; return RESULT_EDITING; }
+			/* Modifiers such as "1;5C" are ignored */
+			if(c == ';') { *piParam = 0; return RESULT_EDITING; }
+			*peEsc = ESC_NONE;
+			if(c == '~')
+			{
+				if(*piParam == 1 || *piParam == 7) Edit_moveTo(0);
+				else if(*piParam == 4 || *piParam == 8) Edit_moveTo(iLen);
+				else if(*piParam == 3) Edit_delete(iPos, Edit_next(iPos), FALSE);
+				return RESULT_EDITING;
+			}
+			break;
+
+		case ESC_SS3:
+			*peEsc = ESC_NONE;
+			break;
+
+		case ESC_NONE:
+			switch(c)
+			{
+				case KEY_ESC: *peEsc = ESC_START; return RESULT_EDITING;
+				case '\r': case '\n': return RESULT_ACCEPT;
+				case KEY_CTRL('C'): return RESULT_CANCEL;
+				case KEY_CTRL('D'):
+					if(iLen == 0) return RESULT_EOF;
+					Edit_delete(iPos, Edit_next(iPos), FALSE);
+					return RESULT_EDITING;
+				case KEY_BACKSPACE: case KEY_CTRL('H'):
+					Edit_delete(Edit_previous(iPos), iPos, FALSE);
+					return RESULT_EDITING;
+				case KEY_CTRL('A'): Edit_moveTo(0); return RESULT_EDITING;
+				case KEY_CTRL('E'): Edit_moveTo(iLen); return RESULT_EDITING;
+				case KEY_CTRL('B'): Edit_moveTo(Edit_previous(iPos)); return RESULT_EDITING;
+				case KEY_CTRL('F'): Edit_moveTo(Edit_next(iPos)); return RESULT_EDITING;
+				case KEY_CTRL('K'): Edit_delete(iPos, iLen, TRUE); return RESULT_EDITING;
+				case KEY_CTRL('U'): Edit_delete(0, iPos, TRUE); return RESULT_EDITING;
+				case KEY_CTRL('W'): Edit_delete(Edit_wordStart(iPos), iPos, TRUE); return RESULT_EDITING;
+				case KEY_CTRL('Y'):
+					if(pcKill != NULL) Edit_insert(pcKill, strlen(pcKill));
+					return RESULT_EDITING;
+				case KEY_CTRL('P'): Edit_walkHistory(-1); return RESULT_EDITING;
+				case KEY_CTRL('N'): Edit_walkHistory(1); return RESULT_EDITING;
+				case KEY_CTRL('L'):
+					Edit_append("\x1b[H\x1b[2J", 7);
+					Edit_refresh();
+					return RESULT_EDITING;
+				default:
+					return RESULT_EDITING;
+			}
+	}
+
+	/* The last byte of a CSI or SS3 sequence */
+	switch(c)
+	{
+		case 'A': Edit_walkHistory(-1); break;
+		case 'B': Edit_walkHistory(1); break;
+		case 'C': Edit_moveTo(Edit_next(iPos)); break;
+		case 'D': Edit_moveTo(Edit_previous(iPos)); break;
+		case 'H': Edit_moveTo(0); break;
+		case 'F': Edit_moveTo(iLen); break;
+	}
+	return RESULT_EDITING;
+}
+
+/*--------------------------------------------------------------------*/
+
+static enum Result Edit_loop(void)
+
+/* Edit the line until it is accepted, dropped or the input ends. */
+
+{
+	enum EscState eEsc = ESC_NONE;
+	enum Result eResult = RESULT_EDITING;
+	int iParam = 0, n, iRun;
+
+	while(eResult == RESULT_EDITING)
+	{
+		if(iInputPos == iInputLen)
+		{
+			n = read(0, acInput, READ_SIZE);
+			if(n < 0 && errno == EINTR) continue;
+			if(n <= 0) return (iLen > 0) ? RESULT_ACCEPT : RESULT_EOF;
+			iInputPos = 0;
+			iInputLen = n;
+		}
+
+		while(iInputPos < iInputLen && eResult == RESULT_EDITING)
+		{
+			/* Insert a run of printable bytes, such as pasted text, at
+			   once */
+			for(iRun=0;eEsc==ESC_NONE&&iInputPos+iRun<iInputLen;iRun++)
+			{
+				unsigned char c = acInput[iInputPos+iRun];
+				if(c < ' ' || c == KEY_BACKSPACE) break;
+			}
+			if(iRun > 0) Edit_insert(acInput + iInputPos, iRun);
+			else
+			{
+				eResult = Edit_key(acInput[iInputPos], &eEsc, &iParam);
+				iRun = 1;
+			}
+			iInputPos += iRun;
+		}
+		Edit_flush();
+	}
+	return eResult;
+}
+
+/*--------------------------------------------------------------------*/
+
+char *Edit_readLine(const char *pcPromptText, char *acLine, int iLineSize)
+
+/* Let the user edit a line into acLine. */
+
+{
+	struct termios sOld, sRaw;
+	struct winsize sSize;
+	enum Result eResult;
+
+	assert(pcPromptText != NULL);
+	assert(acLine != NULL);
+	assert(iLineSize > 2);
+
+	if(tcgetattr(0, &sOld) < 0)
+		return fgets(acLine, iLineSize, stdin);
+	sRaw = sOld;
+	sRaw.c_iflag &= ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
+	sRaw.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
+	sRaw.c_cflag |= CS8;
+	sRaw.c_cc[VMIN] = 1;
+	sRaw.c_cc[VTIME] = 0;
+	if(tcsetattr(0, TCSANOW, &sRaw) < 0)
+		return fgets(acLine, iLineSize, stdin);
+
+	iCols = (ioctl(1, TIOCGWINSZ, &sSize) == 0 && sSize.ws_col > 0) ? sSize.ws_col : DEFAULT_COLUMNS;
+	pcBuf = acLine;
+	iSize = iLineSize;
+	iLen = iPos = iOffset = iScreen = 0;
+	pcPrompt = pcPromptText;
+	iPromptCols = strlen(pcPromptText);
+	iHistoryPos = iHistory;
+
+	Edit_append(pcPrompt, iPromptCols);
+	Edit_flush();
+	eResult = Edit_loop();
+
+	/* Leave the cursor after the line, which may be scrolled */
+	Edit_moveCursor(Edit_visibleEnd());
+	if(eResult == RESULT_CANCEL) Edit_append("^C", 2);
+	Edit_append("\r\n", 2);
+	Edit_flush();
+	tcsetattr(0, TCSANOW, &sOld);
+
+	if(eResult == RESULT_EOF) return NULL;
+	if(eResult == RESULT_CANCEL) iLen = 0;
+	else Edit_addHistory();
+	acLine[iLen] = '\n';
+	acLine[iLen + 1] = '\0';
+	return acLine;
+}
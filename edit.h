@@ -0,0 +1,26 @@
+#ifndef EDIT_INCLUDED
+#define EDIT_INCLUDED
+
+/* A line editor for the interactive prompt.  The terminal is in raw
+   mode only while a line is edited.  A line longer than the screen
+   scrolls horizontally.  Each key redraws only what changed, and all
+   the output caused by one read of input goes out in a single write, so
+   editing stays responsive over slow links and on very long lines.
+
+   Keys: Left, Right, Home, End, Ctrl-B, Ctrl-F, Ctrl-A, Ctrl-E, Alt-B
+   and Alt-F move; Backspace, Delete and Ctrl-D delete; Ctrl-K, Ctrl-U,
+   Ctrl-W and Alt-D kill and Ctrl-Y yanks; Up, Down, Ctrl-P and Ctrl-N
+   walk the history; Ctrl-L clears the screen; Ctrl-C drops the line;
+   Ctrl-D on an empty line is the end of the input. */
+
+/* Return 1 (TRUE) if stdin and stdout are a terminal the editor can
+   drive. */
+int Edit_isTerminal(void);
+
+/* Write pcPrompt and let the user edit a line of at most iSize-2
+   characters into acLine.  Return acLine, ending with '\n' as with
+   fgets, or NULL at the end of the input.  A non-empty line is added to
+   the history. */
+char *Edit_readLine(const char *pcPrompt, char *acLine, int iSize);
+
+#endif
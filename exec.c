@@ -0,0 +1,493 @@
+#define _GNU_SOURCE
+#include "plan.h"
+#include "exec.h"
+#include "zygote.h"
+#include "cgroup.h"
+#include "schedule.h"
+#include "trace.h"
+#include "stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/syscall.h>
+
+/*--------------------------------------------------------------------*/
+
+#ifndef CLOSE_RANGE_CLOEXEC
+#define CLOSE_RANGE_CLOEXEC (1U << 2)
+#endif
+
+/*--------------------------------------------------------------------*/
+
+static int Exec_openRedirections(const char *pcInput, const char *pcOutput,
+	int iStage)
+
+/* Open pcInput as stdin and pcOutput, truncated, as stdout, unless they
+   are NULL.  iStage is the stage the opens are traced for.  Return 1
+   if successful, or 0 after printing why not. */
+
+{
+	int file_descriptor;
+	long long llOpen;
+
+	if(pcInput != NULL)
+	{
+		llOpen = TRACE_BEGIN();
+		file_descriptor = open(pcInput, O_RDONLY);
+		TRACE_END("open", llOpen, getpid(), iStage);
+		if(file_descriptor < 0){
+			perror("open read");
+			return 0;
+		}
+		if(file_descriptor != 0){
+			dup2(file_descriptor, 0);
+			close(file_descriptor);
+		}
+	}
+
+	if(pcOutput != NULL)
+	{
+		llOpen = TRACE_BEGIN();
+		file_descriptor = open(pcOutput, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+		TRACE_END("open", llOpen, getpid(), iStage);
+		if(file_descriptor < 0){
+			perror("open write");
+			return 0;
+		}
+		if(file_descriptor != 1){
+			dup2(file_descriptor, 1);
+			close(file_descriptor);
+		}
+	}
+	return 1;
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Exec_child(struct Pipeline *psPipeline, int i,
+	const int aiStdFds[3], int iReadFd, int iWriteFd, int iNextReadFd)
+
+/* Set up the descriptors of stage i in the freshly forked child and
+   execute it.  iReadFd is the read end of the pipe from the previous
+   stage and iWriteFd the write end of the pipe to the next one, or -1;
+   iNextReadFd is the other end of the latter, which the next stage
+   reads.  Every other descriptor of the shell is dropped at exec, so
+   the child makes a constant number of system calls however long the
+   pipeline is.  Never returns.  The child leaves with _exit: exit()
+   would move the offset of a script the shell reads, which the child
+   shares, back to what the shell has not read from its buffer yet. */
+
+{
+	int totalComm = psPipeline->iStages;
+	int j;
+	long long llStart = TRACE_BEGIN();
+	sigset_t sSet;
+	char **argv;
+
+	/* A function stage does not exec, and must not keep its own
+	   output pipe readable */
+	if(iNextReadFd != -1) close(iNextReadFd);
+
+	/* The caller may block signals around the fork; the command
+	   should start with a clean mask */
+	sigemptyset(&sSet);
+	sigprocmask(SIG_SETMASK, &sSet, NULL);
+
+	for(j=0;j<3;j++)
+	{
+		if(aiStdFds[j] != j && dup2(aiStdFds[j], j) < 0){
+			perror("dup2");
+			_exit(EXIT_FAILURE);
+		}
+	}
+
+	/* Redirect stdin of the first process and stdout of the last, if any */
+	if(!Exec_openRedirections((i == 0) ? psPipeline->pcInput : NULL,
+		(i == totalComm-1) ? psPipeline->pcOutput : NULL, i))
+		_exit(EXIT_FAILURE);
+
+	/* Make child read from pipe if it's not the first command */
+	if(iReadFd != -1)
+	{
+		if(dup2(iReadFd,0) < 0){
+			perror("dup2");
+			_exit(EXIT_FAILURE);
+		}
+		close(iReadFd);
+	}
+
+	/* Make child write to pipe if it's not the last command */
+	if(iWriteFd != -1)
+	{
+		if(dup2(iWriteFd,1) < 0){
+			perror("dup2");
+			_exit(EXIT_FAILURE);
+		}
+		close(iWriteFd);
+	}
+
+	/* The pipes are close-on-exec already; the same for whatever else
+	   the shell has open, in one call. Kernels before 5.11 lack it. */
+	syscall(SYS_close_range, 3, ~0U, CLOSE_RANGE_CLOEXEC);
+	for(j=0;j<psPipeline->iInherit;j++)
+		fcntl(psPipeline->piInherit[j], F_SETFD, 0);
+
+	argv = psPipeline->psStages[i].ppcArgv;
+	if(psPipeline->psStages[i].psSchedule != NULL
+		&& !Schedule_apply(psPipeline->psStages[i].psSchedule))
+	{
+		fprintf(stderr, "sched: %s: %s\n", argv[0], strerror(errno));
+		_exit(EXIT_FAILURE);
+	}
+	TRACE_END("setup", llStart, getpid(), i);
+	if(psPipeline->psStages[i].pfRun != NULL)
+	{
+		j = (*psPipeline->psStages[i].pfRun)(psPipeline->psStages[i].pvRun,
+			argv, psPipeline->psStages[i].iArgc);
+		fflush(stdout);
+		_exit(j);
+	}
+	TRACE_NAME(argv[0]);
+	TRACE_INSTANT("execvp", getpid(), i);
+	/* The cached path may be stale; execvp then searches $PATH again */
+	if(psPipeline->psStages[i].pcPath != NULL)
+		execv(psPipeline->psStages[i].pcPath, argv);
+	execvp(argv[0],argv);
+	fprintf(stderr, "%s: %s\n", argv[0], strerror(errno));
+	_exit(EXIT_FAILURE);
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Exec_forkStdio(char **argv, const int aiFds[3])
+
+/* Fork a child that executes argv with aiFds as its stdin, stdout and
+   stderr.  Return the pid of the child, or -1 if fork failed. */
+
+{
+	sigset_t sSet;
+	int pid, j;
+
+	pid = fork();
+	if(pid != 0) return pid;
+
+	sigemptyset(&sSet);
+	sigprocmask(SIG_SETMASK, &sSet, NULL);
+	for(j=0;j<3;j++)
+	{
+		if(dup2(aiFds[j], j) < 0){
+			perror("dup2");
+			_exit(EXIT_FAILURE);
+		}
+	}
+	execvp(argv[0],argv);
+	fprintf(stderr, "%s: %s\n", argv[0], strerror(errno));
+	_exit(EXIT_FAILURE);
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Exec_spawnZygote(struct Pipeline *psPipeline,
+	const int aiStdFds[3], int *piPids)
+
+/* Spawn the stages of psPipeline through the zygote.  The shell opens
+   the redirections and pipes itself and hands each stage its three
+   descriptors.  Return the number of children started. */
+
+{
+	extern char **environ;
+	int totalComm = psPipeline->iStages;
+	int aiFds[3], p[2];
+	int iPrevRead = -1, i;
+	long long llStart;
+
+	aiFds[2] = aiStdFds[2];
+	for(i=0;i<totalComm;i++)
+	{
+		/* stdin: the redirection, the previous pipe or the pipeline's stdin */
+		if(i == 0 && psPipeline->pcInput != NULL)
+		{
+			llStart = TRACE_BEGIN();
+			iPrevRead = open(psPipeline->pcInput, O_RDONLY | O_CLOEXEC);
+			TRACE_END("open", llStart, -1, i);
+			if(iPrevRead < 0){
+				perror("open read");
+				return 0;
+			}
+		}
+		aiFds[0] = (iPrevRead != -1) ? iPrevRead : aiStdFds[0];
+
+		/* stdout: the next pipe, the redirection or the pipeline's stdout */
+		p[0] = p[1] = -1;
+		if(i != totalComm-1)
+		{
+			llStart = TRACE_BEGIN();
+			if(pipe2(p, O_CLOEXEC) == -1){
+				perror("pipe");
+				break;
+			}
+			TRACE_END("pipe", llStart, -1, i);
+			aiFds[1] = p[1];
+		}
+		else if(psPipeline->pcOutput != NULL)
+		{
+			llStart = TRACE_BEGIN();
+			p[1] = open(psPipeline->pcOutput, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+			TRACE_END("open", llStart, -1, i);
+			if(p[1] < 0){
+				perror("open write");
+				break;
+			}
+			aiFds[1] = p[1];
+		}
+		else aiFds[1] = aiStdFds[1];
+
+		llStart = TRACE_BEGIN();
+		piPids[i] = Zygote_spawn(psPipeline->psStages[i].ppcArgv, environ, aiFds);
+		if(piPids[i] < 0)
+		{
+			if(!Zygote_isRunning()) piPids[i] = Exec_forkStdio(psPipeline->psStages[i].ppcArgv, aiFds);
+			TRACE_END("fork", llStart, piPids[i], i);
+			if(piPids[i] >= 0) Stats_count(STATS_FORKS, 1);
+			if(piPids[i] < 0)
+			{
+				perror("fork");
+				if(p[0] != -1) close(p[0]);
+				if(p[1] != -1) close(p[1]);
+				break;
+			}
+		}
+		else TRACE_END("zygote spawn", llStart, piPids[i], i);
+
+		/* The child holds its own copies; keep only the read end for the next stage */
+		if(iPrevRead != -1) close(iPrevRead);
+		if(p[1] != -1) close(p[1]);
+		iPrevRead = p[0];
+		Stats_count(STATS_EXECS, 1);
+	}
+	if(iPrevRead != -1) close(iPrevRead);
+
+	return i;
+}
+
+/*--------------------------------------------------------------------*/
+
+int Exec_spawnPipeline(struct Pipeline *psPipeline, const int aiStdFds[3],
+	int *piPids)
+
+/* Fork one child per stage of psPipeline and store their pids in
+   piPids.  Return the number of children forked. */
+
+{
+	int totalComm, pid, i;
+	int p[2], iPrevRead = -1;
+	long long llStart;
+
+	assert(psPipeline != NULL);
+	assert(piPids != NULL);
+
+	totalComm = psPipeline->iStages;
+
+	/* The zygote cannot place children in a cgroup, apply a schedule,
+	   run a stage in the shell or pass descriptors beyond stdio */
+	for(i=0;i<totalComm;i++)
+		if(psPipeline->psStages[i].psSchedule != NULL
+			|| psPipeline->psStages[i].pfRun != NULL) break;
+	if(Zygote_isRunning() && psPipeline->iCgroupFd == -1 && psPipeline->iInherit == 0
+		&& i == totalComm)
+		return Exec_spawnZygote(psPipeline, aiStdFds, piPids);
+
+	/* Iterate through each command in a line
+		Create a process for each command from parent process. So, they all are at the same level.
+		Each pipe is created just before the stage that writes to it, and the parent closes its ends as soon
+		as both stages are forked, so that at most one pipe and one read end are open at any time. */
+	for(i=0;i<totalComm;i++)
+	{
+		p[0] = p[1] = -1;
+		if(i != totalComm-1)
+		{
+			llStart = TRACE_BEGIN();
+			if(pipe2(p, O_CLOEXEC) == -1)
+			{
+				perror("pipe");
+				break;
+			}
+			TRACE_END("pipe", llStart, -1, i);
+		}
+
+		llStart = TRACE_BEGIN();
+		if(psPipeline->iCgroupFd == -1) pid = fork();
+		else pid = Cgroup_fork(psPipeline->iCgroupFd);
+		if(pid == 0) Exec_child(psPipeline, i, aiStdFds, iPrevRead, p[1], p[0]);
+		TRACE_END("fork", llStart, pid, i);
+		if(pid < 0)
+		{
+			perror("fork");
+			if(p[0] != -1) close(p[0]);
+			if(p[1] != -1) close(p[1]);
+			break;
+		}
+		piPids[i] = pid;
+		Stats_count(STATS_FORKS, 1);
+		Stats_count(STATS_EXECS, 1);
+
+		/* The child holds its own copies; keep only the read end for the next stage */
+		if(iPrevRead != -1) close(iPrevRead);
+		if(p[1] != -1) close(p[1]);
+		iPrevRead = p[0];
+	}
+	if(iPrevRead != -1) close(iPrevRead);
+
+	return i;
+}
+
+/*--------------------------------------------------------------------*/
+
+int Exec_redirect(const char *pcInput, const char *pcOutput)
+
+/* Apply the redirections of a shell without a command. */
+
+{
+	fflush(stdout);
+	return Exec_openRedirections(pcInput, pcOutput, -1);
+}
+
+/*--------------------------------------------------------------------*/
+
+int Exec_replace(struct Pipeline *psPipeline)
+
+/* Execute the only stage of psPipeline in place of the shell.  stdin
+   and stdout are saved first, so that the shell gets them back if the
+   command cannot be executed. */
+
+{
+	struct Stage *psStage = &psPipeline->psStages[0];
+	char **argv = psStage->ppcArgv;
+	int aiSaved[2], iStatus = 1, j;
+	sigset_t sSet, sOldSet;
+
+	assert(psPipeline->iStages == 1 && psStage->pfRun == NULL);
+
+	fflush(stdout);
+	for(j=0;j<2;j++) aiSaved[j] = fcntl(j, F_DUPFD_CLOEXEC, 3);
+
+	if(Exec_openRedirections(psPipeline->pcInput, psPipeline->pcOutput, 0))
+	{
+		if(psStage->psSchedule != NULL && !Schedule_apply(psStage->psSchedule))
+			fprintf(stderr, "sched: %s: %s\n", argv[0], strerror(errno));
+		else
+		{
+			/* As in a forked child: a clean mask and nothing of the
+			   shell left open but what the command inherits */
+			sigemptyset(&sSet);
+			sigprocmask(SIG_SETMASK, &sSet, &sOldSet);
+			syscall(SYS_close_range, 3, ~0U, CLOSE_RANGE_CLOEXEC);
+			for(j=0;j<psPipeline->iInherit;j++)
+				fcntl(psPipeline->piInherit[j], F_SETFD, 0);
+			TRACE_NAME(argv[0]);
+			TRACE_INSTANT("execvp", getpid(), 0);
+			if(psStage->pcPath != NULL)
+				execv(psStage->pcPath, argv);
+			execvp(argv[0], argv);
+
+			iStatus = (errno == ENOENT) ? 127 : 126;
+			fprintf(stderr, "%s: %s\n", argv[0], strerror(errno));
+			for(j=0;j<psPipeline->iInherit;j++)
+				fcntl(psPipeline->piInherit[j], F_SETFD, FD_CLOEXEC);
+			sigprocmask(SIG_SETMASK, &sOldSet, NULL);
+		}
+	}
+
+	for(j=0;j<2;j++)
+	{
+		if(aiSaved[j] == -1) continue;
+		dup2(aiSaved[j], j);
+		close(aiSaved[j]);
+	}
+	return iStatus;
+}
+
+/*--------------------------------------------------------------------*/
+
+void Exec_feedPipes(struct Feed *psFeeds, int iFeeds)
+{
+	struct pollfd *psPoll;
+	struct sigaction sIgnore, sOldPipe;
+	int *piFeed;
+	int iPolled, i;
+	ssize_t iWritten;
+
+	assert(psFeeds != NULL || iFeeds == 0);
+
+	if(iFeeds == 0) return;
+	psPoll = (struct pollfd *)malloc(iFeeds * sizeof(struct pollfd));
+	piFeed = (int *)malloc(iFeeds * sizeof(int));
+	if(psPoll == NULL || piFeed == NULL)
+	{
+		fprintf(stderr, "Cannot allocate memory\n");
+		exit(EXIT_FAILURE);
+	}
+
+	/* A reader that leaves early makes write fail with EPIPE rather
+	   than stop the shell */
+	memset(&sIgnore, 0, sizeof(sIgnore));
+	sIgnore.sa_handler = SIG_IGN;
+	sigemptyset(&sIgnore.sa_mask);
+	sigaction(SIGPIPE, &sIgnore, &sOldPipe);
+
+	for(i=0;i<iFeeds;i++)
+		fcntl(psFeeds[i].iFd, F_SETFL, fcntl(psFeeds[i].iFd, F_GETFL) | O_NONBLOCK);
+
+	for(;;)
+	{
+		iPolled = 0;
+		for(i=0;i<iFeeds;i++)
+		{
+			if(psFeeds[i].iWritten == psFeeds[i].iSize) continue;
+			psPoll[iPolled].fd = psFeeds[i].iFd;
+			psPoll[iPolled].events = POLLOUT;
+			piFeed[iPolled++] = i;
+		}
+		if(iPolled == 0) break;
+		if(poll(psPoll, iPolled, -1) < 0)
+		{
+			if(errno == EINTR) continue;
+			perror("poll");
+			break;
+		}
+		/* POLLERR means the reader is gone, which write reports */
+		for(i=0;i<iPolled;i++)
+		{
+			struct Feed *psFeed = &psFeeds[piFeed[i]];
+			if(psPoll[i].revents == 0) continue;
+			iWritten = write(psFeed->iFd, psFeed->pcData + psFeed->iWritten,
+				psFeed->iSize - psFeed->iWritten);
+			if(iWritten > 0) psFeed->iWritten += iWritten;
+			else if(errno != EAGAIN && errno != EINTR) psFeed->iWritten = psFeed->iSize;
+		}
+	}
+
+	for(i=0;i<iFeeds;i++) close(psFeeds[i].iFd);
+	sigaction(SIGPIPE, &sOldPipe, NULL);
+	free(psPoll);
+	free(piFeed);
+}
+
+/*--------------------------------------------------------------------*/
+
+int Exec_exitStatus(int iWaitStatus)
+
+/* Convert a status returned by wait into a shell exit status. */
+
+{
+	if(WIFEXITED(iWaitStatus)) return WEXITSTATUS(iWaitStatus);
+	if(WIFSIGNALED(iWaitStatus)) return 128 + WTERMSIG(iWaitStatus);
+	return 1;
+}
@@ -0,0 +1,54 @@
+#ifndef EXEC_INCLUDED
+#define EXEC_INCLUDED
+
+#include "plan.h"
+#include <stddef.h>
+
+/* Fork one child per stage of psPipeline, connect the stages with
+   pipes and apply the file redirections.  A stage with a pfRun runs it
+   in its child and exits with its result.  aiStdFds holds the
+   descriptors that serve as stdin, stdout and stderr of the pipeline.
+   Store the pid of each stage in piPids, which must have room for
+   psPipeline->iStages entries.  Return the number of children forked;
+   a value smaller than iStages means fork failed part way. */
+int Exec_spawnPipeline(struct Pipeline *psPipeline, const int aiStdFds[3],
+	int *piPids);
+
+/* Execute the only stage of psPipeline, which has no pfRun, in place
+   of the calling process, with its redirections and scheduling
+   applied as in a forked child.  Return only if it cannot be
+   executed, with the redirections undone and an exit status: 127 if
+   the command was not found, 126 if it could not be run, or 1 if a
+   redirection or the scheduling failed. */
+int Exec_replace(struct Pipeline *psPipeline);
+
+/* Make pcInput the stdin and pcOutput, truncated, the stdout of the
+   calling process for good, unless they are NULL.  Return 1 (TRUE) if
+   successful, or 0 (FALSE) after printing why not. */
+int Exec_redirect(const char *pcInput, const char *pcOutput);
+
+/* A Feed is data the shell itself writes into a pipe that a spawned
+   stage reads, such as the output of a built-in command. */
+struct Feed
+{
+	/* The write end of the pipe, which Exec_feedPipes closes */
+	int iFd;
+
+	/* The iSize bytes to write, owned by the caller, of which the first
+	   iWritten are written */
+	const char *pcData;
+	size_t iSize, iWritten;
+};
+
+/* Write the data of the iFeeds Feeds of psFeeds into their pipes while
+   the stages that read them run, with non-blocking writes that poll()
+   drives, so that the shell never waits on one pipe while the reader
+   of another waits on the shell.  The rest of a Feed whose reader is
+   gone is dropped, as SIGPIPE would stop a child writing it.  Close
+   the descriptors. */
+void Exec_feedPipes(struct Feed *psFeeds, int iFeeds);
+
+/* Convert a status returned by wait into a shell exit status. */
+int Exec_exitStatus(int iWaitStatus);
+
+#endif
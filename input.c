@@ -0,0 +1,238 @@
+#include "input.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*--------------------------------------------------------------------*/
+
+enum {FALSE, TRUE};
+
+/* Size of each read() of a descriptor that is not mapped, and the
+   initial size of its buffer */
+enum {READ_SIZE = 65536};
+
+struct Input
+{
+	/* Descriptor the input is read from, or -1 once a file is mapped,
+	   and 1 if Input_free closes it */
+	int iFd;
+	int iOwnsFd;
+
+	/* The mapping of a regular file, or NULL */
+	char *pcMap;
+	size_t iMapSize;
+
+	/* Otherwise the blocks read, iBufferSize bytes of room */
+	char *pcBuffer;
+	size_t iBufferSize;
+
+	/* pcData is pcMap or pcBuffer.  Bytes iPos to iLen are not yet
+	   returned, and bytes iPos to iSearched hold no '\n'. */
+	char *pcData;
+	size_t iPos, iLen, iSearched;
+
+	/* 1 once read() found the end of the input */
+	int iEof;
+};
+
+/*--------------------------------------------------------------------*/
+
+static Input_T Input_new(int iFd, int iOwnsFd)
+
+/* Return a new Input_T on iFd, mapped if it is a regular file that is
+   not empty, or NULL if insufficient memory is available.  A mapped
+   file is read from the current offset of iFd. */
+
+{
+	Input_T oInput;
+	struct stat sStat;
+	off_t iOffset;
+	void *pvMap;
+
+	oInput = (Input_T)calloc(1, sizeof(struct Input));
+	if(oInput == NULL) return NULL;
+	oInput->iFd = iFd;
+	oInput->iOwnsFd = iOwnsFd;
+
+	iOffset = lseek(iFd, 0, SEEK_CUR);
+	if(fstat(iFd, &sStat) == 0 && S_ISREG(sStat.st_mode) && iOffset >= 0
+		&& sStat.st_size > iOffset)
+	{
+		pvMap = mmap(NULL, sStat.st_size, PROT_READ, MAP_PRIVATE, iFd, 0);
+		if(pvMap != MAP_FAILED)
+		{
+			madvise(pvMap, sStat.st_size, MADV_SEQUENTIAL);
+			oInput->pcMap = oInput->pcData = (char *)pvMap;
+			oInput->iMapSize = oInput->iLen = sStat.st_size;
+			oInput->iPos = oInput->iSearched = iOffset;
+			/* Nothing else reads a descriptor of our own */
+			if(iOwnsFd)
+			{
+				close(iFd);
+				oInput->iFd = -1;
+			}
+			return oInput;
+		}
+	}
+
+	/* A pipe, a terminal, an empty file or one that cannot be mapped */
+	oInput->pcBuffer = oInput->pcData = (char *)malloc(READ_SIZE);
+	if(oInput->pcBuffer == NULL)
+	{
+		free(oInput);
+		return NULL;
+	}
+	oInput->iBufferSize = READ_SIZE;
+	return oInput;
+}
+
+/*--------------------------------------------------------------------*/
+
+Input_T Input_open(const char *pcPath)
+{
+	Input_T oInput;
+	int iFd, iErrno;
+
+	assert(pcPath != NULL);
+
+	iFd = open(pcPath, O_RDONLY | O_CLOEXEC);
+	if(iFd == -1) return NULL;
+	oInput = Input_new(iFd, TRUE);
+	if(oInput == NULL)
+	{
+		iErrno = errno;
+		close(iFd);
+		errno = iErrno;
+	}
+	return oInput;
+}
+
+/*--------------------------------------------------------------------*/
+
+Input_T Input_fromFd(int iFd)
+{
+	assert(iFd >= 0);
+
+	return Input_new(iFd, FALSE);
+}
+
+/*--------------------------------------------------------------------*/
+
+void Input_free(Input_T oInput)
+{
+	if(oInput == NULL) return;
+	if(oInput->pcMap != NULL) munmap(oInput->pcMap, oInput->iMapSize);
+	free(oInput->pcBuffer);
+	if(oInput->iOwnsFd && oInput->iFd != -1) close(oInput->iFd);
+	free(oInput);
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Input_fill(Input_T oInput)
+
+/* Read the next block of oInput after the bytes not yet returned, which
+   are first moved to the start of the buffer, growing it if they fill
+   it.  Return 1 (TRUE) if anything was read, or 0 (FALSE) at the end of
+   the input or on an error. */
+
+{
+	char *pcBuffer;
+	ssize_t iRead;
+
+	if(oInput->iPos > 0)
+	{
+		memmove(oInput->pcBuffer, oInput->pcBuffer + oInput->iPos, oInput->iLen - oInput->iPos);
+		oInput->iLen -= oInput->iPos;
+		oInput->iSearched -= oInput->iPos;
+		oInput->iPos = 0;
+	}
+	if(oInput->iLen == oInput->iBufferSize)
+	{
+		pcBuffer = (char *)realloc(oInput->pcBuffer, 2 * oInput->iBufferSize);
+		if(pcBuffer == NULL) return FALSE;
+		oInput->pcBuffer = oInput->pcData = pcBuffer;
+		oInput->iBufferSize *= 2;
+	}
+	do
+		iRead = read(oInput->iFd, oInput->pcBuffer + oInput->iLen, oInput->iBufferSize - oInput->iLen);
+	while(iRead == -1 && errno == EINTR);
+	if(iRead <= 0) return FALSE;
+	oInput->iLen += iRead;
+	return TRUE;
+}
+
+/*--------------------------------------------------------------------*/
+
+const char *Input_readLine(Input_T oInput, size_t *piLength)
+{
+	char *pcStart, *pcNewline;
+
+	assert(oInput != NULL);
+	assert(piLength != NULL);
+
+	for(;;)
+	{
+		pcNewline = (char *)memchr(oInput->pcData + oInput->iSearched, '\n',
+			oInput->iLen - oInput->iSearched);
+		if(pcNewline != NULL) break;
+		oInput->iSearched = oInput->iLen;
+		if(oInput->pcMap != NULL || oInput->iEof || !Input_fill(oInput))
+		{
+			/* The last line, which has no '\n' */
+			oInput->iEof = TRUE;
+			if(oInput->iPos == oInput->iLen) return NULL;
+			pcNewline = oInput->pcData + oInput->iLen - 1;
+			break;
+		}
+	}
+	pcStart = oInput->pcData + oInput->iPos;
+	*piLength = pcNewline + 1 - pcStart;
+	oInput->iPos = oInput->iSearched = pcNewline + 1 - oInput->pcData;
+	return pcStart;
+}
+
+/*--------------------------------------------------------------------*/
+
+void Input_sync(Input_T oInput)
+{
+	assert(oInput != NULL);
+
+	if(oInput->pcMap != NULL && oInput->iFd != -1)
+		lseek(oInput->iFd, oInput->iPos, SEEK_SET);
+}
+
+/*--------------------------------------------------------------------*/
+
+void Input_resume(Input_T oInput)
+{
+	off_t iOffset;
+
+	assert(oInput != NULL);
+
+	if(oInput->pcMap == NULL || oInput->iFd == -1) return;
+	iOffset = lseek(oInput->iFd, 0, SEEK_CUR);
+	if(iOffset < 0 || (size_t)iOffset <= oInput->iPos) return;
+	oInput->iPos = oInput->iSearched = ((size_t)iOffset < oInput->iLen) ? (size_t)iOffset : oInput->iLen;
+}
+
+/*--------------------------------------------------------------------*/
+
+int Input_atEnd(Input_T oInput)
+{
+	size_t i;
+
+	assert(oInput != NULL);
+
+	if(oInput->pcMap == NULL && !oInput->iEof) return FALSE;
+	for(i = oInput->iPos; i < oInput->iLen; i++)
+		if(!isspace((unsigned char)oInput->pcData[i])) return FALSE;
+	return TRUE;
+}
@@ -0,0 +1,47 @@
+#ifndef INPUT_INCLUDED
+#define INPUT_INCLUDED
+
+#include <stddef.h>
+
+/* An Input_T splits a script into lines without copying them.  A
+   regular file is mapped with mmap() and each line is found with
+   memchr() on the mapping.  Any other descriptor, such as a pipe or a
+   terminal, is read with block-sized read()s into a buffer that is
+   split the same way.  Lines have no length limit. */
+typedef struct Input * Input_T;
+
+/* Return a new Input_T that reads the file pcPath, or NULL with errno
+   set if it cannot be opened or insufficient memory is available. */
+Input_T Input_open(const char *pcPath);
+
+/* Return a new Input_T that reads iFd from its current offset, or NULL
+   if insufficient memory is available.  iFd stays open when the
+   Input_T is freed. */
+Input_T Input_fromFd(int iFd);
+
+/* Free oInput, and close its descriptor if Input_open opened it. */
+void Input_free(Input_T oInput);
+
+/* Return the next line of oInput, with its '\n' unless it is the last
+   line and has none, and store its length in *piLength.  The line is
+   not terminated by '\0' and is valid until the next call.  Return
+   NULL at the end of the input or on an error. */
+const char *Input_readLine(Input_T oInput, size_t *piLength);
+
+/* Move the offset of the descriptor of a mapped oInput to the end of
+   the last line returned, so that a child that inherits the descriptor
+   goes on reading from there, as after line-at-a-time reads. */
+void Input_sync(Input_T oInput);
+
+/* Go on reading a mapped oInput from the offset of its descriptor if a
+   child moved it forward since Input_sync, so that the lines the child
+   read are not run. */
+void Input_resume(Input_T oInput);
+
+/* Return 1 (TRUE) if nothing but blank lines follows the last line
+   returned by oInput, as far as it can tell without reading on: a
+   mapped file, or a descriptor whose end was reached.  Return 0 (FALSE)
+   otherwise. */
+int Input_atEnd(Input_T oInput);
+
+#endif
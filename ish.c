@@ -10,6 +10,21 @@
 #include "dynarray.h"
 #include "token.h"
 #include "process.h"
+#include "plan.h"
+#include "exec.h"
+#include "server.h"
+#include "zygote.h"
+#include "cgroup.h"
+#include "trace.h"
+#include "stats.h"
+#include "wildcard.h"
+#include "xargs.h"
+#include "block.h"
+#include "define.h"
+#include "edit.h"
+#include "alloc.h"
+#include "output.h"
+#include "input.h"
 #include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -20,40 +35,189 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
+#include <limits.h>
 
 /*--------------------------------------------------------------------*/
 
-#define MAX_LINE_SIZE 1024
+/* Longest line the line editor takes; lines read from files and pipes have no limit */
+#define MAX_LINE_SIZE 65536
 #define MAX_PATH_SIZE 1024
+#define MAX_REAPS 1024
 #define SYSTEM_NAME "./ish"
+#define MAX_FUNCTION_DEPTH 256
+#define MAX_SOURCE_DEPTH 64
+#define MAX_SUBSTITUTIONS 64
 
 DynArray_T processes;
 DynArray_T tokens;
 char *errMsg;
-char **argv;
-int number_token, number_argv, totalComm;
-int *numArgv_each_Comm;
+int number_token;
+int iZygotePid = -1;
 
-/* SIGCHLD_handler is to reap child process after they are exited and remove the process ID from child process ID list
-	and print out the process id */
-void SIGCHLD_handler(int iSig)
+/* Set by SIGINT_handler so that a running loop stops */
+static volatile sig_atomic_t iInterrupted;
+
+/* The input lines are read from, NULL while serving, the input of stdin, which gets prompts, and whether lines
+	read from a file are echoed */
+static Input_T oInput, oStdin;
+static int iEchoInput;
+
+/* Number of files being read by source */
+static int iSourceDepth;
+
+/* The ends the shell keeps of the pipes of the process substitutions of the pipelines that are running, which
+	their stages inherit, and the pids of the commands at the other ends. A pipeline run by a built-in of another
+	stacks its substitutions on top. */
+static int aiSubstFds[MAX_SUBSTITUTIONS], aiSubstPids[MAX_SUBSTITUTIONS];
+static int iSubstitutions;
+
+/* 1 if stdin is a terminal that lines are edited on */
+static int iEditor;
+
+/* Number of shell functions running in the shell */
+static int iFunctionDepth;
+
+/* The lexer of command lines, which keeps a quoted word open across lines */
+static struct Lexer *psLexer;
+
+/* The shell itself, as opposed to the children it forks, set by --memstats */
+static pid_t iMemstatsPid;
+
+/* The input of a non-interactive run, whose last command may replace the shell rather than be waited for; 1 while
+	the last line of the run is running, and 1 while the pipeline that ends it is being started */
+static Input_T oTailInput;
+static int iFinalLine, iTailExec;
+
+static const char *Shell_readLine(const char *pcPrompt, size_t *piLength);
+static int Shell_source(void);
+static int Shell_executeLine(char *acLine);
+static int Shell_runBlock(struct Block *psBlock, DynArray_T oLine);
+static int Shell_runPipeline(void);
+
+/* Token arrays kept from one line to the next so that running a line
+	does not allocate them again. NULL while in use by Shell_executeLine. */
+static DynArray_T oSpareLine, oSparePipeline;
+
+/* The reaps queued by Shell_queueReap: only the SIGCHLD handler adds to them, and the main loop takes them with
+	SIGCHLD blocked */
+static struct Reap
 {
-	int cpid = wait(NULL);
-	if(cpid == -1) return;
-	else
+	int iPid;
+	long long llTime, llLifetime;
+} asReaps[MAX_REAPS];
+static volatile sig_atomic_t iReaps;
+
+/* Write pcMessage to stdout with write(), which unlike stdio may be used in a signal handler:
+	the main loop may hold the stdio or malloc locks when the signal arrives */
+static void Shell_writeSafe(const char *pcMessage, int iLen)
+{
+	while(iLen > 0)
 	{
-		int index;
-		index = Process_getIndex(processes, cpid);
-		assert(index != -1);
+		int iWritten = write(1, pcMessage, iLen);
+		if(iWritten <= 0) return;
+		pcMessage += iWritten;
+		iLen -= iWritten;
+	}
+}
 
-		if(Process_getType(DynArray_get(processes,index)) == PROCESS_BG)
-		{
-			Process_terminate(processes,cpid);
-			fprintf(stdout,"child %d terminated normally\n", cpid);
-			fflush(NULL);
-		}
-		else if(Process_getType(DynArray_get(processes,index)) == PROCESS_FG) Process_terminate(processes,cpid);
+/* Queue "child <pid> terminated normally" for the next prompt with Output_post */
+static void Shell_writeTerminated(int pid)
+{
+	char acMessage[64], acDigits[16];
+	int iLen, iDigits = 0;
+
+	strcpy(acMessage, "child ");
+	iLen = strlen(acMessage);
+	do {
+		acDigits[iDigits++] = '0' + pid % 10;
+		pid /= 10;
+	} while(pid > 0);
+	while(iDigits > 0) acMessage[iLen++] = acDigits[--iDigits];
+	strcpy(acMessage + iLen, " terminated normally\n");
+	iLen += strlen(" terminated normally\n");
+	Output_post(acMessage, iLen);
+}
+
+/* Queue the reap of child cpid at llTime, and the lifetime of a background job or -1, for Shell_recordReaps. The trace
+	event and the histogram sample are formatted and recorded by the main loop, as stdio may not run in a handler. A
+	reap that finds the queue full is not recorded. */
+static void Shell_queueReap(int cpid, long long llTime, long long llLifetime)
+{
+	if(iReaps == MAX_REAPS) return;
+	asReaps[iReaps].iPid = cpid;
+	asReaps[iReaps].llTime = llTime;
+	asReaps[iReaps].llLifetime = llLifetime;
+	iReaps++;
+}
+
+/* Write the trace events and record the job lifetimes of the reaps that Shell_queueReap queued. Called by the main
+	loop, which blocks SIGCHLD meanwhile, before it reads the next line and before stats prints. */
+static void Shell_recordReaps(void)
+{
+	sigset_t sSet, sOldSet;
+	int i;
+
+	sigemptyset(&sSet);
+	sigaddset(&sSet, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &sSet, &sOldSet);
+	for(i=0;i<iReaps;i++)
+	{
+		if(iTraceFd >= 0) Trace_instantAt("reap", asReaps[i].llTime, asReaps[i].iPid, -1);
+		if(asReaps[i].llLifetime >= 0) Stats_record(STATS_BG_LIFETIME, asReaps[i].llLifetime);
+	}
+	iReaps = 0;
+	sigprocmask(SIG_SETMASK, &sOldSet, NULL);
+}
+
+/* Mark the child cpid, which was just reaped, terminated in the process list and queue a notice with its process
+	id if it was a background job. iStatus is its status from waitpid(), kept for wait. It only reads the list and sets
+	fields of an entry, so it never allocates and may run in SIGCHLD_handler. */
+static void Shell_reapChild(int cpid, int iStatus)
+{
+	int index;
+	long long llNow;
+	/* The zygote is our child but not a job */
+	if(cpid == iZygotePid) return;
+	llNow = Stats_now();
+	index = Process_getIndex(processes, cpid);
+	assert(index != -1);
+
+	if(Process_getType(DynArray_get(processes,index)) == PROCESS_BG)
+	{
+		Shell_queueReap(cpid, llNow, llNow - Process_getStartTime(DynArray_get(processes,index)));
+		Process_terminate(processes,cpid,iStatus);
+		Shell_writeTerminated(cpid);
 	}
+	else
+	{
+		Shell_queueReap(cpid, llNow, -1);
+		if(Process_getType(DynArray_get(processes,index)) == PROCESS_FG) Process_terminate(processes,cpid,iStatus);
+	}
+}
+
+/* Free the entries of the children that terminated, before more are added, so that the process list stays as
+	long as the number of running children however many were started. The handlers that read the list are
+	blocked meanwhile. */
+static void Shell_reclaimProcesses(void)
+{
+	sigset_t sSet, sOldSet;
+	sigemptyset(&sSet);
+	sigaddset(&sSet, SIGCHLD);
+	sigaddset(&sSet, SIGINT);
+	sigaddset(&sSet, SIGQUIT);
+	sigprocmask(SIG_BLOCK, &sSet, &sOldSet);
+	Process_reclaim(processes);
+	sigprocmask(SIG_SETMASK, &sOldSet, NULL);
+}
+
+/* SIGCHLD_handler is to reap child process after they are exited and mark them terminated in the process list
+	and queue a notice with the process id. The main loop changes the list with SIGCHLD blocked. */
+void SIGCHLD_handler(int iSig)
+{
+	int cpid, iStatus;
+	/* Never block here: foreground children are waited for by the main loop */
+	while((cpid = waitpid(-1, &iStatus, WNOHANG)) > 0)
+		Shell_reapChild(cpid, iStatus);
 }
 
 /* Parent ignore SIGINT signal but children response to it by their behaviour */
@@ -62,7 +226,11 @@ void SIGINT_handler(int iSig)
 	/* Send SIGINT to children */
 	int length = DynArray_getLength(processes);
 	int i,pid;
+	iInterrupted = 1;
 	for(i=0;i<length;i++){
+		/* The pid of a child that terminated may belong to another process by now */
+		if(Process_getType(DynArray_get(processes,i)) != PROCESS_BG \
+			&& Process_getType(DynArray_get(processes,i)) != PROCESS_FG) continue;
 		pid = Process_getpid(DynArray_get(processes,i));
 		kill( pid, SIGINT );
 	}
@@ -79,8 +247,8 @@ void SIGQUIT_handler1(int iSig)
 {
 	
 	/* Print "Type Ctrl-\ again within 5 seconds to exit" */
-	fprintf(stdout,"Type Ctrl-\\ again within 5 seconds to exit.");
-	fflush(NULL);
+	const char acMessage[] = "Type Ctrl-\\ again within 5 seconds to exit.";
+	Shell_writeSafe(acMessage, sizeof(acMessage) - 1);
 	
 	/* 
 		Set SIGQUIT the second time to responsible for exit 
@@ -93,6 +261,8 @@ void SIGQUIT_handler1(int iSig)
 	int length = DynArray_getLength(processes);
 	int i,pid;
 	for(i=0;i<length;i++){
+		if(Process_getType(DynArray_get(processes,i)) != PROCESS_BG \
+			&& Process_getType(DynArray_get(processes,i)) != PROCESS_FG) continue;
 		pid = Process_getpid(DynArray_get(processes,i));
 		kill( pid, SIGQUIT );
 	}
@@ -108,323 +278,1779 @@ void SIGALRM_handler(int iSig)
 	alarm(0);
 }
 
-int main(void)
+/* Return 1 if pcName is one of the built-in commands */
+static int Shell_isBuiltin(const char *pcName)
+{
+	return strcmp(pcName, "setenv") == 0 || strcmp(pcName, "unsetenv") == 0 \
+		|| strcmp(pcName, "cd") == 0 || strcmp(pcName, "exit") == 0 \
+		|| strcmp(pcName, "fg") == 0 || strcmp(pcName, "jobs") == 0 \
+		|| strcmp(pcName, "limit") == 0 || strcmp(pcName, "stats") == 0 \
+		|| strcmp(pcName, "xargs") == 0 || strcmp(pcName, "alias") == 0 \
+		|| strcmp(pcName, "unalias") == 0 || strcmp(pcName, "wait") == 0 \
+		|| strcmp(pcName, "source") == 0 || strcmp(pcName, "exec") == 0;
+}
 
-/* Read a line from stdin, and write to stdout each number and word
-   that it contains.  Repeat until EOF.  Return 0 iff successful. */
+/* Return 1 if the shell runs pcName itself, as a built-in command or a function, so that it need not be looked up in
+	$PATH */
+static int Shell_runsInShell(const char *pcName)
+{
+	return Shell_isBuiltin(pcName) || Define_get(DEFINE_FUNCTION, pcName) != NULL;
+}
 
+/* Return 1 if a stage that starts with pcName needs the state of the shell: a built-in, a function or an alias, which
+	the server runs in a worker rather than plan directly */
+static int Shell_needsShell(const char *pcName)
 {
-	
-	/*
-		Make sure that SIGINT, SIGQUIT, SIGALRM are not blocked
-	*/
-	sigset_t sSet;
-	sigemptyset(&sSet);
-	sigaddset(&sSet, SIGINT);
-	sigaddset(&sSet, SIGQUIT);
-	sigaddset(&sSet, SIGALRM);
-	sigprocmask(SIG_UNBLOCK, &sSet, NULL);
-	
-	/*
-		acLine: input line buffer
-		tokens: Array of tokens obtained from tokenizing acLine
-		childPIDs: Array of child process ID invoked by this parent
-		iBuiltIn: 1 if the command is a built-in command
-		number_token: the number of tokens in the command
-	*/
-	char acLine[MAX_LINE_SIZE], command[MAX_LINE_SIZE];
-	char *line;
-	int status, iSuccessful, iBuiltIn;
-	
-	errMsg = (char *)malloc(50*sizeof(char));
+	return Shell_runsInShell(pcName) || Define_get(DEFINE_ALIAS, pcName) != NULL;
+}
 
-	/*
-		initiate process array
-	*/
-	processes = Process_init(0); 
+/* Return 1 if pcName is a built-in command that may be a stage of a pipeline: it reads no input, and only changes the
+	shell or prints */
+static int Shell_isStageBuiltin(const char *pcName)
+{
+	return strcmp(pcName, "setenv") == 0 || strcmp(pcName, "unsetenv") == 0 \
+		|| strcmp(pcName, "cd") == 0 || strcmp(pcName, "jobs") == 0 \
+		|| strcmp(pcName, "stats") == 0 || strcmp(pcName, "alias") == 0 \
+		|| strcmp(pcName, "unalias") == 0;
+}
 
-	/*
-		Setup signal handler for each signal
-	*/
-	signal(SIGCHLD, SIGCHLD_handler);
-	signal(SIGINT, SIGINT_handler);
-	signal(SIGQUIT, SIGQUIT_handler1);
-	signal(SIGALRM, SIGALRM_handler);
-	
-	/* 
-		Open ".ishrc" in the home directory 
-		If .ishrc is not found, the file descriptor is set to stdin
-	*/
-	char *ishrc_filepath = (char *)malloc(MAX_PATH_SIZE * sizeof(char));
-	strcpy(ishrc_filepath, getenv("HOME"));
-	strcat(ishrc_filepath, "/.ishrc");
-	FILE* fd = fopen(ishrc_filepath,"r");
+/* Return 1 if the stage built-in ppcArgv only prints: jobs, stats, or alias with no definition. The shell runs those
+	stages itself; the others would change the shell, so they run in a child like any other stage. */
+static int Shell_isOutputBuiltin(char **ppcArgv, int iArgc)
+{
+	int i;
+	if (strcmp(ppcArgv[0], "jobs") == 0 || strcmp(ppcArgv[0], "stats") == 0) return 1;
+	if (strcmp(ppcArgv[0], "alias") != 0) return 0;
+	for (i = 1; i < iArgc; i++)
+		if (strchr(ppcArgv[i], '=') != NULL) return 0;
+	return 1;
+}
+
+/* Return the index in tokens of the "xargs" that starts the last stage of the pipeline, or -1 */
+static int Shell_findXargs(void)
+{
+	int i, iStage = 0;
+	for(i=0;i<number_token;i++)
+		if(Token_getType(DynArray_get(tokens,i)) == TOKEN_P) iStage = i+1;
+	if(iStage < number_token && Token_getType(DynArray_get(tokens,iStage)) == TOKEN_WORD \
+		&& strcmp(Token_getValue(DynArray_get(tokens,iStage)), "xargs") == 0)
+		return iStage;
+	return -1;
+}
 
-	if (fd == NULL){
-		fprintf(stderr,"%s: .ishrc file is not found so the system automatically redirects to stdin.\n",SYSTEM_NAME);
-		fd = stdin;
+/* Wait for a child while xargs runs with SIGCHLD blocked. A batch is removed from piBatches and merged into
+	status; a stage of the producer is set to -1 in piProducer; any other child is a job, reaped as
+	SIGCHLD_handler would. Return the new status: 123 if a batch failed, 124 if one exited with 255 and 125
+	if one was killed. */
+static int Shell_waitXargs(int *piBatches, int *piBatchCount, int *piProducer, int iProducer, int status)
+{
+	int cpid, iWait, i, iBatchStatus;
+
+	cpid = waitpid(-1, &iWait, 0);
+	if(cpid < 0)
+	{
+		/* Nothing left to wait for; should not happen */
+		if(errno == ECHILD) *piBatchCount = 0;
+		return status;
 	}
-	free(ishrc_filepath);
-	
-	LOOP:do{
-		
-		if(fd == stdin){
-			fprintf(stdout,"%% ");
-			fflush(NULL);
-		}
-		line = fgets(acLine, MAX_LINE_SIZE, fd); 
-		if(line == NULL) continue;
+	for(i=0;i<*piBatchCount;i++)
+	{
+		if(piBatches[i] != cpid) continue;
+		piBatches[i] = piBatches[--*piBatchCount];
+		Process_terminate(processes, cpid, iWait);
+		if(WIFSIGNALED(iWait)) iBatchStatus = 125;
+		else if(WEXITSTATUS(iWait) == 255) iBatchStatus = 124;
+		else iBatchStatus = (WEXITSTATUS(iWait) != 0) ? 123 : 0;
+		return (iBatchStatus > status) ? iBatchStatus : status;
+	}
+	for(i=0;i<iProducer;i++)
+	{
+		if(piProducer[i] != cpid) continue;
+		piProducer[i] = -1;
+		Process_terminate(processes, cpid, iWait);
+		return status;
+	}
+	Shell_reapChild(cpid, iWait);
+	return status;
+}
 
-		if(fd != stdin){
-			fprintf(stdout,"%% %s", acLine);
-			fflush(NULL);
+/* xargs [-0] [-n max] [-P procs] [command [args]]: run command, echo by default, with the items read from stdin
+	as extra arguments, in batches as large as ARG_MAX allows, up to procs batches at once (0: one per CPU).
+	tokens[iXargs] is "xargs"; the stages before it, if any, are spawned with their output going to a pipe
+	that xargs reads. No batch is started after one exits with 255 or is killed. Return the exit status. */
+static int Shell_xargs(int iXargs)
+{
+	DynArray_T oProducer = NULL, oCommand = NULL;
+	struct Pipeline *psProducer = NULL, *psCommand = NULL, sBatch;
+	struct Stage sStage;
+	struct Token *psEcho = NULL;
+	Xargs_T oXargs = NULL;
+	sigset_t sSet, sOldSet;
+	char **ppcArgv, *pcEnd;
+	const char *pcOption, *pcValue;
+	int aiProducerFds[3] = {0, -1, 2}, aiBatchFds[3] = {-1, 1, 2}, p[2] = {-1, -1};
+	int *piProducer = NULL, *piBatches = NULL, iProducer = 0, iBatches = 0;
+	int iItemsFd = 0, iNul = 0, iMaxArgs = 0, iParallel = 1, iArgc;
+	int status = 0, i, iWait;
+	long lValue;
+
+	/* Options */
+	for(i=iXargs+1;i<number_token && Token_getType(DynArray_get(tokens,i)) == TOKEN_WORD;i++)
+	{
+		pcOption = Token_getValue(DynArray_get(tokens,i));
+		if(strcmp(pcOption, "-0") == 0)
+		{
+			iNul = 1;
+			continue;
 		}
-		
-		// Allocate memory for tokens
-		tokens = DynArray_new(0);
-		if (tokens == NULL)
+		if((strcmp(pcOption, "-n") != 0 && strcmp(pcOption, "-P") != 0) || i+1 >= number_token) break;
+		pcValue = Token_getValue(DynArray_get(tokens,++i));
+		lValue = strtol(pcValue, &pcEnd, 10);
+		if(*pcEnd != '\0' || pcEnd == pcValue || lValue < 0 || lValue > 65536 \
+			|| (strcmp(pcOption, "-n") == 0 && lValue == 0))
 		{
-			fprintf(stderr, "Cannot allocate memory\n");
-			exit(EXIT_FAILURE);
+			fprintf(stderr, "%s: xargs: usage: xargs [-0] [-n max] [-P procs] [command [args]]\n", SYSTEM_NAME);
+			return 1;
 		}
-		
-		/* Tokenize string in acLine into token and save in tokens
-			It also checks correctness of the syntax. */
-		iSuccessful = lexLine(acLine, tokens, errMsg);
-		if (!iSuccessful) {
-			DynArray_map(tokens, freeToken, NULL);
-			DynArray_free(tokens);
-			if(strcmp(errMsg,"") != 0) fprintf(stderr,"%s: %s\n",SYSTEM_NAME,errMsg);
-			continue;
+		if(strcmp(pcOption, "-n") == 0) iMaxArgs = (int)lValue;
+		else iParallel = (int)lValue;
+	}
+	if(iParallel == 0) iParallel = (sysconf(_SC_NPROCESSORS_ONLN) > 0) ? (int)sysconf(_SC_NPROCESSORS_ONLN) : 1;
+
+	/* Plan the command and the producer like any pipeline; the tokens stay owned by the line */
+	oCommand = DynArray_new(0);
+	oProducer = DynArray_new(0);
+	if(oCommand == NULL || oProducer == NULL)
+	{
+		fprintf(stderr, "Cannot allocate memory\n");
+		exit(EXIT_FAILURE);
+	}
+	for(;i<number_token;i++)
+		if(!DynArray_add(oCommand, DynArray_get(tokens,i))) goto NOMEM;
+	if(DynArray_getLength(oCommand) == 0 || Token_getType(DynArray_get(oCommand,0)) != TOKEN_WORD)
+	{
+		psEcho = makeToken(TOKEN_WORD, "echo");
+		if(psEcho == NULL || !DynArray_addAt(oCommand, 0, psEcho)) goto NOMEM;
+	}
+	for(i=0;i<iXargs-1;i++)
+		if(!DynArray_add(oProducer, DynArray_get(tokens,i))) goto NOMEM;
+
+	psCommand = Plan_makePipeline(oCommand, Shell_runsInShell, errMsg);
+	if(psCommand != NULL && iXargs > 0) psProducer = Plan_makePipeline(oProducer, Shell_runsInShell, errMsg);
+	if(psCommand == NULL || (iXargs > 0 && psProducer == NULL))
+	{
+		fprintf(stderr, "%s: %s\n", SYSTEM_NAME, errMsg);
+		status = 2;
+		goto DONE;
+	}
+	psCommand->piInherit = aiSubstFds;
+	psCommand->iInherit = iSubstitutions;
+	if(psProducer != NULL)
+	{
+		psProducer->piInherit = aiSubstFds;
+		psProducer->iInherit = iSubstitutions;
+	}
+
+	/* The items come from "< file", the producer or stdin. Each batch reads /dev/null, and "> file" is
+		opened once so that the batches do not truncate each other's output. */
+	if(psCommand->pcInput != NULL) iItemsFd = open(psCommand->pcInput, O_RDONLY | O_CLOEXEC);
+	else if(psProducer != NULL && pipe2(p, O_CLOEXEC) == 0) iItemsFd = p[0];
+	else if(psProducer != NULL) iItemsFd = -1;
+	aiBatchFds[0] = open("/dev/null", O_RDONLY | O_CLOEXEC);
+	if(psCommand->pcOutput != NULL)
+		aiBatchFds[1] = open(psCommand->pcOutput, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if(iItemsFd < 0 || aiBatchFds[0] < 0 || aiBatchFds[1] < 0)
+	{
+		fprintf(stderr, "%s: xargs: %s\n", SYSTEM_NAME, strerror(errno));
+		status = 1;
+		goto DONE;
+	}
+	aiProducerFds[1] = p[1];
+
+	oXargs = Xargs_new(iItemsFd, psCommand->psStages[0].ppcArgv, psCommand->psStages[0].iArgc, iMaxArgs, iNul);
+	piBatches = (int *)malloc(iParallel * sizeof(int));
+	piProducer = (int *)malloc((psProducer != NULL ? psProducer->iStages : 1) * sizeof(int));
+	if(oXargs == NULL || piBatches == NULL || piProducer == NULL) goto NOMEM;
+
+	Shell_reclaimProcesses();
+
+	/* Keep SIGCHLD_handler away until every child is in the process table */
+	sigemptyset(&sSet);
+	sigaddset(&sSet, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &sSet, &sOldSet);
+	fflush(stdout);
+
+	if(psProducer != NULL)
+	{
+		if(oStdin != NULL) Input_sync(oStdin);
+		iProducer = Exec_spawnPipeline(psProducer, aiProducerFds, piProducer);
+		for(i=0;i<iProducer;i++) Process_add(processes, piProducer[i], PROCESS_FG);
+		close(p[1]);
+		p[1] = -1;
+		if(iProducer < psProducer->iStages) status = 1;
+	}
+
+	sBatch = *psCommand;
+	sBatch.psStages = &sStage;
+	sBatch.pcInput = sBatch.pcOutput = NULL;
+	while(status < 124 && (ppcArgv = Xargs_next(oXargs, &iArgc)) != NULL)
+	{
+		while(iBatches == iParallel && status < 124)
+			status = Shell_waitXargs(piBatches, &iBatches, piProducer, iProducer, status);
+		if(status >= 124) break;
+
+		sStage = psCommand->psStages[0];
+		sStage.ppcArgv = ppcArgv;
+		sStage.iArgc = iArgc;
+		if(Exec_spawnPipeline(&sBatch, aiBatchFds, &piBatches[iBatches]) != 1)
+		{
+			status = 125;
+			break;
 		}
+		Process_add(processes, piBatches[iBatches++], PROCESS_FG);
+	}
+	if(Xargs_getError(oXargs) != NULL)
+	{
+		fprintf(stderr, "%s: xargs: %s\n", SYSTEM_NAME, Xargs_getError(oXargs));
+		if(status == 0) status = 1;
+	}
+
+	/* Stopping early closes the pipe, so that the producer gets SIGPIPE rather than block */
+	if(p[0] != -1)
+	{
+		close(p[0]);
+		p[0] = -1;
+	}
+	while(iBatches > 0)
+		status = Shell_waitXargs(piBatches, &iBatches, piProducer, iProducer, status);
+	for(i=0;i<iProducer;i++)
+	{
+		if(piProducer[i] == -1) continue;
+		waitpid(piProducer[i], &iWait, 0);
+		Process_terminate(processes, piProducer[i], iWait);
+	}
+	if(iProducer > 0 && oStdin != NULL) Input_resume(oStdin);
+	sigprocmask(SIG_SETMASK, &sOldSet, NULL);
 
-		iBuiltIn = 1;
-		number_token = DynArray_getLength(tokens);
+	DONE:
+	Xargs_free(oXargs);
+	free(piBatches);
+	free(piProducer);
+	if(p[0] != -1) close(p[0]);
+	if(p[1] != -1) close(p[1]);
+	if(psCommand != NULL && psCommand->pcInput != NULL && iItemsFd >= 0) close(iItemsFd);
+	if(aiBatchFds[0] >= 0) close(aiBatchFds[0]);
+	if(aiBatchFds[1] >= 0 && aiBatchFds[1] != 1) close(aiBatchFds[1]);
+	if(psCommand != NULL) Plan_freePipeline(psCommand);
+	if(psProducer != NULL) Plan_freePipeline(psProducer);
+	if(psEcho != NULL) freeToken(psEcho, NULL);
+	DynArray_free(oCommand);
+	DynArray_free(oProducer);
+	return status;
 
-		strcpy(command, Token_getValue(DynArray_get(tokens, 0)) );
-		/*
-			There are 5 built-in commands: setenv, unsetenv, cd, exit, fg
-			We check if the first token is one of the built-in command.
-		*/
-	
-		/* setenv var [value]: set variable var to value. If value is omitted, set to empyty string. */
-		if (strcmp(command, "setenv") == 0)
+	NOMEM:
+	fprintf(stderr, "Cannot allocate memory\n");
+	exit(EXIT_FAILURE);
+}
+
+/* alias [name[=value] ...]: define each alias name as value, which is lexed once here and must be a single pipeline,
+	or print alias name, or every alias, to psOut. Return the exit status. */
+static int Shell_alias(FILE *psOut)
+{
+	char acName[MAX_LINE_SIZE];
+	const char *pcArg, *pcEquals;
+	DynArray_T oValue;
+	int status = 0, i, j;
+
+	if (number_token == 1) return Define_printAliases(psOut, NULL) ? 0 : 1;
+	for (i = 1; i < number_token; i++)
+	{
+		if (Token_getType(DynArray_get(tokens, i)) != TOKEN_WORD) continue;
+		pcArg = Token_getValue(DynArray_get(tokens, i));
+		pcEquals = strchr(pcArg, '=');
+		if (pcEquals == NULL)
 		{
-			// value is not determined
-			if (number_token == 2 && strcmp( Token_getValue(DynArray_get(tokens, 1)),"") != 0)
-			{
-				setenv(Token_getValue(DynArray_get(tokens,1)), "", 1);
-			}
-			else if (number_token == 3 && strcmp(Token_getValue(DynArray_get(tokens,2)),"|") != 0 \
-					&& strcmp(Token_getValue(DynArray_get(tokens,2)),"<") != 0 && strcmp(Token_getValue(DynArray_get(tokens,2)),">") != 0)
-			{
-				setenv(Token_getValue(DynArray_get(tokens,1)), Token_getValue(DynArray_get(tokens,2)), 1);
-			}
-			else
+			if (!Define_printAliases(psOut, pcArg))
 			{
-				fprintf(stderr,"%s: setenv takes one or two parameters\n",SYSTEM_NAME);
+				fprintf(stderr, "%s: alias: %s: not found\n", SYSTEM_NAME, pcArg);
+				status = 1;
 			}
-		} 
-		// unsetenv var: destroy the variable var.
-		else if (strcmp(command, "unsetenv") == 0)
+			continue;
+		}
+		if (pcEquals == pcArg)
 		{
-			if (number_token == 2 && strcmp(Token_getValue(DynArray_get(tokens,1)),"") != 0 \
-				&& strcmp(Token_getValue(DynArray_get(tokens,1)),"|") != 0 && strcmp(Token_getValue(DynArray_get(tokens,1)),"<") != 0 \
-				&& strcmp(Token_getValue(DynArray_get(tokens,1)),">") != 0)
-			{
-				unsetenv(Token_getValue(DynArray_get(tokens,1)));
-			}
-			else
-			{
-				fprintf(stderr,"%s: unsetenv takes one parameter\n", SYSTEM_NAME);
-			}
+			fprintf(stderr, "%s: alias: %s: invalid alias name\n", SYSTEM_NAME, pcArg);
+			status = 1;
+			continue;
 		}
-		// cd [dir]: change current working directory to dir. If dir is omitted, change to user's HOME directory
-		else if (strcmp(command, "cd") == 0)
+		snprintf(acName, sizeof(acName), "%.*s", (int)(pcEquals - pcArg), pcArg);
+
+		oValue = DynArray_new(0);
+		if (oValue == NULL)
 		{
-			if(number_token > 2) fprintf(stderr,"%s: cd: too many arguments\n", SYSTEM_NAME);
-			else if(number_token == 2){
-				if(chdir(Token_getValue(DynArray_get(tokens,1))) != 0) fprintf(stderr, "%s: %s\n", SYSTEM_NAME, strerror(errno));
-			}
-			else chdir(getenv("HOME"));
+			fprintf(stderr, "Cannot allocate memory\n");
+			exit(EXIT_FAILURE);
 		}
-		// exit: exit shell with status 0
-		else if (strcmp(command, "exit") == 0)
+		if (!lexLine(pcEquals + 1, oValue, errMsg))
 		{
-			DynArray_map(tokens, freeToken, NULL);
-			DynArray_free(tokens);
-			exit(0);
+			if (strcmp(errMsg, "") != 0) fprintf(stderr, "%s: alias: %s: %s\n", SYSTEM_NAME, acName, errMsg);
+			else fprintf(stderr, "%s: alias: %s: empty value\n", SYSTEM_NAME, acName);
+			DynArray_map(oValue, freeToken, NULL);
+			DynArray_free(oValue);
+			status = 1;
+			continue;
 		}
-		/* fg: brings a command that has been running in the background to the foreground. 
-		 When there are multiple programs running in the background, it will bring the most recently launched program to the foreground. */
-		else if (strcmp(command, "fg") == 0)
+		for (j = 0; j < DynArray_getLength(oValue); j++)
 		{
-			int lastpid = Process_getLastbg(processes);
-			if(lastpid != -1){
-				fprintf(stdout, "[%d] Lastest background process is executing\n", lastpid);
-				waitpid(lastpid,&status,0);
-				fprintf(stdout, "[%d] Done\n", lastpid);
-				Process_terminate(processes,lastpid);
-			}
-			else{
-				fprintf(stdout, "%s: There is no background process.\n", SYSTEM_NAME);
-			}
+			if (Token_isListOperator(DynArray_get(oValue, j)) || Token_getType(DynArray_get(oValue, j)) == TOKEN_BG)
+				break;
 		}
-		else iBuiltIn = 0;
-		
-		if(iBuiltIn == 0){
-			
-			// Clear all I/O buffers
-			fflush(NULL);
-			
-			// Check if it is foreground or background
-			int foreground;
-			foreground = Token_isBG(tokens);
-			
-			// Fork child process to do the command
-			int pid, i, j;
-			int *p;
-			totalComm = Token_getNumCommand(tokens);
-
-			// TotalComm > 1 means There is at least one pipe
-			if(totalComm > 1)
-			{
-				p = (int *)malloc(2*(totalComm-1)*sizeof(int *));
-				for(i=0;i<totalComm-1;i++){
-					if(pipe(p + i*2) == -1)
-					{
-						perror("pipe");
-						exit(EXIT_FAILURE);
-					}
-				}
-			}
+		if (j < DynArray_getLength(oValue))
+		{
+			fprintf(stderr, "%s: alias: %s: value must be a single pipeline\n", SYSTEM_NAME, acName);
+			DynArray_map(oValue, freeToken, NULL);
+			DynArray_free(oValue);
+			status = 1;
+			continue;
+		}
+		if (!Define_set(DEFINE_ALIAS, acName, pcEquals + 1, oValue, NULL))
+		{
+			fprintf(stderr, "Cannot allocate memory\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	return status;
+}
 
-			/* Iterate through each command in a line
-				Create a process for each command from parent process. So, they all are at the same level.
-				Then, create pipes for number of total commands - 1 and link them via pipes.*/
-			for(i=0;i<totalComm;i++)
-			{
-				pid = fork();
-				if(pid == 0)
-				{
-					int file_descriptor;
-					char *filename;
-					/* Redirect a file descriptor as stdin, if any, for the first process*/
-					if(i==0)
-					{
-						/* Open file from redirection, if any */
-						filename = Token_getInput(tokens,&status);
-						if(status == 0)
-						{
-							file_descriptor = open(filename, O_RDONLY);
-							if(file_descriptor < 0){
-								perror("open read");
-								exit(EXIT_FAILURE);
-							}
-
-							close(0);
-							dup(file_descriptor);
-							close(file_descriptor);
-						}
-						free(filename);
-					}
-
-					/* Redirect stdout if any */
-					if(i == totalComm-1)
-					{
-						filename = Token_getOutput(tokens,&status);
-						if(status == 0)
-						{
-							file_descriptor = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0600);
-							if(file_descriptor < 0){
-								perror("open write");
-								exit(EXIT_FAILURE);
-							}
-
-							close(1);
-							dup(file_descriptor);
-							close(file_descriptor);
-						}
-						free(filename);
-					}
-
-					/* Make child read from pipe if it's not the first command */
-					if(i!=0)
-					{
-						if(dup2(p[2*(i-1)],0) < 0){
-							perror("dup2");
-							exit(EXIT_FAILURE);
-						}
-					}
-
-					/* Make child write to pipe if it's not the last command */
-					if(i!=totalComm-1)
-					{
-						if(dup2(p[2*i+1],1) < 0){
-							perror("dup2");
-							exit(EXIT_FAILURE);
-						}
-					}
-					
-					if(totalComm>1)
-					{
-						for(j=0;j<totalComm-1;j++){
-							close(p[2*j]);
-							close(p[2*j+1]);
-						}
-						free(p);
-					}
-
-					argv = Token_getComm(tokens,i,&number_argv);
-					execvp(argv[0],argv);
-					fprintf(stderr, "%s: %s\n", argv[0], strerror(errno));
-					exit(EXIT_FAILURE);
-				}
-				else if(pid > 0)
-				{
-					if(foreground == 1) Process_add(processes, pid, PROCESS_FG);
-					else Process_add(processes, pid, PROCESS_BG);
-				}
-				else 
-				{
-					perror("fork");
-					exit(EXIT_FAILURE);
-				}
-			}
-			
-			if( foreground == 1 )
-			{
-				if(totalComm>1)
-				{
-					for(j=0;j<totalComm-1;j++){
-						close(p[2*j]);
-						close(p[2*j+1]);
-					}
-					free(p);
-				}
-				for(i=0;i<totalComm;i++)
-				{
-					pid = wait(&status);
-				}
-			}
-			// So there is no action for background
+/* unalias name ...: remove each alias name. Return the exit status. */
+static int Shell_unalias(void)
+{
+	const char *pcName;
+	int status = 0, i;
 
-			DynArray_map(tokens, freeToken, NULL);
-			DynArray_free(tokens);
-			
-			continue;
+	if (number_token == 1)
+	{
+		fprintf(stderr, "%s: unalias: usage: unalias name ...\n", SYSTEM_NAME);
+		return 2;
+	}
+	for (i = 1; i < number_token; i++)
+	{
+		if (Token_getType(DynArray_get(tokens, i)) != TOKEN_WORD) continue;
+		pcName = Token_getValue(DynArray_get(tokens, i));
+		if (!Define_remove(DEFINE_ALIAS, pcName))
+		{
+			fprintf(stderr, "%s: unalias: %s: not found\n", SYSTEM_NAME, pcName);
+			status = 1;
 		}
-		DynArray_map(tokens, freeToken, NULL);
-		DynArray_free(tokens);		
-	} while(line != NULL);
-	if(fd != stdin)
+	}
+	return status;
+}
+
+/* jobs: print the background processes that are still running to psOut, with the usage of their cgroup if any.
+	Return the exit status. */
+static int Shell_jobs(FILE *psOut)
+{
+	int length = DynArray_getLength(processes);
+	int i;
+	for(i=0;i<length;i++)
 	{
-		fclose(fd);
-		fd = stdin;
-		goto LOOP;
+		if(Process_getType(DynArray_get(processes,i)) != PROCESS_BG) continue;
+		fprintf(psOut, "[%d] %d Running\n", Process_getJob(DynArray_get(processes,i)),
+			Process_getpid(DynArray_get(processes,i)));
+		if(Process_getCgroup(DynArray_get(processes,i)) != NULL)
+			Cgroup_printStats(Process_getCgroup(DynArray_get(processes,i)), psOut);
+	}
+	return 0;
+}
+
+/* stats [-j] [-r]: print the counters and latency histograms of the session to psOut, as JSON with -j. -r resets them
+	afterwards. Return the exit status. */
+static int Shell_stats(FILE *psOut)
+{
+	int iJson = 0, iReset = 0, i;
+	sigset_t sSet, sOldSet;
+	for(i=1;i<number_token;i++)
+	{
+		if(strcmp(Token_getValue(DynArray_get(tokens,i)), "-j") == 0) iJson = 1;
+		else if(strcmp(Token_getValue(DynArray_get(tokens,i)), "-r") == 0) iReset = 1;
+		else break;
+	}
+	if(i < number_token)
+	{
+		fprintf(stderr, "%s: stats: usage: stats [-j] [-r]\n", SYSTEM_NAME);
+		return 1;
 	}
-	
-	free(errMsg);
 
+	/* SIGCHLD_handler queues job lifetimes */
+	sigemptyset(&sSet);
+	sigaddset(&sSet, SIGCHLD);
+	Shell_recordReaps();
+	sigprocmask(SIG_BLOCK, &sSet, &sOldSet);
+	Stats_print(psOut, iJson);
+	if(iReset) Stats_reset();
+	sigprocmask(SIG_SETMASK, &sOldSet, NULL);
 	return 0;
 }
+
+/* Take the status of the job or process named by pcOperand, "%job" or a process id, into *piStatus once it has
+	terminated, as Process_waitJob does. Return -1 if pcOperand names none. */
+static int Shell_waitOperand(const char *pcOperand, int *piStatus)
+{
+	const char *pcDigits = (pcOperand[0] == '%') ? pcOperand + 1 : pcOperand;
+	char *pcEnd;
+	long lId;
+
+	errno = 0;
+	lId = strtol(pcDigits, &pcEnd, 10);
+	if (pcEnd == pcDigits || *pcEnd != '\0' || errno != 0 || lId <= 0 || lId > INT_MAX) return -1;
+	if (pcOperand[0] == '%') return Process_waitJob(processes, (int)lId, piStatus);
+	return Process_waitPid(processes, (int)lId, piStatus);
+}
+
+/* wait [-n] [%job | pid ...]: with no operand, wait until every background job has terminated and return 0.
+	With -n, wait for the next job to terminate, so that a slot can be refilled, and return its exit status, or
+	127 if there are no jobs. Otherwise wait for each job or process in turn and return the exit status of the
+	last, or 127 if it is unknown. Return 130 if interrupted. SIGCHLD_handler does the reaping: wait only
+	sleeps until it changes the process table. */
+static int Shell_wait(void)
+{
+	sigset_t sSet, sOldSet;
+	const char *pcOperand;
+	int status = 0, iAny = 0, iResult = -1, iWait = 0, i;
+	int iOuterInterrupted = iInterrupted;
+
+	if (number_token > 1 && strcmp(Token_getValue(DynArray_get(tokens, 1)), "-n") == 0) iAny = 1;
+	if (iAny && number_token > 2)
+	{
+		fprintf(stderr, "%s: wait: usage: wait [-n] [%%job | pid ...]\n", SYSTEM_NAME);
+		return 2;
+	}
+
+	/* With SIGCHLD blocked the table cannot change between a test and sigsuspend(), which unblocks it */
+	sigemptyset(&sSet);
+	sigaddset(&sSet, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &sSet, &sOldSet);
+	iInterrupted = 0;
+	if (number_token == 1)
+	{
+		while (!iInterrupted && Process_getLastbg(processes) != -1) sigsuspend(&sOldSet);
+		/* The statuses are taken, and the entries can be reclaimed */
+		if (!iInterrupted) while (Process_waitJob(processes, 0, &iWait) == 0);
+	}
+	else if (iAny)
+	{
+		while (!iInterrupted && (iResult = Process_waitJob(processes, 0, &iWait)) == 1) sigsuspend(&sOldSet);
+		status = (iResult == 0) ? Exec_exitStatus(iWait) : 127;
+	}
+	else for (i = 1; i < number_token && !iInterrupted; i++)
+	{
+		pcOperand = Token_getValue(DynArray_get(tokens, i));
+		while (!iInterrupted && (iResult = Shell_waitOperand(pcOperand, &iWait)) == 1) sigsuspend(&sOldSet);
+		if (iResult == 0) status = Exec_exitStatus(iWait);
+		else if (iResult == -1)
+		{
+			fprintf(stderr, "%s: wait: %s: no such job\n", SYSTEM_NAME, pcOperand);
+			status = 127;
+		}
+	}
+	sigprocmask(SIG_SETMASK, &sOldSet, NULL);
+
+	if (iInterrupted) return 130;
+	iInterrupted = iOuterInterrupted;
+	return status;
+}
+
+/* exec [command [arg ...]] [< file] [> file]: run command in place of the shell, with the redirections applied.
+	Without a command, apply the redirections to the shell itself for good. Return 2 on misuse, 1 if a redirection
+	fails, and if command cannot be run, the status of Exec_replace, which undoes its redirections. */
+static int Shell_exec(void)
+{
+	struct Pipeline *psPipeline;
+	enum TokenType eType;
+	char *pcInput, *pcOutput;
+	int status, iInput, iOutput, i;
+
+	DynArray_removeAt(tokens, 0);
+	for (i = 0; i < DynArray_getLength(tokens); i++)
+	{
+		eType = Token_getType(DynArray_get(tokens, i));
+		if (eType == TOKEN_P || eType == TOKEN_BG)
+		{
+			fprintf(stderr, "%s: exec: usage: exec [command [arg ...]] [< file] [> file]\n", SYSTEM_NAME);
+			return 2;
+		}
+	}
+
+	/* Only redirections */
+	for (i = 0; i < DynArray_getLength(tokens); i += 2)
+	{
+		eType = Token_getType(DynArray_get(tokens, i));
+		if (eType != TOKEN_RL && eType != TOKEN_RR) break;
+	}
+	if (i >= DynArray_getLength(tokens))
+	{
+		pcInput = Token_getInput(tokens, &iInput);
+		pcOutput = Token_getOutput(tokens, &iOutput);
+		if ((pcInput == NULL && iInput == 0) || (pcOutput == NULL && iOutput == 0))
+		{
+			fprintf(stderr, "Cannot allocate memory\n");
+			exit(EXIT_FAILURE);
+		}
+		status = Exec_redirect(pcInput, pcOutput) ? 0 : 1;
+		Alloc_free(pcInput);
+		Alloc_free(pcOutput);
+		return status;
+	}
+
+	psPipeline = Plan_makePipeline(tokens, Shell_runsInShell, errMsg);
+	if (psPipeline == NULL)
+	{
+		fprintf(stderr, "%s: %s\n", SYSTEM_NAME, errMsg);
+		return 2;
+	}
+	psPipeline->piInherit = aiSubstFds;
+	psPipeline->iInherit = iSubstitutions;
+	/* The command goes on reading stdin after the lines the shell took */
+	if (oStdin != NULL) Input_sync(oStdin);
+	status = Exec_replace(psPipeline);
+	Plan_freePipeline(psPipeline);
+	return status;
+}
+
+/* Run function psDefinition in the shell with ppcArgv[1] to ppcArgv[iArgc-1] as $1 to $9: its plan tree runs as is,
+	with no lexing, on a pipeline array of its own. Return its exit status. */
+static int Shell_callFunction(struct Definition *psDefinition, char **ppcArgv, int iArgc)
+{
+	DynArray_T oOuterTokens = tokens;
+	char **ppcOuterArguments;
+	int status, iOuterArguments;
+
+	if (iFunctionDepth == MAX_FUNCTION_DEPTH)
+	{
+		fprintf(stderr, "%s: %s: maximum function nesting exceeded\n", SYSTEM_NAME, ppcArgv[0]);
+		return 2;
+	}
+	tokens = (oSparePipeline != NULL) ? oSparePipeline : DynArray_new(0);
+	oSparePipeline = NULL;
+	if (tokens == NULL)
+	{
+		fprintf(stderr, "Cannot allocate memory\n");
+		exit(EXIT_FAILURE);
+	}
+	ppcOuterArguments = Token_getArguments(&iOuterArguments);
+	Token_setArguments(ppcArgv + 1, iArgc - 1);
+	if (iFunctionDepth == 0) iInterrupted = 0;
+
+	/* The function may define itself again while it runs */
+	Define_hold(psDefinition);
+	iFunctionDepth++;
+	status = Shell_runBlock(Define_getBlock(psDefinition), Define_getTokens(psDefinition));
+	iFunctionDepth--;
+	Define_release(psDefinition);
+
+	Token_setArguments(ppcOuterArguments, iOuterArguments);
+	DynArray_clear(tokens);
+	if (oSparePipeline == NULL) oSparePipeline = tokens;
+	else DynArray_free(tokens);
+	tokens = oOuterTokens;
+	return status;
+}
+
+/* Run the function pvRun of a pipeline stage in its forked child. Return its exit status. */
+static int Shell_runFunction(void *pvRun, char **ppcArgv, int iArgc)
+{
+	Zygote_detach();
+	return Shell_callFunction((struct Definition *)pvRun, ppcArgv, iArgc);
+}
+
+/* Run the built-in command ppcArgv, a stage of a pipeline, as Shell_runPipeline runs a line that is the command alone.
+	The built-ins that only print, as Shell_isOutputBuiltin tells, print to psOut; the others print only errors, and
+	run in a child whose stdout is the stage's own. Return its exit status. */
+static int Shell_runBuiltin(char **ppcArgv, int iArgc, FILE *psOut)
+{
+	DynArray_T oOuterTokens = tokens;
+	void *pvToken;
+	int status, iOuterNumber = number_token, i;
+
+	tokens = DynArray_new(0);
+	if (tokens == NULL)
+	{
+		fprintf(stderr, "Cannot allocate memory\n");
+		exit(EXIT_FAILURE);
+	}
+	for (i = 0; i < iArgc; i++)
+	{
+		pvToken = makeToken(TOKEN_WORD, ppcArgv[i]);
+		if (pvToken == NULL || !DynArray_add(tokens, pvToken))
+		{
+			fprintf(stderr, "Cannot allocate memory\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	number_token = iArgc;
+
+	if (!Shell_isOutputBuiltin(ppcArgv, iArgc)) status = Shell_runPipeline();
+	else
+	{
+		if (strcmp(ppcArgv[0], "jobs") == 0) status = Shell_jobs(psOut);
+		else if (strcmp(ppcArgv[0], "stats") == 0) status = Shell_stats(psOut);
+		else status = Shell_alias(psOut);
+		Stats_count(STATS_BUILTINS, 1);
+	}
+
+	DynArray_map(tokens, freeToken, NULL);
+	DynArray_free(tokens);
+	tokens = oOuterTokens;
+	number_token = iOuterNumber;
+	return status;
+}
+
+/* Run the built-in command of a pipeline stage in its forked child: one that changes the shell, which a stage must not
+	do, or any of them when the shell does not wait for the pipeline, in the background or in a cgroup. Return its exit
+	status. */
+static int Shell_runBuiltinChild(void *pvRun, char **ppcArgv, int iArgc)
+{
+	Zygote_detach();
+	return Shell_runBuiltin(ppcArgv, iArgc, stdout);
+}
+
+/* Return 1 if psStage is a built-in command that Shell_spawnMixed runs in the shell */
+static int Shell_isOutputStage(const struct Stage *psStage)
+{
+	return psStage->pfRun == Shell_runBuiltinChild && Shell_isOutputBuiltin(psStage->ppcArgv, psStage->iArgc);
+}
+
+/* Start the foreground pipeline psPipeline, whose stages that Shell_isOutputStage tells are built-in commands that run
+	here in the shell instead, in the order of the stages. Each run of the other stages between them is spawned as
+	a pipeline of its own with aiStdFds, reading from a pipe the output of the built-in before it, which the shell
+	collects in memory; a built-in reads no input, so the stages before it write to a pipe that nobody reads. Only
+	the external stages fork. Store the pid of each stage in piPids, or -1 for a built-in, and the wait status of the
+	last stage in *piLastWait if it is a built-in. The outputs still to write go to the *piFeeds Feeds of psFeeds, for
+	Exec_feedPipes; the caller frees their data. Return the number of stages started. */
+static int Shell_spawnMixed(struct Pipeline *psPipeline, const int aiStdFds[3], int *piPids, int *piLastWait,
+	struct Feed *psFeeds, int *piFeeds)
+{
+	struct Pipeline sSegment;
+	struct Stage *psStage;
+	FILE *psOut;
+	char *pcPending = NULL;
+	size_t iPending = 0;
+	int aiFds[3], aiPipe[2];
+	int iStages = psPipeline->iStages;
+	int i = 0, j, status, iSpawned, iFd;
+
+	*piFeeds = 0;
+	while (i < iStages)
+	{
+		psStage = &psPipeline->psStages[i];
+		if (Shell_isOutputStage(psStage))
+		{
+			/* The last stage prints to stdout itself; any other output is kept for the next stage, if it reads */
+			piPids[i] = -1;
+			free(pcPending);
+			pcPending = NULL;
+			if (i == iStages-1 && psPipeline->pcOutput == NULL)
+			{
+				*piLastWait = W_EXITCODE(Shell_runBuiltin(psStage->ppcArgv, psStage->iArgc, stdout), 0);
+				i++;
+				continue;
+			}
+			psOut = open_memstream(&pcPending, &iPending);
+			if (psOut == NULL)
+			{
+				fprintf(stderr, "Cannot allocate memory\n");
+				exit(EXIT_FAILURE);
+			}
+			status = Shell_runBuiltin(psStage->ppcArgv, psStage->iArgc, psOut);
+			fclose(psOut);
+			if (++i < iStages) continue;
+
+			/* The last stage, whose output goes to a file */
+			*piLastWait = W_EXITCODE(status, 0);
+			iFd = open(psPipeline->pcOutput, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+			if (iFd < 0)
+			{
+				perror("open write");
+				*piLastWait = W_EXITCODE(1, 0);
+				break;
+			}
+			psFeeds[*piFeeds].iFd = iFd;
+			psFeeds[*piFeeds].pcData = pcPending;
+			psFeeds[*piFeeds].iSize = iPending;
+			psFeeds[(*piFeeds)++].iWritten = 0;
+			return i;
+		}
+
+		/* Stages i to j-1 are spawned together */
+		for (j = i; j < iStages && !Shell_isOutputStage(&psPipeline->psStages[j]); j++);
+		memcpy(aiFds, aiStdFds, sizeof(aiFds));
+		if (pcPending != NULL)
+		{
+			if (pipe2(aiPipe, O_CLOEXEC) == -1)
+			{
+				perror("pipe");
+				break;
+			}
+			aiFds[0] = aiPipe[0];
+			psFeeds[*piFeeds].iFd = aiPipe[1];
+			psFeeds[*piFeeds].pcData = pcPending;
+			psFeeds[*piFeeds].iSize = iPending;
+			psFeeds[(*piFeeds)++].iWritten = 0;
+			pcPending = NULL;
+		}
+		if (j < iStages)
+		{
+			if (pipe2(aiPipe, O_CLOEXEC) == -1)
+			{
+				perror("pipe");
+				if (aiFds[0] != aiStdFds[0]) close(aiFds[0]);
+				break;
+			}
+			close(aiPipe[0]);
+			aiFds[1] = aiPipe[1];
+		}
+		sSegment = *psPipeline;
+		sSegment.psStages = psStage;
+		sSegment.iStages = j - i;
+		if (i > 0) sSegment.pcInput = NULL;
+		if (j < iStages) sSegment.pcOutput = NULL;
+		iSpawned = Exec_spawnPipeline(&sSegment, aiFds, piPids + i);
+		if (aiFds[0] != aiStdFds[0]) close(aiFds[0]);
+		if (aiFds[1] != aiStdFds[1]) close(aiFds[1]);
+		i += iSpawned;
+		if (i < j) break;
+	}
+	free(pcPending);
+	return i;
+}
+
+/* Run the pipeline in tokens, whose variables are expanded, either as a built-in command or as a pipeline of
+	child processes. Return the exit status of the pipeline. */
+static int Shell_runPipeline(void)
+{
+	const char *command;
+	int status = 0, iBuiltIn, iXargs, iStages = 1, iTail = iTailExec, i;
+	char *pcCgroup = NULL;
+	int iCgroupFd = -1, iCgroupCreated = 0;
+
+	/* Only this pipeline may replace the shell, not the ones a built-in runs */
+	iTailExec = 0;
+
+	/* limit [-n name] [-c cpu.max] [-m memory.max] [-i io.max] pipeline: run the pipeline in a cgroup v2 */
+	if (strcmp(Token_getValue(DynArray_get(tokens, 0)), "limit") == 0)
+	{
+		const char *apcLimit[4] = {NULL, NULL, NULL, NULL};
+		const char *pcOption;
+
+		DynArray_removeAt(tokens, 0);
+		while (DynArray_getLength(tokens) >= 2 && Token_getType(DynArray_get(tokens, 0)) == TOKEN_WORD)
+		{
+			pcOption = Token_getValue(DynArray_get(tokens, 0));
+			if (strcmp(pcOption, "-n") == 0) apcLimit[0] = Token_getValue(DynArray_get(tokens, 1));
+			else if (strcmp(pcOption, "-c") == 0) apcLimit[1] = Token_getValue(DynArray_get(tokens, 1));
+			else if (strcmp(pcOption, "-m") == 0) apcLimit[2] = Token_getValue(DynArray_get(tokens, 1));
+			else if (strcmp(pcOption, "-i") == 0) apcLimit[3] = Token_getValue(DynArray_get(tokens, 1));
+			else break;
+			DynArray_removeAt(tokens, 0);
+			DynArray_removeAt(tokens, 0);
+		}
+		if (DynArray_getLength(tokens) == 0 || Token_getType(DynArray_get(tokens, 0)) != TOKEN_WORD \
+			|| Shell_isBuiltin(Token_getValue(DynArray_get(tokens, 0))))
+		{
+			fprintf(stderr, "%s: limit: [-n name] [-c cpu.max] [-m memory.max] [-i io.max] command\n", SYSTEM_NAME);
+			return 2;
+		}
+		iCgroupFd = Cgroup_open(apcLimit[0], apcLimit[1], apcLimit[2], apcLimit[3], &pcCgroup, &iCgroupCreated);
+		if (iCgroupFd == -1) return 1;
+	}
+
+	iBuiltIn = 1;
+	number_token = DynArray_getLength(tokens);
+	for (i = 0; i < number_token; i++)
+		if (Token_getType(DynArray_get(tokens, i)) == TOKEN_P) iStages++;
+
+	command = Token_getValue(DynArray_get(tokens, 0));
+	/*
+		The built-in commands are setenv, unsetenv, cd, exit, exec, fg, jobs, wait, source, stats, xargs, alias and unalias
+		We check if the first token is one of the built-in command.
+	*/
+
+	/* xargs, alone or as the last stage of the pipeline. Under limit an external xargs runs in the cgroup. */
+	if (iCgroupFd == -1 && (iXargs = Shell_findXargs()) != -1)
+	{
+		status = Shell_xargs(iXargs);
+	}
+	/* A built-in that is the first stage of a pipeline runs with the other stages below */
+	else if (iStages > 1 && Shell_isStageBuiltin(command))
+	{
+		iBuiltIn = 0;
+	}
+	/* alias [name[=value] ...]: define or print aliases */
+	else if (strcmp(command, "alias") == 0)
+	{
+		status = Shell_alias(stdout);
+	}
+	/* unalias name ...: remove aliases */
+	else if (strcmp(command, "unalias") == 0)
+	{
+		status = Shell_unalias();
+	}
+	/* setenv var [value]: set variable var to value. If value is omitted, set to empyty string. */
+	else if (strcmp(command, "setenv") == 0)
+	{
+		// value is not determined
+		if (number_token == 2 && strcmp( Token_getValue(DynArray_get(tokens, 1)),"") != 0)
+		{
+			setenv(Token_getValue(DynArray_get(tokens,1)), "", 1);
+		}
+		else if (number_token == 3 && strcmp(Token_getValue(DynArray_get(tokens,2)),"|") != 0 \
+				&& strcmp(Token_getValue(DynArray_get(tokens,2)),"<") != 0 && strcmp(Token_getValue(DynArray_get(tokens,2)),">") != 0)
+		{
+			setenv(Token_getValue(DynArray_get(tokens,1)), Token_getValue(DynArray_get(tokens,2)), 1);
+		}
+		else
+		{
+			fprintf(stderr,"%s: setenv takes one or two parameters\n",SYSTEM_NAME);
+			status = 1;
+		}
+	} 
+	// unsetenv var: destroy the variable var.
+	else if (strcmp(command, "unsetenv") == 0)
+	{
+		if (number_token == 2 && strcmp(Token_getValue(DynArray_get(tokens,1)),"") != 0 \
+			&& strcmp(Token_getValue(DynArray_get(tokens,1)),"|") != 0 && strcmp(Token_getValue(DynArray_get(tokens,1)),"<") != 0 \
+			&& strcmp(Token_getValue(DynArray_get(tokens,1)),">") != 0)
+		{
+			unsetenv(Token_getValue(DynArray_get(tokens,1)));
+		}
+		else
+		{
+			fprintf(stderr,"%s: unsetenv takes one parameter\n", SYSTEM_NAME);
+			status = 1;
+		}
+	}
+	// cd [dir]: change current working directory to dir. If dir is omitted, change to user's HOME directory
+	else if (strcmp(command, "cd") == 0)
+	{
+		if(number_token > 2){
+			fprintf(stderr,"%s: cd: too many arguments\n", SYSTEM_NAME);
+			status = 1;
+		}
+		else if(number_token == 2){
+			if(chdir(Token_getValue(DynArray_get(tokens,1))) != 0){
+				fprintf(stderr, "%s: %s\n", SYSTEM_NAME, strerror(errno));
+				status = 1;
+			}
+		}
+		else chdir(getenv("HOME"));
+	}
+	// exit: exit shell with status 0
+	else if (strcmp(command, "exit") == 0)
+	{
+		DynArray_free(tokens);
+		exit(0);
+	}
+	/* fg: brings a command that has been running in the background to the foreground. 
+	 When there are multiple programs running in the background, it will bring the most recently launched program to the foreground. */
+	else if (strcmp(command, "fg") == 0)
+	{
+		sigset_t sSet, sOldSet;
+		sigemptyset(&sSet);
+		sigaddset(&sSet, SIGCHLD);
+		sigprocmask(SIG_BLOCK, &sSet, &sOldSet);
+
+		int lastpid = Process_getLastbg(processes);
+		if(lastpid != -1){
+			fprintf(stdout, "[%d] Lastest background process is executing\n", lastpid);
+			waitpid(lastpid,&status,0);
+			fprintf(stdout, "[%d] Done\n", lastpid);
+			int index = Process_getIndex(processes, lastpid);
+			Stats_record(STATS_BG_LIFETIME, Stats_now() - Process_getStartTime(DynArray_get(processes,index)));
+			Process_terminate(processes,lastpid,status);
+			/* fg took the status, so wait does not */
+			Process_waitPid(processes,lastpid,&status);
+			status = Exec_exitStatus(status);
+		}
+		else{
+			fprintf(stdout, "%s: There is no background process.\n", SYSTEM_NAME);
+			status = 1;
+		}
+		sigprocmask(SIG_SETMASK, &sOldSet, NULL);
+	}
+	/* exec [command [arg ...]] [< file] [> file]: replace the shell with command, or redirect the shell itself */
+	else if (strcmp(command, "exec") == 0)
+	{
+		status = Shell_exec();
+	}
+	/* source file: run the lines of file in this shell */
+	else if (strcmp(command, "source") == 0)
+	{
+		status = Shell_source();
+	}
+	/* wait [-n] [%job | pid ...]: wait for background jobs and return their exit status */
+	else if (strcmp(command, "wait") == 0)
+	{
+		status = Shell_wait();
+	}
+	/* jobs: list the background processes that are still running, with the usage of their cgroup if any */
+	else if (strcmp(command, "jobs") == 0)
+	{
+		status = Shell_jobs(stdout);
+	}
+	/* stats [-j] [-r]: print the counters and latency histograms of the session, as JSON with -j. -r resets them afterwards. */
+	else if (strcmp(command, "stats") == 0)
+	{
+		status = Shell_stats(stdout);
+	}
+	else iBuiltIn = 0;
+
+	if(iBuiltIn == 1) Stats_count(STATS_BUILTINS, 1);
+	
+	if(iBuiltIn == 0){
+		struct Pipeline *psPipeline;
+		struct Definition *psFunction;
+		struct Feed *psFeeds = NULL;
+		int aiStdFds[3] = {0, 1, 2};
+		int *piPids;
+		int iSpawned, iJob, iInShell = 0, iFeeds = 0, iLastWait = 0;
+		long long llSpawn;
+		
+		// Clear the stdout buffer, the only one the shell fills; stderr is unbuffered
+		fflush(stdout);
+		
+		psPipeline = Plan_makePipeline(tokens, Shell_runsInShell, errMsg);
+		if (psPipeline == NULL)
+		{
+			fprintf(stderr, "%s: %s\n", SYSTEM_NAME, errMsg);
+			if(iCgroupFd != -1) close(iCgroupFd);
+			if(iCgroupCreated) rmdir(pcCgroup);
+			free(pcCgroup);
+			return 2;
+		}
+
+		/* A shell function runs in the shell, unless it needs a child of its own for a pipe, a redirection,
+			the background or a cgroup */
+		for(i=0;i<psPipeline->iStages;i++)
+		{
+			psFunction = Define_get(DEFINE_FUNCTION, psPipeline->psStages[i].ppcArgv[0]);
+			if(psFunction == NULL) continue;
+			psPipeline->psStages[i].pfRun = Shell_runFunction;
+			psPipeline->psStages[i].pvRun = psFunction;
+		}
+		/* So does a built-in stage that only prints, unless the pipeline runs in the background or in a cgroup,
+			which the shell does not wait for or join. One that changes the shell runs in its child, where the change
+			is lost, as a function's would be. */
+		for(i=0;psPipeline->iStages>1 && i<psPipeline->iStages;i++)
+		{
+			if(!Shell_isStageBuiltin(psPipeline->psStages[i].ppcArgv[0])) continue;
+			psPipeline->psStages[i].pfRun = Shell_runBuiltinChild;
+			psPipeline->psStages[i].pvRun = NULL;
+			if(Shell_isOutputStage(&psPipeline->psStages[i]) && psPipeline->iBackground == 0 && iCgroupFd == -1)
+				iInShell = 1;
+		}
+		if(psPipeline->iStages == 1 && psPipeline->psStages[0].pfRun != NULL && psPipeline->pcInput == NULL \
+			&& psPipeline->pcOutput == NULL && psPipeline->iBackground == 0 && iCgroupFd == -1)
+		{
+			status = Shell_callFunction(psPipeline->psStages[0].pvRun, psPipeline->psStages[0].ppcArgv,
+				psPipeline->psStages[0].iArgc);
+			Plan_freePipeline(psPipeline);
+			free(pcCgroup);
+			return status;
+		}
+
+		/* The simple command that ends a non-interactive run replaces the shell, which would only wait for it, unless
+			the shell has something left to do at exit: a zygote, a trace or the --memstats report */
+		if(iTail && psPipeline->iStages == 1 && psPipeline->psStages[0].pfRun == NULL && psPipeline->iBackground == 0 \
+			&& iCgroupFd == -1 && iSubstitutions == 0 && !Zygote_isRunning() && iTraceFd < 0 && iMemstatsPid != getpid())
+		{
+			if(oStdin != NULL) Input_sync(oStdin);
+			status = Exec_replace(psPipeline);
+			Plan_freePipeline(psPipeline);
+			free(pcCgroup);
+			return status;
+		}
+
+		piPids = (int *)malloc(psPipeline->iStages * sizeof(int));
+		if (iInShell) psFeeds = (struct Feed *)malloc(psPipeline->iStages * sizeof(struct Feed));
+		if (piPids == NULL || (iInShell && psFeeds == NULL))
+		{
+			fprintf(stderr, "Cannot allocate memory\n");
+			exit(EXIT_FAILURE);
+		}
+		psPipeline->iCgroupFd = iCgroupFd;
+		psPipeline->piInherit = aiSubstFds;
+		psPipeline->iInherit = iSubstitutions;
+
+		Shell_reclaimProcesses();
+
+		/* Keep SIGCHLD_handler away until every child is in the process table */
+		sigset_t sSet, sOldSet;
+		sigemptyset(&sSet);
+		sigaddset(&sSet, SIGCHLD);
+		sigprocmask(SIG_BLOCK, &sSet, &sOldSet);
+
+		// Fork child process to do the command. A child reading stdin starts after the lines the shell took.
+		if(oStdin != NULL) Input_sync(oStdin);
+		llSpawn = Stats_now();
+		if(iInShell) iSpawned = Shell_spawnMixed(psPipeline, aiStdFds, piPids, &iLastWait, psFeeds, &iFeeds);
+		else iSpawned = Exec_spawnPipeline(psPipeline, aiStdFds, piPids);
+		if(iSpawned > 0) Stats_record(STATS_SPAWN, Stats_now() - llSpawn);
+		iJob = (psPipeline->iBackground == 0) ? 0 : Process_nextJob(processes);
+		for(i=0;i<iSpawned;i++)
+		{
+			if(piPids[i] == -1) continue;
+			if(psPipeline->iBackground == 0) Process_add(processes, piPids[i], PROCESS_FG);
+			else Process_add(processes, piPids[i], PROCESS_BG);
+			if(iJob != 0) Process_setJob(processes, piPids[i], iJob);
+			if(pcCgroup != NULL) Process_setCgroup(processes, piPids[i], pcCgroup, iCgroupCreated);
+		}
+		if(iSpawned == 0 && iCgroupCreated) rmdir(pcCgroup);
+		
+		/* SIGCHLD stays blocked so that the handler cannot take the exit status of a foreground child */
+		if( psPipeline->iBackground == 0 )
+		{
+			/* The output of the built-ins goes to the stages while they run, so that neither side waits for the other */
+			Exec_feedPipes(psFeeds, iFeeds);
+			for(i=0;i<iSpawned;i++)
+			{
+				long long llWait;
+				if(piPids[i] == -1)
+				{
+					status = iLastWait;
+					continue;
+				}
+				llWait = TRACE_BEGIN();
+				waitpid(piPids[i], &status, 0);
+				TRACE_END("wait", llWait, piPids[i], i);
+				Process_terminate(processes, piPids[i], status);
+			}
+			status = (iSpawned == psPipeline->iStages) ? Exec_exitStatus(status) : 1;
+			if(oStdin != NULL) Input_resume(oStdin);
+			if(iSpawned > 0) Stats_record(STATS_FG_WALL, Stats_now() - llSpawn);
+		}
+		// So there is no action for background
+		sigprocmask(SIG_SETMASK, &sOldSet, NULL);
+
+		for(i=0;i<iFeeds;i++) free((char *)psFeeds[i].pcData);
+		free(psFeeds);
+		free(piPids);
+		Plan_freePipeline(psPipeline);
+	}
+	else if (iCgroupFd != -1)
+	{
+		close(iCgroupFd);
+		if(iCgroupCreated) rmdir(pcCgroup);
+	}
+	free(pcCgroup);
+
+	return status;
+}
+
+/* Run the command of a process substitution, the string pvRun, in its forked child, whose stdin or stdout is the
+	pipe. The shell's ends of the substitutions are closed first, so that no pipe is held open by a command that
+	does not use it. Return its exit status. */
+static int Shell_runSubstitution(void *pvRun, char **ppcArgv, int iArgc)
+{
+	int i;
+
+	for(i=0;i<iSubstitutions;i++) close(aiSubstFds[i]);
+	iSubstitutions = 0;
+	Zygote_detach();
+	/* The child runs nothing after the line, whose last command may replace it */
+	iFinalLine = 1;
+	iTailExec = 0;
+	/* A quote left open is an error rather than a read of the script */
+	oInput = NULL;
+	return Shell_executeLine((char *)pvRun);
+}
+
+/* Start the command of the process substitution pvToken, "<(command)" or ">(command)", as a child in the process
+	table connected to a pipe, and return a new word "/dev/fd/N" that names the shell's end of the pipe, which the
+	stages inherit. Return NULL with a message if the command could not be started. */
+static void *Shell_substitute(void *pvToken)
+{
+	struct Pipeline sPipeline;
+	struct Stage sStage;
+	char *apcArgv[2], acPath[32];
+	int p[2], aiFds[3] = {0, 1, 2}, iChildEnd, pid = -1;
+	sigset_t sSet, sOldSet;
+
+	if(iSubstitutions == MAX_SUBSTITUTIONS)
+	{
+		fprintf(stderr, "%s: too many process substitutions\n", SYSTEM_NAME);
+		return NULL;
+	}
+	if(pipe2(p, O_CLOEXEC) == -1)
+	{
+		perror("pipe");
+		return NULL;
+	}
+	/* <(command) writes what the pipeline reads, and >(command) reads what it writes */
+	iChildEnd = (Token_getType(pvToken) == TOKEN_SUBIN) ? 1 : 0;
+	aiFds[iChildEnd] = p[iChildEnd];
+	aiSubstFds[iSubstitutions++] = p[1 - iChildEnd];
+
+	apcArgv[0] = Token_getValue(pvToken);
+	apcArgv[1] = NULL;
+	memset(&sStage, 0, sizeof(sStage));
+	sStage.ppcArgv = apcArgv;
+	sStage.iArgc = 1;
+	sStage.pfRun = Shell_runSubstitution;
+	sStage.pvRun = Token_getValue(pvToken);
+	memset(&sPipeline, 0, sizeof(sPipeline));
+	sPipeline.iStages = 1;
+	sPipeline.psStages = &sStage;
+	sPipeline.iCgroupFd = -1;
+
+	fflush(stdout);
+	Shell_reclaimProcesses();
+	sigemptyset(&sSet);
+	sigaddset(&sSet, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &sSet, &sOldSet);
+	if(Exec_spawnPipeline(&sPipeline, aiFds, &pid) == 1) Process_add(processes, pid, PROCESS_FG);
+	else pid = -1;
+	sigprocmask(SIG_SETMASK, &sOldSet, NULL);
+	close(p[iChildEnd]);
+
+	if(pid == -1)
+	{
+		close(aiSubstFds[--iSubstitutions]);
+		return NULL;
+	}
+	aiSubstPids[iSubstitutions - 1] = pid;
+	snprintf(acPath, sizeof(acPath), "/dev/fd/%d", p[1 - iChildEnd]);
+	return makeToken(TOKEN_WORD, acPath);
+}
+
+/* Close the shell's ends of the process substitutions from iFirst on, so that their commands see the end of their
+	input or a closed output, and unless the pipeline ran in the background, wait for those commands. */
+static void Shell_endSubstitutions(int iFirst, int iBackground)
+{
+	sigset_t sSet, sOldSet;
+	int i, index, iWait;
+
+	for(i=iFirst;i<iSubstitutions;i++) close(aiSubstFds[i]);
+	if(!iBackground)
+	{
+		/* Those that exited already were reaped by SIGCHLD_handler */
+		sigemptyset(&sSet);
+		sigaddset(&sSet, SIGCHLD);
+		sigprocmask(SIG_BLOCK, &sSet, &sOldSet);
+		for(i=iFirst;i<iSubstitutions;i++)
+		{
+			index = Process_getIndex(processes, aiSubstPids[i]);
+			if(index == -1 || Process_getType(DynArray_get(processes,index)) != PROCESS_FG) continue;
+			waitpid(aiSubstPids[i], &iWait, 0);
+			Process_terminate(processes, aiSubstPids[i], iWait);
+		}
+		sigprocmask(SIG_SETMASK, &sOldSet, NULL);
+	}
+	iSubstitutions = iFirst;
+}
+
+/* Replace each alias that starts a stage of tokens by its tokens, expand the variables of the words, so that
+	built-ins see their values too, start the process substitutions and run the pipeline. Return the exit status
+	of the pipeline. */
+static int Shell_executePipeline(void)
+{
+	DynArray_T oExpanded = NULL, oAliases = NULL;
+	struct Definition *psAlias;
+	DynArray_T oValue;
+	void *pvToken, *pvExpanded;
+	int status = 1, i, j, iOuterSubstitutions = iSubstitutions, iBackground;
+
+	/* The tokens of an alias stay owned by its definition, held until the pipeline ran */
+	for (i = 0; i < DynArray_getLength(tokens); i++)
+	{
+		if (i > 0 && Token_getType(DynArray_get(tokens, i - 1)) != TOKEN_P) continue;
+		pvToken = DynArray_get(tokens, i);
+		if (Token_getType(pvToken) != TOKEN_WORD) continue;
+		psAlias = Define_get(DEFINE_ALIAS, Token_getValue(pvToken));
+		if (psAlias == NULL) continue;
+		if (oAliases == NULL) oAliases = DynArray_new(0);
+		if (oAliases == NULL || !DynArray_add(oAliases, psAlias)) goto NOMEM;
+		Define_hold(psAlias);
+		oValue = Define_getTokens(psAlias);
+		DynArray_removeAt(tokens, i);
+		for (j = 0; j < DynArray_getLength(oValue); j++)
+			if (!DynArray_addAt(tokens, i + j, DynArray_get(oValue, j))) goto NOMEM;
+		i += j - 1;
+	}
+
+	for (i = 0; i < DynArray_getLength(tokens); i++)
+	{
+		pvToken = DynArray_get(tokens, i);
+		if (Token_getType(pvToken) != TOKEN_WORD) continue;
+		pvExpanded = Token_expandVariables(pvToken);
+		if (pvExpanded == pvToken) continue;
+		if (oExpanded == NULL) oExpanded = DynArray_new(0);
+		if (pvExpanded == NULL || oExpanded == NULL || !DynArray_add(oExpanded, pvExpanded)) goto NOMEM;
+		DynArray_set(tokens, i, pvExpanded);
+	}
+
+	/* The pipeline gets the names of the pipes of its process substitutions */
+	iBackground = Token_getType(DynArray_get(tokens, DynArray_getLength(tokens) - 1)) == TOKEN_BG;
+	for (i = 0; i < DynArray_getLength(tokens); i++)
+	{
+		pvToken = DynArray_get(tokens, i);
+		if (Token_getType(pvToken) != TOKEN_SUBIN && Token_getType(pvToken) != TOKEN_SUBOUT) continue;
+		pvExpanded = Shell_substitute(pvToken);
+		if (pvExpanded == NULL) break;
+		if (oExpanded == NULL) oExpanded = DynArray_new(0);
+		if (oExpanded == NULL || !DynArray_add(oExpanded, pvExpanded)) goto NOMEM;
+		DynArray_set(tokens, i, pvExpanded);
+	}
+
+	if (i == DynArray_getLength(tokens)) status = Shell_runPipeline();
+	Shell_endSubstitutions(iOuterSubstitutions, iBackground);
+
+	if (oExpanded != NULL)
+	{
+		DynArray_map(oExpanded, freeToken, NULL);
+		DynArray_free(oExpanded);
+	}
+	if (oAliases != NULL)
+	{
+		for (i = 0; i < DynArray_getLength(oAliases); i++) Define_release(DynArray_get(oAliases, i));
+		DynArray_free(oAliases);
+	}
+	return status;
+
+	NOMEM:
+	fprintf(stderr, "Cannot allocate memory\n");
+	exit(EXIT_FAILURE);
+}
+
+/* Run the plan tree psBlock of the tokens oLine and return its exit status. A pipeline is copied into tokens
+	and run as usual; loops only expand their words again, and stop once SIGINT was received. */
+static int Shell_runBlock(struct Block *psBlock, DynArray_T oLine)
+{
+	struct Block *psBody;
+	DynArray_T oBody;
+	void *pvToken;
+	char **ppcWords;
+	int status = 0, iWords, i;
+
+	switch(psBlock->eType)
+	{
+		case BLOCK_PIPELINE:
+			DynArray_clear(tokens);
+			for(i=psBlock->iStart;i<psBlock->iEnd;i++)
+			{
+				if(!DynArray_add(tokens, DynArray_get(oLine,i)))
+				{
+					fprintf(stderr, "Cannot allocate memory\n");
+					exit(EXIT_FAILURE);
+				}
+			}
+			return Shell_executePipeline();
+
+		case BLOCK_SEQUENCE:
+			for(i=0;i<psBlock->iBlocks && !iInterrupted;i++)
+			{
+				if(psBlock->peOperators[i] == TOKEN_SEMI || (psBlock->peOperators[i] == TOKEN_AND && status == 0) \
+					|| (psBlock->peOperators[i] == TOKEN_OR && status != 0))
+					status = Shell_runBlock(psBlock->ppsBlocks[i], oLine);
+			}
+			return status;
+
+		case BLOCK_FOR:
+			if(DynArray_getLength(psBlock->oWords) == 0) return 0;
+			ppcWords = Token_getComm(psBlock->oWords, 0, &iWords);
+			if(ppcWords == NULL)
+			{
+				fprintf(stderr, "Cannot allocate memory\n");
+				exit(EXIT_FAILURE);
+			}
+			for(i=0;i<iWords && !iInterrupted;i++)
+			{
+				setenv(psBlock->pcName, ppcWords[i], 1);
+				status = Shell_runBlock(psBlock->psBody, oLine);
+			}
+			Alloc_free(ppcWords);
+			return status;
+
+		case BLOCK_WHILE:
+			while(!iInterrupted && Shell_runBlock(psBlock->psCondition, oLine) == 0 && !iInterrupted)
+				status = Shell_runBlock(psBlock->psBody, oLine);
+			return status;
+
+		case BLOCK_IF:
+			if(Shell_runBlock(psBlock->psCondition, oLine) == 0) return Shell_runBlock(psBlock->psBody, oLine);
+			if(psBlock->psElse != NULL) return Shell_runBlock(psBlock->psElse, oLine);
+			return 0;
+
+		case BLOCK_GROUP:
+			return Shell_runBlock(psBlock->psBody, oLine);
+
+		case BLOCK_FUNCTION:
+			/* The definition keeps a copy of the body and its plan tree, parsed once here */
+			oBody = DynArray_new(0);
+			if(oBody == NULL)
+			{
+				fprintf(stderr, "Cannot allocate memory\n");
+				exit(EXIT_FAILURE);
+			}
+			for(i=psBlock->iStart;i<psBlock->iEnd;i++)
+			{
+				pvToken = Token_copy(DynArray_get(oLine,i));
+				if(pvToken == NULL || !DynArray_add(oBody, pvToken))
+				{
+					fprintf(stderr, "Cannot allocate memory\n");
+					exit(EXIT_FAILURE);
+				}
+			}
+			psBody = Block_parse(oBody, errMsg);
+			if(psBody == NULL || !Define_set(DEFINE_FUNCTION, psBlock->pcName, NULL, oBody, psBody))
+			{
+				fprintf(stderr, "%s: %s\n", SYSTEM_NAME, (psBody == NULL) ? errMsg : "Cannot allocate memory");
+				if(psBody == NULL)
+				{
+					DynArray_map(oBody, freeToken, NULL);
+					DynArray_free(oBody);
+				}
+				return 2;
+			}
+			return 0;
+	}
+	return status;
+}
+
+/* Lex the iLength characters of pcLine into oTokens as lexLine does, but while a quote is left open at the end of
+	a line, read the next one after a "> " prompt and go on with it, so that a quoted word may span lines. Each
+	character is lexed once, where it was read. Return 1 (TRUE) if successful, or 0 (FALSE) with a message in
+	errMsg, which is empty for an empty line. */
+static int Shell_lexLine(const char *pcLine, size_t iLength, DynArray_T oTokens)
+{
+	enum LexStatus eStatus;
+
+	if(psLexer == NULL && (psLexer = Lexer_new()) == NULL)
+	{
+		strcpy(errMsg,"Cannot allocate memory");
+		return 0;
+	}
+	/* The lexer keeps the open word, so the line may be dropped by the next read */
+	while((eStatus = Lexer_feed(psLexer, pcLine, iLength, oTokens, errMsg)) == LEX_MORE)
+	{
+		if(oInput == NULL || (pcLine = Shell_readLine("> ", &iLength)) == NULL)
+		{
+			Lexer_reset(psLexer);
+			strcpy(errMsg,"Could not find quote pair");
+			return 0;
+		}
+	}
+	return eStatus == LEX_DONE;
+}
+
+/* Read the rest of the blocks started in oLine, which are iNesting deep, and the body of a function whose
+	"name()" ends it, then parse the whole command list into a plan tree and run it. Each line is lexed once,
+	and its tokens are appended to oLine after a ';' unless the previous line ended with do, then, else, '{'
+	or "name()". Return the exit status. */
+static int Shell_executeBlock(DynArray_T oLine, int iNesting)
+{
+	const char *pcLine;
+	size_t iLength;
+	DynArray_T oNext;
+	struct Block *psBlock;
+	struct Token *psSemi;
+	int status, iCompound, i;
+
+	while(iNesting > 0 || Block_needsBody(oLine))
+	{
+		if(oInput == NULL || (pcLine = Shell_readLine("> ", &iLength)) == NULL)
+		{
+			fprintf(stderr, "%s: Unterminated for, while or if\n", SYSTEM_NAME);
+			return 2;
+		}
+		oNext = DynArray_new(0);
+		if(oNext == NULL)
+		{
+			fprintf(stderr, "Cannot allocate memory\n");
+			exit(EXIT_FAILURE);
+		}
+		if(!Shell_lexLine(pcLine, iLength, oNext))
+		{
+			DynArray_map(oNext, freeToken, NULL);
+			DynArray_free(oNext);
+			/* An empty line */
+			if(strcmp(errMsg,"") == 0) continue;
+			fprintf(stderr, "%s: %s\n", SYSTEM_NAME, errMsg);
+			Stats_count(STATS_LEX_ERRORS, 1);
+			return 2;
+		}
+		iNesting += Block_nesting(oNext, &iCompound);
+
+		if(Block_needsSeparator(oLine))
+		{
+			psSemi = makeToken(TOKEN_SEMI, ";");
+			if(psSemi == NULL || !DynArray_add(oLine, psSemi))
+			{
+				fprintf(stderr, "Cannot allocate memory\n");
+				exit(EXIT_FAILURE);
+			}
+		}
+		for(i=0;i<DynArray_getLength(oNext);i++)
+		{
+			if(!DynArray_add(oLine, DynArray_get(oNext,i)))
+			{
+				fprintf(stderr, "Cannot allocate memory\n");
+				exit(EXIT_FAILURE);
+			}
+		}
+		DynArray_free(oNext);
+	}
+
+	psBlock = Block_parse(oLine, errMsg);
+	if(psBlock == NULL)
+	{
+		fprintf(stderr, "%s: %s\n", SYSTEM_NAME, errMsg);
+		return 2;
+	}
+	iInterrupted = 0;
+	status = Shell_runBlock(psBlock, oLine);
+	Block_free(psBlock);
+	return status;
+}
+
+/* Clear oLine and tokens and keep them for the next line, or free them if a nested line already did.
+	Restore tokens to oOuterTokens, the pipeline of the line that is running this one, if any. */
+static void Shell_releaseArrays(DynArray_T oLine, DynArray_T oOuterTokens)
+{
+	DynArray_clear(oLine);
+	DynArray_clear(tokens);
+	if(oSpareLine == NULL) oSpareLine = oLine;
+	else DynArray_free(oLine);
+	if(oSparePipeline == NULL) oSparePipeline = tokens;
+	else DynArray_free(tokens);
+	tokens = oOuterTokens;
+}
+
+/* Tokenize the iLength characters of pcLine and run the pipelines of its command list in order. A pipeline after
+	"&&" runs only if the previous one succeeded, and after "||" only if it failed. Return the exit status of the
+	last pipeline run. */
+static int Shell_executeText(const char *pcLine, size_t iLength)
+{
+	DynArray_T oLine, oOuterTokens = tokens;
+	enum TokenType eOperator = TOKEN_SEMI;
+	int status = 0, iSuccessful, iTokens, iStart, i, j, iNesting, iCompound;
+	long long llStart;
+
+	// Allocate memory for tokens, unless the arrays of the previous line can be reused
+	oLine = (oSpareLine != NULL) ? oSpareLine : DynArray_new(0);
+	tokens = (oSparePipeline != NULL) ? oSparePipeline : DynArray_new(0);
+	oSpareLine = oSparePipeline = NULL;
+	if (oLine == NULL || tokens == NULL)
+	{
+		fprintf(stderr, "Cannot allocate memory\n");
+		exit(EXIT_FAILURE);
+	}
+	
+	/* Tokenize string in acLine into token and save in oLine
+		It also checks correctness of the syntax. */
+	llStart = TRACE_BEGIN();
+	iSuccessful = Shell_lexLine(pcLine, iLength, oLine);
+	TRACE_END("lexLine", llStart, -1, -1);
+	if (!iSuccessful) {
+		DynArray_map(oLine, freeToken, NULL);
+		Shell_releaseArrays(oLine, oOuterTokens);
+		if(strcmp(errMsg,"") != 0){
+			fprintf(stderr,"%s: %s\n",SYSTEM_NAME,errMsg);
+			Stats_count(STATS_LEX_ERRORS, 1);
+			return 2;
+		}
+		return 0;
+	}
+
+	/* A line with for, while or if is read up to the end of its blocks and run as a plan tree */
+	iNesting = Block_nesting(oLine, &iCompound);
+	if(iCompound)
+	{
+		status = Shell_executeBlock(oLine, iNesting);
+		Wildcard_flushCache();
+		DynArray_map(oLine, freeToken, NULL);
+		Shell_releaseArrays(oLine, oOuterTokens);
+		return status;
+	}
+
+	/* tokens holds one pipeline at a time; the tokens themselves stay owned by oLine */
+	iTokens = DynArray_getLength(oLine);
+	iStart = 0;
+	for(i=0;i<=iTokens;i++)
+	{
+		if(i < iTokens && !Token_isListOperator(DynArray_get(oLine,i))) continue;
+
+		if(i > iStart && (eOperator == TOKEN_SEMI || (eOperator == TOKEN_AND && status == 0) \
+			|| (eOperator == TOKEN_OR && status != 0)))
+		{
+			DynArray_clear(tokens);
+			for(j=iStart;j<i;j++)
+			{
+				if(!DynArray_add(tokens, DynArray_get(oLine,j)))
+				{
+					fprintf(stderr, "Cannot allocate memory\n");
+					exit(EXIT_FAILURE);
+				}
+			}
+			iTailExec = iFinalLine && i == iTokens;
+			status = Shell_executePipeline();
+			iTailExec = 0;
+		}
+
+		if(i < iTokens) eOperator = Token_getType(DynArray_get(oLine,i));
+		iStart = i+1;
+	}
+
+	// The directories read for globs are cached for this line only
+	Wildcard_flushCache();
+	DynArray_map(oLine, freeToken, NULL);
+	Shell_releaseArrays(oLine, oOuterTokens);
+	return status;
+}
+
+/* Run the command line acLine, a string, as Shell_executeText does */
+static int Shell_executeLine(char *acLine)
+{
+	return Shell_executeText(acLine, strlen(acLine));
+}
+
+/* Return the next line of oInput, after pcPrompt if it is stdin, and store its length in *piLength. The line is
+	valid until the next read. Lines read from a file are echoed after the prompt if iEchoInput is set. The job
+	notices queued meanwhile are written first. While the read blocks, notices are written as they come, except
+	to the line editor, which would lose its display. Return NULL at EOF. */
+static const char *Shell_readLine(const char *pcPrompt, size_t *piLength)
+{
+	static char acEdited[MAX_LINE_SIZE];
+	const char *pcLine;
+	long long llStart;
+
+	fflush(stdout);
+	Shell_recordReaps();
+	Output_drain();
+
+	/* A terminal gets the line editor, which writes the prompt itself */
+	if(oInput == oStdin && iEditor)
+	{
+		pcLine = Edit_readLine(pcPrompt, acEdited, MAX_LINE_SIZE);
+		if(pcLine != NULL) *piLength = strlen(pcLine);
+		return pcLine;
+	}
+	if(oInput == oStdin){
+		fputs(pcPrompt, stdout);
+		fflush(stdout);
+	}
+	llStart = TRACE_BEGIN();
+	Output_setIdle(1);
+	pcLine = Input_readLine(oInput, piLength);
+	Output_setIdle(0);
+	TRACE_END("read", llStart, -1, -1);
+
+	if(pcLine != NULL && oInput != oStdin && iEchoInput){
+		fputs(pcPrompt, stdout);
+		fwrite(pcLine, 1, *piLength, stdout);
+		fflush(stdout);
+	}
+	return pcLine;
+}
+
+/* Read lines from oFile and execute them until EOF. Lines read from a file are echoed after the prompt if iEcho
+	is set. Return the exit status of the last line. */
+static int Shell_readLoop(Input_T oFile, int iEcho)
+{
+	const char *pcLine;
+	size_t iLength;
+	Input_T oOuterInput = oInput;
+	int iOuterEcho = iEchoInput, status = 0;
+
+	oInput = oFile;
+	iEchoInput = iEcho;
+	while((pcLine = Shell_readLine("% ", &iLength)) != NULL)
+	{
+		iFinalLine = oFile == oTailInput && Input_atEnd(oFile);
+		status = Shell_executeText(pcLine, iLength);
+	}
+	iFinalLine = 0;
+	oInput = oOuterInput;
+	iEchoInput = iOuterEcho;
+	return status;
+}
+
+/* source file: run the lines of file in this shell, with the file mapped rather than read. Return the exit status
+	of the last line, or 1 if file cannot be read. */
+static int Shell_source(void)
+{
+	Input_T oFile;
+	const char *pcPath;
+	int status;
+
+	if (number_token != 2 || Token_getType(DynArray_get(tokens, 1)) != TOKEN_WORD)
+	{
+		fprintf(stderr, "%s: source: usage: source file\n", SYSTEM_NAME);
+		return 2;
+	}
+	if (iSourceDepth == MAX_SOURCE_DEPTH)
+	{
+		fprintf(stderr, "%s: source: maximum nesting exceeded\n", SYSTEM_NAME);
+		return 2;
+	}
+	pcPath = Token_getValue(DynArray_get(tokens, 1));
+	oFile = Input_open(pcPath);
+	if (oFile == NULL)
+	{
+		fprintf(stderr, "%s: source: %s: %s\n", SYSTEM_NAME, pcPath, strerror(errno));
+		return 1;
+	}
+	iSourceDepth++;
+	status = Shell_readLoop(oFile, 0);
+	iSourceDepth--;
+	Input_free(oFile);
+	return status;
+}
+
+/* Print the allocation accounting of the lexer, planner and job table to stderr when the shell exits, for
+	--memstats. Forked children that exit through exit() print nothing. */
+static void Shell_printMemstats(void)
+{
+	if(getpid() != iMemstatsPid) return;
+	fflush(stdout);
+	Alloc_print(stderr, 0);
+}
+
+int main(int argc, char *argv[])
+
+/* Read a line from stdin, and write to stdout each number and word
+   that it contains.  Repeat until EOF.  Return 0 iff successful. */
+
+{
+	int status;
+
+	/*
+		ish --memstats ...: print the live allocations of the lexer, planner and job table on exit
+	*/
+	if(argc >= 2 && strcmp(argv[1], "--memstats") == 0)
+	{
+		iMemstatsPid = getpid();
+		atexit(Shell_printMemstats);
+		argv++;
+		argc--;
+	}
+
+	/*
+		ish --client SOCKET [LINE]: send command lines to a running server
+	*/
+	if(argc >= 3 && strcmp(argv[1], "--client") == 0)
+	{
+		return Client_run(argv[2], argc >= 4 ? argv[3] : NULL);
+	}
+	else if(argc > 1 && !(argc == 2 && argv[1][0] != '-') \
+		&& !(argc == 3 && (strcmp(argv[1], "--serve") == 0 || strcmp(argv[1], "-c") == 0)))
+	{
+		fprintf(stderr, "Usage: %s [--memstats] [FILE | -c LINE | --serve SOCKET | --client SOCKET [LINE]]\n", SYSTEM_NAME);
+		return EXIT_FAILURE;
+	}
+
+	/*
+		ISH_ZYGOTE: fork commands from a helper started while the shell is still small
+	*/
+	if(argc <= 2 && getenv("ISH_ZYGOTE") != NULL) iZygotePid = Zygote_start();
+
+	/*
+		ISH_TRACE=file.json: write a Chrome trace of each command line
+	*/
+	if(getenv("ISH_TRACE") != NULL && !Trace_open(getenv("ISH_TRACE")))
+		fprintf(stderr, "%s: %s: %s\n", SYSTEM_NAME, getenv("ISH_TRACE"), strerror(errno));
+
+	/*
+		Make sure that SIGINT, SIGQUIT, SIGALRM are not blocked
+	*/
+	sigset_t sSet;
+	sigemptyset(&sSet);
+	sigaddset(&sSet, SIGINT);
+	sigaddset(&sSet, SIGQUIT);
+	sigaddset(&sSet, SIGALRM);
+	sigprocmask(SIG_UNBLOCK, &sSet, NULL);
+	
+	errMsg = (char *)malloc(MAX_ERROR_SIZE*sizeof(char));
+
+	/*
+		initiate process array
+	*/
+	processes = Process_init(0); 
+
+	/*
+		Setup signal handler for each signal
+	*/
+	signal(SIGCHLD, SIGCHLD_handler);
+	signal(SIGINT, SIGINT_handler);
+	signal(SIGQUIT, SIGQUIT_handler1);
+	signal(SIGALRM, SIGALRM_handler);
+	
+	/* 
+		Open ".ishrc" in the home directory 
+		If .ishrc is not found, the file descriptor is set to stdin
+	*/
+	char *ishrc_filepath = (char *)malloc(MAX_PATH_SIZE * sizeof(char));
+	strcpy(ishrc_filepath, getenv("HOME"));
+	strcat(ishrc_filepath, "/.ishrc");
+	Input_T oRc = Input_open(ishrc_filepath);
+
+	if (oRc == NULL){
+		if(argc == 1) fprintf(stderr,"%s: .ishrc file is not found so the system automatically redirects to stdin.\n",SYSTEM_NAME);
+	}
+	else
+	{
+		Shell_readLoop(oRc, 1);
+		Input_free(oRc);
+	}
+	free(ishrc_filepath);
+
+	/*
+		ish -c LINE: run the command line LINE, whose last command replaces the shell
+	*/
+	if(argc == 3 && strcmp(argv[1], "-c") == 0)
+	{
+		iFinalLine = 1;
+		status = Shell_executeLine(argv[2]);
+		free(errMsg);
+		return status;
+	}
+
+	/*
+		ish --serve SOCKET: keep .ishrc settings and serve command lines to clients
+	*/
+	if(argc == 3) return Server_run(argv[2], Shell_executeLine, Shell_needsShell);
+	
+	/*
+		ish FILE: run the script FILE instead of reading stdin, and exit with the status of its last command
+	*/
+	if(argc == 2)
+	{
+		Input_T oScript = Input_open(argv[1]);
+		if(oScript == NULL)
+		{
+			fprintf(stderr, "%s: %s: %s\n", SYSTEM_NAME, argv[1], strerror(errno));
+			return EXIT_FAILURE;
+		}
+		oTailInput = oScript;
+		status = Shell_readLoop(oScript, 0);
+		Input_free(oScript);
+		free(errMsg);
+		return status;
+	}
+
+	iEditor = Edit_isTerminal();
+	/* A script on stdin is mapped if it is a file and read in blocks otherwise */
+	oStdin = Input_fromFd(STDIN_FILENO);
+	if(oStdin == NULL)
+	{
+		fprintf(stderr, "Cannot allocate memory\n");
+		exit(EXIT_FAILURE);
+	}
+	/* Only a script that is not typed ends with a command that may replace the shell */
+	if(!iEditor) oTailInput = oStdin;
+	status = Shell_readLoop(oStdin, 1);
+	Input_free(oStdin);
+	
+	free(errMsg);
+
+	return status;
+}
@@ -0,0 +1,133 @@
+#include "output.h"
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+
+/*--------------------------------------------------------------------*/
+
+/* Size of the ring: enough for a couple of thousand job notices
+   between two prompts */
+enum {RING_SIZE = 1 << 16};
+
+/* Longest notice reporting lost notices */
+enum {MAX_LOST_SIZE = 64};
+
+/* The ring holds the bytes from iTail up to iHead, wrapping around, and
+   is full one byte short of RING_SIZE.  Output_post, the only
+   producer, only moves iHead, and the main loop, the only consumer,
+   only iTail, so neither needs a lock: a handler that interrupts the
+   main loop at worst sees less free space, and the main loop fewer
+   bytes, than there are. */
+static char acRing[RING_SIZE];
+static volatile sig_atomic_t iHead, iTail;
+
+/* Notices dropped because the ring was full, counted by Output_post,
+   and those already reported by Output_drain */
+static volatile sig_atomic_t iLost;
+static int iLostReported;
+
+/* 1 while the main loop waits for input, so that a notice is written
+   by Output_post itself */
+static volatile sig_atomic_t iIdle;
+
+/* Where Output_drain gathers the notices for its write() */
+static char acOut[RING_SIZE + MAX_LOST_SIZE];
+
+/*--------------------------------------------------------------------*/
+
+static void Output_write(const char *pcBytes, int iLen)
+
+/* Write the iLen bytes of pcBytes to stdout, retrying short writes. */
+
+{
+	int iWritten;
+
+	while(iLen > 0)
+	{
+		iWritten = write(1, pcBytes, iLen);
+		if(iWritten <= 0) return;
+		pcBytes += iWritten;
+		iLen -= iWritten;
+	}
+}
+
+/*--------------------------------------------------------------------*/
+
+void Output_post(const char *pcMessage, int iLen)
+
+/* Queue the iLen bytes of pcMessage. */
+
+{
+	int iStart = iHead, iFirst;
+
+	assert(pcMessage != NULL);
+
+	if(iIdle)
+	{
+		Output_write(pcMessage, iLen);
+		return;
+	}
+	if(iLen > RING_SIZE - 1 - (iStart - iTail + RING_SIZE) % RING_SIZE)
+	{
+		iLost++;
+		return;
+	}
+	iFirst = (iLen < RING_SIZE - iStart) ? iLen : RING_SIZE - iStart;
+	memcpy(acRing + iStart, pcMessage, iFirst);
+	memcpy(acRing, pcMessage + iFirst, iLen - iFirst);
+	/* Published only once the bytes are in place */
+	iHead = (iStart + iLen) % RING_SIZE;
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Output_flush(void)
+
+/* Write the queued notices with one write(). */
+
+{
+	int iEnd = iHead, iStart = iTail, iLen, iFirst, iLostNow = iLost;
+
+	if(iEnd == iStart && iLostNow == iLostReported) return;
+
+	/* The ring may wrap; the count of lost notices joins the same write */
+	iLen = (iEnd - iStart + RING_SIZE) % RING_SIZE;
+	iFirst = (iLen < RING_SIZE - iStart) ? iLen : RING_SIZE - iStart;
+	memcpy(acOut, acRing + iStart, iFirst);
+	memcpy(acOut + iFirst, acRing, iLen - iFirst);
+	iTail = iEnd;
+	if(iLostNow != iLostReported)
+	{
+		iLen += snprintf(acOut + iLen, MAX_LOST_SIZE, "%d notices lost\n",
+			iLostNow - iLostReported);
+		iLostReported = iLostNow;
+	}
+	Output_write(acOut, iLen);
+}
+
+/*--------------------------------------------------------------------*/
+
+void Output_drain(void)
+
+/* Write the queued notices with one write(). */
+
+{
+	assert(!iIdle);
+
+	Output_flush();
+}
+
+/*--------------------------------------------------------------------*/
+
+void Output_setIdle(int iIdleNow)
+
+/* Record whether the main loop waits for input. */
+
+{
+	iIdle = iIdleNow;
+	/* Nothing is queued once idle, so what is left can be written
+	   without racing a handler */
+	if(iIdle) Output_flush();
+}
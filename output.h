@@ -0,0 +1,26 @@
+#ifndef OUTPUT_INCLUDED
+#define OUTPUT_INCLUDED
+
+/* Notices for the user that signal handlers produce, such as job
+   completions.  A handler only copies its notice into a ring buffer,
+   and the main loop writes everything queued with one write() before
+   it draws the next prompt, so that notices never interleave with
+   stdio output.  While the main loop is idle, waiting for input, a
+   notice is written at once instead. */
+
+/* Queue the iLen bytes of pcMessage, or drop them and count the loss if
+   the ring is full.  Allocates nothing and takes no lock, so it may be
+   called from a signal handler, which must not interrupt another call
+   of Output_post. */
+void Output_post(const char *pcMessage, int iLen);
+
+/* Write the queued notices to stdout with one write().  Called by the
+   main loop only. */
+void Output_drain(void);
+
+/* Tell the output layer whether the main loop is blocked waiting for
+   input (1) or not (0).  Becoming idle writes what is still queued.
+   Output_drain must not be called while idle. */
+void Output_setIdle(int iIdle);
+
+#endif
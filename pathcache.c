@@ -0,0 +1,155 @@
+#include "pathcache.h"
+#include "stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/*--------------------------------------------------------------------*/
+
+enum {MAX_PATH_SIZE = 1024};
+
+enum {BUCKET_COUNT = 256};
+
+/* An Entry maps a command name to the path it was found at. */
+struct Entry
+{
+	char *pcName;
+	char *pcPath;
+	struct Entry *psNext;
+};
+
+static struct Entry *apsBuckets[BUCKET_COUNT];
+
+/* The value of $PATH the entries were found with, or NULL */
+static char *pcCachedPath;
+
+/*--------------------------------------------------------------------*/
+
+static unsigned int PathCache_hash(const char *pcName)
+
+/* Return the bucket of pcName. */
+
+{
+	unsigned int uiHash = 5381;
+
+	while(*pcName != '\0')
+		uiHash = uiHash * 33 + (unsigned char)*pcName++;
+	return uiHash % BUCKET_COUNT;
+}
+
+/*--------------------------------------------------------------------*/
+
+void PathCache_flush(void)
+
+/* Forget every cached path. */
+
+{
+	struct Entry *psEntry, *psNext;
+	int i;
+
+	for(i=0;i<BUCKET_COUNT;i++)
+	{
+		for(psEntry = apsBuckets[i]; psEntry != NULL; psEntry = psNext)
+		{
+			psNext = psEntry->psNext;
+			free(psEntry->pcName);
+			free(psEntry->pcPath);
+			free(psEntry);
+		}
+		apsBuckets[i] = NULL;
+	}
+	free(pcCachedPath);
+	pcCachedPath = NULL;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int PathCache_search(const char *pcPathVar, const char *pcName,
+	char *pcFound)
+
+/* Search the directories of pcPathVar for the executable pcName and
+   store its path in pcFound, which has room for MAX_PATH_SIZE
+   characters.  Return 1 if it was found. */
+
+{
+	const char *pcDir = pcPathVar, *pcEnd;
+	struct stat sStat;
+	int iDirLen;
+
+	for(;;)
+	{
+		pcEnd = strchr(pcDir, ':');
+		iDirLen = (pcEnd == NULL) ? (int)strlen(pcDir) : (int)(pcEnd - pcDir);
+
+		/* An empty entry is the current directory */
+		if(iDirLen == 0)
+			snprintf(pcFound, MAX_PATH_SIZE, "%s", pcName);
+		else
+			snprintf(pcFound, MAX_PATH_SIZE, "%.*s/%s", iDirLen, pcDir, pcName);
+		if(stat(pcFound, &sStat) == 0 && S_ISREG(sStat.st_mode)
+			&& access(pcFound, X_OK) == 0)
+			return 1;
+
+		if(pcEnd == NULL) return 0;
+		pcDir = pcEnd + 1;
+	}
+}
+
+/*--------------------------------------------------------------------*/
+
+const char *PathCache_lookup(const char *pcName)
+
+/* Return the path of the executable pcName found in $PATH, or NULL. */
+
+{
+	char acFound[MAX_PATH_SIZE];
+	const char *pcPathVar = getenv("PATH");
+	struct Entry *psEntry;
+	unsigned int uiBucket;
+
+	assert(pcName != NULL);
+
+	if(pcName[0] == '\0' || strchr(pcName, '/') != NULL) return NULL;
+
+	/* Default search path of execvp */
+	if(pcPathVar == NULL) pcPathVar = "/bin:/usr/bin";
+	if(pcCachedPath == NULL || strcmp(pcCachedPath, pcPathVar) != 0)
+	{
+		PathCache_flush();
+		pcCachedPath = strdup(pcPathVar);
+		if(pcCachedPath == NULL) return NULL;
+	}
+
+	uiBucket = PathCache_hash(pcName);
+	for(psEntry = apsBuckets[uiBucket]; psEntry != NULL; psEntry = psEntry->psNext)
+	{
+		if(strcmp(psEntry->pcName, pcName) == 0)
+		{
+			Stats_count(STATS_PATH_HITS, 1);
+			return psEntry->pcPath;
+		}
+	}
+
+	/* Commands that are not found are not cached, so that they are
+	   found once installed */
+	Stats_count(STATS_PATH_MISSES, 1);
+	if(!PathCache_search(pcPathVar, pcName, acFound)) return NULL;
+
+	psEntry = (struct Entry *)malloc(sizeof(struct Entry));
+	if(psEntry == NULL) return NULL;
+	psEntry->pcName = strdup(pcName);
+	psEntry->pcPath = strdup(acFound);
+	if(psEntry->pcName == NULL || psEntry->pcPath == NULL)
+	{
+		free(psEntry->pcName);
+		free(psEntry->pcPath);
+		free(psEntry);
+		return NULL;
+	}
+	psEntry->psNext = apsBuckets[uiBucket];
+	apsBuckets[uiBucket] = psEntry;
+	return psEntry->pcPath;
+}
@@ -0,0 +1,20 @@
+#ifndef PATHCACHE_INCLUDED
+#define PATHCACHE_INCLUDED
+
+/* The PATH cache remembers where commands were found in $PATH, so
+   that the shell searches each directory once per command rather than
+   each child searching it again before exec.  It is emptied whenever
+   $PATH changes. */
+
+/* Return the path of the executable pcName found in $PATH, or NULL if
+   pcName contains a '/', is not found, or memory is insufficient.  The
+   cache owns the string, which stays valid until a lookup under a
+   different $PATH or PathCache_flush empties the cache.  A cached path
+   may have gone stale, so exec should fall back to a $PATH search when
+   it fails. */
+const char *PathCache_lookup(const char *pcName);
+
+/* Forget every cached path. */
+void PathCache_flush(void);
+
+#endif
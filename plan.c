@@ -0,0 +1,116 @@
+#define _GNU_SOURCE
+#include "dynarray.h"
+#include "token.h"
+#include "plan.h"
+#include "schedule.h"
+#include "trace.h"
+#include "pathcache.h"
+#include "alloc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+
+/*--------------------------------------------------------------------*/
+
+struct Pipeline *Plan_makePipeline(DynArray_T oTokens,
+	int (*pfInShell)(const char *pcName), char *errMsg)
+
+/* Build the execution plan of the tokens in oTokens.  The redirection
+   and '&' tokens are consumed from oTokens.  Return NULL with a
+   message in errMsg on failure. */
+
+{
+	struct Pipeline *psPipeline;
+	int i, iStatus, iPos = 0;
+	long long llStart = TRACE_BEGIN();
+
+	assert(oTokens != NULL);
+	assert(DynArray_getLength(oTokens) > 0);
+
+	strcpy(errMsg, "Cannot allocate memory");
+	psPipeline = (struct Pipeline *)Alloc_malloc(ALLOC_PLANNER, sizeof(struct Pipeline));
+	if (psPipeline == NULL)
+		return NULL;
+
+	psPipeline->iCgroupFd = -1;
+	psPipeline->piInherit = NULL;
+	psPipeline->iInherit = 0;
+
+	/* Strip '&' and the redirections first so that only words and
+	   pipes are left for Token_getComm */
+	psPipeline->iBackground = !Token_isBG(oTokens);
+	psPipeline->psStages = NULL;
+	psPipeline->iStages = 0;
+	psPipeline->pcOutput = NULL;
+	psPipeline->pcInput = Token_getInput(oTokens, &iStatus);
+	if (psPipeline->pcInput == NULL && iStatus == 0)
+	{
+		Plan_freePipeline(psPipeline);
+		return NULL;
+	}
+	psPipeline->pcOutput = Token_getOutput(oTokens, &iStatus);
+	if (psPipeline->pcOutput == NULL && iStatus == 0)
+	{
+		Plan_freePipeline(psPipeline);
+		return NULL;
+	}
+
+	psPipeline->iStages = Token_getNumCommand(oTokens);
+	psPipeline->psStages = (struct Stage *)Alloc_calloc(ALLOC_PLANNER,
+		(size_t)psPipeline->iStages, sizeof(struct Stage));
+	if (psPipeline->psStages == NULL)
+	{
+		psPipeline->iStages = 0;
+		Plan_freePipeline(psPipeline);
+		return NULL;
+	}
+
+	for (i = 0; i < psPipeline->iStages; i++)
+	{
+		psPipeline->psStages[i].ppcArgv =
+			Token_getNextComm(oTokens, &iPos, &psPipeline->psStages[i].iArgc);
+		if (psPipeline->psStages[i].ppcArgv == NULL
+			|| !Schedule_parse(psPipeline->psStages[i].ppcArgv,
+				&psPipeline->psStages[i].iArgc,
+				&psPipeline->psStages[i].psSchedule, errMsg))
+		{
+			Plan_freePipeline(psPipeline);
+			return NULL;
+		}
+		if (pfInShell == NULL || !(*pfInShell)(psPipeline->psStages[i].ppcArgv[0]))
+			psPipeline->psStages[i].pcPath =
+				PathCache_lookup(psPipeline->psStages[i].ppcArgv[0]);
+		if (psPipeline->psStages[i].psSchedule != NULL)
+			Schedule_placeNear(psPipeline->psStages[i].psSchedule,
+				i > 0 ? psPipeline->psStages[i-1].psSchedule : NULL);
+	}
+
+	TRACE_END("plan", llStart, -1, -1);
+	return psPipeline;
+}
+
+/*--------------------------------------------------------------------*/
+
+void Plan_freePipeline(struct Pipeline *psPipeline)
+
+/* Free psPipeline and everything it owns. */
+
+{
+	int i;
+
+	assert(psPipeline != NULL);
+
+	for (i = 0; i < psPipeline->iStages; i++)
+	{
+		free(psPipeline->psStages[i].psSchedule);
+		Alloc_free(psPipeline->psStages[i].ppcArgv);
+	}
+	if (psPipeline->iCgroupFd != -1)
+		close(psPipeline->iCgroupFd);
+	Alloc_free(psPipeline->psStages);
+	Alloc_free(psPipeline->pcInput);
+	Alloc_free(psPipeline->pcOutput);
+	Alloc_free(psPipeline);
+}
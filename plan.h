@@ -0,0 +1,81 @@
+#ifndef PLAN_INCLUDED
+#define PLAN_INCLUDED
+
+#include "dynarray.h"
+
+struct Schedule;
+
+/* A Stage is one command of a pipeline, ready to be passed to
+   execvp. */
+struct Stage
+{
+	/* NULL-terminated argument vector of the command, in one block
+	   with its strings */
+	char **ppcArgv;
+
+	/* The number of arguments in ppcArgv */
+	int iArgc;
+
+	/* Scheduling settings from a "sched" prefix, or NULL */
+	struct Schedule *psSchedule;
+
+	/* Where ppcArgv[0] was found in $PATH, owned by the PATH cache, or
+	   NULL to let execvp search it */
+	const char *pcPath;
+
+	/* Function the forked child calls with pvRun and ppcArgv instead of
+	   executing ppcArgv, as for a shell function, or NULL.  It returns
+	   the exit status of the stage.  Set by the caller of
+	   Plan_makePipeline. */
+	int (*pfRun)(void *pvRun, char **ppcArgv, int iArgc);
+	void *pvRun;
+};
+
+/* A Pipeline is the execution plan of one line: its stages, the file
+   redirections applied to the first and the last stage, and whether it
+   runs in the background. */
+struct Pipeline
+{
+	/* The number of stages */
+	int iStages;
+
+	/* Array of iStages stages */
+	struct Stage *psStages;
+
+	/* File to read stdin of the first stage from, or NULL */
+	char *pcInput;
+
+	/* File to write stdout of the last stage to, or NULL */
+	char *pcOutput;
+
+	/* 1 if the line ended with '&' */
+	int iBackground;
+
+	/* Descriptor of the cgroup the stages are created in, or -1.
+	   Closed by Plan_freePipeline. */
+	int iCgroupFd;
+
+	/* The iInherit descriptors that the stages keep open across exec,
+	   such as the pipes of process substitutions that their /dev/fd
+	   arguments name, or NULL.  Set by the caller of
+	   Plan_makePipeline, which owns them. */
+	const int *piInherit;
+	int iInherit;
+};
+
+/* Build the execution plan of the tokens in oTokens, which must have
+   passed lexLine().  The redirection and '&' tokens are consumed from
+   oTokens without being freed, so oTokens must not be the array that
+   owns them, and "sched" prefixes from the stages.  The command of
+   each stage is looked up in the PATH cache unless pfInShell, if not
+   NULL, returns 1 (TRUE) for it, as for the built-ins and functions
+   the shell runs itself.  Return NULL with a message in errMsg if
+   insufficient memory is available or a prefix is invalid.  The
+   caller owns the Pipeline. */
+struct Pipeline *Plan_makePipeline(DynArray_T oTokens,
+	int (*pfInShell)(const char *pcName), char *errMsg);
+
+/* Free psPipeline and everything it owns. */
+void Plan_freePipeline(struct Pipeline *psPipeline);
+
+#endif
@@ -4,8 +4,18 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <sys/wait.h>
+#include <string.h>
+#include "stats.h"
+#include "alloc.h"
 
-enum ProcessType { PROCESS_BG, PROCESS_FG, PROCESS_TERMINATED };
+/* PROCESS_DONE is a background process that terminated and whose status no wait has taken yet */
+enum ProcessType { PROCESS_BG, PROCESS_FG, PROCESS_TERMINATED, PROCESS_DONE };
+
+/* Number of PROCESS_DONE entries kept for wait; older ones are freed by Process_reclaim */
+enum {MAX_DONE = 1024};
+
+/* Counts the processes that terminate, to order them */
+static long lTerminations;
 
 struct Process
 {
@@ -14,6 +24,23 @@ struct Process
 
 	/* process ID */
 	int pid;
+
+	/* The cgroup the process was started in, or NULL */
+	char *pcCgroup;
+
+	/* 1 if the shell created the cgroup, which the last of its
+	   processes to terminate removes */
+	int iRemoveCgroup;
+
+	/* When the process was added, from Stats_now() */
+	long long llStart;
+
+	/* The job of a background process, numbered from 1, or 0 */
+	int iJob;
+
+	/* Once terminated, the status from waitpid() and lTerminations at the time */
+	int iStatus;
+	long lTerminated;
 };
 
 void freeProcess(void *pvItem, void *pvExtra)
@@ -23,7 +50,8 @@ void freeProcess(void *pvItem, void *pvExtra)
 {
 	assert(pvItem != NULL);
 	struct Process *psProcess = (struct Process *)pvItem;
-	free(psProcess);
+	Alloc_free(psProcess->pcCgroup);
+	Alloc_free(psProcess);
 }
 
 enum ProcessType Process_getType(void *pvItem)
@@ -56,13 +84,19 @@ struct Process *makeProcess(enum ProcessType eProcessType, int pid)
 	assert(pid > 0);
 	struct Process *psProcess;
 
-	psProcess = (struct Process *)malloc(sizeof(struct Process));
+	psProcess = (struct Process *)Alloc_malloc(ALLOC_JOBS, sizeof(struct Process));
 	if (psProcess == NULL)
     	return NULL;
 
 	psProcess->pType = eProcessType;
 
 	psProcess->pid = pid;
+	psProcess->pcCgroup = NULL;
+	psProcess->iRemoveCgroup = 0;
+	psProcess->llStart = Stats_now();
+	psProcess->iJob = 0;
+	psProcess->iStatus = 0;
+	psProcess->lTerminated = 0;
 	return psProcess;
 }
 
@@ -93,7 +127,26 @@ int Process_getLastbg(DynArray_T p)
 	return -1;
 }
 
-void Process_terminate(DynArray_T p, int pid)
+/* Return the number of processes in p that have not terminated and run in the cgroup pcPath, counting only those
+	that remove it if iRemoving is 1. It neither allocates nor changes p, so Process_terminate may call it from
+	SIGCHLD_handler. */
+static int Process_countCgroup(DynArray_T p, const char *pcPath, int iRemoving)
+{
+	int length = DynArray_getLength(p);
+	int i, iCount = 0;
+	for(i=0;i<length;i++){
+		struct Process *psProcess = (struct Process *)DynArray_get(p,i);
+		if(psProcess->pType == PROCESS_TERMINATED || psProcess->pType == PROCESS_DONE
+			|| psProcess->pcCgroup == NULL) continue;
+		if(iRemoving && !psProcess->iRemoveCgroup) continue;
+		if(strcmp(psProcess->pcCgroup, pcPath) == 0) iCount++;
+	}
+	return iCount;
+}
+
+/* Record that process pid terminated with iStatus from waitpid(). A background process stays in the list until
+	a wait takes its status. It never allocates, so it may run in SIGCHLD_handler. */
+void Process_terminate(DynArray_T p, int pid, int iStatus)
 {
 	assert(p != NULL);
 	assert(pid > 0);
@@ -102,12 +155,39 @@ void Process_terminate(DynArray_T p, int pid)
 	for(i=length-1;i>=0;i--){
 		if(Process_getpid(DynArray_get(p,i)) == pid){
 			struct Process *psProcess = (struct Process *)DynArray_get(p,i);
-			psProcess->pType = PROCESS_TERMINATED;
+			if(psProcess->pType == PROCESS_TERMINATED || psProcess->pType == PROCESS_DONE) return;
+			psProcess->pType = (psProcess->pType == PROCESS_BG) ? PROCESS_DONE : PROCESS_TERMINATED;
+			psProcess->iStatus = iStatus;
+			psProcess->lTerminated = ++lTerminations;
+			if(psProcess->iRemoveCgroup && Process_countCgroup(p, psProcess->pcCgroup, 0) == 0)
+				rmdir(psProcess->pcCgroup);
 			return;
 		} 
 	}
 }
 
+/* Free the processes marked terminated and close up the list, which then holds only the processes that
+	are still running and the newest MAX_DONE that no wait took yet. It frees memory, so the handlers that read
+	the list must be blocked meanwhile. */
+void Process_reclaim(DynArray_T p)
+{
+	assert(p != NULL);
+	int length = DynArray_getLength(p);
+	int i, j = 0, iDone = 0;
+	for(i=0;i<length;i++)
+		if(Process_getType(DynArray_get(p,i)) == PROCESS_DONE) iDone++;
+	for(i=0;i<length;i++){
+		struct Process *psProcess = (struct Process *)DynArray_get(p,i);
+		if(psProcess->pType == PROCESS_DONE && iDone > MAX_DONE){
+			iDone--;
+			freeProcess(psProcess, NULL);
+		}
+		else if(psProcess->pType == PROCESS_TERMINATED) freeProcess(psProcess, NULL);
+		else DynArray_set(p, j++, psProcess);
+	}
+	for(i=length-1;i>=j;i--) DynArray_removeAt(p, i);
+}
+
 void Process_add(DynArray_T p, int pid, enum ProcessType eProcessType)
 {
 	assert(p != NULL);
@@ -120,7 +200,11 @@ void Process_add(DynArray_T p, int pid, enum ProcessType eProcessType)
 		exit(EXIT_FAILURE);
 	} 
 
-	DynArray_add(p, psProcess);
+	if(!DynArray_add(p, psProcess))
+	{
+		fprintf(stderr, "Cannot allocate memory\n");
+		exit(EXIT_FAILURE);
+	}
 }
 
 int Process_compare(const void *pvElement1, const void *pvElement2)
@@ -145,6 +229,39 @@ int Process_getIndex(DynArray_T p, int pid)
 	}
 	return -1;
 }
+
+/* Record that process pid runs in the cgroup pcPath.  iRemove is 1 if the shell created the cgroup for this job.
+	A named cgroup may hold several jobs, and whichever of their processes terminates last removes it, so a job that
+	joins a cgroup another running job created removes it too. */
+void Process_setCgroup(DynArray_T p, int pid, const char *pcPath, int iRemove)
+{
+	assert(p != NULL);
+	assert(pcPath != NULL);
+	int index = Process_getIndex(p, pid);
+	if(index == -1) return;
+	struct Process *psProcess = (struct Process *)DynArray_get(p,index);
+	Alloc_free(psProcess->pcCgroup);
+	psProcess->pcCgroup = NULL;
+	iRemove = iRemove || Process_countCgroup(p, pcPath, 1) > 0;
+	psProcess->pcCgroup = Alloc_strdup(ALLOC_JOBS, pcPath);
+	psProcess->iRemoveCgroup = (psProcess->pcCgroup != NULL) && iRemove;
+}
+
+/* Return when the process was added to the list, in microseconds from Stats_now() */
+long long Process_getStartTime(void *pvItem)
+{
+	assert(pvItem != NULL);
+	struct Process *psProcess = (struct Process *)pvItem;
+	return psProcess->llStart;
+}
+
+/* Return the cgroup of the process, or NULL */
+const char *Process_getCgroup(void *pvItem)
+{
+	assert(pvItem != NULL);
+	struct Process *psProcess = (struct Process *)pvItem;
+	return psProcess->pcCgroup;
+}
 // DynArray_T ChildPID_init(int size)
 // {
 // 	assert(size >= 0);
@@ -205,3 +322,88 @@ int Process_getIndex(DynArray_T p, int pid)
 // 	int *childPID = (int *)pvItem;
 // 	free(childPID);
 // }
+
+/* Return the number for a new job: one more than the highest of the jobs in the list, or 1 */
+int Process_nextJob(DynArray_T p)
+{
+	assert(p != NULL);
+	int length = DynArray_getLength(p);
+	int i, iJob = 0;
+	for(i=0;i<length;i++){
+		struct Process *psProcess = (struct Process *)DynArray_get(p,i);
+		if(psProcess->iJob > iJob) iJob = psProcess->iJob;
+	}
+	return iJob + 1;
+}
+
+/* Make process pid part of job iJob */
+void Process_setJob(DynArray_T p, int pid, int iJob)
+{
+	assert(p != NULL);
+	int index = Process_getIndex(p, pid);
+	if(index == -1) return;
+	((struct Process *)DynArray_get(p,index))->iJob = iJob;
+}
+
+/* Return the job of the process, or 0 */
+int Process_getJob(void *pvItem)
+{
+	assert(pvItem != NULL);
+	return ((struct Process *)pvItem)->iJob;
+}
+
+/* Take the status of job iJob, or with iJob 0 of the job that finished first among those no wait took yet. A job
+	is finished once all of its processes are, and its status is that of its last stage. Return 0 with the status
+	from waitpid() in *piStatus if a job was taken, 1 if the job, or with iJob 0 some job, is still running, or -1
+	if there is no such job. The processes of a job are added together, so they are next to each other. */
+int Process_waitJob(DynArray_T p, int iJob, int *piStatus)
+{
+	assert(p != NULL);
+	assert(piStatus != NULL);
+	int length = DynArray_getLength(p);
+	int i, j, k, iRunning = 0, iDone, iBest = -1, iBestEnd = -1;
+	long lFinished, lBestFinished = 0;
+	struct Process *psProcess;
+	for(i=0;i<length;i=j){
+		int iThisJob = Process_getJob(DynArray_get(p,i));
+		for(j=i;j<length && Process_getJob(DynArray_get(p,j)) == iThisJob;j++);
+		if(iThisJob == 0 || (iJob != 0 && iThisJob != iJob)) continue;
+		iDone = 0;
+		lFinished = 0;
+		for(k=i;k<j;k++){
+			psProcess = (struct Process *)DynArray_get(p,k);
+			if(psProcess->pType == PROCESS_BG) break;
+			if(psProcess->pType == PROCESS_DONE) iDone = 1;
+			if(psProcess->lTerminated > lFinished) lFinished = psProcess->lTerminated;
+		}
+		if(k < j) iRunning = 1;
+		else if(iDone && (iBest == -1 || lFinished < lBestFinished)){
+			iBest = i;
+			iBestEnd = j;
+			lBestFinished = lFinished;
+		}
+	}
+	if(iBest == -1) return iRunning ? 1 : -1;
+	*piStatus = ((struct Process *)DynArray_get(p,iBestEnd-1))->iStatus;
+	for(k=iBest;k<iBestEnd;k++){
+		psProcess = (struct Process *)DynArray_get(p,k);
+		if(psProcess->pType == PROCESS_DONE) psProcess->pType = PROCESS_TERMINATED;
+	}
+	return 0;
+}
+
+/* Take the status of background process pid as Process_waitJob does for a job */
+int Process_waitPid(DynArray_T p, int pid, int *piStatus)
+{
+	assert(p != NULL);
+	assert(piStatus != NULL);
+	int index = Process_getIndex(p, pid);
+	struct Process *psProcess;
+	if(index == -1) return -1;
+	psProcess = (struct Process *)DynArray_get(p,index);
+	if(psProcess->pType == PROCESS_BG) return 1;
+	if(psProcess->pType != PROCESS_DONE) return -1;
+	*piStatus = psProcess->iStatus;
+	psProcess->pType = PROCESS_TERMINATED;
+	return 0;
+}
@@ -1,7 +1,8 @@
 #ifndef CHILD_INCLUDED
 #define CHILD_INCLUDED
 
-enum ProcessType { PROCESS_BG, PROCESS_FG };
+/* PROCESS_DONE is a background process that terminated and whose status no wait has taken yet */
+enum ProcessType { PROCESS_BG, PROCESS_FG, PROCESS_TERMINATED, PROCESS_DONE };
 
 void freeProcess(void *pvItem, void *pvExtra);
 
@@ -15,7 +16,19 @@ DynArray_T Process_init(int size);
 
 int Process_getLastbg(DynArray_T p);
 
-void Process_terminate(DynArray_T p, int pid);
+void Process_terminate(DynArray_T p, int pid, int iStatus);
+
+void Process_reclaim(DynArray_T p);
+
+int Process_nextJob(DynArray_T p);
+
+void Process_setJob(DynArray_T p, int pid, int iJob);
+
+int Process_getJob(void *pvItem);
+
+int Process_waitJob(DynArray_T p, int iJob, int *piStatus);
+
+int Process_waitPid(DynArray_T p, int pid, int *piStatus);
 
 void Process_add(DynArray_T p, int pid, enum ProcessType eProcessType);
 
@@ -23,6 +36,12 @@ int Process_compare(const void *pvElement1, const void *pvElement2);
 
 int Process_getIndex(DynArray_T p, int pid);
 
+void Process_setCgroup(DynArray_T p, int pid, const char *pcPath, int iRemove);
+
+long long Process_getStartTime(void *pvItem);
+
+const char *Process_getCgroup(void *pvItem);
+
 // DynArray_T ChildPID_init(int size);
 
 // int ChildPID_getLength(DynArray_T cp);
@@ -0,0 +1,246 @@
+#define _GNU_SOURCE
+#include "schedule.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+/*--------------------------------------------------------------------*/
+
+enum {FALSE, TRUE};
+
+enum {MAX_PATH_SIZE = 1024};
+
+/* From linux/ioprio.h */
+enum {IOPRIO_CLASS_SHIFT = 13, IOPRIO_WHO_PROCESS = 1};
+enum {IOPRIO_CLASS_RT = 1, IOPRIO_CLASS_BE = 2, IOPRIO_CLASS_IDLE = 3};
+
+/*--------------------------------------------------------------------*/
+
+static int Schedule_parseCpus(const char *pcList, cpu_set_t *psSet)
+
+/* Parse a CPU list such as "0-3,6" into *psSet.  Return 1 (TRUE) if
+   successful, or 0 (FALSE) otherwise. */
+
+{
+	const char *pc = pcList;
+	char *pcEnd;
+	long lFirst, lLast, l;
+
+	CPU_ZERO(psSet);
+	while(*pc != '\0' && *pc != '\n')
+	{
+		lFirst = strtol(pc, &pcEnd, 10);
+		if(pcEnd == pc || lFirst < 0) return FALSE;
+		lLast = lFirst;
+		pc = pcEnd;
+		if(*pc == '-')
+		{
+			lLast = strtol(pc + 1, &pcEnd, 10);
+			if(pcEnd == pc + 1 || lLast < lFirst) return FALSE;
+			pc = pcEnd;
+		}
+		if(lLast >= CPU_SETSIZE) return FALSE;
+		for(l=lFirst;l<=lLast;l++) CPU_SET(l, psSet);
+		if(*pc == ',') pc++;
+		else if(*pc != '\0' && *pc != '\n') return FALSE;
+	}
+	return CPU_COUNT(psSet) > 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Schedule_parseIoprio(const char *pcValue)
+
+/* Parse "class[:level]" into an ioprio value.  Return -1 if pcValue
+   is invalid. */
+
+{
+	int iClass, iLevel = 4;
+	const char *pcLevel = strchr(pcValue, ':');
+	int iLen = (pcLevel == NULL) ? (int)strlen(pcValue) : (int)(pcLevel - pcValue);
+
+	if(iLen == 2 && strncmp(pcValue, "rt", 2) == 0) iClass = IOPRIO_CLASS_RT;
+	else if(iLen == 2 && strncmp(pcValue, "be", 2) == 0) iClass = IOPRIO_CLASS_BE;
+	else if(iLen == 4 && strncmp(pcValue, "idle", 4) == 0) iClass = IOPRIO_CLASS_IDLE;
+	else return -1;
+
+	if(pcLevel != NULL)
+	{
+		if(pcLevel[1] < '0' || pcLevel[1] > '7' || pcLevel[2] != '\0') return -1;
+		iLevel = pcLevel[1] - '0';
+	}
+	if(iClass == IOPRIO_CLASS_IDLE) iLevel = 0;
+	return (iClass << IOPRIO_CLASS_SHIFT) | iLevel;
+}
+
+/*--------------------------------------------------------------------*/
+
+int Schedule_parse(char **ppcArgv, int *piArgc,
+	struct Schedule **ppsSchedule, char *errMsg)
+
+/* Strip a leading "sched" prefix from ppcArgv into *ppsSchedule. */
+
+{
+	struct Schedule *psSchedule;
+	char *pcOption, *pcValue, *pcEnd;
+	int iUsed = 1;
+
+	assert(ppcArgv != NULL);
+	assert(piArgc != NULL);
+	assert(ppsSchedule != NULL);
+
+	*ppsSchedule = NULL;
+	if(*piArgc == 0 || strcmp(ppcArgv[0], "sched") != 0) return TRUE;
+
+	psSchedule = (struct Schedule *)calloc(1, sizeof(struct Schedule));
+	if(psSchedule == NULL)
+	{
+		strcpy(errMsg, "Cannot allocate memory");
+		return FALSE;
+	}
+	psSchedule->iIoprio = -1;
+	psSchedule->iPolicy = -1;
+
+	while(iUsed + 1 < *piArgc && ppcArgv[iUsed][0] == '-')
+	{
+		pcOption = ppcArgv[iUsed];
+		pcValue = ppcArgv[iUsed + 1];
+		if(strcmp(pcOption, "-c") == 0)
+		{
+			if(strcmp(pcValue, "cache") == 0) psSchedule->iNearPrevious = 1;
+			else if(!Schedule_parseCpus(pcValue, &psSchedule->sCpus)) break;
+			psSchedule->iHasCpus = 1;
+		}
+		else if(strcmp(pcOption, "-n") == 0)
+		{
+			psSchedule->iNice = strtol(pcValue, &pcEnd, 10);
+			if(*pcEnd != '\0' || pcEnd == pcValue) break;
+			psSchedule->iHasNice = 1;
+		}
+		else if(strcmp(pcOption, "-i") == 0)
+		{
+			psSchedule->iIoprio = Schedule_parseIoprio(pcValue);
+			if(psSchedule->iIoprio == -1) break;
+		}
+		else if(strcmp(pcOption, "-p") == 0)
+		{
+			if(strcmp(pcValue, "other") == 0) psSchedule->iPolicy = SCHED_OTHER;
+			else if(strcmp(pcValue, "batch") == 0) psSchedule->iPolicy = SCHED_BATCH;
+			else if(strcmp(pcValue, "idle") == 0) psSchedule->iPolicy = SCHED_IDLE;
+			else break;
+		}
+		else break;
+		iUsed += 2;
+	}
+
+	/* Stopped before the command: an unknown option or a bad value */
+	if(iUsed >= *piArgc || ppcArgv[iUsed][0] == '-')
+	{
+		strcpy(errMsg, "sched: invalid option or missing command");
+		free(psSchedule);
+		return FALSE;
+	}
+
+	/* The strings share the block of ppcArgv */
+	memmove(ppcArgv, ppcArgv + iUsed, (*piArgc - iUsed + 1) * sizeof(char *));
+	*piArgc -= iUsed;
+	*ppsSchedule = psSchedule;
+	return TRUE;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Schedule_cacheCpus(int iCpu, cpu_set_t *psSet)
+
+/* Store the CPUs sharing the last-level cache with iCpu in *psSet.
+   Return 1 (TRUE) if the cache topology could be read. */
+
+{
+	char acPath[MAX_PATH_SIZE], acList[MAX_PATH_SIZE];
+	FILE *psFile;
+	int iIndex, iLevel, iBest = -1;
+
+	for(iIndex=0;;iIndex++)
+	{
+		snprintf(acPath, MAX_PATH_SIZE, "/sys/devices/system/cpu/cpu%d/cache/index%d/level", iCpu, iIndex);
+		psFile = fopen(acPath, "r");
+		if(psFile == NULL) break;
+		if(fscanf(psFile, "%d", &iLevel) != 1) iLevel = -1;
+		fclose(psFile);
+		if(iLevel <= iBest) continue;
+
+		snprintf(acPath, MAX_PATH_SIZE, "/sys/devices/system/cpu/cpu%d/cache/index%d/shared_cpu_list", iCpu, iIndex);
+		psFile = fopen(acPath, "r");
+		if(psFile == NULL) continue;
+		if(fgets(acList, MAX_PATH_SIZE, psFile) != NULL && Schedule_parseCpus(acList, psSet))
+			iBest = iLevel;
+		fclose(psFile);
+	}
+	return iBest != -1;
+}
+
+/*--------------------------------------------------------------------*/
+
+void Schedule_placeNear(struct Schedule *psSchedule,
+	const struct Schedule *psPrevious)
+
+/* Resolve "-c cache" for psSchedule. */
+
+{
+	int iCpu = -1, i;
+
+	assert(psSchedule != NULL);
+
+	if(!psSchedule->iNearPrevious) return;
+
+	if(psPrevious != NULL && psPrevious->iHasCpus)
+	{
+		for(i=0;i<CPU_SETSIZE;i++)
+		{
+			if(CPU_ISSET(i, &psPrevious->sCpus))
+			{
+				iCpu = i;
+				break;
+			}
+		}
+	}
+	if(iCpu == -1) iCpu = sched_getcpu();
+
+	/* Without topology information the stage is not pinned */
+	if(iCpu < 0 || !Schedule_cacheCpus(iCpu, &psSchedule->sCpus))
+		psSchedule->iHasCpus = 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+int Schedule_apply(const struct Schedule *psSchedule)
+
+/* Apply psSchedule to the calling process. */
+
+{
+	struct sched_param sParam;
+
+	assert(psSchedule != NULL);
+
+	if(psSchedule->iHasCpus
+		&& sched_setaffinity(0, sizeof(cpu_set_t), &psSchedule->sCpus) != 0)
+		return FALSE;
+	if(psSchedule->iPolicy != -1)
+	{
+		memset(&sParam, 0, sizeof(sParam));
+		if(sched_setscheduler(0, psSchedule->iPolicy, &sParam) != 0)
+			return FALSE;
+	}
+	if(psSchedule->iHasNice
+		&& setpriority(PRIO_PROCESS, 0, psSchedule->iNice) != 0)
+		return FALSE;
+	if(psSchedule->iIoprio != -1
+		&& syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, psSchedule->iIoprio) != 0)
+		return FALSE;
+	return TRUE;
+}
@@ -0,0 +1,49 @@
+#ifndef SCHEDULE_INCLUDED
+#define SCHEDULE_INCLUDED
+
+#include <sched.h>
+
+/* A Schedule holds the scheduling settings of one pipeline stage,
+   given with the prefix
+      sched [-c cpus] [-n nice] [-i ioclass[:level]] [-p policy] command
+   cpus is a list such as "0-3,6", or "cache" for the CPUs sharing the
+   last-level cache with the previous stage.  ioclass is rt, be or
+   idle, and policy is other, batch or idle. */
+struct Schedule
+{
+	/* 1 if sCpus is set */
+	int iHasCpus;
+	cpu_set_t sCpus;
+
+	/* 1 if the stage follows the previous stage's cache ("-c cache") */
+	int iNearPrevious;
+
+	/* 1 if iNice is set */
+	int iHasNice;
+	int iNice;
+
+	/* I/O priority as given to ioprio_set, or -1 */
+	int iIoprio;
+
+	/* SCHED_OTHER, SCHED_BATCH or SCHED_IDLE, or -1 */
+	int iPolicy;
+};
+
+/* If ppcArgv starts with "sched", parse its options, remove them from
+   ppcArgv, an argv of Token_getComm, and update *piArgc.  Store a new
+   Schedule in *ppsSchedule, or NULL if there is no prefix.  Return 1
+   (TRUE) if successful, or 0 (FALSE) with a message in errMsg. */
+int Schedule_parse(char **ppcArgv, int *piArgc,
+	struct Schedule **ppsSchedule, char *errMsg);
+
+/* Resolve "-c cache" for psSchedule: use the CPUs sharing the
+   last-level cache with the first CPU of psPrevious, or with the
+   current CPU if psPrevious has no CPU set.  psPrevious may be NULL. */
+void Schedule_placeNear(struct Schedule *psSchedule,
+	const struct Schedule *psPrevious);
+
+/* Apply psSchedule to the calling process.  Return 1 (TRUE) if
+   successful, or 0 (FALSE) with errno set. */
+int Schedule_apply(const struct Schedule *psSchedule);
+
+#endif
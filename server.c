@@ -0,0 +1,541 @@
+#define _GNU_SOURCE
+#include "dynarray.h"
+#include "token.h"
+#include "plan.h"
+#include "exec.h"
+#include "server.h"
+#include "trace.h"
+#include "wildcard.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+/*--------------------------------------------------------------------*/
+
+enum {MAX_LINE_SIZE = 65536};
+
+enum {MAX_EVENTS = 64};
+
+#define SYSTEM_NAME "./ish"
+
+/* A Client is one connection to the server together with the
+   request it is currently running, if any. */
+struct Client
+{
+	/* The connection, or -1 once the client has gone away */
+	int iSock;
+
+	/* The pids of the running request.  piPids[iPids-1] gives the
+	   exit status of the request. */
+	int *piPids;
+	int iPids;
+
+	/* The number of pids of the request not reaped yet */
+	int iRunning;
+
+	/* The exit status of the last stage */
+	int iStatus;
+};
+
+/* Markers stored in the epoll data of the listening socket and the
+   signalfd, to tell them apart from clients */
+static int iListenMarker, iSignalMarker;
+
+static int iEpollFd;
+
+/* Array of struct Client * */
+static DynArray_T oClients;
+
+/*--------------------------------------------------------------------*/
+
+static void Server_freeClient(struct Client *psClient)
+
+/* Close psClient's connection, remove it from oClients and free it. */
+
+{
+	int i;
+
+	if(psClient->iSock != -1)
+	{
+		epoll_ctl(iEpollFd, EPOLL_CTL_DEL, psClient->iSock, NULL);
+		close(psClient->iSock);
+	}
+	for(i=DynArray_getLength(oClients)-1;i>=0;i--)
+	{
+		if(DynArray_get(oClients,i) == psClient)
+		{
+			DynArray_removeAt(oClients,i);
+			break;
+		}
+	}
+	free(psClient->piPids);
+	free(psClient);
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Server_reply(struct Client *psClient, int iStatus)
+
+/* Send exit status iStatus to psClient and wait for its next
+   request. */
+
+{
+	struct epoll_event sEvent;
+
+	free(psClient->piPids);
+	psClient->piPids = NULL;
+	psClient->iPids = 0;
+	psClient->iRunning = 0;
+
+	if(psClient->iSock == -1)
+	{
+		Server_freeClient(psClient);
+		return;
+	}
+	send(psClient->iSock, &iStatus, sizeof(iStatus), MSG_NOSIGNAL);
+
+	sEvent.events = EPOLLIN;
+	sEvent.data.ptr = psClient;
+	epoll_ctl(iEpollFd, EPOLL_CTL_MOD, psClient->iSock, &sEvent);
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Server_start(struct Client *psClient, char *pcLine,
+	const int aiFds[3], int (*pfRunLine)(char *pcLine),
+	int (*pfNeedsShell)(const char *pcName))
+
+/* Start running pcLine for psClient with stdio aiFds.  Return 1 if
+   children were started, or 0 if psClient->iStatus already holds the
+   final exit status of the line. */
+
+{
+	DynArray_T oTokens, oPipeline;
+	struct Pipeline *psPipeline;
+	char acErrMsg[MAX_ERROR_SIZE];
+	int pid, i;
+
+	oTokens = DynArray_new(0);
+	if(oTokens == NULL)
+	{
+		dprintf(aiFds[2], "%s: Cannot allocate memory\n", SYSTEM_NAME);
+		psClient->iStatus = 1;
+		return 0;
+	}
+
+	if(!lexLine(pcLine, oTokens, acErrMsg))
+	{
+		if(strcmp(acErrMsg,"") != 0)
+		{
+			dprintf(aiFds[2], "%s: %s\n", SYSTEM_NAME, acErrMsg);
+			psClient->iStatus = 2;
+		}
+		else psClient->iStatus = 0;
+		DynArray_map(oTokens, freeToken, NULL);
+		DynArray_free(oTokens);
+		return 0;
+	}
+
+	/* Built-ins, aliases, functions, command lists and process
+	   substitutions need the whole shell; run them in a worker so that
+	   they cannot change the state of the server */
+	for(i=0;i<DynArray_getLength(oTokens);i++)
+	{
+		if(Token_isListOperator(DynArray_get(oTokens,i))
+			|| Token_getType(DynArray_get(oTokens,i)) == TOKEN_SUBIN
+			|| Token_getType(DynArray_get(oTokens,i)) == TOKEN_SUBOUT) break;
+		if((i == 0 || Token_getType(DynArray_get(oTokens,i-1)) == TOKEN_P)
+			&& Token_getType(DynArray_get(oTokens,i)) == TOKEN_WORD
+			&& (*pfNeedsShell)(Token_getValue(DynArray_get(oTokens,i)))) break;
+	}
+	if(i < DynArray_getLength(oTokens))
+	{
+		DynArray_map(oTokens, freeToken, NULL);
+		DynArray_free(oTokens);
+
+		psClient->piPids = (int *)malloc(sizeof(int));
+		if(psClient->piPids == NULL)
+		{
+			psClient->iStatus = 1;
+			return 0;
+		}
+		fflush(NULL);
+		pid = fork();
+		if(pid == 0)
+		{
+			sigset_t sSet;
+			for(i=0;i<3;i++) dup2(aiFds[i], i);
+			signal(SIGCHLD, SIG_DFL);
+			sigemptyset(&sSet);
+			sigprocmask(SIG_SETMASK, &sSet, NULL);
+			exit((*pfRunLine)(pcLine));
+		}
+		else if(pid < 0)
+		{
+			perror("fork");
+			psClient->iStatus = 1;
+			return 0;
+		}
+		psClient->piPids[0] = pid;
+		psClient->iPids = psClient->iRunning = 1;
+		return 1;
+	}
+
+	/* The planner takes the redirections out of the array it is given,
+	   so it gets a copy and oTokens still frees every token */
+	psPipeline = NULL;
+	oPipeline = DynArray_new(0);
+	for(i=0;oPipeline != NULL && i<DynArray_getLength(oTokens);i++)
+		if(!DynArray_add(oPipeline, DynArray_get(oTokens,i))) break;
+	if(oPipeline != NULL && i == DynArray_getLength(oTokens))
+		psPipeline = Plan_makePipeline(oPipeline, pfNeedsShell, acErrMsg);
+	else strcpy(acErrMsg, "Cannot allocate memory");
+	Wildcard_flushCache();
+	if(oPipeline != NULL) DynArray_free(oPipeline);
+	DynArray_map(oTokens, freeToken, NULL);
+	DynArray_free(oTokens);
+	if(psPipeline == NULL)
+	{
+		dprintf(aiFds[2], "%s: %s\n", SYSTEM_NAME, acErrMsg);
+		psClient->iStatus = 2;
+		return 0;
+	}
+
+	psClient->piPids = (int *)malloc(psPipeline->iStages * sizeof(int));
+	if(psClient->piPids == NULL)
+	{
+		Plan_freePipeline(psPipeline);
+		psClient->iStatus = 1;
+		return 0;
+	}
+	psClient->iPids = Exec_spawnPipeline(psPipeline, aiFds, psClient->piPids);
+
+	/* A background line is answered as soon as it is started; its
+	   children are reaped without an owner */
+	if(psPipeline->iBackground || psClient->iPids < psPipeline->iStages)
+	{
+		psClient->iStatus = (psClient->iPids < psPipeline->iStages);
+		for(i=0;i<psClient->iPids;i++) psClient->piPids[i] = -1;
+		Plan_freePipeline(psPipeline);
+		return 0;
+	}
+	Plan_freePipeline(psPipeline);
+
+	psClient->iRunning = psClient->iPids;
+	return 1;
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Server_receive(struct Client *psClient,
+	int (*pfRunLine)(char *pcLine), int (*pfNeedsShell)(const char *pcName))
+
+/* Read one request from psClient and start it. */
+
+{
+	char acLine[MAX_LINE_SIZE + 1];
+	char acControl[CMSG_SPACE(3 * sizeof(int))];
+	struct msghdr sMsg;
+	struct iovec sIov;
+	struct cmsghdr *psCmsg;
+	struct epoll_event sEvent;
+	int aiFds[3] = {-1, -1, -1};
+	int iLen, i;
+
+	sIov.iov_base = acLine;
+	sIov.iov_len = MAX_LINE_SIZE;
+	memset(&sMsg, 0, sizeof(sMsg));
+	sMsg.msg_iov = &sIov;
+	sMsg.msg_iovlen = 1;
+	sMsg.msg_control = acControl;
+	sMsg.msg_controllen = sizeof(acControl);
+
+	iLen = recvmsg(psClient->iSock, &sMsg, MSG_CMSG_CLOEXEC);
+	if(iLen <= 0)
+	{
+		if(iLen < 0 && errno == EINTR) return;
+		Server_freeClient(psClient);
+		return;
+	}
+	acLine[iLen] = '\0';
+
+	for(psCmsg = CMSG_FIRSTHDR(&sMsg); psCmsg != NULL; psCmsg = CMSG_NXTHDR(&sMsg, psCmsg))
+	{
+		if(psCmsg->cmsg_level == SOL_SOCKET && psCmsg->cmsg_type == SCM_RIGHTS
+			&& psCmsg->cmsg_len == CMSG_LEN(3 * sizeof(int)))
+			memcpy(aiFds, CMSG_DATA(psCmsg), 3 * sizeof(int));
+	}
+
+	if(aiFds[0] == -1 || (sMsg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)))
+	{
+		for(i=0;i<3;i++) if(aiFds[i] != -1) close(aiFds[i]);
+		Server_freeClient(psClient);
+		return;
+	}
+
+	if(Server_start(psClient, acLine, aiFds, pfRunLine, pfNeedsShell))
+	{
+		/* Do not read the next request before this one is done */
+		sEvent.events = 0;
+		sEvent.data.ptr = psClient;
+		epoll_ctl(iEpollFd, EPOLL_CTL_MOD, psClient->iSock, &sEvent);
+	}
+	else Server_reply(psClient, psClient->iStatus);
+
+	/* The children hold their own copies now */
+	for(i=0;i<3;i++) close(aiFds[i]);
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Server_reap(int iSigFd)
+
+/* Reap every exited child and answer the clients whose request has
+   finished. */
+
+{
+	struct signalfd_siginfo sInfo;
+	struct Client *psClient;
+	int pid, iWaitStatus, i, j, iLength;
+
+	while(read(iSigFd, &sInfo, sizeof(sInfo)) == sizeof(sInfo))
+		;
+
+	while((pid = waitpid(-1, &iWaitStatus, WNOHANG)) > 0)
+	{
+		TRACE_INSTANT("reap", pid, -1);
+		iLength = DynArray_getLength(oClients);
+		for(i=0;i<iLength;i++)
+		{
+			psClient = DynArray_get(oClients,i);
+			for(j=0;j<psClient->iPids;j++)
+				if(psClient->piPids[j] == pid) break;
+			if(j == psClient->iPids) continue;
+
+			if(j == psClient->iPids-1)
+				psClient->iStatus = Exec_exitStatus(iWaitStatus);
+			if(--psClient->iRunning == 0)
+				Server_reply(psClient, psClient->iStatus);
+			break;
+		}
+	}
+}
+
+/*--------------------------------------------------------------------*/
+
+int Server_run(const char *pcPath, int (*pfRunLine)(char *pcLine),
+	int (*pfNeedsShell)(const char *pcName))
+
+/* Serve command lines on the UNIX socket pcPath. */
+
+{
+	struct sockaddr_un sAddr;
+	struct epoll_event sEvent, asEvents[MAX_EVENTS];
+	struct Client *psClient;
+	sigset_t sSet;
+	int iListenFd, iSigFd, iSock, n, i;
+
+	assert(pcPath != NULL);
+
+	if(strlen(pcPath) >= sizeof(sAddr.sun_path))
+	{
+		fprintf(stderr, "%s: %s: socket path too long\n", SYSTEM_NAME, pcPath);
+		return EXIT_FAILURE;
+	}
+
+	oClients = DynArray_new(0);
+	if(oClients == NULL)
+	{
+		fprintf(stderr, "Cannot allocate memory\n");
+		return EXIT_FAILURE;
+	}
+
+	/* Children are reaped through a signalfd, not by SIGCHLD_handler */
+	signal(SIGINT, SIG_DFL);
+	signal(SIGQUIT, SIG_DFL);
+	signal(SIGPIPE, SIG_IGN);
+	sigemptyset(&sSet);
+	sigaddset(&sSet, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &sSet, NULL);
+	iSigFd = signalfd(-1, &sSet, SFD_NONBLOCK | SFD_CLOEXEC);
+
+	iListenFd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	memset(&sAddr, 0, sizeof(sAddr));
+	sAddr.sun_family = AF_UNIX;
+	strcpy(sAddr.sun_path, pcPath);
+	unlink(pcPath);
+	if(iSigFd < 0 || iListenFd < 0
+		|| bind(iListenFd, (struct sockaddr *)&sAddr, sizeof(sAddr)) < 0
+		|| listen(iListenFd, SOMAXCONN) < 0)
+	{
+		fprintf(stderr, "%s: %s: %s\n", SYSTEM_NAME, pcPath, strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	iEpollFd = epoll_create1(EPOLL_CLOEXEC);
+	sEvent.events = EPOLLIN;
+	sEvent.data.ptr = &iListenMarker;
+	epoll_ctl(iEpollFd, EPOLL_CTL_ADD, iListenFd, &sEvent);
+	sEvent.data.ptr = &iSignalMarker;
+	epoll_ctl(iEpollFd, EPOLL_CTL_ADD, iSigFd, &sEvent);
+
+	for(;;)
+	{
+		n = epoll_wait(iEpollFd, asEvents, MAX_EVENTS, -1);
+		if(n < 0)
+		{
+			if(errno == EINTR) continue;
+			perror("epoll_wait");
+			return EXIT_FAILURE;
+		}
+
+		/* Reap first, so that a finished client is never read from
+		   while it still looks busy */
+		for(i=0;i<n;i++)
+			if(asEvents[i].data.ptr == &iSignalMarker) Server_reap(iSigFd);
+
+		for(i=0;i<n;i++)
+		{
+			if(asEvents[i].data.ptr == &iSignalMarker) continue;
+			if(asEvents[i].data.ptr == &iListenMarker)
+			{
+				while((iSock = accept4(iListenFd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK)) >= 0)
+				{
+					psClient = (struct Client *)calloc(1, sizeof(struct Client));
+					if(psClient == NULL || !DynArray_add(oClients, psClient))
+					{
+						free(psClient);
+						close(iSock);
+						continue;
+					}
+					psClient->iSock = iSock;
+					sEvent.events = EPOLLIN;
+					sEvent.data.ptr = psClient;
+					epoll_ctl(iEpollFd, EPOLL_CTL_ADD, iSock, &sEvent);
+				}
+				continue;
+			}
+
+			psClient = asEvents[i].data.ptr;
+			if(psClient->iRunning > 0)
+			{
+				/* Hung up while its request is running: forget the
+				   connection and drop the client once it is reaped */
+				if(asEvents[i].events & (EPOLLHUP | EPOLLERR))
+				{
+					epoll_ctl(iEpollFd, EPOLL_CTL_DEL, psClient->iSock, NULL);
+					close(psClient->iSock);
+					psClient->iSock = -1;
+				}
+				continue;
+			}
+			Server_receive(psClient, pfRunLine, pfNeedsShell);
+		}
+	}
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Client_send(int iSock, const char *pcLine, const int aiFds[3])
+
+/* Send pcLine with stdio aiFds over iSock and wait for the reply.
+   Return the exit status of the line, or -1 if the server went
+   away. */
+
+{
+	char acControl[CMSG_SPACE(3 * sizeof(int))];
+	struct msghdr sMsg;
+	struct iovec sIov;
+	struct cmsghdr *psCmsg;
+	int iStatus;
+
+	sIov.iov_base = (void *)pcLine;
+	sIov.iov_len = strlen(pcLine);
+	memset(&sMsg, 0, sizeof(sMsg));
+	memset(acControl, 0, sizeof(acControl));
+	sMsg.msg_iov = &sIov;
+	sMsg.msg_iovlen = 1;
+	sMsg.msg_control = acControl;
+	sMsg.msg_controllen = sizeof(acControl);
+	psCmsg = CMSG_FIRSTHDR(&sMsg);
+	psCmsg->cmsg_level = SOL_SOCKET;
+	psCmsg->cmsg_type = SCM_RIGHTS;
+	psCmsg->cmsg_len = CMSG_LEN(3 * sizeof(int));
+	memcpy(CMSG_DATA(psCmsg), aiFds, 3 * sizeof(int));
+
+	if(sendmsg(iSock, &sMsg, MSG_NOSIGNAL) < 0) return -1;
+	if(recv(iSock, &iStatus, sizeof(iStatus), 0) != sizeof(iStatus)) return -1;
+	return iStatus;
+}
+
+/*--------------------------------------------------------------------*/
+
+int Client_run(const char *pcPath, const char *pcLine)
+
+/* Run pcLine, or each line of stdin, on the server at pcPath. */
+
+{
+	struct sockaddr_un sAddr;
+	char *pcBuffer = NULL;
+	size_t iBufferSize = 0;
+	ssize_t iLen;
+	int aiFds[3] = {0, 1, 2};
+	int iSock, iStatus = 0;
+
+	assert(pcPath != NULL);
+
+	if(strlen(pcPath) >= sizeof(sAddr.sun_path)
+		|| (pcLine != NULL && strlen(pcLine) >= MAX_LINE_SIZE))
+	{
+		fprintf(stderr, "%s: argument too long\n", SYSTEM_NAME);
+		return EXIT_FAILURE;
+	}
+
+	iSock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+	memset(&sAddr, 0, sizeof(sAddr));
+	sAddr.sun_family = AF_UNIX;
+	strcpy(sAddr.sun_path, pcPath);
+	if(iSock < 0 || connect(iSock, (struct sockaddr *)&sAddr, sizeof(sAddr)) < 0)
+	{
+		fprintf(stderr, "%s: %s: %s\n", SYSTEM_NAME, pcPath, strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	if(pcLine != NULL) iStatus = Client_send(iSock, pcLine, aiFds);
+	else
+	{
+		/* stdin carries the lines, so the commands get /dev/null */
+		aiFds[0] = open("/dev/null", O_RDONLY | O_CLOEXEC);
+		while(iStatus != -1 && (iLen = getline(&pcBuffer, &iBufferSize, stdin)) != -1)
+		{
+			/* The server takes a line in one request, so a longer
+			   one is refused rather than run in pieces */
+			if(iLen >= MAX_LINE_SIZE)
+			{
+				fprintf(stderr, "%s: line too long\n", SYSTEM_NAME);
+				iStatus = EXIT_FAILURE;
+				continue;
+			}
+			iStatus = Client_send(iSock, pcBuffer, aiFds);
+		}
+		free(pcBuffer);
+	}
+
+	if(iStatus == -1)
+	{
+		fprintf(stderr, "%s: %s: server closed the connection\n", SYSTEM_NAME, pcPath);
+		iStatus = EXIT_FAILURE;
+	}
+	close(iSock);
+	return iStatus;
+}
@@ -0,0 +1,21 @@
+#ifndef SERVER_INCLUDED
+#define SERVER_INCLUDED
+
+/* Accept clients on the UNIX socket pcPath and run the command lines
+   they send.  Each request carries the client's stdin, stdout and
+   stderr, which become the stdio of the command, and is answered with
+   the exit status of the line.  Command lists and lines with a stage
+   whose first word satisfies *pfNeedsShell, such as a built-in, an
+   alias or a function defined in .ishrc, are run by *pfRunLine in a
+   forked worker; other pipelines are planned and spawned directly by
+   the server.  Return EXIT_FAILURE if the server could not be set up;
+   otherwise never returns. */
+int Server_run(const char *pcPath, int (*pfRunLine)(char *pcLine),
+	int (*pfNeedsShell)(const char *pcName));
+
+/* Connect to the server listening on pcPath and run pcLine there with
+   this process's stdio.  If pcLine is NULL, send each line read from
+   stdin instead.  Return the exit status of the last line. */
+int Client_run(const char *pcPath, const char *pcLine);
+
+#endif
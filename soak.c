@@ -0,0 +1,680 @@
+/*--------------------------------------------------------------------*/
+/* soak.c                                                             */
+/* Load and soak test of ish: drive the shell through a pipe with     */
+/* many background jobs, short foreground pipelines and signal        */
+/* storms, and check its reaping path against thresholds.             */
+/*--------------------------------------------------------------------*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+/*--------------------------------------------------------------------*/
+
+enum {FALSE, TRUE};
+
+enum {MAX_LINE_SIZE = 1024, MAX_PATH_SIZE = 1024};
+
+/* Foreground commands run before the baseline RSS is taken */
+enum {WARMUP_LINES = 200};
+
+/* The lines of the lines phase, sent in turn: built-ins, aliases,
+   functions, blocks, quotes across lines and errors, which the shell
+   runs without forking */
+static const char *apcLines[] = {"setenv SOAK_X 1\n", "cd .\n",
+	"alias soak_a='cd .'\n", "soak_a\n", "unalias soak_a\n",
+	"soak_f() { cd . ; }\n", "soak_f a b\n",
+	"if cd .; then setenv SOAK_X \"$SOAK_X\"; fi\n",
+	"setenv SOAK_Y 'a\nb'\n", "true ; | soak_bad\n"};
+enum {LINE_KINDS = sizeof(apcLines) / sizeof(apcLines[0])};
+
+/* One line in LINES_PER_FORK of the lines phase is a pipeline with
+   redirections, which goes through the planner and the job table */
+enum {LINES_PER_FORK = 1000};
+
+/* How long to wait for a sync marker, for the jobs to be reaped after
+   the last one, and for the shell to exit on SIGQUIT (ms) */
+enum {SYNC_TIMEOUT = 120000, DRAIN_TIMEOUT = 10000, QUIT_TIMEOUT = 2000};
+
+/* Interval between zombie samples and SIGQUITs (ms) */
+enum {SAMPLE_INTERVAL = 10};
+
+/* The phases of a run, in order.  Each one but the last two ends with
+   a sync marker echoed by the shell. */
+enum Phase {PHASE_WARMUP, PHASE_JOBS, PHASE_PIPELINES, PHASE_LINES,
+	PHASE_DRAIN, PHASE_QUIT, PHASE_DONE};
+
+/* The options of a run and the thresholds it must stay within */
+struct Options
+{
+	int iJobs;
+	int iPipelines;
+	int iLines;
+	int iSignals;
+	double dMaxLatency;
+	int iMaxZombies;
+	long lMaxRssGrowth;
+	int iMaxAsserts;
+};
+
+/* The state of a run */
+struct Soak
+{
+	struct Options sOptions;
+
+	/* The shell, its stdin and merged stdout/stderr */
+	int iPid;
+	int iToShell, iFromShell;
+
+	/* Set once the shell has been reaped, with its wait status */
+	int iExited, iStatus;
+
+	enum Phase ePhase;
+	int iSent, iSignalsSent, iSyncSeen;
+
+	/* The sync marker that ends the current phase, or 0 if not sent */
+	int iPhaseSync;
+	long long llPhaseStart;
+
+	/* Pending output to the shell */
+	char acOut[MAX_LINE_SIZE];
+	int iOutLen, iOutPos;
+
+	/* Partial line from the shell */
+	char acIn[4 * MAX_LINE_SIZE];
+	int iInLen;
+
+	/* Exit times of jobs not reaped yet, in an open-addressed table
+	   keyed by pid (0 is an empty slot) */
+	int *piStampPid;
+	long long *pllStampTime;
+	int iStampSize;
+
+	/* Reaping latencies (ms) */
+	double *pdLatency;
+	int iLatencies, iStamped;
+
+	int iMaxZombies, iFinalZombies;
+	long lRssStart, lRssEnd;
+	int iAsserts;
+	long long llLastSample;
+};
+
+/*--------------------------------------------------------------------*/
+
+static long long Soak_now(void)
+
+/* Return CLOCK_MONOTONIC in nanoseconds. */
+
+{
+	struct timespec sNow;
+
+	clock_gettime(CLOCK_MONOTONIC, &sNow);
+	return (long long)sNow.tv_sec * 1000000000LL + sNow.tv_nsec;
+}
+
+/*--------------------------------------------------------------------*/
+
+static long Soak_getRss(int iPid)
+
+/* Return VmRSS of iPid in kB, or -1 if it cannot be read. */
+
+{
+	char acPath[MAX_PATH_SIZE], acLine[MAX_LINE_SIZE];
+	FILE *psFile;
+	long lRss = -1;
+
+	snprintf(acPath, MAX_PATH_SIZE, "/proc/%d/status", iPid);
+	psFile = fopen(acPath, "r");
+	if(psFile == NULL) return -1;
+	while(fgets(acLine, MAX_LINE_SIZE, psFile) != NULL)
+		if(sscanf(acLine, "VmRSS: %ld", &lRss) == 1) break;
+	fclose(psFile);
+	return lRss;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Soak_countZombies(int iParent)
+
+/* Return the number of zombie children of iParent. */
+
+{
+	char acPath[MAX_PATH_SIZE], acStat[MAX_LINE_SIZE], *pc;
+	struct dirent *psEntry;
+	DIR *psDir;
+	FILE *psFile;
+	int iCount = 0, iPpid;
+	char cState;
+
+	psDir = opendir("/proc");
+	if(psDir == NULL) return 0;
+	while((psEntry = readdir(psDir)) != NULL)
+	{
+		if(psEntry->d_name[0] < '0' || psEntry->d_name[0] > '9') continue;
+		snprintf(acPath, MAX_PATH_SIZE, "/proc/%s/stat", psEntry->d_name);
+		psFile = fopen(acPath, "r");
+		if(psFile == NULL) continue;
+		if(fgets(acStat, MAX_LINE_SIZE, psFile) != NULL)
+		{
+			/* The command name may hold spaces and parentheses */
+			pc = strrchr(acStat, ')');
+			if(pc != NULL && sscanf(pc + 1, " %c %d", &cState, &iPpid) == 2
+				&& cState == 'Z' && iPpid == iParent)
+				iCount++;
+		}
+		fclose(psFile);
+	}
+	closedir(psDir);
+	return iCount;
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Soak_addStamp(struct Soak *psSoak, int iPid, long long llTime)
+
+/* Remember that job iPid exited at llTime. */
+
+{
+	int i = iPid & (psSoak->iStampSize - 1);
+
+	while(psSoak->piStampPid[i] != 0 && psSoak->piStampPid[i] != iPid)
+		i = (i + 1) & (psSoak->iStampSize - 1);
+	psSoak->piStampPid[i] = iPid;
+	psSoak->pllStampTime[i] = llTime;
+	psSoak->iStamped++;
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Soak_reaped(struct Soak *psSoak, int iPid, long long llTime)
+
+/* Record the reaping latency of job iPid, reported at llTime, if its
+   exit time is known. */
+
+{
+	int i = iPid & (psSoak->iStampSize - 1), j, k;
+
+	while(psSoak->piStampPid[i] != iPid)
+	{
+		if(psSoak->piStampPid[i] == 0) return;
+		i = (i + 1) & (psSoak->iStampSize - 1);
+	}
+	if(psSoak->iLatencies < psSoak->sOptions.iJobs)
+		psSoak->pdLatency[psSoak->iLatencies++] =
+			(llTime - psSoak->pllStampTime[i]) / 1e6;
+
+	/* Delete slot i, moving later entries of its cluster back */
+	psSoak->piStampPid[i] = 0;
+	for(j = (i + 1) & (psSoak->iStampSize - 1); psSoak->piStampPid[j] != 0;
+		j = (j + 1) & (psSoak->iStampSize - 1))
+	{
+		k = psSoak->piStampPid[j] & (psSoak->iStampSize - 1);
+		if((j > i && (k <= i || k > j)) || (j < i && k <= i && k > j))
+		{
+			psSoak->piStampPid[i] = psSoak->piStampPid[j];
+			psSoak->pllStampTime[i] = psSoak->pllStampTime[j];
+			psSoak->piStampPid[j] = 0;
+			i = j;
+		}
+	}
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Soak_parseLine(struct Soak *psSoak, const char *pcLine)
+
+/* Account for one line of output of the shell.  Prompts are not ended
+   by a newline, so the messages may follow some of them. */
+
+{
+	const char *pc;
+	long long llTime;
+	int iPid, iSync;
+
+	if((pc = strstr(pcLine, "__soak_exit ")) != NULL)
+	{
+		if(sscanf(pc, "__soak_exit %d %lld", &iPid, &llTime) == 2)
+			Soak_addStamp(psSoak, iPid, llTime);
+	}
+	else if((pc = strstr(pcLine, "child ")) != NULL)
+	{
+		if(sscanf(pc, "child %d terminated", &iPid) == 1)
+			Soak_reaped(psSoak, iPid, Soak_now());
+	}
+	else if((pc = strstr(pcLine, "__soak_sync ")) != NULL)
+	{
+		if(sscanf(pc, "__soak_sync %d", &iSync) == 1 && iSync > psSoak->iSyncSeen)
+			psSoak->iSyncSeen = iSync;
+	}
+	if(strstr(pcLine, "Assertion") != NULL)
+	{
+		psSoak->iAsserts++;
+		fprintf(stderr, "soak: %s\n", pcLine);
+	}
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Soak_read(struct Soak *psSoak)
+
+/* Read the available output of the shell and parse its complete
+   lines. */
+
+{
+	char *pcStart, *pcEnd;
+	int iRead;
+
+	iRead = read(psSoak->iFromShell, psSoak->acIn + psSoak->iInLen,
+		sizeof(psSoak->acIn) - 1 - psSoak->iInLen);
+	if(iRead <= 0) return;
+	psSoak->iInLen += iRead;
+	psSoak->acIn[psSoak->iInLen] = '\0';
+
+	pcStart = psSoak->acIn;
+	while((pcEnd = strchr(pcStart, '\n')) != NULL)
+	{
+		*pcEnd = '\0';
+		Soak_parseLine(psSoak, pcStart);
+		pcStart = pcEnd + 1;
+	}
+
+	/* A line longer than the buffer is parsed in pieces */
+	psSoak->iInLen -= pcStart - psSoak->acIn;
+	if(psSoak->iInLen == (int)sizeof(psSoak->acIn) - 1)
+	{
+		Soak_parseLine(psSoak, pcStart);
+		psSoak->iInLen = 0;
+	}
+	memmove(psSoak->acIn, pcStart, psSoak->iInLen);
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Soak_nextLine(struct Soak *psSoak, const char *pcSelf)
+
+/* Queue the next command line of the current phase, if any, and
+   advance to the next phase once its sync marker has come back. */
+
+{
+	int iCount = 0, iWanted;
+
+	switch(psSoak->ePhase)
+	{
+	case PHASE_WARMUP: iCount = WARMUP_LINES; break;
+	case PHASE_JOBS: iCount = psSoak->sOptions.iJobs; break;
+	case PHASE_PIPELINES: iCount = psSoak->sOptions.iPipelines; break;
+	case PHASE_LINES: iCount = psSoak->sOptions.iLines; break;
+	default: return;
+	}
+
+	if(psSoak->iSent < iCount)
+	{
+		if(psSoak->ePhase == PHASE_WARMUP)
+			psSoak->iOutLen = snprintf(psSoak->acOut, MAX_LINE_SIZE, "true\n");
+		else if(psSoak->ePhase == PHASE_JOBS)
+			psSoak->iOutLen = snprintf(psSoak->acOut, MAX_LINE_SIZE, "%s --exit &\n", pcSelf);
+		else if(psSoak->ePhase == PHASE_LINES)
+		{
+			if((psSoak->iSent + 1) % LINES_PER_FORK == 0)
+				psSoak->iOutLen = snprintf(psSoak->acOut, MAX_LINE_SIZE, "true < /dev/null > /dev/null\n");
+			else
+				psSoak->iOutLen = snprintf(psSoak->acOut, MAX_LINE_SIZE, "%s", apcLines[psSoak->iSent % LINE_KINDS]);
+		}
+		else
+		{
+			psSoak->iOutLen = snprintf(psSoak->acOut, MAX_LINE_SIZE, "true | true\n");
+
+			/* SIGINT storm, spread over the pipelines while they run */
+			iWanted = (long)(psSoak->iSent + 1) * psSoak->sOptions.iSignals / iCount;
+			while(psSoak->iSignalsSent < iWanted)
+			{
+				kill(psSoak->iPid, SIGINT);
+				psSoak->iSignalsSent++;
+			}
+		}
+		psSoak->iOutPos = 0;
+		psSoak->iSent++;
+	}
+	else if(psSoak->iPhaseSync == 0)
+	{
+		/* Written only after the last signal of the phase, so that the
+		   storm cannot kill the echo */
+		psSoak->iPhaseSync = psSoak->ePhase + 1;
+		psSoak->iOutLen = snprintf(psSoak->acOut, MAX_LINE_SIZE, "echo __soak_sync %d\n", psSoak->iPhaseSync);
+		psSoak->iOutPos = 0;
+	}
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Soak_advance(struct Soak *psSoak)
+
+/* Move to the next phase once the current one is complete. */
+
+{
+	long long llNow = Soak_now();
+
+	switch(psSoak->ePhase)
+	{
+	case PHASE_WARMUP:
+	case PHASE_JOBS:
+	case PHASE_PIPELINES:
+	case PHASE_LINES:
+		if(psSoak->iPhaseSync == 0 || psSoak->iSyncSeen < psSoak->iPhaseSync) return;
+		/* Every job must have run before the storm, which would kill
+		   the ones still starting */
+		if(psSoak->ePhase == PHASE_JOBS && psSoak->iStamped < psSoak->sOptions.iJobs) return;
+		if(psSoak->ePhase == PHASE_WARMUP)
+			psSoak->lRssStart = Soak_getRss(psSoak->iPid);
+		break;
+	case PHASE_DRAIN:
+		/* Every job that reported its exit must be reaped */
+		if(psSoak->iLatencies < psSoak->iStamped
+			&& llNow - psSoak->llPhaseStart < DRAIN_TIMEOUT * 1000000LL)
+			return;
+		psSoak->iFinalZombies = Soak_countZombies(psSoak->iPid);
+		psSoak->lRssEnd = Soak_getRss(psSoak->iPid);
+		break;
+	case PHASE_QUIT:
+		if(!psSoak->iExited && llNow - psSoak->llPhaseStart < QUIT_TIMEOUT * 1000000LL)
+			return;
+		break;
+	default:
+		return;
+	}
+	psSoak->ePhase++;
+	psSoak->iSent = 0;
+	psSoak->iPhaseSync = 0;
+	psSoak->llPhaseStart = llNow;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Soak_start(struct Soak *psSoak, const char *pcShell)
+
+/* Start pcShell with a pipe as stdin and another one as stdout and
+   stderr.  Return 1 (TRUE) if successful. */
+
+{
+	int aiIn[2], aiOut[2];
+	struct rlimit sNoCore = {0, 0};
+
+	if(pipe2(aiIn, O_CLOEXEC) != 0 || pipe2(aiOut, O_CLOEXEC) != 0)
+		return FALSE;
+
+	psSoak->iPid = fork();
+	if(psSoak->iPid < 0) return FALSE;
+	if(psSoak->iPid == 0)
+	{
+		dup2(aiIn[0], 0);
+		dup2(aiOut[1], 1);
+		dup2(aiOut[1], 2);
+		/* Keep the storm away from the harness, SIGQUIT from dumping
+		   cores of the jobs, and any .ishrc out of the run */
+		setpgid(0, 0);
+		setrlimit(RLIMIT_CORE, &sNoCore);
+		setenv("HOME", "/dev/null", 1);
+		execl(pcShell, pcShell, (char *)NULL);
+		perror(pcShell);
+		_exit(127);
+	}
+	close(aiIn[0]);
+	close(aiOut[1]);
+	psSoak->iToShell = aiIn[1];
+	psSoak->iFromShell = aiOut[0];
+	fcntl(psSoak->iToShell, F_SETFL, O_NONBLOCK);
+	fcntl(psSoak->iFromShell, F_SETFL, O_NONBLOCK);
+	return TRUE;
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Soak_run(struct Soak *psSoak, const char *pcSelf)
+
+/* Drive the shell through all phases. */
+
+{
+	struct pollfd asFds[2];
+	long long llNow;
+	int iWritten, iNfds;
+
+	psSoak->llPhaseStart = Soak_now();
+	while(psSoak->ePhase != PHASE_DONE)
+	{
+		llNow = Soak_now();
+
+		if(!psSoak->iExited && waitpid(psSoak->iPid, &psSoak->iStatus, WNOHANG) == psSoak->iPid)
+			psSoak->iExited = TRUE;
+		if(psSoak->iExited && psSoak->ePhase < PHASE_QUIT)
+		{
+			fprintf(stderr, "soak: the shell died before the end of the run\n");
+			Soak_read(psSoak);
+			break;
+		}
+		if(psSoak->ePhase < PHASE_DRAIN
+			&& llNow - psSoak->llPhaseStart > SYNC_TIMEOUT * 1000000LL)
+		{
+			fprintf(stderr, "soak: timed out in phase %d\n", (int)psSoak->ePhase);
+			break;
+		}
+
+		if(llNow - psSoak->llLastSample >= SAMPLE_INTERVAL * 1000000LL)
+		{
+			int iZombies = Soak_countZombies(psSoak->iPid);
+			if(iZombies > psSoak->iMaxZombies) psSoak->iMaxZombies = iZombies;
+			/* A storm of SIGQUIT must make the shell exit cleanly */
+			if(psSoak->ePhase == PHASE_QUIT && !psSoak->iExited)
+				kill(psSoak->iPid, SIGQUIT);
+			psSoak->llLastSample = llNow;
+		}
+
+		if(psSoak->iOutPos == psSoak->iOutLen)
+			Soak_nextLine(psSoak, pcSelf);
+
+		asFds[0].fd = psSoak->iFromShell;
+		asFds[0].events = POLLIN;
+		asFds[1].fd = psSoak->iToShell;
+		asFds[1].events = POLLOUT;
+		iNfds = (psSoak->iOutPos < psSoak->iOutLen) ? 2 : 1;
+		if(poll(asFds, iNfds, SAMPLE_INTERVAL) > 0)
+		{
+			if(asFds[0].revents & (POLLIN | POLLHUP))
+				Soak_read(psSoak);
+			if(iNfds == 2 && (asFds[1].revents & POLLOUT))
+			{
+				iWritten = write(psSoak->iToShell, psSoak->acOut + psSoak->iOutPos,
+					psSoak->iOutLen - psSoak->iOutPos);
+				if(iWritten > 0) psSoak->iOutPos += iWritten;
+			}
+		}
+
+		Soak_advance(psSoak);
+	}
+
+	if(!psSoak->iExited)
+	{
+		kill(psSoak->iPid, SIGKILL);
+		waitpid(psSoak->iPid, &psSoak->iStatus, 0);
+	}
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Soak_compare(const void *pv1, const void *pv2)
+
+/* Compare two latencies for qsort. */
+
+{
+	double d1 = *(const double *)pv1, d2 = *(const double *)pv2;
+
+	return (d1 > d2) - (d1 < d2);
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Soak_report(struct Soak *psSoak)
+
+/* Print the results of the run and check them against the thresholds.
+   Return 1 (TRUE) if the run passed. */
+
+{
+	struct Options *psOptions = &psSoak->sOptions;
+	double dP50 = 0, dP99 = 0, dMax = 0;
+	long lGrowth = psSoak->lRssEnd - psSoak->lRssStart;
+	int iPassed = TRUE;
+
+	if(psSoak->iLatencies > 0)
+	{
+		qsort(psSoak->pdLatency, psSoak->iLatencies, sizeof(double), Soak_compare);
+		dP50 = psSoak->pdLatency[psSoak->iLatencies / 2];
+		dP99 = psSoak->pdLatency[(psSoak->iLatencies * 99) / 100];
+		dMax = psSoak->pdLatency[psSoak->iLatencies - 1];
+	}
+
+	printf("soak: %d jobs, %d pipelines, %d lines, %d SIGINTs\n",
+		psOptions->iJobs, psOptions->iPipelines, psOptions->iLines, psSoak->iSignalsSent);
+	printf("soak: reaped %d of %d jobs, latency p50 %.2fms p99 %.2fms max %.2fms\n",
+		psSoak->iLatencies, psSoak->iStamped, dP50, dP99, dMax);
+	printf("soak: zombies max %d, after drain %d\n", psSoak->iMaxZombies, psSoak->iFinalZombies);
+	printf("soak: rss %ldkB -> %ldkB (%+ldkB)\n", psSoak->lRssStart, psSoak->lRssEnd, lGrowth);
+	printf("soak: assertion failures %d\n", psSoak->iAsserts);
+
+	if(psSoak->ePhase != PHASE_DONE)
+	{
+		printf("soak: FAIL: the run did not complete\n");
+		iPassed = FALSE;
+	}
+	if(psSoak->iLatencies < psSoak->iStamped || psSoak->iStamped < psOptions->iJobs)
+	{
+		printf("soak: FAIL: %d jobs were never reported\n",
+			psOptions->iJobs - psSoak->iLatencies);
+		iPassed = FALSE;
+	}
+	if(dP99 > psOptions->dMaxLatency)
+	{
+		printf("soak: FAIL: p99 reaping latency above %.2fms\n", psOptions->dMaxLatency);
+		iPassed = FALSE;
+	}
+	if(psSoak->iMaxZombies > psOptions->iMaxZombies || psSoak->iFinalZombies > 0)
+	{
+		printf("soak: FAIL: more than %d zombies, or zombies left\n", psOptions->iMaxZombies);
+		iPassed = FALSE;
+	}
+	if(psSoak->lRssStart < 0 || psSoak->lRssEnd < 0 || lGrowth > psOptions->lMaxRssGrowth)
+	{
+		printf("soak: FAIL: rss growth above %ldkB\n", psOptions->lMaxRssGrowth);
+		iPassed = FALSE;
+	}
+	if(psSoak->iAsserts > psOptions->iMaxAsserts)
+	{
+		printf("soak: FAIL: more than %d assertion failures\n", psOptions->iMaxAsserts);
+		iPassed = FALSE;
+	}
+	if(psSoak->iExited && !(WIFEXITED(psSoak->iStatus) && WEXITSTATUS(psSoak->iStatus) == 0))
+	{
+		printf("soak: FAIL: the shell did not exit cleanly on SIGQUIT\n");
+		iPassed = FALSE;
+	}
+	printf("soak: %s\n", iPassed ? "PASS" : "FAIL");
+	return iPassed;
+}
+
+/*--------------------------------------------------------------------*/
+
+int main(int argc, char *argv[])
+
+/* soak [-j jobs] [-f pipelines] [-n lines] [-s signals]
+        [-l p99 latency ms] [-z zombies] [-r rss growth kB]
+        [-a assertion failures] shell
+   Return 0 iff the shell stays within every threshold.  Run as
+   "soak --exit", print the pid and time and exit: the job of the
+   background phase. */
+
+{
+	struct Soak sSoak;
+	char acSelf[MAX_PATH_SIZE];
+	int iOpt, iLen;
+
+	if(argc == 2 && strcmp(argv[1], "--exit") == 0)
+	{
+		printf("__soak_exit %d %lld\n", (int)getpid(), Soak_now());
+		return 0;
+	}
+
+	memset(&sSoak, 0, sizeof(sSoak));
+	sSoak.sOptions.iJobs = 10000;
+	sSoak.sOptions.iPipelines = 5000;
+	sSoak.sOptions.iLines = 1000000;
+	sSoak.sOptions.iSignals = 500;
+	sSoak.sOptions.dMaxLatency = 50;
+	sSoak.sOptions.iMaxZombies = 64;
+	sSoak.sOptions.lMaxRssGrowth = 512;
+	sSoak.sOptions.iMaxAsserts = 0;
+
+	while((iOpt = getopt(argc, argv, "j:f:n:s:l:z:r:a:")) != -1)
+	{
+		switch(iOpt)
+		{
+		case 'j': sSoak.sOptions.iJobs = atoi(optarg); break;
+		case 'f': sSoak.sOptions.iPipelines = atoi(optarg); break;
+		case 'n': sSoak.sOptions.iLines = atoi(optarg); break;
+		case 's': sSoak.sOptions.iSignals = atoi(optarg); break;
+		case 'l': sSoak.sOptions.dMaxLatency = atof(optarg); break;
+		case 'z': sSoak.sOptions.iMaxZombies = atoi(optarg); break;
+		case 'r': sSoak.sOptions.lMaxRssGrowth = atol(optarg); break;
+		case 'a': sSoak.sOptions.iMaxAsserts = atoi(optarg); break;
+		default: optind = argc + 1; break;
+		}
+	}
+	if(optind != argc - 1 || sSoak.sOptions.iJobs <= 0 || sSoak.sOptions.iPipelines <= 0
+		|| sSoak.sOptions.iLines < 0)
+	{
+		fprintf(stderr, "Usage: %s [-j jobs] [-f pipelines] [-n lines] [-s signals] [-l ms] [-z zombies] [-r kB] [-a asserts] shell\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	/* The jobs run this program by its absolute path */
+	iLen = readlink("/proc/self/exe", acSelf, MAX_PATH_SIZE - 1);
+	if(iLen < 0)
+	{
+		perror("/proc/self/exe");
+		return EXIT_FAILURE;
+	}
+	acSelf[iLen] = '\0';
+
+	for(sSoak.iStampSize = 1; sSoak.iStampSize < 2 * sSoak.sOptions.iJobs; sSoak.iStampSize *= 2);
+	sSoak.piStampPid = (int *)calloc(sSoak.iStampSize, sizeof(int));
+	sSoak.pllStampTime = (long long *)calloc(sSoak.iStampSize, sizeof(long long));
+	sSoak.pdLatency = (double *)calloc(sSoak.sOptions.iJobs, sizeof(double));
+	if(sSoak.piStampPid == NULL || sSoak.pllStampTime == NULL || sSoak.pdLatency == NULL)
+	{
+		fprintf(stderr, "Cannot allocate memory\n");
+		return EXIT_FAILURE;
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+	if(!Soak_start(&sSoak, argv[optind]))
+	{
+		perror(argv[optind]);
+		return EXIT_FAILURE;
+	}
+	Soak_run(&sSoak, acSelf);
+
+	iOpt = Soak_report(&sSoak);
+	free(sSoak.piStampPid);
+	free(sSoak.pllStampTime);
+	free(sSoak.pdLatency);
+	return iOpt ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,209 @@
+#include "stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+
+/*--------------------------------------------------------------------*/
+
+/* The histograms are log-linear, as in HdrHistogram: values below
+   LINEAR_BUCKETS have a bucket each, and every larger power of two is
+   split into 2^SUB_BITS buckets, so a bucket is within 1/2^SUB_BITS
+   of its values.  Larger values, from about 25 days, share the last
+   bucket. */
+enum {SUB_BITS = 3, SUB_BUCKETS = 1 << SUB_BITS};
+enum {MAX_EXPONENT = 40};
+enum {LINEAR_BUCKETS = 2 * SUB_BUCKETS};
+enum {HISTOGRAM_BUCKETS = LINEAR_BUCKETS + (MAX_EXPONENT - SUB_BITS) * SUB_BUCKETS};
+
+struct Histogram
+{
+	long lCount;
+	long long llSum, llMin, llMax;
+	long alBuckets[HISTOGRAM_BUCKETS];
+};
+
+static const char *apcCounterNames[STATS_COUNTERS] = {"forks", "execs",
+	"builtins", "lex_errors", "path_hits", "path_misses", "glob_reads",
+	"glob_hits"};
+
+static const char *apcHistogramNames[STATS_HISTOGRAMS] = {"spawn_us",
+	"fg_wall_us", "bg_lifetime_us"};
+
+/* Written by the main loop and SIGCHLD_handler; plain stores, so that
+   the handler never allocates */
+static volatile long alCounters[STATS_COUNTERS];
+static struct Histogram asHistograms[STATS_HISTOGRAMS];
+
+/*--------------------------------------------------------------------*/
+
+long long Stats_now(void)
+
+/* Return the current time in microseconds. */
+
+{
+	struct timespec sNow;
+
+	clock_gettime(CLOCK_MONOTONIC, &sNow);
+	return (long long)sNow.tv_sec * 1000000LL + sNow.tv_nsec / 1000;
+}
+
+/*--------------------------------------------------------------------*/
+
+void Stats_count(enum StatsCounter eCounter, long lAmount)
+
+/* Add lAmount to counter eCounter. */
+
+{
+	assert(eCounter < STATS_COUNTERS);
+	alCounters[eCounter] += lAmount;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Stats_bucket(long long llValue)
+
+/* Return the bucket of llValue. */
+
+{
+	int iExponent = 0, iBucket;
+
+	if(llValue < LINEAR_BUCKETS) return (int)llValue;
+	while((llValue >> iExponent) >= 2 * SUB_BUCKETS) iExponent++;
+	/* llValue >> iExponent is in [SUB_BUCKETS, 2*SUB_BUCKETS) */
+	iBucket = LINEAR_BUCKETS + (iExponent - 1) * SUB_BUCKETS
+		+ (int)(llValue >> iExponent) - SUB_BUCKETS;
+	return iBucket < HISTOGRAM_BUCKETS ? iBucket : HISTOGRAM_BUCKETS - 1;
+}
+
+/*--------------------------------------------------------------------*/
+
+static long long Stats_bucketLimit(int iBucket)
+
+/* Return the largest value of bucket iBucket. */
+
+{
+	int iExponent;
+
+	if(iBucket < LINEAR_BUCKETS) return iBucket;
+	iExponent = (iBucket - LINEAR_BUCKETS) / SUB_BUCKETS + 1;
+	return ((long long)(SUB_BUCKETS + (iBucket - LINEAR_BUCKETS) % SUB_BUCKETS + 1)
+		<< iExponent) - 1;
+}
+
+/*--------------------------------------------------------------------*/
+
+void Stats_record(enum StatsHistogram eHistogram, long long llMicros)
+
+/* Record llMicros in histogram eHistogram. */
+
+{
+	struct Histogram *psHistogram;
+
+	assert(eHistogram < STATS_HISTOGRAMS);
+
+	psHistogram = &asHistograms[eHistogram];
+	if(llMicros < 0) llMicros = 0;
+	if(psHistogram->lCount == 0 || llMicros < psHistogram->llMin)
+		psHistogram->llMin = llMicros;
+	if(llMicros > psHistogram->llMax) psHistogram->llMax = llMicros;
+	psHistogram->llSum += llMicros;
+	psHistogram->alBuckets[Stats_bucket(llMicros)]++;
+	psHistogram->lCount++;
+}
+
+/*--------------------------------------------------------------------*/
+
+static long long Stats_percentile(const struct Histogram *psHistogram,
+	int iPercent)
+
+/* Return the iPercent'th percentile of psHistogram, to the precision
+   of its buckets. */
+
+{
+	long lRank, lSeen = 0;
+	int i;
+
+	if(psHistogram->lCount == 0) return 0;
+	lRank = (psHistogram->lCount * iPercent + 99) / 100;
+	if(lRank < 1) lRank = 1;
+	for(i=0;i<HISTOGRAM_BUCKETS;i++)
+	{
+		lSeen += psHistogram->alBuckets[i];
+		if(lSeen >= lRank)
+			return Stats_bucketLimit(i) < psHistogram->llMax
+				? Stats_bucketLimit(i) : psHistogram->llMax;
+	}
+	return psHistogram->llMax;
+}
+
+/*--------------------------------------------------------------------*/
+
+void Stats_print(FILE *psFile, int iJson)
+
+/* Print all counters and histograms to psFile. */
+
+{
+	const struct Histogram *psHistogram;
+	int i, j, iFirst;
+
+	assert(psFile != NULL);
+
+	if(!iJson)
+	{
+		for(i=0;i<STATS_COUNTERS;i++)
+			fprintf(psFile, "%-16s %ld\n", apcCounterNames[i], alCounters[i]);
+		for(i=0;i<STATS_HISTOGRAMS;i++)
+		{
+			psHistogram = &asHistograms[i];
+			fprintf(psFile, "%-16s count %ld", apcHistogramNames[i], psHistogram->lCount);
+			if(psHistogram->lCount > 0)
+				fprintf(psFile, " min %lld mean %lld p50 %lld p90 %lld p99 %lld max %lld",
+					psHistogram->llMin, psHistogram->llSum / psHistogram->lCount,
+					Stats_percentile(psHistogram, 50), Stats_percentile(psHistogram, 90),
+					Stats_percentile(psHistogram, 99), psHistogram->llMax);
+			fprintf(psFile, "\n");
+		}
+		return;
+	}
+
+	fprintf(psFile, "{\"counters\":{");
+	for(i=0;i<STATS_COUNTERS;i++)
+		fprintf(psFile, "%s\"%s\":%ld", i ? "," : "", apcCounterNames[i], alCounters[i]);
+	fprintf(psFile, "},\"histograms\":{");
+	for(i=0;i<STATS_HISTOGRAMS;i++)
+	{
+		psHistogram = &asHistograms[i];
+		fprintf(psFile, "%s\"%s\":{\"count\":%ld,\"min\":%lld,\"mean\":%lld,\"p50\":%lld,\"p90\":%lld,\"p99\":%lld,\"max\":%lld,\"buckets\":[",
+			i ? "," : "", apcHistogramNames[i], psHistogram->lCount,
+			psHistogram->llMin,
+			psHistogram->lCount ? psHistogram->llSum / psHistogram->lCount : 0,
+			Stats_percentile(psHistogram, 50), Stats_percentile(psHistogram, 90),
+			Stats_percentile(psHistogram, 99), psHistogram->llMax);
+		/* Only the buckets in use, as [largest value, count] */
+		iFirst = 1;
+		for(j=0;j<HISTOGRAM_BUCKETS;j++)
+		{
+			if(psHistogram->alBuckets[j] == 0) continue;
+			fprintf(psFile, "%s[%lld,%ld]", iFirst ? "" : ",",
+				Stats_bucketLimit(j), psHistogram->alBuckets[j]);
+			iFirst = 0;
+		}
+		fprintf(psFile, "]}");
+	}
+	fprintf(psFile, "}}\n");
+}
+
+/*--------------------------------------------------------------------*/
+
+void Stats_reset(void)
+
+/* Set all counters and histograms to zero. */
+
+{
+	int i;
+
+	for(i=0;i<STATS_COUNTERS;i++) alCounters[i] = 0;
+	memset(asHistograms, 0, sizeof(asHistograms));
+}
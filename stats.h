@@ -0,0 +1,34 @@
+#ifndef STATS_INCLUDED
+#define STATS_INCLUDED
+
+#include <stdio.h>
+
+/* Session-wide counters of the shell */
+enum StatsCounter {STATS_FORKS, STATS_EXECS, STATS_BUILTINS,
+	STATS_LEX_ERRORS, STATS_PATH_HITS, STATS_PATH_MISSES,
+	STATS_GLOB_READS, STATS_GLOB_HITS, STATS_COUNTERS};
+
+/* Session-wide latency histograms, in microseconds */
+enum StatsHistogram {STATS_SPAWN, STATS_FG_WALL, STATS_BG_LIFETIME,
+	STATS_HISTOGRAMS};
+
+/* Return the current time in microseconds, from the monotonic clock.
+   Traces and histograms share it. */
+long long Stats_now(void);
+
+/* Add lAmount to counter eCounter. */
+void Stats_count(enum StatsCounter eCounter, long lAmount);
+
+/* Record llMicros in histogram eHistogram.  Neither Stats_count nor
+   Stats_record allocates, so both may be called from a signal
+   handler. */
+void Stats_record(enum StatsHistogram eHistogram, long long llMicros);
+
+/* Print all counters and histograms to psFile, as JSON if iJson is
+   1. */
+void Stats_print(FILE *psFile, int iJson);
+
+/* Set all counters and histograms to zero. */
+void Stats_reset(void);
+
+#endif
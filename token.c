@@ -6,6 +6,9 @@
 /*--------------------------------------------------------------------*/
 
 #include "dynarray.h"
+#include "token.h"
+#include "wildcard.h"
+#include "alloc.h"
 #include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -14,11 +17,20 @@
 
 /*--------------------------------------------------------------------*/
 
-enum {MAX_LINE_SIZE = 1024};
-
 enum {FALSE, TRUE};
 
-enum TokenType {TOKEN_WORD, TOKEN_P, TOKEN_BG, TOKEN_RL, TOKEN_RR};
+/* What a word needs expanded before it becomes an argument */
+enum {WORD_GLOB = 1, WORD_VARIABLES = 2};
+
+/* How the character of a word was quoted */
+enum Quote {QUOTE_NONE, QUOTE_SINGLE, QUOTE_DOUBLE};
+
+/* Longest variable name expanded */
+enum {MAX_NAME_SIZE = 256};
+
+/* The arguments $1 to $9 and $# stand for, set by Token_setArguments */
+static char **ppcArguments;
+static int iArguments;
 
 /*--------------------------------------------------------------------*/
 
@@ -31,6 +43,14 @@ struct Token
 
    char *pcValue;
    /* The string which is the token's value. */
+
+   char *pcPattern;
+   /* For a word with an unquoted glob or a variable, the word as
+      typed: the characters that must stay literal are escaped with
+      '\\'.  NULL otherwise. */
+
+   int iWordFlags;
+   /* WORD_GLOB and WORD_VARIABLES of pcPattern */
 };
 
 /*--------------------------------------------------------------------*/
@@ -42,8 +62,9 @@ void freeToken(void *pvItem, void *pvExtra)
 {
 	assert(pvItem != NULL);
    struct Token *psToken = (struct Token*)pvItem;
-   free(psToken->pcValue);
-   free(psToken);
+   Alloc_free(psToken->pcValue);
+   Alloc_free(psToken->pcPattern);
+   Alloc_free(psToken);
 }
 
 /*--------------------------------------------------------------------*/
@@ -72,6 +93,41 @@ char *Token_getValue(void *pvItem)
 
 /*--------------------------------------------------------------------*/
 
+char *Token_getPattern(void *pvItem)
+
+/* Return the word as typed with its literal characters escaped, or
+   NULL if it has no glob or variable */
+
+{
+	assert(pvItem != NULL);
+	struct Token *psToken = (struct Token*)pvItem;
+	return psToken->pcPattern;
+}
+
+/*--------------------------------------------------------------------*/
+
+int Token_isListOperator(void *pvItem)
+
+/* Return 1 (TRUE) if the token separates pipelines of a list */
+
+{
+	enum TokenType eType = Token_getType(pvItem);
+	return eType == TOKEN_SEMI || eType == TOKEN_AND || eType == TOKEN_OR;
+}
+
+/*--------------------------------------------------------------------*/
+
+int Token_isArgument(void *pvItem)
+
+/* Return 1 (TRUE) if the token stands for an argument of a command */
+
+{
+	enum TokenType eType = Token_getType(pvItem);
+	return eType == TOKEN_WORD || eType == TOKEN_SUBIN || eType == TOKEN_SUBOUT;
+}
+
+/*--------------------------------------------------------------------*/
+
 struct Token *makeToken(enum TokenType eTokenType,
    char *pcValue)
 
@@ -82,363 +138,867 @@ struct Token *makeToken(enum TokenType eTokenType,
 {
    struct Token *psToken;
 
-   psToken = (struct Token*)malloc(sizeof(struct Token));
+   psToken = (struct Token*)Alloc_malloc(ALLOC_LEXER, sizeof(struct Token));
    if (psToken == NULL)
       return NULL;
 
    psToken->eType = eTokenType;
+   psToken->pcPattern = NULL;
+   psToken->iWordFlags = 0;
 
-   psToken->pcValue = (char*)malloc(strlen(pcValue) + 1);
+   psToken->pcValue = Alloc_strdup(ALLOC_LEXER, pcValue);
    if (psToken->pcValue == NULL)
    {
-      free(psToken);
+      Alloc_free(psToken);
       return NULL;
    }
 
-   strcpy(psToken->pcValue, pcValue);
-
    return psToken;
 }
 
 /*--------------------------------------------------------------------*/
 
-int lexLine(const char *pcLine, DynArray_T oTokens, char *errMsg)
+static struct Token *makeWordToken(char *pcValue, char *pcPattern,
+	int iWordFlags)
 
-/* Lexically analyze string pcLine.  Populate oTokens with the
-   tokens that pcLine contains.  Return 1 (TRUE) if successful, or
-   0 (FALSE) otherwise.  In the latter case, oTokens may contain
-   tokens that were discovered before the error. The caller owns the
-   tokens placed in oTokens. */
+/* Create and return a WORD Token whose value is pcValue and whose
+   escaped form is pcPattern, which may be NULL, with iWordFlags.
+   Return NULL if insufficient memory is available. */
+
+{
+	struct Token *psToken;
+
+	psToken = makeToken(TOKEN_WORD, pcValue);
+	if (psToken == NULL || pcPattern == NULL)
+		return psToken;
+
+	psToken->pcPattern = Alloc_strdup(ALLOC_LEXER, pcPattern);
+	if (psToken->pcPattern == NULL)
+	{
+		freeToken(psToken, NULL);
+		return NULL;
+	}
+	psToken->iWordFlags = iWordFlags;
+	return psToken;
+}
+
+/*--------------------------------------------------------------------*/
 
-/* lexLine() uses a DFA approach.  It "reads" its characters from
-   pcLine. */
+void *Token_copy(void *pvItem)
+
+/* Return a new Token equal to pvItem, or NULL if insufficient memory
+   is available. */
 
 {
-   enum LexState {STATE_START, STATE_IN_WORD, STATE_IN_STRINGONE, STATE_IN_STRINGTWO};
+   struct Token *psToken = (struct Token*)pvItem;
 
-   enum LexState eState = STATE_START;
+   assert(pvItem != NULL);
 
-   int iLineIndex = 0;
-   int iValueIndex = 0;
-   int number_token = 0;
-   char c;
-   char acValue[MAX_LINE_SIZE];
-   struct Token *psToken;
+   if (psToken->eType != TOKEN_WORD)
+      return makeToken(psToken->eType, psToken->pcValue);
+   return makeWordToken(psToken->pcValue, psToken->pcPattern,
+      psToken->iWordFlags);
+}
 
-   assert(pcLine != NULL);
-   assert(oTokens != NULL);
+/*--------------------------------------------------------------------*/
 
-   for (;;)
-   {
-      /* "Read" the next character from pcLine. */
-      c = pcLine[iLineIndex++];
+void Token_setArguments(char **ppcArgv, int iArgc)
 
-		switch (eState)
+/* Make $1 to $9 expand to the iArgc strings of ppcArgv and $# to
+   iArgc. */
+
+{
+   assert(ppcArgv != NULL || iArgc == 0);
+
+   ppcArguments = ppcArgv;
+   iArguments = iArgc;
+}
+
+/*--------------------------------------------------------------------*/
+
+char **Token_getArguments(int *piArgc)
+
+/* Return the arguments $1 to $9 stand for, and their number in
+   *piArgc. */
+
+{
+   assert(piArgc != NULL);
+
+   *piArgc = iArguments;
+   return ppcArguments;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Token_addPatternChar(char *acPattern, int iIndex, char c,
+	enum Quote eQuote, int *piWordFlags)
+
+/* Append c, quoted as eQuote, to the escaped form acPattern of length
+   iIndex.  Characters that must stay literal are escaped with '\\'.
+   An unquoted '*', '?' or '[' sets WORD_GLOB in *piWordFlags, and a
+   '$' outside single quotes WORD_VARIABLES.  Return the new length. */
+
+{
+	if (c == '*' || c == '?' || c == '[')
+	{
+		if (eQuote == QUOTE_NONE)
+			*piWordFlags |= WORD_GLOB;
+		else
+			acPattern[iIndex++] = '\\';
+	}
+	else if (c == '$')
+	{
+		if (eQuote == QUOTE_SINGLE)
+			acPattern[iIndex++] = '\\';
+		else
+			*piWordFlags |= WORD_VARIABLES;
+	}
+	else if (c == '\\')
+		acPattern[iIndex++] = '\\';
+	acPattern[iIndex++] = c;
+	return iIndex;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Token_isNameChar(char c, int iFirst)
+
+/* Return 1 (TRUE) if c may appear in a variable name, as its first
+   character if iFirst. */
+
+{
+	return c == '_' || isalpha((unsigned char)c) || (!iFirst && isdigit((unsigned char)c));
+}
+
+/*--------------------------------------------------------------------*/
+
+static char *Token_substitute(const char *pcPattern)
+
+/* Return a new string holding pcPattern with each $NAME and ${NAME}
+   replaced by the value of environment variable NAME, and $1 to $9
+   and $# by the arguments, escaped so that it stays literal, or NULL
+   if insufficient memory is available. */
+
+{
+	char acName[MAX_NAME_SIZE], acCount[16];
+	const char *pc, *pcValue;
+	char *pcOut, *pcNew;
+	size_t iLen = 0, iSize = strlen(pcPattern) + 64;
+	int iName, iBraces;
+
+	pcOut = (char *)Alloc_malloc(ALLOC_LEXER, iSize);
+	if (pcOut == NULL)
+		return NULL;
+
+	for (pc = pcPattern; *pc != '\0'; pc++)
+	{
+		pcValue = NULL;
+		iName = 0;
+		iBraces = (*pc == '$' && pc[1] == '{');
+		if (*pc == '$' && (isdigit((unsigned char)pc[1 + iBraces])
+			|| pc[1 + iBraces] == '#') && (!iBraces || pc[3] == '}'))
 		{
-			case STATE_START:
-				if ((c == '\n') || (c == '\0'))
+			if (pc[1 + iBraces] == '#')
+			{
+				snprintf(acCount, sizeof(acCount), "%d", iArguments);
+				pcValue = acCount;
+			}
+			else if (pc[1 + iBraces] != '0'
+				&& pc[1 + iBraces] - '0' <= iArguments)
+				pcValue = ppcArguments[pc[1 + iBraces] - '1'];
+			else
+				pcValue = "";
+			pc += 1 + 2 * iBraces;
+		}
+		else if (*pc == '$')
+		{
+			while (iName < MAX_NAME_SIZE - 1
+				&& Token_isNameChar(pc[1 + iBraces + iName], iName == 0))
+			{
+				acName[iName] = pc[1 + iBraces + iName];
+				iName++;
+			}
+			acName[iName] = '\0';
+			if (iName > 0 && (!iBraces || pc[1 + iBraces + iName] == '}'))
+			{
+				pcValue = getenv(acName);
+				if (pcValue == NULL)
+					pcValue = "";
+				pc += iName + 2 * iBraces;
+			}
+		}
+
+		/* Room for the value, every character escaped, or for one
+		   escaped character */
+		if (iLen + 2 * (pcValue != NULL ? strlen(pcValue) : 1) + 1 > iSize)
+		{
+			iSize = 2 * (iSize + (pcValue != NULL ? strlen(pcValue) : 1));
+			pcNew = (char *)Alloc_realloc(ALLOC_LEXER, pcOut, iSize);
+			if (pcNew == NULL)
+			{
+				Alloc_free(pcOut);
+				return NULL;
+			}
+			pcOut = pcNew;
+		}
+
+		if (pcValue == NULL)
+		{
+			/* A literal character, escaped or not */
+			if (*pc == '\\' && pc[1] != '\0')
+				pcOut[iLen++] = *pc++;
+			pcOut[iLen++] = *pc;
+			continue;
+		}
+		for (; *pcValue != '\0'; pcValue++)
+		{
+			if (*pcValue == '*' || *pcValue == '?' || *pcValue == '['
+				|| *pcValue == '\\')
+				pcOut[iLen++] = '\\';
+			pcOut[iLen++] = *pcValue;
+		}
+	}
+	pcOut[iLen] = '\0';
+	return pcOut;
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Token_unescape(char *pcWord)
+
+/* Remove the escapes of pcWord in place. */
+
+{
+	char *pcOut = pcWord;
+
+	for (; *pcWord != '\0'; pcWord++)
+	{
+		if (*pcWord == '\\' && pcWord[1] != '\0')
+			pcWord++;
+		*pcOut++ = *pcWord;
+	}
+	*pcOut = '\0';
+}
+
+/*--------------------------------------------------------------------*/
+
+void *Token_expandVariables(void *pvItem)
+
+/* Return a new word Token that is pvItem with its variables expanded
+   and its globs kept, or pvItem itself if it has no variables.
+   Return NULL if insufficient memory is available. */
+
+{
+	struct Token *psToken = (struct Token*)pvItem, *psExpanded;
+	char *pcPattern, *pcValue;
+
+	assert(pvItem != NULL);
+
+	if (!(psToken->iWordFlags & WORD_VARIABLES))
+		return psToken;
+
+	pcPattern = Token_substitute(psToken->pcPattern);
+	if (pcPattern == NULL)
+		return NULL;
+	pcValue = Alloc_strdup(ALLOC_LEXER, pcPattern);
+	if (pcValue == NULL)
+	{
+		Alloc_free(pcPattern);
+		return NULL;
+	}
+	Token_unescape(pcValue);
+	psExpanded = makeWordToken(pcValue,
+		(psToken->iWordFlags & WORD_GLOB) ? pcPattern : NULL, WORD_GLOB);
+	Alloc_free(pcValue);
+	Alloc_free(pcPattern);
+	return psExpanded;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Token_expandWord(struct Token *psToken)
+
+/* Append the arguments that psToken expands to to the matches of the
+   wildcard module, unless it is a plain word.  Return their number, 0
+   for a plain word, or -1 if insufficient memory is available. */
+
+{
+	char *pcWord;
+	int iCount = 0;
+
+	if (psToken->pcPattern == NULL)
+		return 0;
+
+	pcWord = psToken->pcPattern;
+	if (psToken->iWordFlags & WORD_VARIABLES)
+	{
+		pcWord = Token_substitute(psToken->pcPattern);
+		if (pcWord == NULL)
+			return -1;
+	}
+	if (psToken->iWordFlags & WORD_GLOB)
+		iCount = Wildcard_expand(pcWord);
+	if (iCount == 0)
+	{
+		if (pcWord == psToken->pcPattern)
+			iCount = Wildcard_addWord(psToken->pcValue) ? 1 : -1;
+		else
+		{
+			Token_unescape(pcWord);
+			iCount = Wildcard_addWord(pcWord) ? 1 : -1;
+		}
+	}
+	if (pcWord != psToken->pcPattern)
+		Alloc_free(pcWord);
+	return iCount;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Token_analyzePipeline(DynArray_T oTokens, int iStart, int iEnd,
+   char *errMsg)
+
+/* Check the syntax of the pipeline made of tokens iStart to iEnd-1 of
+   oTokens.  Return 1 (TRUE) if it is valid, or 0 (FALSE) with a
+   message in errMsg otherwise. */
+
+{
+	int i,nRL=0,nRR=0,nP=0;
+	for(i=iStart;i<iEnd;i++)
+	{
+		switch(Token_getType(DynArray_get(oTokens,i)))
+		{
+			case TOKEN_BG:
+				if(i != iEnd-1 || i == iStart)
+				{
+					strcpy(errMsg,"Wrong Syntax using &");
+					return FALSE;
+				}
+				break;
+
+			case TOKEN_P:
+				if(i > iStart && i < iEnd-1)
 				{
-					if (iValueIndex != 0)
+					if(!Token_isArgument(DynArray_get(oTokens,i-1)) || !Token_isArgument(DynArray_get(oTokens,i+1)))
 					{
-						acValue[iValueIndex] = '\0';
-						psToken = makeToken(TOKEN_WORD, acValue);
-						if (psToken == NULL)
-						{
-							strcpy(errMsg,"Cannot allocate memory");
-							return FALSE;
-						}
-						if (! DynArray_add(oTokens, psToken))
-						{
-							strcpy(errMsg,"Cannot allocate memory");
-							return FALSE;
-						}
-						iValueIndex = 0;
-						
-						goto ANALYZE;
+						strcpy(errMsg,"Pipe or redirection destination is not specified");
+						return FALSE;
 					}
-					else if(iLineIndex==1){
-						strcpy(errMsg,"");
+					else if(nP == 0 && nRR != 0) {
+						strcpy(errMsg,"Multiple redirection of standard input");
 						return FALSE;
 					}
-					else goto ANALYZE;
-				}
-				else if (c == '\'')
-			    {
-			       eState = STATE_IN_STRINGONE;
-			    }
-				else if (c == '"')
-				{
-					eState = STATE_IN_STRINGTWO;
+					else if(nP != 0 && nRR > nP) {
+						strcpy(errMsg,"Multiple redirection of standard input");
+						return FALSE;
+					}
+					nRR++;
+					nP++;
 				}
-			    else if (isspace(c))
+				else
 				{
-			       eState = STATE_START;
+					strcpy(errMsg,"Pipe or redirection destination is not specified");
+					return FALSE;
 				}
-			    else if (c == '&' || c == '|' || c == '>' || c == '<')
-				{
-					acValue[iValueIndex++] = c;
-					acValue[iValueIndex++] = '\0';
-					switch (c)
-					{
-						case '&': 
-							psToken = makeToken(TOKEN_BG, acValue);
-							break;
-						case '|': 
-							psToken = makeToken(TOKEN_P, acValue);
-							break;
-						case '<':
-							psToken = makeToken(TOKEN_RL, acValue);
-							break;
-						case '>':
-							psToken = makeToken(TOKEN_RR, acValue);
-							break;
-						default:
-							assert(FALSE);
-					}
-					if (psToken == NULL)
-					{
-						strcpy(errMsg,"Cannot allocate memory");
+				break;
+
+			case TOKEN_RR:
+				if(i < iEnd - 1) {
+					if(!Token_isArgument(DynArray_get(oTokens,i+1))) {
+						strcpy(errMsg,"Pipe or redirection destination is not specified");
 						return FALSE;
 					}
-					if (! DynArray_add(oTokens, psToken))
-					{
-						strcpy(errMsg,"Cannot allocate memory");
+					else if(nRR != 0 && nRR != nP) {
+						strcpy(errMsg,"Multiple redirection of standard output");
 						return FALSE;
 					}
-					iValueIndex = 0;
-					eState = STATE_START;
+					nRR++;
 				}
-			    else
-			    {
-			       acValue[iValueIndex++] = c;
-			       eState = STATE_IN_WORD;
-			    }
-			    break;
-			
-			case STATE_IN_STRINGONE:
-				if(c == '\n' || c == '\0')
-				{
-					strcpy(errMsg,"Could not find quote pair");
+				else {
+					strcpy(errMsg,"Pipe or redirection destination is not specified");
 					return FALSE;
 				}
-				else if(c != '\'')
-				{
-					acValue[iValueIndex++] = c;
-					eState = STATE_IN_STRINGONE;
+				break;
+
+			case TOKEN_RL:
+				if(i<iEnd-1) {
+					if(!Token_isArgument(DynArray_get(oTokens,i+1))) {
+						strcpy(errMsg,"Standard input redirection without file name");
+						return FALSE;
+					}
+					else if(nRL != 0 || nP !=0 ) {
+						strcpy(errMsg,"Multiple redirection of standard input");
+						return FALSE;
+					}
+					nRL++;
 				}
-				else
-				{
-					eState = STATE_IN_WORD;
+				else {
+					strcpy(errMsg,"Pipe or redirection destination is not specified");
+					return FALSE;
 				}
 				break;
-			
-			case STATE_IN_STRINGTWO:
-				if(c == '\n' || c == '\0')
+
+			default:
+				break;
+		}
+	}
+	return TRUE;
+}
+
+/*--------------------------------------------------------------------*/
+
+enum LexState {STATE_START, STATE_IN_WORD, STATE_IN_STRINGONE, STATE_IN_STRINGTWO};
+
+/* Initial size of the word buffers of a Lexer, which double as needed */
+enum {LEXER_WORD_SIZE = 256};
+
+/* A Lexer is the DFA of Lexer_feed() between two chunks of input: its
+   state and the word it is in the middle of. */
+
+struct Lexer
+{
+   enum LexState eState;
+   /* The state at the end of the last chunk. */
+
+   char *pcValue;
+   char *pcPattern;
+   int iSize;
+   /* The word read so far and its escaped form, in buffers of iSize
+      and 2 * iSize bytes, since every character may be escaped. */
+
+   int iValueIndex;
+   int iPatternIndex;
+   int iWordFlags;
+   /* The lengths and WORD_GLOB and WORD_VARIABLES of the word */
+};
+
+/* The Lexer of lexLine(), kept so that its buffers are allocated once */
+static struct Lexer *psLineLexer;
+
+/*--------------------------------------------------------------------*/
+
+void Lexer_free(struct Lexer *psLexer)
+
+/* Free psLexer. */
+
+{
+	if (psLexer == NULL)
+		return;
+	Alloc_free(psLexer->pcValue);
+	Alloc_free(psLexer->pcPattern);
+	Alloc_free(psLexer);
+}
+
+/*--------------------------------------------------------------------*/
+
+struct Lexer *Lexer_new(void)
+
+/* Create and return a Lexer at the start of a line, or NULL if
+   insufficient memory is available. */
+
+{
+	struct Lexer *psLexer;
+
+	psLexer = (struct Lexer *)Alloc_calloc(ALLOC_LEXER, 1, sizeof(struct Lexer));
+	if (psLexer == NULL)
+		return NULL;
+	psLexer->iSize = LEXER_WORD_SIZE;
+	psLexer->pcValue = (char *)Alloc_malloc(ALLOC_LEXER, psLexer->iSize);
+	psLexer->pcPattern = (char *)Alloc_malloc(ALLOC_LEXER, 2 * psLexer->iSize);
+	if (psLexer->pcValue == NULL || psLexer->pcPattern == NULL)
+	{
+		Lexer_free(psLexer);
+		return NULL;
+	}
+	psLexer->eState = STATE_START;
+	return psLexer;
+}
+
+/*--------------------------------------------------------------------*/
+
+void Lexer_reset(struct Lexer *psLexer)
+
+/* Drop the word psLexer is in the middle of and return it to the start
+   of a line. */
+
+{
+	assert(psLexer != NULL);
+
+	psLexer->eState = STATE_START;
+	psLexer->iValueIndex = psLexer->iPatternIndex = 0;
+	psLexer->iWordFlags = 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Lexer_grow(struct Lexer *psLexer)
+
+/* Double the word buffers of psLexer.  Return 0 (FALSE) if
+   insufficient memory is available. */
+
+{
+	char *pcValue, *pcPattern;
+
+	pcValue = (char *)Alloc_realloc(ALLOC_LEXER, psLexer->pcValue, 2 * psLexer->iSize);
+	if (pcValue == NULL)
+		return FALSE;
+	psLexer->pcValue = pcValue;
+	pcPattern = (char *)Alloc_realloc(ALLOC_LEXER, psLexer->pcPattern, 4 * psLexer->iSize);
+	if (pcPattern == NULL)
+		return FALSE;
+	psLexer->pcPattern = pcPattern;
+	psLexer->iSize *= 2;
+	return TRUE;
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Lexer_addChar(struct Lexer *psLexer, char c, enum Quote eQuote)
+
+/* Append c, quoted as eQuote, to the word of psLexer, which has room
+   for it. */
+
+{
+	psLexer->pcValue[psLexer->iValueIndex++] = c;
+	psLexer->iPatternIndex = Token_addPatternChar(psLexer->pcPattern,
+		psLexer->iPatternIndex, c, eQuote, &psLexer->iWordFlags);
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Lexer_addWord(struct Lexer *psLexer, DynArray_T oTokens,
+   char *errMsg)
+
+/* Append the word of psLexer to oTokens as a WORD token and start a new
+   one.  Return 1 (TRUE) if successful, or 0 (FALSE) with a message in
+   errMsg otherwise. */
+
+{
+	struct Token *psToken;
+
+	psLexer->pcValue[psLexer->iValueIndex] = '\0';
+	psLexer->pcPattern[psLexer->iPatternIndex] = '\0';
+	psToken = makeWordToken(psLexer->pcValue,
+		psLexer->iWordFlags != 0 ? psLexer->pcPattern : NULL,
+		psLexer->iWordFlags);
+	psLexer->iValueIndex = psLexer->iPatternIndex = 0;
+	psLexer->iWordFlags = 0;
+	if (psToken == NULL)
+	{
+		strcpy(errMsg,"Cannot allocate memory");
+		return FALSE;
+	}
+	if (! DynArray_add(oTokens, psToken))
+	{
+		freeToken(psToken, NULL);
+		strcpy(errMsg,"Cannot allocate memory");
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Lexer_addOperator(const char *pcOperator, size_t iAvailable,
+   DynArray_T oTokens, char *errMsg)
+
+/* Append the operator token that pcOperator, of which iAvailable
+   characters may be read, starts with to oTokens.  Return the number of
+   characters it takes, or 0 with a message in errMsg if insufficient
+   memory is available. */
+
+{
+	char acValue[3];
+	int iLength = 1;
+	struct Token *psToken;
+
+	acValue[0] = pcOperator[0];
+	/* "&&" and "||" are list operators */
+	if ((pcOperator[0] == '&' || pcOperator[0] == '|') && iAvailable > 1
+		&& pcOperator[1] == pcOperator[0])
+		acValue[iLength++] = pcOperator[1];
+	acValue[iLength] = '\0';
+	switch (pcOperator[0])
+	{
+		case '&':
+			psToken = makeToken(iLength == 2 ? TOKEN_AND : TOKEN_BG, acValue);
+			break;
+		case '|':
+			psToken = makeToken(iLength == 2 ? TOKEN_OR : TOKEN_P, acValue);
+			break;
+		case ';':
+			psToken = makeToken(TOKEN_SEMI, acValue);
+			break;
+		case '<':
+			psToken = makeToken(TOKEN_RL, acValue);
+			break;
+		case '>':
+			psToken = makeToken(TOKEN_RR, acValue);
+			break;
+		default:
+			assert(FALSE);
+			return 0;
+	}
+	if (psToken == NULL)
+	{
+		strcpy(errMsg,"Cannot allocate memory");
+		return 0;
+	}
+	if (! DynArray_add(oTokens, psToken))
+	{
+		freeToken(psToken, NULL);
+		strcpy(errMsg,"Cannot allocate memory");
+		return 0;
+	}
+	return iLength;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Token_analyzeLine(DynArray_T oTokens, char *errMsg)
+
+/* Check the syntax of the command list in oTokens.  Return 1 (TRUE)
+   if it is valid, or 0 (FALSE) with a message in errMsg otherwise,
+   which is empty if oTokens is. */
+
+{
+	int number_token = DynArray_getLength(oTokens);
+	int i,iStart=0;
+
+	if(number_token == 0)
+	{
+		strcpy(errMsg,"");
+		return FALSE;
+	}
+
+	/* ';', "&&" and "||" split the line into pipelines, which are
+	   checked one by one.  Only ';' may end the line. */
+	for(i=0;i<=number_token;i++)
+	{
+		if(i < number_token && !Token_isListOperator(DynArray_get(oTokens,i)))
+			continue;
+		if(i == iStart)
+		{
+			if(i == number_token && Token_getType(DynArray_get(oTokens,i-1)) == TOKEN_SEMI)
+				break;
+			snprintf(errMsg, MAX_ERROR_SIZE, "Wrong Syntax using %s",
+				Token_getValue(DynArray_get(oTokens, i < number_token ? i : i-1)));
+			return FALSE;
+		}
+		if(!Token_analyzePipeline(oTokens, iStart, i, errMsg))
+			return FALSE;
+		iStart = i+1;
+	}
+	return TRUE;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Lexer_addSubstitution(const char *pcStart, size_t iAvailable,
+   DynArray_T oTokens, char *errMsg)
+
+/* Append the process substitution "<(command)" or ">(command)" that
+   pcStart, of which iAvailable characters may be read, starts with to
+   oTokens, as a token whose value is command.  Parentheses nest, and
+   those in quotes do not count.  Return the number of characters it
+   takes, or 0 with a message in errMsg if it does not end on this line
+   or insufficient memory is available. */
+
+{
+	size_t i;
+	int iDepth = 1;
+	char cQuote = '\0', *pcCommand;
+	struct Token *psToken;
+
+	for (i = 2; i < iAvailable && pcStart[i] != '\n' && pcStart[i] != '\0'; i++)
+	{
+		if (cQuote != '\0')
+		{
+			if (pcStart[i] == cQuote) cQuote = '\0';
+		}
+		else if (pcStart[i] == '\'' || pcStart[i] == '"')
+			cQuote = pcStart[i];
+		else if (pcStart[i] == '(')
+			iDepth++;
+		else if (pcStart[i] == ')' && --iDepth == 0)
+			break;
+	}
+	if (iDepth != 0)
+	{
+		strcpy(errMsg,"Could not find parenthesis pair");
+		return 0;
+	}
+
+	pcCommand = (char *)Alloc_malloc(ALLOC_LEXER, i - 1);
+	if (pcCommand == NULL)
+	{
+		strcpy(errMsg,"Cannot allocate memory");
+		return 0;
+	}
+	memcpy(pcCommand, pcStart + 2, i - 2);
+	pcCommand[i - 2] = '\0';
+	psToken = makeToken(pcStart[0] == '<' ? TOKEN_SUBIN : TOKEN_SUBOUT, pcCommand);
+	Alloc_free(pcCommand);
+	if (psToken == NULL || ! DynArray_add(oTokens, psToken))
+	{
+		if (psToken != NULL) freeToken(psToken, NULL);
+		strcpy(errMsg,"Cannot allocate memory");
+		return 0;
+	}
+	return (int)i + 1;
+}
+
+/*--------------------------------------------------------------------*/
+
+enum LexStatus Lexer_feed(struct Lexer *psLexer, const char *pcChunk,
+   size_t iLength, DynArray_T oTokens, char *errMsg)
+
+/* Lexically analyze the iLength characters of pcChunk, the next line
+   of the input of psLexer.  Populate oTokens with the tokens that it
+   completes. */
+
+/* Lexer_feed() uses a DFA approach.  It "reads" its characters from
+   pcChunk once, and keeps its state in psLexer when pcChunk ends inside
+   a quote, so that feeding it the following lines costs only their own
+   length.  The end of pcChunk reads as a '\0', so that pcChunk may be
+   a line of a mapped file that nothing terminates. */
+
+{
+   enum LexState eState;
+   size_t iLineIndex = 0;
+   int iUsed;
+   char c;
+
+   assert(psLexer != NULL);
+   assert(pcChunk != NULL);
+   assert(oTokens != NULL);
+
+   eState = psLexer->eState;
+   for (;;)
+   {
+      /* "Read" the next character from pcChunk. */
+      c = (iLineIndex < iLength) ? pcChunk[iLineIndex] : '\0';
+      iLineIndex++;
+
+      /* Room for c, its escape and the '\0' that ends the word */
+      if (psLexer->iValueIndex + 2 > psLexer->iSize && ! Lexer_grow(psLexer))
+      {
+         strcpy(errMsg,"Cannot allocate memory");
+         goto FAIL;
+      }
+
+		switch (eState)
+		{
+			case STATE_START:
+				if ((c == '\n') || (c == '\0'))
+					goto ANALYZE;
+				else if (c == '\'')
+					eState = STATE_IN_STRINGONE;
+				else if (c == '"')
+					eState = STATE_IN_STRINGTWO;
+				else if (isspace(c))
+					eState = STATE_START;
+				else if ((c == '<' || c == '>') && iLineIndex < iLength
+					&& pcChunk[iLineIndex] == '(')
 				{
-					strcpy(errMsg,"Could not find quote pair");
-					return FALSE;
+					iUsed = Lexer_addSubstitution(pcChunk + iLineIndex - 1,
+						iLength - iLineIndex + 1, oTokens, errMsg);
+					if (iUsed == 0)
+						goto FAIL;
+					iLineIndex += iUsed - 1;
 				}
-				else if(c != '"')
+				else if (c == '&' || c == '|' || c == '>' || c == '<' || c == ';')
 				{
-					acValue[iValueIndex++] = c;
-					eState = STATE_IN_STRINGTWO;
+					iUsed = Lexer_addOperator(pcChunk + iLineIndex - 1,
+						iLength - iLineIndex + 1, oTokens, errMsg);
+					if (iUsed == 0)
+						goto FAIL;
+					iLineIndex += iUsed - 1;
 				}
 				else
 				{
+					Lexer_addChar(psLexer, c, QUOTE_NONE);
 					eState = STATE_IN_WORD;
 				}
 				break;
 
-			case STATE_IN_WORD:
-				if ((c == '\n') || (c == '\0'))
+			case STATE_IN_STRINGONE:
+			case STATE_IN_STRINGTWO:
+				/* A quote left open continues on the next line */
+				if (iLineIndex > iLength)
 				{
-					/* Create a WORD token. */
-					acValue[iValueIndex] = '\0';
-					psToken = makeToken(TOKEN_WORD, acValue);
-					if (psToken == NULL)
-					{
-						strcpy(errMsg,"Cannot allocate memory");
-						return FALSE;
-					}
-					if (! DynArray_add(oTokens, psToken))
-					{
-						strcpy(errMsg,"Cannot allocate memory");
-						return FALSE;
-					}
-					iValueIndex = 0;
-					
-					goto ANALYZE;
+					psLexer->eState = eState;
+					return LEX_MORE;
 				}
-				else if (c == '\'')
-				{
+				else if (c == (eState == STATE_IN_STRINGONE ? '\'' : '"'))
+					eState = STATE_IN_WORD;
+				else
+					Lexer_addChar(psLexer, c, eState == STATE_IN_STRINGONE ? QUOTE_SINGLE : QUOTE_DOUBLE);
+				break;
+
+			case STATE_IN_WORD:
+				if (c == '\'')
 					eState = STATE_IN_STRINGONE;
-				}
 				else if (c == '"')
-				{
 					eState = STATE_IN_STRINGTWO;
-				}
-				else if (isspace(c))
+				else if ((c == '\n') || (c == '\0') || isspace(c)
+					|| c == '&' || c == '|' || c == '>' || c == '<' || c == ';')
 				{
 					/* Create a WORD token. */
-					acValue[iValueIndex] = '\0';
-					psToken = makeToken(TOKEN_WORD, acValue);
-					if (psToken == NULL)
-					{
-						strcpy(errMsg,"Cannot allocate memory");
-						return FALSE;
-					}
-					if (! DynArray_add(oTokens, psToken))
-					{
-						strcpy(errMsg,"Cannot allocate memory");
-						return FALSE;
-					}
-					iValueIndex = 0;
-					
-					eState = STATE_START;
-				}
-				else if (c == '&' || c == '|' || c == '>' || c == '<')
-				{
-					acValue[iValueIndex] = '\0';
-					psToken = makeToken(TOKEN_WORD, acValue);
-					if (psToken == NULL)
-					{
-						strcpy(errMsg,"Cannot allocate memory");
-						return FALSE;
-					}
-					if (! DynArray_add(oTokens, psToken))
-					{
-						strcpy(errMsg,"Cannot allocate memory");
-						return FALSE;
-					}
-					iValueIndex = 0;
-
-					acValue[iValueIndex++] = c;
-					acValue[iValueIndex++] = '\0';
-					switch (c)
-					{
-						case '&': 
-							psToken = makeToken(TOKEN_BG, acValue);
-							break;
-						case '|': 
-							psToken = makeToken(TOKEN_P, acValue);
-							break;
-						case '<':
-							psToken = makeToken(TOKEN_RL, acValue);
-							break;
-						case '>':
-							psToken = makeToken(TOKEN_RR, acValue);
-							break;
-						default:
-							assert(FALSE);
-					}
-					if (psToken == NULL)
-					{
-						strcpy(errMsg,"Cannot allocate memory");
-						return FALSE;
-					}
-					if (! DynArray_add(oTokens, psToken))
-					{
-						strcpy(errMsg,"Cannot allocate memory");
-						return FALSE;
-					}
-					iValueIndex = 0;
+					if (! Lexer_addWord(psLexer, oTokens, errMsg))
+						goto FAIL;
 					eState = STATE_START;
+					/* Let STATE_START take the end of the line or the
+					   operator */
+					iLineIndex--;
 				}
 				else
-				{
-					acValue[iValueIndex++] = c;
-					eState = STATE_IN_WORD;
-				}
+					Lexer_addChar(psLexer, c, QUOTE_NONE);
 				break;
-				
+
 			default:
 				assert(FALSE);
 		}
 	}
-	
+
 	ANALYZE:
-		number_token = DynArray_getLength(oTokens);
-		int i,nRL=0,nRR=0,nP=0;
-		for(i=0;i<number_token;i++)
-		{
-			switch(Token_getType(DynArray_get(oTokens,i)))
-			{
-				case TOKEN_BG:
-					if(i != number_token-1 || i == 0)
-					{
-						strcpy(errMsg,"Wrong Syntax using &");
-						return FALSE;
-					}
-					break;
+		Lexer_reset(psLexer);
+		return Token_analyzeLine(oTokens, errMsg) ? LEX_DONE : LEX_ERROR;
 
-				case TOKEN_P:
-					if(i > 0 && i < number_token-1)
-					{
-						if(Token_getType(DynArray_get(oTokens,i-1)) != TOKEN_WORD || Token_getType(DynArray_get(oTokens,i+1)) != TOKEN_WORD)
-						{
-							strcpy(errMsg,"Pipe or redirection destination is not specified");
-							return FALSE;
-						}
-						else if(nP == 0 && nRR != 0) {
-							strcpy(errMsg,"Multiple redirection of standard input");
-							return FALSE;
-						}
-						else if(nP != 0 && nRR > nP) {
-							strcpy(errMsg,"Multiple redirection of standard input");
-							return FALSE;
-						}
-						nRR++;
-						nP++;
-					}
-					else
-					{
-						strcpy(errMsg,"Pipe or redirection destination is not specified");
-						return FALSE;
-					}
-					break;
-
-				case TOKEN_RR:
-					if(i < number_token - 1) {
-						if(Token_getType(DynArray_get(oTokens,i+1)) != TOKEN_WORD) {
-							strcpy(errMsg,"Pipe or redirection destination is not specified");
-							return FALSE;
-						}
-						else if(nRR != 0 && nRR != nP) {
-							strcpy(errMsg,"Multiple redirection of standard output");
-							return FALSE;
-						}
-						nRR++;
-					}
-					else {
-						strcpy(errMsg,"Pipe or redirection destination is not specified");
-						return FALSE;
-					}
-					break;
-
-				case TOKEN_RL:
-					if(i<number_token-1) {
-						if(Token_getType(DynArray_get(oTokens,i+1)) != TOKEN_WORD) {
-							strcpy(errMsg,"Standard input redirection without file name");
-							return FALSE;
-						}
-						else if(nRL != 0 || nP !=0 ) {
-							strcpy(errMsg,"Multiple redirection of standard input");
-							return FALSE;
-						}
-						nRL++;
-					}
-					else {
-						strcpy(errMsg,"Pipe or redirection destination is not specified");
-						return FALSE;
-					}
-					break;
+	FAIL:
+		Lexer_reset(psLexer);
+		return LEX_ERROR;
+}
 
-				default:
-					break;
-			}
-		}
-		return TRUE;
-	
+/*--------------------------------------------------------------------*/
+
+int lexLine(const char *pcLine, DynArray_T oTokens, char *errMsg)
+
+/* Lexically analyze string pcLine.  Populate oTokens with the
+   tokens that pcLine contains.  Return 1 (TRUE) if successful, or
+   0 (FALSE) otherwise.  In the latter case, oTokens may contain
+   tokens that were discovered before the error. The caller owns the
+   tokens placed in oTokens. */
+
+{
+   enum LexStatus eStatus;
+
+   assert(pcLine != NULL);
+   assert(oTokens != NULL);
+
+   if (psLineLexer == NULL && (psLineLexer = Lexer_new()) == NULL)
+   {
+      strcpy(errMsg,"Cannot allocate memory");
+      return FALSE;
+   }
+   eStatus = Lexer_feed(psLineLexer, pcLine, strlen(pcLine), oTokens, errMsg);
+   if (eStatus == LEX_MORE)
+   {
+      Lexer_reset(psLineLexer);
+      strcpy(errMsg,"Could not find quote pair");
+      return FALSE;
+   }
+   return eStatus == LEX_DONE;
 }
 
 int Token_isBG(DynArray_T oTokens)
@@ -458,13 +1018,15 @@ char *Token_getInput(DynArray_T oTokens, int *status)
 	
 	int i,length;
 	char *filename;
-	filename = (char *)malloc(100*sizeof(char));
 	*status = -1;
 	length = DynArray_getLength(oTokens);
 	for(i=0;i<length;i++){
 		if(Token_getType(DynArray_get(oTokens,i)) == TOKEN_RL){
+			/* Allocated only once a redirection is found, at the
+			   length of its file name */
 			*status = 0;
-			strcpy(filename,Token_getValue(DynArray_get(oTokens,i+1)));
+			filename = Alloc_strdup(ALLOC_PLANNER, Token_getValue(DynArray_get(oTokens,i+1)));
+			if(filename == NULL) return NULL;
 			DynArray_removeAt(oTokens,i);
 			DynArray_removeAt(oTokens,i);
 			return filename;
@@ -479,13 +1041,15 @@ char *Token_getOutput(DynArray_T oTokens, int *status)
 	
 	int i,length;
 	char *filename;
-	filename = (char *)malloc(100*sizeof(char));
 	*status = -1;
 	length = DynArray_getLength(oTokens);
 	for(i=0;i<length;i++){
 		if(Token_getType(DynArray_get(oTokens,i)) == TOKEN_RR){
+			/* Allocated only once a redirection is found, at the
+			   length of its file name */
 			*status = 0;
-			strcpy(filename,Token_getValue(DynArray_get(oTokens,i+1)));
+			filename = Alloc_strdup(ALLOC_PLANNER, Token_getValue(DynArray_get(oTokens,i+1)));
+			if(filename == NULL) return NULL;
 			DynArray_removeAt(oTokens,i);
 			DynArray_removeAt(oTokens,i);
 			return filename;
@@ -507,15 +1071,69 @@ int Token_getNumCommand(DynArray_T oTokens)
 	return total;
 }
 
+/*--------------------------------------------------------------------*/
+
+static char **Token_makeArgv(DynArray_T oTokens, int i, int j, int *size)
+
+/* Return the words i to j-1 of oTokens as a NULL-terminated argv whose
+   length is stored in *size, with their variables and globs expanded,
+   or NULL if insufficient memory is available.  The strings are in
+   the same block as the argv. */
+
+{
+	int k, subsize = j-i;
+	char **res;
+
+	/* Expand the variables and globs first, so that the argv and all
+	   its strings fit in one block.  A glob without matches stays as it
+	   is. */
+	int aiMatches[subsize+1];
+	int m, iWords = 0, iMatch = 0;
+	size_t iBytes = 0;
+	char *pcStrings;
+	Wildcard_clearMatches();
+	for(k=i;k<j;k++){
+		aiMatches[k-i] = Token_expandWord(DynArray_get(oTokens,k));
+		if(aiMatches[k-i] < 0) return NULL;
+		if(aiMatches[k-i] == 0){
+			iBytes += strlen(Token_getValue(DynArray_get(oTokens,k))) + 1;
+			iWords++;
+		}
+		for(m=0;m<aiMatches[k-i];m++)
+			iBytes += strlen(Wildcard_getMatch(iMatch++)) + 1;
+		iWords += aiMatches[k-i];
+	}
+	res = (char **)Alloc_malloc(ALLOC_PLANNER, (iWords+1) * sizeof(char *) + iBytes);
+	if(res == NULL) return NULL;
+
+	pcStrings = (char *)(res + iWords + 1);
+	iWords = 0; iMatch = 0;
+	for(k=i;k<j;k++){
+		if(aiMatches[k-i] == 0){
+			res[iWords++] = pcStrings;
+			pcStrings = stpcpy(pcStrings, Token_getValue(DynArray_get(oTokens,k))) + 1;
+		}
+		for(;aiMatches[k-i] > 0;aiMatches[k-i]--){
+			res[iWords++] = pcStrings;
+			pcStrings = stpcpy(pcStrings, Wildcard_getMatch(iMatch++)) + 1;
+		}
+	}
+
+	res[iWords] = NULL;
+	*size = iWords;
+	return res;
+}
+
+/*--------------------------------------------------------------------*/
+
 char **Token_getComm(DynArray_T oTokens, int index, int *size)
 {
 	assert(oTokens != NULL);
 
-	int i,j,k;
-	int length,subsize,curPos;
-	char **res;
+	int i,j;
+	int length,curPos;
 	length = DynArray_getLength(oTokens);
-	subsize=0; i=0; j=0;
+	i=0; j=0; curPos=0;
 	
 	if(index == 0){
 		if( Token_getType(DynArray_get(oTokens,0)) == TOKEN_RL || Token_getType(DynArray_get(oTokens,0)) == TOKEN_RR){
@@ -544,14 +1162,24 @@ char **Token_getComm(DynArray_T oTokens, int index, int *size)
 			}
 		}
 	}
-	subsize = j-i;
-	res = (char **)malloc( (subsize+1)* sizeof(char *));
-	for(k=i;k<j;k++){
-		res[k-i] = (char *)malloc(100 * sizeof(char));
-		strcpy(res[k-i],Token_getValue(DynArray_get(oTokens,k)));
-	}
-
-	res[subsize] = NULL;
-	*size = subsize;
-	return res;
+	return Token_makeArgv(oTokens, i, j, size);
 }
+
+/*--------------------------------------------------------------------*/
+
+char **Token_getNextComm(DynArray_T oTokens, int *piPos, int *size)
+
+/* Return the command of oTokens that starts at *piPos as an argv, and
+   move *piPos to the start of the next one. */
+
+{
+	int iStart = *piPos, iEnd, iLength;
+
+	assert(oTokens != NULL);
+
+	iLength = DynArray_getLength(oTokens);
+	for(iEnd=iStart;iEnd<iLength;iEnd++)
+		if(Token_getType(DynArray_get(oTokens,iEnd)) == TOKEN_P) break;
+	*piPos = iEnd + 1;
+	return Token_makeArgv(oTokens, iStart, iEnd, size);
+}
\ No newline at end of file
@@ -1,7 +1,24 @@
 #ifndef TOKEN_INCLUDED
 #define TOKEN_INCLUDED
 
-enum TokenType {TOKEN_WORD, TOKEN_P, TOKEN_BG, TOKEN_RL, TOKEN_RR};
+#include <stddef.h>
+
+/* TOKEN_SUBIN and TOKEN_SUBOUT are the process substitutions
+   "<(command)" and ">(command)", whose value is command */
+enum TokenType {TOKEN_WORD, TOKEN_P, TOKEN_BG, TOKEN_RL, TOKEN_RR,
+   TOKEN_SEMI, TOKEN_AND, TOKEN_OR, TOKEN_SUBIN, TOKEN_SUBOUT};
+
+/* Size of the errMsg buffers that lexLine(), the planner and the block
+   parser write their error messages to, '\0' included */
+enum {MAX_ERROR_SIZE = 128};
+
+/* What Lexer_feed() made of its input: an error, a complete command
+   list, or a quote still open at its end */
+enum LexStatus {LEX_ERROR, LEX_DONE, LEX_MORE};
+
+/* A Lexer is a lexical analysis that can stop at the end of a line and
+   go on with the next, as when a quoted word spans lines */
+struct Lexer;
 
 /* Free token pvItem.  pvExtra is unused. */
 void freeToken(void *pvItem, void *pvExtra);
@@ -20,37 +37,106 @@ enum TokenType Token_getType(void *pvItem);
 /* Return value of the token to caller */
 char * Token_getValue(void *pvItem);
 
+/* Return the word as typed, in which the characters that must stay
+   literal are escaped with '\\', or NULL if the token is not a word
+   with an unquoted '*', '?' or '[' or a '$' outside single quotes */
+char *Token_getPattern(void *pvItem);
+
+/* Return 1 (TRUE) if the token is ';', "&&" or "||", which separate
+   the pipelines of a command list */
+int Token_isListOperator(void *pvItem);
+
+/* Return 1 (TRUE) if the token is a word or a process substitution,
+   which both stand for an argument of a command */
+int Token_isArgument(void *pvItem);
+
 /* Create and return a Token whose type is eTokenType and whose
    value consists of string pcValue.  Return NULL if insufficient
    memory is available.  The caller owns the Token. */
 struct Token *makeToken(enum TokenType eTokenType,
    char *pcValue);
 
+/* Return a new word Token that is pvItem with its variables expanded
+   and its globs kept, or pvItem itself if it has no variables.
+   Return NULL if insufficient memory is available.  The caller owns
+   the new Token. */
+void *Token_expandVariables(void *pvItem);
+
+/* Return a new Token equal to pvItem, or NULL if insufficient memory
+   is available.  The caller owns the new Token. */
+void *Token_copy(void *pvItem);
+
+/* Make $1 to $9 expand to the iArgc strings of ppcArgv, which must
+   stay valid until the next call, and $# to iArgc. */
+void Token_setArguments(char **ppcArgv, int iArgc);
+
+/* Return the arguments set by Token_setArguments, and their number in
+   *piArgc. */
+char **Token_getArguments(int *piArgc);
+
 /* Lexically analyze string pcLine.  Populate oTokens with the
    tokens that pcLine contains.  Return 1 (TRUE) if successful, or
-   0 (FALSE) otherwise.  In the latter case, oTokens may contain
+   0 (FALSE) otherwise, with a message in errMsg, which holds
+   MAX_ERROR_SIZE bytes.  In the latter case, oTokens may contain
    tokens that were discovered before the error. The caller owns the
    tokens placed in oTokens. */
 
 /* lexLine() uses a DFA approach.  It "reads" its characters from
-   pcLine. */
+   pcLine.  A quote left open at the end of pcLine is an error. */
 int lexLine(const char *pcLine, DynArray_T oTokens, char *errMsg);
 
+/* Create and return a Lexer at the start of a line, or NULL if
+   insufficient memory is available.  The caller owns the Lexer. */
+struct Lexer *Lexer_new(void);
+
+/* Free psLexer. */
+void Lexer_free(struct Lexer *psLexer);
+
+/* Drop the word psLexer is in the middle of and return it to the start
+   of a line, as when the rest of a quote never comes. */
+void Lexer_reset(struct Lexer *psLexer);
+
+/* Lexically analyze the iLength characters of pcChunk, the next line
+   of the input of psLexer, which need not end with '\0', populating
+   oTokens with the tokens it completes, as lexLine() does.  Return
+   LEX_MORE if pcChunk ends inside a quote: the word goes on, after a
+   newline, with the next chunk fed.  Otherwise check the syntax of all
+   of oTokens and return LEX_DONE, or LEX_ERROR with a message in errMsg,
+   which is empty if oTokens is.  Each character is read once, however
+   many lines a command spans. */
+enum LexStatus Lexer_feed(struct Lexer *psLexer, const char *pcChunk,
+   size_t iLength, DynArray_T oTokens, char *errMsg);
+
 /* Check if this set of tokens is a background process (end with &) 
    And eliminate the '&' out grom the array
+   The tokens removed by Token_isBG, Token_getInput and Token_getOutput
+   are not freed: oTokens must not be the array that owns them.
 */
 int Token_isBG(DynArray_T oTokens);
 
-/* Get input file descriptor */
+/* Get input file descriptor: remove the '<' and its file name from
+   oTokens and return a copy of the name, which the caller frees with
+   Alloc_free.  *status is 0 if there is one and -1 otherwise.  Return
+   NULL with *status 0 if insufficient memory is available. */
 char *Token_getInput(DynArray_T oTokens, int *status);
 
-/* Get output file descriptor */
+/* Get output file descriptor, as Token_getInput does for '>' */
 char *Token_getOutput(DynArray_T oTokens, int *status);
 
 /* Get the total number of command in a set of tokens*/
 int Token_getNumCommand(DynArray_T oTokens);
 
-/* Get ith command in the set of tokens*/
+/* Get ith command in the set of tokens as a NULL-terminated argv whose
+   length is stored in *size, with its variables and globs expanded.  Return NULL if
+   insufficient memory is available.  The strings are stored in the
+   same block as the argv, so the caller frees only the argv, with
+   Alloc_free. */
 char **Token_getComm(DynArray_T oTokens, int index, int *size);
 
+/* Like Token_getComm for the command that starts at token *piPos of
+   oTokens, which holds only words and pipes, and move *piPos to the
+   start of the next command.  Walking a pipeline this way is linear in
+   its length. */
+char **Token_getNextComm(DynArray_T oTokens, int *piPos, int *size);
+
 #endif
@@ -0,0 +1,189 @@
+#define _GNU_SOURCE
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/*--------------------------------------------------------------------*/
+
+enum {FALSE, TRUE};
+
+enum {MAX_EVENT_SIZE = 512, MAX_NAME_SIZE = 128};
+
+/* Lowest descriptor the trace file may use, so that it stays clear of
+   the descriptors a child sets up before exec */
+enum {TRACE_MIN_FD = 10};
+
+int iTraceFd = -1;
+
+/* The shell: the "pid" of every event, so that they share one track
+   group, and the only process that ends the trace */
+static int iTracePid;
+
+/*--------------------------------------------------------------------*/
+
+static void Trace_write(const char *pcEvent, int iLen)
+
+/* Append one event.  The file is opened with O_APPEND, so events
+   written by several processes do not overwrite each other. */
+
+{
+	if(iLen <= 0 || iLen >= MAX_EVENT_SIZE) return;
+	if(write(iTraceFd, pcEvent, iLen) != iLen)
+	{
+		/* Stop tracing rather than write a truncated trace */
+		close(iTraceFd);
+		iTraceFd = -1;
+	}
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Trace_escape(const char *pcName, char *pcOut)
+
+/* Copy pcName to pcOut, which has room for MAX_NAME_SIZE characters,
+   as the contents of a JSON string. */
+
+{
+	int i = 0;
+
+	for(; *pcName != '\0' && i < MAX_NAME_SIZE - 3; pcName++)
+	{
+		if(*pcName == '"' || *pcName == '\\') pcOut[i++] = '\\';
+		pcOut[i++] = ((unsigned char)*pcName < ' ') ? '?' : *pcName;
+	}
+	pcOut[i] = '\0';
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Trace_args(char *pcOut, int iPid, int iStage)
+
+/* Write the args object of an event for iPid and iStage to pcOut.
+   Return its length. */
+
+{
+	if(iPid != -1 && iStage != -1)
+		return sprintf(pcOut, ",\"args\":{\"pid\":%d,\"stage\":%d}", iPid, iStage);
+	if(iPid != -1)
+		return sprintf(pcOut, ",\"args\":{\"pid\":%d}", iPid);
+	if(iStage != -1)
+		return sprintf(pcOut, ",\"args\":{\"stage\":%d}", iStage);
+	pcOut[0] = '\0';
+	return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+void Trace_span(const char *pcName, long long llStart, int iPid,
+	int iStage)
+
+/* Write a complete ("X") event from llStart to now. */
+
+{
+	char acEvent[MAX_EVENT_SIZE], acArgs[64];
+	long long llEnd = Stats_now();
+
+	assert(pcName != NULL);
+
+	if(iTraceFd < 0) return;
+	Trace_args(acArgs, iPid, iStage);
+	Trace_write(acEvent, snprintf(acEvent, MAX_EVENT_SIZE,
+		"{\"name\":\"%s\",\"cat\":\"ish\",\"ph\":\"X\",\"ts\":%lld,\"dur\":%lld,\"pid\":%d,\"tid\":%d%s},\n",
+		pcName, llStart, llEnd - llStart, iTracePid, (int)getpid(), acArgs));
+}
+
+/*--------------------------------------------------------------------*/
+
+void Trace_instant(const char *pcName, int iPid, int iStage)
+
+/* Write an instant ("i") event scoped to the calling process. */
+
+{
+	Trace_instantAt(pcName, Stats_now(), iPid, iStage);
+}
+
+/*--------------------------------------------------------------------*/
+
+void Trace_instantAt(const char *pcName, long long llTime, int iPid,
+	int iStage)
+
+/* Write an instant ("i") event at llTime. */
+
+{
+	char acEvent[MAX_EVENT_SIZE], acArgs[64];
+
+	assert(pcName != NULL);
+
+	if(iTraceFd < 0) return;
+	Trace_args(acArgs, iPid, iStage);
+	Trace_write(acEvent, snprintf(acEvent, MAX_EVENT_SIZE,
+		"{\"name\":\"%s\",\"cat\":\"ish\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%lld,\"pid\":%d,\"tid\":%d%s},\n",
+		pcName, llTime, iTracePid, (int)getpid(), acArgs));
+}
+
+/*--------------------------------------------------------------------*/
+
+void Trace_nameProcess(const char *pcName)
+
+/* Write a thread_name metadata event for the calling process. */
+
+{
+	char acEvent[MAX_EVENT_SIZE], acName[MAX_NAME_SIZE];
+
+	assert(pcName != NULL);
+
+	if(iTraceFd < 0) return;
+	Trace_escape(pcName, acName);
+	Trace_write(acEvent, snprintf(acEvent, MAX_EVENT_SIZE,
+		"{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}},\n",
+		iTracePid, (int)getpid(), acName));
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Trace_close(void)
+
+/* Close the JSON array when the shell exits.  Children that exit
+   before exec leave the trace open. */
+
+{
+	char acEvent[MAX_EVENT_SIZE];
+
+	if(iTraceFd < 0 || getpid() != iTracePid) return;
+	Trace_write(acEvent, snprintf(acEvent, MAX_EVENT_SIZE,
+		"{\"name\":\"exit\",\"cat\":\"ish\",\"ph\":\"i\",\"s\":\"p\",\"ts\":%lld,\"pid\":%d,\"tid\":%d}\n]\n",
+		Stats_now(), iTracePid, iTracePid));
+	close(iTraceFd);
+	iTraceFd = -1;
+}
+
+/*--------------------------------------------------------------------*/
+
+int Trace_open(const char *pcPath)
+
+/* Start tracing to pcPath. */
+
+{
+	char acEvent[MAX_EVENT_SIZE];
+	int iFd;
+
+	assert(pcPath != NULL);
+
+	iFd = open(pcPath, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+	if(iFd < 0) return FALSE;
+	iTraceFd = fcntl(iFd, F_DUPFD_CLOEXEC, TRACE_MIN_FD);
+	close(iFd);
+	if(iTraceFd < 0) return FALSE;
+
+	iTracePid = getpid();
+	Trace_write(acEvent, snprintf(acEvent, MAX_EVENT_SIZE,
+		"[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"ish\"}},\n",
+		iTracePid, iTracePid));
+	Trace_nameProcess("ish");
+	atexit(Trace_close);
+	return TRUE;
+}
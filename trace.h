@@ -0,0 +1,50 @@
+#ifndef TRACE_INCLUDED
+#define TRACE_INCLUDED
+
+#include "stats.h"
+
+/* Tracing writes the lifecycle of each command line to a file in the
+   Chrome trace event format, which Perfetto and chrome://tracing can
+   load.  Each event carries the pid of the process it concerns and
+   the index of its pipeline stage, if any.  Events are written with
+   one write each and may come from forked children before exec. */
+
+/* Descriptor of the trace file, or -1 if tracing is off */
+extern int iTraceFd;
+
+/* Start tracing to pcPath, truncating it.  Return 1 (TRUE) if
+   successful, or 0 (FALSE) with errno set. */
+int Trace_open(const char *pcPath);
+
+/* Write a span named pcName from llStart to now.  iPid and iStage are
+   -1 if they do not apply. */
+void Trace_span(const char *pcName, long long llStart, int iPid,
+	int iStage);
+
+/* Write an instant event named pcName. */
+void Trace_instant(const char *pcName, int iPid, int iStage);
+
+/* Write an instant event named pcName that happened at llTime, from
+   Stats_now(), as for an event a signal handler only noted. */
+void Trace_instantAt(const char *pcName, long long llTime, int iPid,
+	int iStage);
+
+/* Name the track of the calling process pcName, e.g. the command it
+   is about to execute. */
+void Trace_nameProcess(const char *pcName);
+
+/* The macros below cost one comparison when tracing is off. */
+
+/* Return the start time of a span, or 0 if tracing is off. */
+#define TRACE_BEGIN() (iTraceFd < 0 ? 0 : Stats_now())
+
+#define TRACE_END(pcName, llStart, iPid, iStage) \
+	do { if (iTraceFd >= 0) Trace_span(pcName, llStart, iPid, iStage); } while (0)
+
+#define TRACE_INSTANT(pcName, iPid, iStage) \
+	do { if (iTraceFd >= 0) Trace_instant(pcName, iPid, iStage); } while (0)
+
+#define TRACE_NAME(pcName) \
+	do { if (iTraceFd >= 0) Trace_nameProcess(pcName); } while (0)
+
+#endif
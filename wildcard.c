@@ -0,0 +1,1030 @@
+#define _GNU_SOURCE
+#include "wildcard.h"
+#include "stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+/*--------------------------------------------------------------------*/
+
+enum {FALSE, TRUE};
+
+enum {MAX_PATH_SIZE = 4096, MAX_NAME_SIZE = 256};
+
+/* Size of each batch of directory entries read by getdents64 */
+enum {DENTS_SIZE = 32768};
+
+/* A directory entry as returned by getdents64 */
+struct Dirent64
+{
+	unsigned long long ullIno;
+	long long llOff;
+	unsigned short usReclen;
+	unsigned char ucType;
+	char acName[];
+};
+
+/* An Entry is a name of a cached directory. */
+struct Entry
+{
+	int iName;
+	/* Offset of the name in pcNames of its Dir */
+
+	unsigned char ucType;
+	/* d_type of the name */
+};
+
+/* A Dir is a directory read by Wildcard_readDir. */
+struct Dir
+{
+	char *pcPath;
+	/* The directory as it prefixes the matches: "" for the current
+	   directory, or a path ending with '/' */
+
+	dev_t iDev;
+	ino_t iIno;
+	struct timespec sMtime;
+	/* Identity of the directory when it was read */
+
+	char *pcNames;
+	/* The names of the directory, each terminated by '\0' */
+
+	struct Entry *psEntries;
+	int iEntries;
+	/* The entries, sorted by name */
+
+	struct Dir *psNext;
+};
+
+static struct Dir *psDirs;
+
+/* A list of paths, each terminated by '\0', at the offsets
+   piOffsets of pcStrings */
+struct Matches
+{
+	char *pcStrings;
+	int iLen, iSize;
+	int *piOffsets;
+	int iCount, iCapacity;
+};
+
+/* The matches */
+static struct Matches sMatches;
+
+/* The most threads that walk the tree below a "**", the directories
+   the calling thread queues before it starts the others, and the most
+   components of a pattern from its "**" */
+enum {MAX_WORKERS = 8, PARALLEL_THRESHOLD = 8, MAX_COMPONENTS = 64};
+
+/* A Worker is a thread of a Walk. */
+struct Worker
+{
+	struct Walk *psWalk;
+	pthread_t sThread;
+	int iStarted;
+
+	pthread_mutex_t sLock;
+	char **ppcTasks;
+	int iHead, iTail, iCapacity;
+	/* The directories to read, from iHead to iTail, as paths relative
+	   to the base of the Walk.  The Worker pushes and pops at the tail,
+	   reading depth first, and the others steal the oldest directories,
+	   the roots of the largest subtrees, at the head.  Guarded by
+	   sLock. */
+
+	struct Matches sMatches;
+	int iReads;
+};
+
+/* A Walk is the expansion of a pattern from its first "**" component,
+   which matches any number of directories that are not hidden, by
+   workers that read each directory below a base once. */
+struct Walk
+{
+	const char *pcBase;
+	int iBaseLen;
+	int iBaseFd;
+	/* The base as it prefixes the matches, and a descriptor of it */
+
+	char *pcPattern;
+	char *apcComponents[MAX_COMPONENTS];
+	int iComponents;
+	/* The components of the pattern, in the block pcPattern */
+
+	int iDirOnly;
+	/* 1 (TRUE) if the pattern ends with '/' and matches directories */
+
+	int iFixedTail;
+	/* 1 (TRUE) if the "**" is followed by components without one */
+
+	struct Worker asWorkers[MAX_WORKERS];
+	int iWorkers, iStarted;
+
+	pthread_mutex_t sLock;
+	pthread_cond_t sWake;
+	int iQueued, iPending, iSleeping, iFailed;
+	/* The directories in the deques, those queued or being read, the
+	   workers waiting for some, and 1 (TRUE) once memory ran out.
+	   Guarded by sLock. */
+};
+
+/* The number of Workers of each Walk, 0 until known */
+static int iWalkWorkers;
+
+/* The names sorted by Wildcard_compare */
+static const char *pcSortNames;
+
+/*--------------------------------------------------------------------*/
+
+static void Wildcard_freeDir(struct Dir *psDir)
+
+/* Free psDir. */
+
+{
+	free(psDir->pcPath);
+	free(psDir->pcNames);
+	free(psDir->psEntries);
+	free(psDir);
+}
+
+/*--------------------------------------------------------------------*/
+
+void Wildcard_flushCache(void)
+
+/* Forget every cached directory. */
+
+{
+	struct Dir *psNext;
+
+	for(; psDirs != NULL; psDirs = psNext)
+	{
+		psNext = psDirs->psNext;
+		Wildcard_freeDir(psDirs);
+	}
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Wildcard_compare(const void *pvFirst, const void *pvSecond)
+
+/* Compare the names of Entries pvFirst and pvSecond. */
+
+{
+	return strcmp(pcSortNames + ((const struct Entry *)pvFirst)->iName,
+		pcSortNames + ((const struct Entry *)pvSecond)->iName);
+}
+
+/*--------------------------------------------------------------------*/
+
+static struct Dir *Wildcard_readDir(const char *pcPath,
+	const struct stat *psStat)
+
+/* Read the directory pcPath, whose status is *psStat, in batches of
+   DENTS_SIZE bytes.  Return the new Dir, or NULL if the directory
+   cannot be read or memory is insufficient. */
+
+{
+	char acDents[DENTS_SIZE] __attribute__((aligned(8)));
+	struct Dirent64 *psDent;
+	struct Dir *psDir;
+	struct Entry *psNewEntries;
+	char *pcNewNames;
+	long lRead, lPos;
+	int iFd, iNamesLen = 0, iNamesSize = 4096, iCapacity = 64, iNameLen;
+
+	iFd = open(pcPath[0] != '\0' ? pcPath : ".",
+		O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if(iFd < 0) return NULL;
+
+	psDir = (struct Dir *)calloc(1, sizeof(struct Dir));
+	if(psDir == NULL
+		|| (psDir->pcPath = strdup(pcPath)) == NULL
+		|| (psDir->pcNames = (char *)malloc(iNamesSize)) == NULL
+		|| (psDir->psEntries = (struct Entry *)malloc(iCapacity * sizeof(struct Entry))) == NULL)
+		goto FAIL;
+	psDir->iDev = psStat->st_dev;
+	psDir->iIno = psStat->st_ino;
+	psDir->sMtime = psStat->st_mtim;
+
+	while((lRead = syscall(SYS_getdents64, iFd, acDents, DENTS_SIZE)) > 0)
+	{
+		for(lPos = 0; lPos < lRead; lPos += psDent->usReclen)
+		{
+			psDent = (struct Dirent64 *)(acDents + lPos);
+			if(strcmp(psDent->acName, ".") == 0 || strcmp(psDent->acName, "..") == 0)
+				continue;
+
+			iNameLen = strlen(psDent->acName) + 1;
+			if(iNamesLen + iNameLen > iNamesSize)
+			{
+				while(iNamesLen + iNameLen > iNamesSize) iNamesSize *= 2;
+				pcNewNames = (char *)realloc(psDir->pcNames, iNamesSize);
+				if(pcNewNames == NULL) goto FAIL;
+				psDir->pcNames = pcNewNames;
+			}
+			if(psDir->iEntries == iCapacity)
+			{
+				iCapacity *= 2;
+				psNewEntries = (struct Entry *)realloc(psDir->psEntries,
+					iCapacity * sizeof(struct Entry));
+				if(psNewEntries == NULL) goto FAIL;
+				psDir->psEntries = psNewEntries;
+			}
+
+			memcpy(psDir->pcNames + iNamesLen, psDent->acName, iNameLen);
+			psDir->psEntries[psDir->iEntries].iName = iNamesLen;
+			psDir->psEntries[psDir->iEntries].ucType = psDent->ucType;
+			psDir->iEntries++;
+			iNamesLen += iNameLen;
+		}
+	}
+	if(lRead < 0) goto FAIL;
+	close(iFd);
+
+	/* Sorted once, so that the matches of every pattern come out in
+	   order */
+	pcSortNames = psDir->pcNames;
+	qsort(psDir->psEntries, psDir->iEntries, sizeof(struct Entry),
+		Wildcard_compare);
+	Stats_count(STATS_GLOB_READS, 1);
+	return psDir;
+
+	FAIL:
+		close(iFd);
+		if(psDir != NULL) Wildcard_freeDir(psDir);
+		return NULL;
+}
+
+/*--------------------------------------------------------------------*/
+
+static struct Dir *Wildcard_getDir(const char *pcPath)
+
+/* Return the Dir of the directory pcPath, reading it unless a current
+   copy is cached.  Return NULL if it cannot be read. */
+
+{
+	struct Dir *psDir, **ppsLink;
+	struct stat sStat;
+
+	if(stat(pcPath[0] != '\0' ? pcPath : ".", &sStat) != 0
+		|| !S_ISDIR(sStat.st_mode))
+		return NULL;
+
+	for(ppsLink = &psDirs; *ppsLink != NULL; ppsLink = &(*ppsLink)->psNext)
+	{
+		psDir = *ppsLink;
+		if(strcmp(psDir->pcPath, pcPath) != 0) continue;
+		if(psDir->iDev == sStat.st_dev && psDir->iIno == sStat.st_ino
+			&& psDir->sMtime.tv_sec == sStat.st_mtim.tv_sec
+			&& psDir->sMtime.tv_nsec == sStat.st_mtim.tv_nsec)
+		{
+			Stats_count(STATS_GLOB_HITS, 1);
+			return psDir;
+		}
+		/* Changed since it was read */
+		*ppsLink = psDir->psNext;
+		Wildcard_freeDir(psDir);
+		break;
+	}
+
+	psDir = Wildcard_readDir(pcPath, &sStat);
+	if(psDir == NULL) return NULL;
+	psDir->psNext = psDirs;
+	psDirs = psDir;
+	return psDir;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Wildcard_addMatch(struct Matches *psMatches, const char *pcPath,
+	int iLen)
+
+/* Append pcPath, of length iLen, to psMatches.  Return 1 (TRUE) if
+   successful, or 0 (FALSE) if insufficient memory is available. */
+
+{
+	char *pcNewStrings;
+	int *piNewOffsets;
+	int iNewSize;
+
+	if(psMatches->iLen + iLen + 1 > psMatches->iSize)
+	{
+		iNewSize = (psMatches->iSize == 0) ? 4096 : psMatches->iSize;
+		while(psMatches->iLen + iLen + 1 > iNewSize) iNewSize *= 2;
+		pcNewStrings = (char *)realloc(psMatches->pcStrings, iNewSize);
+		if(pcNewStrings == NULL) return FALSE;
+		psMatches->pcStrings = pcNewStrings;
+		psMatches->iSize = iNewSize;
+	}
+	if(psMatches->iCount == psMatches->iCapacity)
+	{
+		iNewSize = (psMatches->iCapacity == 0) ? 64 : 2 * psMatches->iCapacity;
+		piNewOffsets = (int *)realloc(psMatches->piOffsets, iNewSize * sizeof(int));
+		if(piNewOffsets == NULL) return FALSE;
+		psMatches->piOffsets = piNewOffsets;
+		psMatches->iCapacity = iNewSize;
+	}
+
+	psMatches->piOffsets[psMatches->iCount++] = psMatches->iLen;
+	memcpy(psMatches->pcStrings + psMatches->iLen, pcPath, iLen);
+	psMatches->pcStrings[psMatches->iLen + iLen] = '\0';
+	psMatches->iLen += iLen + 1;
+	return TRUE;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Wildcard_hasMeta(const char *pcComponent)
+
+/* Return 1 (TRUE) if pcComponent has an unescaped '*', '?' or '['. */
+
+{
+	for(; *pcComponent != '\0'; pcComponent++)
+	{
+		if(*pcComponent == '\\' && pcComponent[1] != '\0') pcComponent++;
+		else if(*pcComponent == '*' || *pcComponent == '?' || *pcComponent == '[')
+			return TRUE;
+	}
+	return FALSE;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Wildcard_isDir(const char *pcPath, unsigned char ucType)
+
+/* Return 1 (TRUE) if pcPath, whose d_type is ucType, is a directory
+   or a link to one. */
+
+{
+	struct stat sStat;
+
+	if(ucType == DT_DIR) return TRUE;
+	if(ucType != DT_LNK && ucType != DT_UNKNOWN) return FALSE;
+	return stat(pcPath, &sStat) == 0 && S_ISDIR(sStat.st_mode);
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Wildcard_matchComponent(const char *pcPattern, const char *pcName,
+	int iLen)
+
+/* Return 1 (TRUE) if the iLen characters of pcName, a name that need
+   not end with '\0', match pcPattern. */
+
+{
+	char acName[MAX_NAME_SIZE];
+
+	if(iLen >= MAX_NAME_SIZE) return FALSE;
+	memcpy(acName, pcName, iLen);
+	acName[iLen] = '\0';
+	return fnmatch(pcPattern, acName, FNM_PERIOD) == 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Wildcard_matchPath(char **ppcComponents, int iComponents,
+	const char *pcPath, int iPrefix)
+
+/* Return 1 (TRUE) if pcPath, relative to the base of a Walk, matches
+   the iComponents components ppcComponents.  If iPrefix, return 1
+   instead if pcPath is a directory below which paths may match, so
+   that the others are not read.  "**" matches any number of names
+   that do not start with '.', or, as the last component, any path
+   below. */
+
+{
+	const char *pcEnd, *pcNext;
+
+	if(*pcPath == '\0') return iPrefix ? iComponents > 0 : iComponents == 0;
+	if(iComponents == 0) return FALSE;
+
+	pcEnd = strchr(pcPath, '/');
+	if(pcEnd == NULL) pcEnd = pcPath + strlen(pcPath);
+	pcNext = (*pcEnd == '/') ? pcEnd + 1 : pcEnd;
+
+	if(strcmp(ppcComponents[0], "**") == 0)
+	{
+		if(*pcPath == '.') return iComponents > 1
+			&& Wildcard_matchPath(ppcComponents + 1, iComponents - 1, pcPath, iPrefix);
+		if(iComponents == 1) return strstr(pcPath, "/.") == NULL;
+		return Wildcard_matchPath(ppcComponents + 1, iComponents - 1, pcPath, iPrefix)
+			|| Wildcard_matchPath(ppcComponents, iComponents, pcNext, iPrefix);
+	}
+	if(!Wildcard_matchComponent(ppcComponents[0], pcPath, pcEnd - pcPath))
+		return FALSE;
+	return Wildcard_matchPath(ppcComponents + 1, iComponents - 1, pcNext, iPrefix);
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Wildcard_matchEntry(struct Walk *psWalk, const char *pcPath,
+	int iLen)
+
+/* Return 1 (TRUE) if pcPath, of length iLen and relative to the base
+   of psWalk, matches its pattern.  A "**" followed by plain
+   components only needs these to match the last names of pcPath. */
+
+{
+	const char *pc = pcPath + iLen, *pcEnd;
+	int iTail = psWalk->iComponents - 1, i;
+
+	if(!psWalk->iFixedTail)
+		return Wildcard_matchPath(psWalk->apcComponents, psWalk->iComponents,
+			pcPath, FALSE);
+
+	for(i = 0; i < iTail; i++)
+	{
+		if(pc == pcPath) return FALSE;
+		if(i > 0) pc--;
+		while(pc > pcPath && pc[-1] != '/') pc--;
+	}
+	/* The directories matched by "**" */
+	if(pc > pcPath && (pcPath[0] == '.' || memmem(pcPath, pc - pcPath, "/.", 2) != NULL))
+		return FALSE;
+
+	for(i = 1; i <= iTail; i++)
+	{
+		pcEnd = strchr(pc, '/');
+		if(pcEnd == NULL) pcEnd = pcPath + iLen;
+		if(!Wildcard_matchComponent(psWalk->apcComponents[i], pc, pcEnd - pc))
+			return FALSE;
+		pc = pcEnd + 1;
+	}
+	return TRUE;
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Wildcard_fail(struct Walk *psWalk)
+
+/* Record that memory ran out in psWalk, whose workers then stop
+   reading directories. */
+
+{
+	pthread_mutex_lock(&psWalk->sLock);
+	psWalk->iFailed = TRUE;
+	pthread_mutex_unlock(&psWalk->sLock);
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Wildcard_pushTasks(struct Worker *psWorker, char **ppcTasks,
+	int iTasks)
+
+/* Push the iTasks directories ppcTasks to the deque of psWorker, and
+   wake as many waiting workers.  Return 0 (FALSE) if insufficient
+   memory is available, in which case the directories are freed. */
+
+{
+	struct Walk *psWalk = psWorker->psWalk;
+	char **ppcNewTasks;
+	int iNewCapacity, i;
+
+	pthread_mutex_lock(&psWorker->sLock);
+	if(psWorker->iTail + iTasks > psWorker->iCapacity)
+	{
+		/* Move the tasks not stolen yet back to the start */
+		memmove(psWorker->ppcTasks, psWorker->ppcTasks + psWorker->iHead,
+			(psWorker->iTail - psWorker->iHead) * sizeof(char *));
+		psWorker->iTail -= psWorker->iHead;
+		psWorker->iHead = 0;
+	}
+	if(psWorker->iTail + iTasks > psWorker->iCapacity)
+	{
+		iNewCapacity = (psWorker->iCapacity == 0) ? 64 : 2 * psWorker->iCapacity;
+		while(psWorker->iTail + iTasks > iNewCapacity) iNewCapacity *= 2;
+		ppcNewTasks = (char **)realloc(psWorker->ppcTasks, iNewCapacity * sizeof(char *));
+		if(ppcNewTasks == NULL)
+		{
+			pthread_mutex_unlock(&psWorker->sLock);
+			for(i = 0; i < iTasks; i++) free(ppcTasks[i]);
+			return FALSE;
+		}
+		psWorker->ppcTasks = ppcNewTasks;
+		psWorker->iCapacity = iNewCapacity;
+	}
+	memcpy(psWorker->ppcTasks + psWorker->iTail, ppcTasks, iTasks * sizeof(char *));
+	psWorker->iTail += iTasks;
+	pthread_mutex_unlock(&psWorker->sLock);
+
+	/* The directory being read is pending, so the count cannot reach
+	   0 before it is raised, even if the new ones are stolen first */
+	pthread_mutex_lock(&psWalk->sLock);
+	psWalk->iQueued += iTasks;
+	psWalk->iPending += iTasks;
+	if(psWalk->iSleeping > 0)
+	{
+		if(iTasks == 1) pthread_cond_signal(&psWalk->sWake);
+		else pthread_cond_broadcast(&psWalk->sWake);
+	}
+	pthread_mutex_unlock(&psWalk->sLock);
+	return TRUE;
+}
+
+/*--------------------------------------------------------------------*/
+
+static char *Wildcard_takeTask(struct Worker *psWorker)
+
+/* Pop the newest directory of the deque of psWorker or, if it is
+   empty, steal the oldest of another worker.  Return NULL if every
+   deque is empty. */
+
+{
+	struct Walk *psWalk = psWorker->psWalk;
+	struct Worker *psVictim;
+	int iSelf = psWorker - psWalk->asWorkers, i;
+	char *pcTask = NULL;
+
+	for(i = 0; i < psWalk->iWorkers && pcTask == NULL; i++)
+	{
+		psVictim = &psWalk->asWorkers[(iSelf + i) % psWalk->iWorkers];
+		pthread_mutex_lock(&psVictim->sLock);
+		if(psVictim->iHead < psVictim->iTail)
+			pcTask = (i == 0) ? psVictim->ppcTasks[--psVictim->iTail]
+				: psVictim->ppcTasks[psVictim->iHead++];
+		pthread_mutex_unlock(&psVictim->sLock);
+	}
+	return pcTask;
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Wildcard_readTask(struct Worker *psWorker, char *pcDir)
+
+/* Read the directory pcDir, a path relative to the base of the Walk of
+   psWorker that is "" or ends with '/', with getdents64.  Add its
+   entries that match to the matches of psWorker, and push its
+   subdirectories below which paths may match.  Entry types come from
+   getdents64, and links to directories are not followed.  Free
+   pcDir. */
+
+{
+	char acDents[DENTS_SIZE] __attribute__((aligned(8)));
+	char acPath[MAX_PATH_SIZE];
+	struct Walk *psWalk = psWorker->psWalk;
+	struct Dirent64 *psDent;
+	struct stat sStat;
+	char **ppcDirs = NULL, **ppcNewDirs;
+	char *pcRelative = acPath + psWalk->iBaseLen;
+	int iFd, iDirLen = strlen(pcDir), iLen, iIsDir, iDirs = 0, iCapacity = 0;
+	long lRead, lPos;
+
+	if(psWalk->iBaseLen + iDirLen >= MAX_PATH_SIZE - 1) goto DONE;
+	memcpy(acPath, psWalk->pcBase, psWalk->iBaseLen);
+	memcpy(pcRelative, pcDir, iDirLen);
+
+	iFd = openat(psWalk->iBaseFd, pcDir[0] != '\0' ? pcDir : ".",
+		O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if(iFd < 0) goto DONE;
+	psWorker->iReads++;
+
+	while((lRead = syscall(SYS_getdents64, iFd, acDents, DENTS_SIZE)) > 0)
+	{
+		for(lPos = 0; lPos < lRead; lPos += psDent->usReclen)
+		{
+			psDent = (struct Dirent64 *)(acDents + lPos);
+			if(strcmp(psDent->acName, ".") == 0 || strcmp(psDent->acName, "..") == 0)
+				continue;
+			iLen = iDirLen + strlen(psDent->acName);
+			if(psWalk->iBaseLen + iLen >= MAX_PATH_SIZE - 1) continue;
+			strcpy(pcRelative + iDirLen, psDent->acName);
+
+			iIsDir = psDent->ucType == DT_DIR
+				|| (psDent->ucType == DT_UNKNOWN
+				&& fstatat(iFd, psDent->acName, &sStat, AT_SYMLINK_NOFOLLOW) == 0
+				&& S_ISDIR(sStat.st_mode));
+
+			if(Wildcard_matchEntry(psWalk, pcRelative, iLen)
+				&& (!psWalk->iDirOnly || iIsDir
+				|| (psDent->ucType == DT_LNK
+				&& fstatat(iFd, psDent->acName, &sStat, 0) == 0
+				&& S_ISDIR(sStat.st_mode))))
+			{
+				if(psWalk->iDirOnly) pcRelative[iLen] = '/';
+				if(!Wildcard_addMatch(&psWorker->sMatches, acPath,
+					psWalk->iBaseLen + iLen + psWalk->iDirOnly))
+					goto FAIL;
+				pcRelative[iLen] = '\0';
+			}
+
+			if(iIsDir && Wildcard_matchPath(psWalk->apcComponents,
+				psWalk->iComponents, pcRelative, TRUE))
+			{
+				if(iDirs == iCapacity)
+				{
+					iCapacity = (iCapacity == 0) ? 16 : 2 * iCapacity;
+					ppcNewDirs = (char **)realloc(ppcDirs, iCapacity * sizeof(char *));
+					if(ppcNewDirs == NULL) goto FAIL;
+					ppcDirs = ppcNewDirs;
+				}
+				pcRelative[iLen] = '/';
+				ppcDirs[iDirs] = strndup(pcRelative, iLen + 1);
+				if(ppcDirs[iDirs] == NULL) goto FAIL;
+				iDirs++;
+			}
+		}
+	}
+	close(iFd);
+	if(iDirs > 0 && !Wildcard_pushTasks(psWorker, ppcDirs, iDirs))
+		Wildcard_fail(psWalk);
+	goto DONE;
+
+	FAIL:
+		close(iFd);
+		while(iDirs > 0) free(ppcDirs[--iDirs]);
+		Wildcard_fail(psWalk);
+	DONE:
+		free(ppcDirs);
+		free(pcDir);
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Wildcard_startWorkers(struct Walk *psWalk);
+
+static void Wildcard_work(struct Worker *psWorker)
+
+/* Read the directories of the Walk of psWorker until there are none
+   left to read. */
+
+{
+	struct Walk *psWalk = psWorker->psWalk;
+	char *pcTask;
+	int iFailed, iDone;
+
+	for(;;)
+	{
+		pcTask = Wildcard_takeTask(psWorker);
+		if(pcTask != NULL)
+		{
+			pthread_mutex_lock(&psWalk->sLock);
+			psWalk->iQueued--;
+			iFailed = psWalk->iFailed;
+			pthread_mutex_unlock(&psWalk->sLock);
+
+			if(iFailed) free(pcTask);
+			else Wildcard_readTask(psWorker, pcTask);
+
+			/* The calling thread walks alone until the tree proves
+			   large enough for the others */
+			if(psWorker == psWalk->asWorkers && !psWalk->iStarted
+				&& psWorker->iTail - psWorker->iHead > PARALLEL_THRESHOLD)
+				Wildcard_startWorkers(psWalk);
+
+			pthread_mutex_lock(&psWalk->sLock);
+			if(--psWalk->iPending == 0) pthread_cond_broadcast(&psWalk->sWake);
+			pthread_mutex_unlock(&psWalk->sLock);
+			continue;
+		}
+
+		pthread_mutex_lock(&psWalk->sLock);
+		while(psWalk->iQueued <= 0 && psWalk->iPending > 0)
+		{
+			psWalk->iSleeping++;
+			pthread_cond_wait(&psWalk->sWake, &psWalk->sLock);
+			psWalk->iSleeping--;
+		}
+		iDone = (psWalk->iPending == 0);
+		pthread_mutex_unlock(&psWalk->sLock);
+		if(iDone) return;
+	}
+}
+
+/*--------------------------------------------------------------------*/
+
+static void *Wildcard_runWorker(void *pvWorker)
+
+/* The start routine of the threads of a Walk. */
+
+{
+	Wildcard_work((struct Worker *)pvWorker);
+	return NULL;
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Wildcard_startWorkers(struct Walk *psWalk)
+
+/* Start the threads of every worker of psWalk but the first, which is
+   the calling thread.  They block every signal, so that the handlers
+   of the shell run only in its own thread.  A worker whose thread
+   cannot be started has its deque, always empty. */
+
+{
+	sigset_t sAll, sOld;
+	int i;
+
+	psWalk->iStarted = TRUE;
+	sigfillset(&sAll);
+	pthread_sigmask(SIG_SETMASK, &sAll, &sOld);
+	for(i = 1; i < psWalk->iWorkers; i++)
+		psWalk->asWorkers[i].iStarted = pthread_create(&psWalk->asWorkers[i].sThread,
+			NULL, Wildcard_runWorker, &psWalk->asWorkers[i]) == 0;
+	pthread_sigmask(SIG_SETMASK, &sOld, NULL);
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Wildcard_comparePaths(const void *pvFirst, const void *pvSecond)
+
+/* Compare the paths pvFirst and pvSecond point to in the order in
+   which a walk of sorted directories finds them: '/' sorts before
+   every other character, so that a directory is followed by its
+   contents. */
+
+{
+	const unsigned char *pc1 = *(const unsigned char **)pvFirst;
+	const unsigned char *pc2 = *(const unsigned char **)pvSecond;
+
+	while(*pc1 == *pc2 && *pc1 != '\0')
+	{
+		pc1++;
+		pc2++;
+	}
+	return ((*pc1 == '/') ? 1 : (*pc1 == '\0') ? 0 : *pc1 + 2)
+		- ((*pc2 == '/') ? 1 : (*pc2 == '\0') ? 0 : *pc2 + 2);
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Wildcard_merge(struct Walk *psWalk)
+
+/* Append the matches of every worker of psWalk to the matches, in the
+   order of Wildcard_comparePaths, which does not depend on how the
+   directories were shared out.  Return 0 (FALSE) if insufficient
+   memory is available. */
+
+{
+	const char **ppcSorted;
+	struct Matches *psMatches;
+	int iCount = 0, iSorted = 0, i, j;
+
+	for(i = 0; i < psWalk->iWorkers; i++)
+		iCount += psWalk->asWorkers[i].sMatches.iCount;
+	if(iCount == 0) return TRUE;
+
+	ppcSorted = (const char **)malloc(iCount * sizeof(const char *));
+	if(ppcSorted == NULL) return FALSE;
+	for(i = 0; i < psWalk->iWorkers; i++)
+	{
+		psMatches = &psWalk->asWorkers[i].sMatches;
+		for(j = 0; j < psMatches->iCount; j++)
+			ppcSorted[iSorted++] = psMatches->pcStrings + psMatches->piOffsets[j];
+	}
+	qsort(ppcSorted, iCount, sizeof(const char *), Wildcard_comparePaths);
+
+	for(i = 0; i < iCount; i++)
+		if(!Wildcard_addMatch(&sMatches, ppcSorted[i], strlen(ppcSorted[i])))
+		{
+			free(ppcSorted);
+			return FALSE;
+		}
+	free(ppcSorted);
+	return TRUE;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Wildcard_getWorkers(void)
+
+/* Return the number of workers of a Walk: ISH_GLOB_WORKERS if set, or
+   the number of online processors, at most MAX_WORKERS. */
+
+{
+	const char *pcWorkers;
+
+	if(iWalkWorkers > 0) return iWalkWorkers;
+	pcWorkers = getenv("ISH_GLOB_WORKERS");
+	iWalkWorkers = (pcWorkers != NULL) ? atoi(pcWorkers)
+		: (int)sysconf(_SC_NPROCESSORS_ONLN);
+	if(iWalkWorkers < 1) iWalkWorkers = 1;
+	if(iWalkWorkers > MAX_WORKERS) iWalkWorkers = MAX_WORKERS;
+	return iWalkWorkers;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Wildcard_walkRecursive(const char *pcPattern, const char *pcBase,
+	int iBaseLen)
+
+/* Append to the matches the paths matching pcPattern, whose first
+   component is "**", below pcBase, the first iBaseLen characters of
+   which are "" or a directory ending with '/'.  Return 0 (FALSE) if
+   insufficient memory is available. */
+
+{
+	struct Walk *psWalk;
+	char *pc, *pcTask;
+	int iOk, i;
+
+	assert(iBaseLen == 0 || pcBase[iBaseLen - 1] == '/');
+
+	psWalk = (struct Walk *)calloc(1, sizeof(struct Walk));
+	if(psWalk == NULL) return FALSE;
+	psWalk->pcBase = pcBase;
+	psWalk->iBaseLen = iBaseLen;
+	psWalk->pcPattern = strdup(pcPattern);
+	pcTask = strdup("");
+	if(psWalk->pcPattern == NULL || pcTask == NULL)
+	{
+		free(psWalk->pcPattern);
+		free(pcTask);
+		free(psWalk);
+		return FALSE;
+	}
+
+	/* Split the pattern into components, skipping empty ones */
+	for(pc = strtok(psWalk->pcPattern, "/"); pc != NULL; pc = strtok(NULL, "/"))
+	{
+		if(psWalk->iComponents == MAX_COMPONENTS) break;
+		psWalk->apcComponents[psWalk->iComponents++] = pc;
+	}
+	psWalk->iDirOnly = pcPattern[strlen(pcPattern) - 1] == '/';
+	psWalk->iFixedTail = psWalk->iComponents > 1;
+	for(i = 1; i < psWalk->iComponents; i++)
+		if(strcmp(psWalk->apcComponents[i], "**") == 0) psWalk->iFixedTail = FALSE;
+
+	psWalk->iBaseFd = open(iBaseLen > 0 ? pcBase : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if(psWalk->iBaseFd < 0 || pc != NULL)
+	{
+		/* No base directory, or too many components to match */
+		if(psWalk->iBaseFd >= 0) close(psWalk->iBaseFd);
+		free(psWalk->pcPattern);
+		free(pcTask);
+		free(psWalk);
+		return TRUE;
+	}
+
+	psWalk->iWorkers = Wildcard_getWorkers();
+	pthread_mutex_init(&psWalk->sLock, NULL);
+	pthread_cond_init(&psWalk->sWake, NULL);
+	for(i = 0; i < psWalk->iWorkers; i++)
+	{
+		psWalk->asWorkers[i].psWalk = psWalk;
+		pthread_mutex_init(&psWalk->asWorkers[i].sLock, NULL);
+	}
+
+	/* The base is the first directory, read by the calling thread */
+	psWalk->iStarted = psWalk->iWorkers == 1;
+	if(Wildcard_pushTasks(&psWalk->asWorkers[0], &pcTask, 1))
+		Wildcard_work(&psWalk->asWorkers[0]);
+	else
+		Wildcard_fail(psWalk);
+
+	for(i = 1; i < psWalk->iWorkers; i++)
+		if(psWalk->asWorkers[i].iStarted)
+			pthread_join(psWalk->asWorkers[i].sThread, NULL);
+
+	iOk = !psWalk->iFailed && Wildcard_merge(psWalk);
+
+	for(i = 0; i < psWalk->iWorkers; i++)
+	{
+		Stats_count(STATS_GLOB_READS, psWalk->asWorkers[i].iReads);
+		while(psWalk->asWorkers[i].iHead < psWalk->asWorkers[i].iTail)
+			free(psWalk->asWorkers[i].ppcTasks[psWalk->asWorkers[i].iHead++]);
+		free(psWalk->asWorkers[i].ppcTasks);
+		free(psWalk->asWorkers[i].sMatches.pcStrings);
+		free(psWalk->asWorkers[i].sMatches.piOffsets);
+		pthread_mutex_destroy(&psWalk->asWorkers[i].sLock);
+	}
+	pthread_mutex_destroy(&psWalk->sLock);
+	pthread_cond_destroy(&psWalk->sWake);
+	close(psWalk->iBaseFd);
+	free(psWalk->pcPattern);
+	free(psWalk);
+	return iOk;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Wildcard_walk(const char *pcPattern, char *acPath, int iPathLen)
+
+/* Append to the matches the paths matching pcPattern below acPath,
+   the first iPathLen characters of which are the path matched so
+   far.  Return 0 (FALSE) if insufficient memory is available. */
+
+{
+	char acComponent[MAX_PATH_SIZE];
+	const char *pcEnd, *pcName;
+	struct Dir *psDir;
+	struct stat sStat;
+	int iLen, iNameLen, i;
+
+	while(*pcPattern == '/' && iPathLen < MAX_PATH_SIZE - 1)
+		acPath[iPathLen++] = *pcPattern++;
+	acPath[iPathLen] = '\0';
+	if(*pcPattern == '\0')
+	{
+		/* The components after the last glob were not looked up */
+		if(lstat(acPath, &sStat) != 0) return TRUE;
+		return Wildcard_addMatch(&sMatches, acPath, iPathLen);
+	}
+
+	pcEnd = strchr(pcPattern, '/');
+	if(pcEnd == NULL) pcEnd = pcPattern + strlen(pcPattern);
+	iLen = pcEnd - pcPattern;
+	if(iLen >= MAX_PATH_SIZE) return TRUE;
+	memcpy(acComponent, pcPattern, iLen);
+	acComponent[iLen] = '\0';
+
+	if(strcmp(acComponent, "**") == 0)
+		return Wildcard_walkRecursive(pcPattern, acPath, iPathLen);
+
+	if(!Wildcard_hasMeta(acComponent))
+	{
+		for(i = 0; i < iLen && iPathLen < MAX_PATH_SIZE - 1; i++)
+		{
+			if(acComponent[i] == '\\' && i + 1 < iLen) i++;
+			acPath[iPathLen++] = acComponent[i];
+		}
+		return Wildcard_walk(pcEnd, acPath, iPathLen);
+	}
+
+	psDir = Wildcard_getDir(acPath);
+	if(psDir == NULL) return TRUE;
+	for(i = 0; i < psDir->iEntries; i++)
+	{
+		pcName = psDir->pcNames + psDir->psEntries[i].iName;
+		if(fnmatch(acComponent, pcName, FNM_PERIOD) != 0) continue;
+		iNameLen = strlen(pcName);
+		if(iPathLen + iNameLen >= MAX_PATH_SIZE - 1) continue;
+		memcpy(acPath + iPathLen, pcName, iNameLen + 1);
+
+		if(*pcEnd == '\0')
+		{
+			if(!Wildcard_addMatch(&sMatches, acPath, iPathLen + iNameLen)) return FALSE;
+		}
+		else if(Wildcard_isDir(acPath, psDir->psEntries[i].ucType))
+		{
+			/* Deeper directories have longer paths, so psDir stays
+			   cached */
+			if(!Wildcard_walk(pcEnd, acPath, iPathLen + iNameLen)) return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/*--------------------------------------------------------------------*/
+
+int Wildcard_expand(const char *pcPattern)
+
+/* Append the paths matching pcPattern to the matches. */
+
+{
+	char acPath[MAX_PATH_SIZE];
+	int iBefore = sMatches.iCount, iBeforeLen = sMatches.iLen;
+
+	assert(pcPattern != NULL);
+
+	if(!Wildcard_walk(pcPattern, acPath, 0))
+	{
+		sMatches.iCount = iBefore;
+		sMatches.iLen = iBeforeLen;
+		return -1;
+	}
+	return sMatches.iCount - iBefore;
+}
+
+/*--------------------------------------------------------------------*/
+
+int Wildcard_addWord(const char *pcWord)
+
+/* Append pcWord to the matches. */
+
+{
+	assert(pcWord != NULL);
+
+	return Wildcard_addMatch(&sMatches, pcWord, strlen(pcWord));
+}
+
+/*--------------------------------------------------------------------*/
+
+const char *Wildcard_getMatch(int iIndex)
+
+/* Return the iIndex'th match. */
+
+{
+	assert(iIndex >= 0 && iIndex < sMatches.iCount);
+
+	return sMatches.pcStrings + sMatches.piOffsets[iIndex];
+}
+
+/*--------------------------------------------------------------------*/
+
+void Wildcard_clearMatches(void)
+
+/* Forget every match. */
+
+{
+	sMatches.iCount = 0;
+	sMatches.iLen = 0;
+}
@@ -0,0 +1,40 @@
+#ifndef WILDCARD_INCLUDED
+#define WILDCARD_INCLUDED
+
+/* Glob expansion of the words of a command.  Directories are read
+   whole with getdents64 and kept, sorted, until Wildcard_flushCache,
+   so that the patterns of one line that search the same directory
+   read it once.  A cached directory is read again if its mtime
+   changed, so that the files created by an earlier pipeline of the
+   line are seen.
+
+   A "**" component matches any number of directories that are not
+   hidden, and as the last component any path below them.  The tree
+   it stands for is walked by a pool of threads, one per processor or
+   ISH_GLOB_WORKERS, which steal directories from each other and
+   descend only where the rest of the pattern may still match.  Links
+   to directories are not followed. */
+
+/* Append the paths matching pcPattern to the matches, in sorted
+   order.  pcPattern is a pattern of fnmatch, in which '\' escapes
+   the next character, and names starting with '.' are matched only
+   by an explicit '.'.  Return the number of paths appended, or -1 if
+   insufficient memory is available. */
+int Wildcard_expand(const char *pcPattern);
+
+/* Append pcWord to the matches as it is.  Return 0 (FALSE) if
+   insufficient memory is available. */
+int Wildcard_addWord(const char *pcWord);
+
+/* Return the iIndex'th match since Wildcard_clearMatches.  The
+   string is valid until the next Wildcard_expand or
+   Wildcard_clearMatches. */
+const char *Wildcard_getMatch(int iIndex);
+
+/* Forget every match. */
+void Wildcard_clearMatches(void);
+
+/* Forget every cached directory.  Called at the end of each line. */
+void Wildcard_flushCache(void);
+
+#endif
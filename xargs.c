@@ -0,0 +1,351 @@
+#include "xargs.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <unistd.h>
+
+/*--------------------------------------------------------------------*/
+
+enum {FALSE, TRUE};
+
+/* Size of each read() of items */
+enum {READ_SIZE = 65536};
+
+/* Room left for the auxiliary vector and what exec itself adds, as
+   POSIX asks of xargs */
+enum {ARG_HEADROOM = 2048};
+
+/* Longest single argument Linux accepts (MAX_ARG_STRLEN) */
+enum {MAX_ARG_LENGTH = 32 * 4096};
+
+struct Xargs
+{
+	/* Descriptor the items are read from */
+	int iFd;
+
+	/* 1 if items are separated by '\0' */
+	int iNul;
+
+	/* The command that prefixes each batch */
+	char **ppcCommand;
+	int iCommandArgc;
+
+	/* Most items in a batch, or 0 */
+	int iMaxArgs;
+
+	/* Bytes of ARG_MAX left for the items of a batch */
+	long lMaxBytes;
+
+	/* Input read but not yet split into items, and 1 once the end of
+	   the input was read */
+	char acInput[READ_SIZE];
+	int iInputPos, iInputLen;
+	int iEof;
+
+	/* The items of the batch, each terminated by '\0', at the offsets
+	   piItems */
+	char *pcItems;
+	size_t iItemsLen, iItemsSize;
+	int *piItems;
+	int iItems, iItemsCapacity;
+
+	/* 1 if piItems[iItems] is an item read for the next batch */
+	int iPending;
+
+	/* The argv of the last batch */
+	char **ppcArgv;
+	int iArgvCapacity;
+
+	const char *pcError;
+};
+
+/*--------------------------------------------------------------------*/
+
+static long Xargs_maxBytes(char **ppcCommand, int iCommandArgc)
+
+/* Return the bytes of ARG_MAX left for items once the environment and
+   the command ppcCommand of iCommandArgc strings are counted.  Each
+   string costs its characters, its '\0' and its pointer. */
+
+{
+	extern char **environ;
+	long lMax = sysconf(_SC_ARG_MAX);
+	int i;
+
+	if(lMax <= 0) lMax = 131072;
+	lMax -= ARG_HEADROOM + 2 * sizeof(char *);
+	for(i=0;environ[i]!=NULL;i++)
+		lMax -= strlen(environ[i]) + 1 + sizeof(char *);
+	for(i=0;i<iCommandArgc;i++)
+		lMax -= strlen(ppcCommand[i]) + 1 + sizeof(char *);
+	return lMax;
+}
+
+/*--------------------------------------------------------------------*/
+
+Xargs_T Xargs_new(int iFd, char **ppcCommand, int iCommandArgc,
+	int iMaxArgs, int iNul)
+
+/* Return a new Xargs_T reading items from iFd. */
+
+{
+	Xargs_T oXargs;
+
+	assert(ppcCommand != NULL);
+	assert(iCommandArgc > 0);
+	assert(iMaxArgs >= 0);
+
+	oXargs = (Xargs_T)calloc(1, sizeof(struct Xargs));
+	if(oXargs == NULL) return NULL;
+	oXargs->iFd = iFd;
+	oXargs->iNul = iNul;
+	oXargs->ppcCommand = ppcCommand;
+	oXargs->iCommandArgc = iCommandArgc;
+	oXargs->iMaxArgs = iMaxArgs;
+	oXargs->lMaxBytes = Xargs_maxBytes(ppcCommand, iCommandArgc);
+	return oXargs;
+}
+
+/*--------------------------------------------------------------------*/
+
+void Xargs_free(Xargs_T oXargs)
+
+/* Free oXargs. */
+
+{
+	if(oXargs == NULL) return;
+	free(oXargs->pcItems);
+	free(oXargs->piItems);
+	free(oXargs->ppcArgv);
+	free(oXargs);
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Xargs_isSeparator(Xargs_T oXargs, char c)
+
+/* Return 1 (TRUE) if c ends an item. */
+
+{
+	if(oXargs->iNul) return c == '\0';
+	return c == ' ' || c == '\t' || c == '\n';
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Xargs_fill(Xargs_T oXargs)
+
+/* Read the next block of input.  Return 0 (FALSE) at the end of the
+   input or on an error. */
+
+{
+	int n;
+
+	do n = read(oXargs->iFd, oXargs->acInput, READ_SIZE);
+	while(n < 0 && errno == EINTR);
+	if(n < 0) oXargs->pcError = strerror(errno);
+	if(n <= 0)
+	{
+		oXargs->iEof = TRUE;
+		return FALSE;
+	}
+	oXargs->iInputPos = 0;
+	oXargs->iInputLen = n;
+	return TRUE;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Xargs_reserve(Xargs_T oXargs, size_t iBytes)
+
+/* Make room for iBytes more bytes of items.  Return 0 (FALSE) if
+   insufficient memory is available. */
+
+{
+	char *pcNew;
+	size_t iNewSize;
+
+	if(oXargs->iItemsLen + iBytes <= oXargs->iItemsSize) return TRUE;
+	iNewSize = (oXargs->iItemsSize == 0) ? READ_SIZE : oXargs->iItemsSize;
+	while(oXargs->iItemsLen + iBytes > iNewSize) iNewSize *= 2;
+	pcNew = (char *)realloc(oXargs->pcItems, iNewSize);
+	if(pcNew == NULL)
+	{
+		oXargs->pcError = "Cannot allocate memory";
+		return FALSE;
+	}
+	oXargs->pcItems = pcNew;
+	oXargs->iItemsSize = iNewSize;
+	return TRUE;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Xargs_readItem(Xargs_T oXargs)
+
+/* Append the next item to the items.  Return 0 (FALSE) if there is
+   none or on an error. */
+
+{
+	const char *pcStart, *pcEnd;
+	int iOffset, *piNew;
+	size_t iLen;
+
+	/* Skip empty items */
+	for(;;)
+	{
+		if(oXargs->iInputPos == oXargs->iInputLen
+			&& (oXargs->iEof || !Xargs_fill(oXargs)))
+			return FALSE;
+		if(!Xargs_isSeparator(oXargs, oXargs->acInput[oXargs->iInputPos])) break;
+		oXargs->iInputPos++;
+	}
+
+	iOffset = oXargs->iItemsLen;
+	for(;;)
+	{
+		/* Copy up to the separator or the end of the block */
+		pcStart = oXargs->acInput + oXargs->iInputPos;
+		pcEnd = pcStart;
+		while(pcEnd < oXargs->acInput + oXargs->iInputLen
+			&& !Xargs_isSeparator(oXargs, *pcEnd))
+			pcEnd++;
+		iLen = pcEnd - pcStart;
+		if(!Xargs_reserve(oXargs, iLen + 1)) return FALSE;
+		memcpy(oXargs->pcItems + oXargs->iItemsLen, pcStart, iLen);
+		oXargs->iItemsLen += iLen;
+		oXargs->iInputPos += iLen;
+		if(oXargs->iItemsLen - iOffset >= MAX_ARG_LENGTH)
+		{
+			oXargs->pcError = "argument too long";
+			return FALSE;
+		}
+
+		if(oXargs->iInputPos < oXargs->iInputLen)
+		{
+			oXargs->iInputPos++;
+			break;
+		}
+		if(!Xargs_fill(oXargs))
+		{
+			if(oXargs->pcError != NULL) return FALSE;
+			break;
+		}
+	}
+	oXargs->pcItems[oXargs->iItemsLen++] = '\0';
+
+	if(oXargs->iItems == oXargs->iItemsCapacity)
+	{
+		oXargs->iItemsCapacity = oXargs->iItemsCapacity ? 2 * oXargs->iItemsCapacity : 1024;
+		piNew = (int *)realloc(oXargs->piItems, oXargs->iItemsCapacity * sizeof(int));
+		if(piNew == NULL)
+		{
+			oXargs->pcError = "Cannot allocate memory";
+			return FALSE;
+		}
+		oXargs->piItems = piNew;
+	}
+	oXargs->piItems[oXargs->iItems++] = iOffset;
+	return TRUE;
+}
+
+/*--------------------------------------------------------------------*/
+
+char **Xargs_next(Xargs_T oXargs, int *piArgc)
+
+/* Return the next batch of items as an argv. */
+
+{
+	char **ppcNew;
+	long lBytes = 0, lCost;
+	size_t iLeftover;
+	int iArgc, iOffset, i;
+
+	assert(oXargs != NULL);
+	assert(piArgc != NULL);
+
+	if(oXargs->pcError != NULL) return NULL;
+
+	/* Start over, keeping the item that did not fit in the last
+	   batch */
+	if(oXargs->iPending)
+	{
+		iOffset = oXargs->piItems[oXargs->iItems];
+		iLeftover = oXargs->iItemsLen - iOffset;
+		memmove(oXargs->pcItems, oXargs->pcItems + iOffset, iLeftover);
+		oXargs->iItemsLen = iLeftover;
+		oXargs->piItems[0] = 0;
+		oXargs->iItems = 1;
+		oXargs->iPending = FALSE;
+		lBytes = iLeftover + sizeof(char *);
+		if(lBytes > oXargs->lMaxBytes)
+		{
+			oXargs->pcError = "argument list too long";
+			return NULL;
+		}
+	}
+	else
+	{
+		oXargs->iItems = 0;
+		oXargs->iItemsLen = 0;
+	}
+
+	for(;;)
+	{
+		if(oXargs->iMaxArgs > 0 && oXargs->iItems >= oXargs->iMaxArgs) break;
+		if(!Xargs_readItem(oXargs))
+		{
+			if(oXargs->pcError != NULL) return NULL;
+			break;
+		}
+		lCost = oXargs->iItemsLen - oXargs->piItems[oXargs->iItems - 1] + sizeof(char *);
+		if(lBytes + lCost > oXargs->lMaxBytes)
+		{
+			if(oXargs->iItems == 1)
+			{
+				oXargs->pcError = "argument list too long";
+				return NULL;
+			}
+			/* Leave it for the next batch */
+			oXargs->iItems--;
+			oXargs->iPending = TRUE;
+			break;
+		}
+		lBytes += lCost;
+	}
+	if(oXargs->iItems == 0) return NULL;
+
+	iArgc = oXargs->iCommandArgc + oXargs->iItems;
+	if(iArgc + 1 > oXargs->iArgvCapacity)
+	{
+		ppcNew = (char **)realloc(oXargs->ppcArgv, (iArgc + 1) * sizeof(char *));
+		if(ppcNew == NULL)
+		{
+			oXargs->pcError = "Cannot allocate memory";
+			return NULL;
+		}
+		oXargs->ppcArgv = ppcNew;
+		oXargs->iArgvCapacity = iArgc + 1;
+	}
+	for(i=0;i<oXargs->iCommandArgc;i++)
+		oXargs->ppcArgv[i] = oXargs->ppcCommand[i];
+	for(i=0;i<oXargs->iItems;i++)
+		oXargs->ppcArgv[oXargs->iCommandArgc + i] = oXargs->pcItems + oXargs->piItems[i];
+	oXargs->ppcArgv[iArgc] = NULL;
+	*piArgc = iArgc;
+	return oXargs->ppcArgv;
+}
+
+/*--------------------------------------------------------------------*/
+
+const char *Xargs_getError(Xargs_T oXargs)
+
+/* Return the error that ended the batches, or NULL. */
+
+{
+	assert(oXargs != NULL);
+
+	return oXargs->pcError;
+}
@@ -0,0 +1,29 @@
+#ifndef XARGS_INCLUDED
+#define XARGS_INCLUDED
+
+/* An Xargs_T reads the items of the xargs built-in from a descriptor
+   and packs them into argument vectors that exec accepts: each batch
+   fits in ARG_MAX minus the size of the environment and the command. */
+typedef struct Xargs * Xargs_T;
+
+/* Return a new Xargs_T that reads items from iFd and prefixes each
+   batch with the iCommandArgc strings of ppcCommand, which must stay
+   valid.  Items are separated by '\0' if iNul is 1, or else by blanks
+   and newlines.  A batch holds at most iMaxArgs items, unless iMaxArgs
+   is 0.  Return NULL if insufficient memory is available. */
+Xargs_T Xargs_new(int iFd, char **ppcCommand, int iCommandArgc,
+	int iMaxArgs, int iNul);
+
+/* Free oXargs.  The descriptor is not closed. */
+void Xargs_free(Xargs_T oXargs);
+
+/* Return the next batch as a NULL-terminated argv whose length is
+   stored in *piArgc, or NULL at the end of the items or on an error.
+   The argv is valid until the next call. */
+char **Xargs_next(Xargs_T oXargs, int *piArgc);
+
+/* Return a message describing the error that ended the batches, or
+   NULL if the items were all read. */
+const char *Xargs_getError(Xargs_T oXargs);
+
+#endif
@@ -0,0 +1,346 @@
+#define _GNU_SOURCE
+#include "zygote.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <signal.h>
+#include <sched.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+/*--------------------------------------------------------------------*/
+
+enum {FALSE, TRUE};
+
+/* The descriptors of a request: stdin, stdout, stderr and the current
+   directory of the shell */
+enum {REQUEST_FDS = 4};
+
+/* A Request is the fixed-size head of a spawn request.  It carries
+   the REQUEST_FDS descriptors as SCM_RIGHTS and is followed by iSize
+   bytes: the iArgc argument strings and then the iEnvc environment
+   strings, each terminated by '\0'.  The zygote was forked with the
+   directory and umask the shell had at startup, so the child takes
+   the shell's current ones from the request. */
+struct Request
+{
+	int iArgc;
+	int iEnvc;
+	int iSize;
+	mode_t iUmask;
+};
+
+/* The shell's end of the socketpair, or -1 if there is no zygote */
+static int iZygoteFd = -1;
+
+/*--------------------------------------------------------------------*/
+
+static int Zygote_readFull(int iFd, void *pvBuf, int iSize)
+
+/* Read exactly iSize bytes from iFd into pvBuf.  Return 1 (TRUE) if
+   successful, or 0 (FALSE) on EOF or error. */
+
+{
+	char *pcBuf = (char *)pvBuf;
+	int n;
+
+	while(iSize > 0)
+	{
+		n = read(iFd, pcBuf, iSize);
+		if(n < 0 && errno == EINTR) continue;
+		if(n <= 0) return FALSE;
+		pcBuf += n;
+		iSize -= n;
+	}
+	return TRUE;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Zygote_writeFull(int iFd, const void *pvBuf, int iSize)
+
+/* Write exactly iSize bytes of pvBuf to iFd.  Return 1 (TRUE) if
+   successful, or 0 (FALSE) otherwise. */
+
+{
+	const char *pcBuf = (const char *)pvBuf;
+	int n;
+
+	while(iSize > 0)
+	{
+		n = send(iFd, pcBuf, iSize, MSG_NOSIGNAL);
+		if(n < 0 && errno == EINTR) continue;
+		if(n <= 0) return FALSE;
+		pcBuf += n;
+		iSize -= n;
+	}
+	return TRUE;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Zygote_fork(char **ppcArgv, char **ppcEnvp,
+	const int aiFds[REQUEST_FDS], mode_t iUmask)
+
+/* Create the child of the shell that executes ppcArgv in the directory
+   aiFds[3] with umask iUmask.  Runs in the zygote.  Return the pid of
+   the child, or -errno on failure. */
+
+{
+	extern char **environ;
+	int pid, i;
+
+	/* CLONE_PARENT makes the shell the parent of the command, so the
+	   shell reaps it and gets its SIGCHLD as for a command it forked
+	   itself */
+	pid = syscall(SYS_clone, CLONE_PARENT | SIGCHLD, 0, 0, 0, 0);
+	if(pid < 0) return -errno;
+	if(pid > 0) return pid;
+
+	for(i=0;i<3;i++)
+	{
+		if(dup2(aiFds[i], i) < 0){
+			perror("dup2");
+			_exit(EXIT_FAILURE);
+		}
+	}
+	if(fchdir(aiFds[3]) < 0){
+		perror("fchdir");
+		_exit(EXIT_FAILURE);
+	}
+	umask(iUmask);
+	signal(SIGINT, SIG_DFL);
+	signal(SIGQUIT, SIG_DFL);
+
+	environ = ppcEnvp;
+	execvp(ppcArgv[0], ppcArgv);
+	fprintf(stderr, "%s: %s\n", ppcArgv[0], strerror(errno));
+	_exit(EXIT_FAILURE);
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Zygote_serve(int iFd)
+
+/* Answer spawn requests read from iFd until the shell closes it.
+   Runs in the zygote and never returns. */
+
+{
+	struct Request sRequest;
+	char acControl[CMSG_SPACE(REQUEST_FDS * sizeof(int))];
+	struct msghdr sMsg;
+	struct iovec sIov;
+	struct cmsghdr *psCmsg;
+	char *pcStrings, **ppcVector;
+	int aiFds[REQUEST_FDS];
+	int n, i, iReply;
+
+	for(;;)
+	{
+		sIov.iov_base = &sRequest;
+		sIov.iov_len = sizeof(sRequest);
+		memset(&sMsg, 0, sizeof(sMsg));
+		sMsg.msg_iov = &sIov;
+		sMsg.msg_iovlen = 1;
+		sMsg.msg_control = acControl;
+		sMsg.msg_controllen = sizeof(acControl);
+
+		do n = recvmsg(iFd, &sMsg, MSG_CMSG_CLOEXEC);
+		while(n < 0 && errno == EINTR);
+		if(n <= 0) _exit(0);
+
+		psCmsg = CMSG_FIRSTHDR(&sMsg);
+		if(psCmsg == NULL || psCmsg->cmsg_type != SCM_RIGHTS
+			|| psCmsg->cmsg_len != CMSG_LEN(REQUEST_FDS * sizeof(int)))
+			_exit(EXIT_FAILURE);
+		memcpy(aiFds, CMSG_DATA(psCmsg), REQUEST_FDS * sizeof(int));
+
+		if(n < (int)sizeof(sRequest)
+			&& !Zygote_readFull(iFd, (char *)&sRequest + n, sizeof(sRequest) - n))
+			_exit(EXIT_FAILURE);
+
+		pcStrings = (char *)malloc(sRequest.iSize);
+		ppcVector = (char **)malloc((sRequest.iArgc + sRequest.iEnvc + 2) * sizeof(char *));
+		if(pcStrings == NULL || ppcVector == NULL
+			|| !Zygote_readFull(iFd, pcStrings, sRequest.iSize))
+			_exit(EXIT_FAILURE);
+
+		/* argv and envp share ppcVector, each NULL-terminated */
+		n = 0;
+		for(i=0;i<sRequest.iArgc;i++)
+		{
+			ppcVector[i] = pcStrings + n;
+			n += strlen(pcStrings + n) + 1;
+		}
+		ppcVector[sRequest.iArgc] = NULL;
+		for(i=sRequest.iArgc+1;i<=sRequest.iArgc + sRequest.iEnvc;i++)
+		{
+			ppcVector[i] = pcStrings + n;
+			n += strlen(pcStrings + n) + 1;
+		}
+		ppcVector[i] = NULL;
+
+		iReply = Zygote_fork(ppcVector, ppcVector + sRequest.iArgc + 1, aiFds,
+			sRequest.iUmask);
+
+		for(i=0;i<REQUEST_FDS;i++) close(aiFds[i]);
+		free(ppcVector);
+		free(pcStrings);
+
+		if(!Zygote_writeFull(iFd, &iReply, sizeof(iReply))) _exit(0);
+	}
+}
+
+/*--------------------------------------------------------------------*/
+
+int Zygote_start(void)
+
+/* Fork the zygote.  Return its pid, or -1 if it is not running. */
+
+{
+	int aiPair[2];
+	int pid;
+
+	if(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, aiPair) < 0)
+		return -1;
+
+	pid = fork();
+	if(pid < 0)
+	{
+		close(aiPair[0]);
+		close(aiPair[1]);
+		return -1;
+	}
+	if(pid == 0)
+	{
+		close(aiPair[0]);
+		/* Ctrl-C and Ctrl-\ are meant for the shell and its jobs */
+		signal(SIGINT, SIG_IGN);
+		signal(SIGQUIT, SIG_IGN);
+		Zygote_serve(aiPair[1]);
+	}
+
+	close(aiPair[1]);
+	iZygoteFd = aiPair[0];
+	return pid;
+}
+
+/*--------------------------------------------------------------------*/
+
+int Zygote_isRunning(void)
+
+/* Return 1 (TRUE) if the zygote can take spawn requests. */
+
+{
+	return iZygoteFd != -1;
+}
+
+/*--------------------------------------------------------------------*/
+
+int Zygote_spawn(char **ppcArgv, char **ppcEnvp, const int aiFds[3])
+
+/* Ask the zygote to start ppcArgv.  Return its pid, or -1. */
+
+{
+	struct Request sRequest;
+	char acControl[CMSG_SPACE(REQUEST_FDS * sizeof(int))];
+	struct msghdr sMsg;
+	struct iovec sIov;
+	struct cmsghdr *psCmsg;
+	char *pcStrings;
+	int aiRequestFds[REQUEST_FDS];
+	int i, n, iReply;
+
+	assert(ppcArgv != NULL);
+	assert(ppcEnvp != NULL);
+
+	if(iZygoteFd == -1) return -1;
+
+	/* umask can only be read by setting it */
+	sRequest.iUmask = umask(0);
+	umask(sRequest.iUmask);
+
+	sRequest.iArgc = sRequest.iEnvc = sRequest.iSize = 0;
+	for(i=0;ppcArgv[i]!=NULL;i++,sRequest.iArgc++)
+		sRequest.iSize += strlen(ppcArgv[i]) + 1;
+	for(i=0;ppcEnvp[i]!=NULL;i++,sRequest.iEnvc++)
+		sRequest.iSize += strlen(ppcEnvp[i]) + 1;
+
+	pcStrings = (char *)malloc(sRequest.iSize);
+	if(pcStrings == NULL) return -1;
+	memcpy(aiRequestFds, aiFds, 3 * sizeof(int));
+	aiRequestFds[3] = open(".", O_PATH | O_DIRECTORY | O_CLOEXEC);
+	if(aiRequestFds[3] < 0)
+	{
+		free(pcStrings);
+		return -1;
+	}
+	n = 0;
+	for(i=0;ppcArgv[i]!=NULL;i++)
+	{
+		strcpy(pcStrings + n, ppcArgv[i]);
+		n += strlen(ppcArgv[i]) + 1;
+	}
+	for(i=0;ppcEnvp[i]!=NULL;i++)
+	{
+		strcpy(pcStrings + n, ppcEnvp[i]);
+		n += strlen(ppcEnvp[i]) + 1;
+	}
+
+	sIov.iov_base = &sRequest;
+	sIov.iov_len = sizeof(sRequest);
+	memset(&sMsg, 0, sizeof(sMsg));
+	memset(acControl, 0, sizeof(acControl));
+	sMsg.msg_iov = &sIov;
+	sMsg.msg_iovlen = 1;
+	sMsg.msg_control = acControl;
+	sMsg.msg_controllen = sizeof(acControl);
+	psCmsg = CMSG_FIRSTHDR(&sMsg);
+	psCmsg->cmsg_level = SOL_SOCKET;
+	psCmsg->cmsg_type = SCM_RIGHTS;
+	psCmsg->cmsg_len = CMSG_LEN(REQUEST_FDS * sizeof(int));
+	memcpy(CMSG_DATA(psCmsg), aiRequestFds, REQUEST_FDS * sizeof(int));
+
+	do n = sendmsg(iZygoteFd, &sMsg, MSG_NOSIGNAL);
+	while(n < 0 && errno == EINTR);
+	close(aiRequestFds[3]);
+
+	if(n <= 0
+		|| (n < (int)sizeof(sRequest)
+			&& !Zygote_writeFull(iZygoteFd, (char *)&sRequest + n, sizeof(sRequest) - n))
+		|| !Zygote_writeFull(iZygoteFd, pcStrings, sRequest.iSize)
+		|| !Zygote_readFull(iZygoteFd, &iReply, sizeof(iReply)))
+	{
+		/* The zygote is gone; the caller falls back to fork */
+		free(pcStrings);
+		close(iZygoteFd);
+		iZygoteFd = -1;
+		return -1;
+	}
+	free(pcStrings);
+
+	if(iReply < 0)
+	{
+		errno = -iReply;
+		return -1;
+	}
+	return iReply;
+}
+
+/*--------------------------------------------------------------------*/
+
+void Zygote_detach(void)
+
+/* Close the connection to the zygote.  The zygote keeps serving the
+   shell that started it. */
+
+{
+	if(iZygoteFd == -1) return;
+	close(iZygoteFd);
+	iZygoteFd = -1;
+}
@@ -0,0 +1,29 @@
+#ifndef ZYGOTE_INCLUDED
+#define ZYGOTE_INCLUDED
+
+/* The zygote is a helper process forked while the shell is still
+   small.  It forks commands on behalf of the shell, so the cost of a
+   spawn does not grow with the memory the shell has allocated.  The
+   commands it starts are children of the shell, not of the zygote. */
+
+/* Fork the zygote.  Call it early in main(), before the shell
+   allocates anything large.  Return the pid of the zygote, or -1 if
+   it could not be started. */
+int Zygote_start(void);
+
+/* Return 1 (TRUE) if the zygote can take spawn requests. */
+int Zygote_isRunning(void);
+
+/* Ask the zygote to execute ppcArgv with environment ppcEnvp and
+   aiFds as stdin, stdout and stderr, in the current directory and
+   with the umask of the caller.  Return the pid of the new child, or
+   -1 if the zygote could not start it.  If the zygote has
+   gone away, Zygote_isRunning() returns 0 (FALSE) afterwards. */
+int Zygote_spawn(char **ppcArgv, char **ppcEnvp, const int aiFds[3]);
+
+/* Stop using the zygote in a forked copy of the shell, such as a child
+   that runs a shell function: the commands the zygote starts would be
+   children of the original shell instead. */
+void Zygote_detach(void);
+
+#endif